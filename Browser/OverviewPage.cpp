@@ -311,10 +311,15 @@ void Browser::OverviewPage::updateImageCount()
 {
     QElapsedTimer timer;
     timer.start();
+    const QList<DB::CategoryPtr> categoryList = categories();
+    QStringList categoryNames;
+    for (const DB::CategoryPtr &category : categoryList)
+        categoryNames.append(category->name());
+    const auto classification = DB::ImageDB::instance()->classifyAll(BrowserPage::searchInfo(), categoryNames, DB::anyMediaType, DB::ClassificationMode::PartialCount);
+
     int row = 0;
-    for (const DB::CategoryPtr &category : categories()) {
-        QMap<QString, DB::CountWithRange> items = DB::ImageDB::instance()->classify(BrowserPage::searchInfo(), category->name(), DB::anyMediaType, DB::ClassificationMode::PartialCount);
-        m_rowHasSubcategories[row] = items.count() > 1;
+    for (const QString &categoryName : std::as_const(categoryNames)) {
+        m_rowHasSubcategories[row] = classification.value(categoryName).count() > 1;
         ++row;
     }
     qCDebug(TimingLog) << "Browser::Overview::updateImageCount(): " << timer.elapsed() << "ms.";
@@ -32,6 +32,11 @@ struct CountWithRange {
         count++;
         range.extendTo(date);
     }
+    void merge(const CountWithRange &other)
+    {
+        count += other.count;
+        range.extendTo(other.range);
+    }
 };
 
 /**
@@ -41,16 +41,17 @@ GroupCounter::GroupCounter(const QString &category)
 {
     const MemberMap map = DB::ImageDB::instance()->memberMap();
     QMap<QString, StringSet> groupToMemberMap = map.groupMap(category);
+    auto &dictionary = TagDictionary::instance();
 
     m_memberToGroup.reserve(2729 /* A large prime */);
     m_groupCount.reserve(2729 /* A large prime */);
 
     // Populate the m_memberToGroup map
     for (QMap<QString, StringSet>::Iterator groupToMemberIt = groupToMemberMap.begin(); groupToMemberIt != groupToMemberMap.end(); ++groupToMemberIt) {
-        const StringSet members = groupToMemberIt.value();
-        const QString group = groupToMemberIt.key();
+        const TagIdList members = dictionary.intern(groupToMemberIt.value());
+        const TagId group = dictionary.intern(groupToMemberIt.key());
 
-        for (const auto &member : members) {
+        for (const TagId member : members) {
             m_memberToGroup[member].append(group);
         }
         m_groupCount.insert(group, CountWithRange());
@@ -58,43 +59,39 @@ GroupCounter::GroupCounter(const QString &category)
 }
 
 /**
- * categories is the selected categories for one image, members may be Las Vegas, Chicago, and Los Angeles if the
- * category in question is Places.
+ * tags is the sorted list of tag ids for one image in the category in question, e.g. the ids of Las Vegas,
+ * Chicago, and Los Angeles if the category is Places.
  * This function then increases m_groupCount with 1 for each of the groups the relavant items belongs to
  * Las Vegas might increase the m_groupCount[Nevada] by one.
- * The tricky part is to avoid increasing it by more than 1 per image, that is what the countedGroupDict is
+ * The tricky part is to avoid increasing it by more than 1 per image, that is what the m_countedGroups is
  * used for.
  */
-void GroupCounter::count(const StringSet &categories, const ImageDate &date)
+void GroupCounter::count(const TagIdList &tags, const ImageDate &date)
 {
-    static StringSet countedGroupDict;
-
-    countedGroupDict.clear();
-    for (StringSet::const_iterator categoryIt = categories.begin(); categoryIt != categories.end(); ++categoryIt) {
-        if (m_memberToGroup.contains(*categoryIt)) {
-            const QStringList groups = m_memberToGroup[*categoryIt];
-            for (const QString &group : groups) {
-                if (!countedGroupDict.contains(group)) {
-                    countedGroupDict.insert(group);
+    m_countedGroups.clear();
+    for (const TagId tag : tags) {
+        const auto groupsIt = m_memberToGroup.constFind(tag);
+        if (groupsIt != m_memberToGroup.constEnd()) {
+            for (const TagId group : groupsIt.value()) {
+                if (TagDictionary::insertSorted(m_countedGroups, group))
                     m_groupCount[group].add(date);
-                }
             }
         }
         // The item Nevada should itself go into the group Nevada.
-        if (!countedGroupDict.contains(*categoryIt) && m_groupCount.contains(*categoryIt)) {
-            countedGroupDict.insert(*categoryIt);
-            m_groupCount[*categoryIt].add(date);
-        }
+        const auto countIt = m_groupCount.find(tag);
+        if (countIt != m_groupCount.end() && TagDictionary::insertSorted(m_countedGroups, tag))
+            countIt.value().add(date);
     }
 }
 
-QMap<QString, CountWithRange> GroupCounter::result()
+QMap<QString, CountWithRange> GroupCounter::result() const
 {
     QMap<QString, CountWithRange> res;
+    const auto &dictionary = TagDictionary::instance();
 
-    for (QHash<QString, CountWithRange>::const_iterator it = m_groupCount.constBegin(); it != m_groupCount.constEnd(); ++it) {
+    for (QHash<TagId, CountWithRange>::const_iterator it = m_groupCount.constBegin(); it != m_groupCount.constEnd(); ++it) {
         if (it.value().count != 0)
-            res.insert(it.key(), it.value());
+            res.insert(dictionary.name(it.key()), it.value());
     }
     return res;
 }
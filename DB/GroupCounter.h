@@ -6,6 +6,7 @@
 #ifndef GROUPCOUNTER_H
 #define GROUPCOUNTER_H
 #include "Category.h"
+#include "TagDictionary.h"
 
 #include <kpabase/SettingsData.h>
 
@@ -19,12 +20,13 @@ class GroupCounter
 {
 public:
     explicit GroupCounter(const QString &category);
-    void count(const StringSet &, const ImageDate &date);
-    QMap<QString, CountWithRange> result();
+    void count(const TagIdList &tags, const ImageDate &date);
+    QMap<QString, CountWithRange> result() const;
 
 private:
-    QHash<QString, QStringList> m_memberToGroup;
-    QHash<QString, CountWithRange> m_groupCount;
+    QHash<TagId, TagIdList> m_memberToGroup;
+    QHash<TagId, CountWithRange> m_groupCount;
+    TagIdList m_countedGroups;
 };
 
 }
@@ -27,6 +27,7 @@
 #include <DB/XML/AttributeEscaping.h>
 #include <DB/XML/FileReader.h>
 #include <DB/XML/FileWriter.h>
+#include <DB/XML/Journal.h>
 #include <Utilities/FastDateTime.h>
 #include <kpabase/FileExtensions.h>
 #include <kpabase/FileName.h>
@@ -39,9 +40,12 @@
 #include <QDir>
 #include <QElapsedTimer>
 #include <QFileInfo>
-#include <QMutex>
 #include <QProgressDialog>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
 
+#include <algorithm>
 #include <utility>
 
 using namespace DB;
@@ -50,14 +54,34 @@ using Utilities::StringSet;
 
 namespace
 {
-void checkForBackupFile(const QString &fileName, DB::UIDelegate &ui)
+/**
+ * @brief The ErrorCollector class keeps the errors that occur while saving in the background,
+ * so that they can be shown once the GUI thread takes over again.
+ */
+class ErrorCollector : public DB::DummyUIDelegate
+{
+public:
+    struct Error {
+        QString message;
+        QString title;
+    };
+    QList<Error> errors;
+
+protected:
+    void showError(const QString &msg, const QString &title, const QString &) override
+    {
+        errors.append({ msg, title });
+    }
+};
+
+bool checkForBackupFile(const QString &fileName, DB::UIDelegate &ui)
 {
     QString backupName = DB::ImageDB::autoSaveFileName(fileName);
     QFileInfo backUpFile(backupName);
     QFileInfo indexFile(fileName);
 
     if (!backUpFile.exists() || indexFile.lastModified() > backUpFile.lastModified() || backUpFile.size() == 0)
-        return;
+        return false;
 
     const long backupSizeKB = backUpFile.size() >> 10;
     const DB::UserFeedback choice = ui.questionYesNo(
@@ -79,34 +103,35 @@ void checkForBackupFile(const QString &fileName, DB::UIDelegate &ui)
                     out.write(data, len);
             }
         }
+        return true;
     }
+    return false;
 }
 
 // During profiling of loading, I found that a significant amount of time was spent in Utilities::FastDateTime::fromString.
 // Reviewing the code, I fount that it did a lot of extra checks we don't need (like checking if the string have
 // timezone information (which they won't in KPA), this function is a replacement that is faster than the original.
-Utilities::FastDateTime dateTimeFromString(const QString &str)
+Utilities::FastDateTime dateTimeFromString(QStringView str)
 {
     // Caching the last used date/time string will help for photographers
     // who frequently take bursts.
-    static QString s_lastDateTimeString;
-    static Utilities::FastDateTime s_lastDateTime;
-    static QMutex s_lastDateTimeLocker;
-    QMutexLocker dummy(&s_lastDateTimeLocker);
+    // The cache is per thread, because the images are loaded from several threads at once:
+    thread_local QString s_lastDateTimeString;
+    thread_local Utilities::FastDateTime s_lastDateTime;
     static const QChar T = QChar::fromLatin1('T');
     if (str != s_lastDateTimeString) {
-        if (str[10] == T)
+        if (str.size() > 10 && str[10] == T)
             s_lastDateTime = QDateTime(QDate::fromString(str.left(10), Qt::ISODate), QTime::fromString(str.mid(11), Qt::ISODate));
         else
-            s_lastDateTime = QDateTime::fromString(str, Qt::ISODate);
-        s_lastDateTimeString = str;
+            s_lastDateTime = QDateTime::fromString(str.toString(), Qt::ISODate);
+        s_lastDateTimeString = str.toString();
     }
     return s_lastDateTime;
 }
 
 } // namespace
 
-bool ImageDB::s_anyImageWithEmptySize = false;
+std::atomic<bool> ImageDB::s_anyImageWithEmptySize = false;
 ImageDB *ImageDB::s_instance = nullptr;
 
 ImageDB *DB::ImageDB::instance()
@@ -126,6 +151,9 @@ void ImageDB::setupXMLDB(const QString &configFile, UIDelegate &delegate)
 
 void ImageDB::deleteInstance()
 {
+    // the background save must not outlive the database, and its result must be handled:
+    if (s_instance)
+        s_instance->waitForSave();
     delete s_instance;
     s_instance = nullptr;
 }
@@ -140,10 +168,15 @@ void ImageDB::forceUpdate(const ImageInfoList &images)
 {
     // FIXME: merge stack information
     DB::ImageInfoList newImages = images.sort();
+    for (const DB::ImageInfoPtr &imageInfo : std::as_const(newImages)) {
+        imageInfo->attachToTagIndex(&m_tagIndex);
+        if (imageInfo->isStacked())
+            m_stackMap[imageInfo->stackId()].append(imageInfo->fileName());
+    }
     if (m_images.count() == 0) {
         // case 1: The existing imagelist is empty.
         for (const DB::ImageInfoPtr &imageInfo : std::as_const(newImages))
-            m_imageCache.insert(imageInfo->fileName().absolute(), imageInfo);
+            m_fileNameIndex.insert(imageInfo->fileName(), imageInfo);
         m_images = newImages;
     } else if (newImages.count() == 0) {
         // case 2: No images to merge in - that's easy ;-)
@@ -151,17 +184,17 @@ void ImageDB::forceUpdate(const ImageInfoList &images)
     } else if (newImages.first()->date().start() > m_images.last()->date().start()) {
         // case 2: The new list is later than the existsing
         for (const DB::ImageInfoPtr &imageInfo : std::as_const(newImages))
-            m_imageCache.insert(imageInfo->fileName().absolute(), imageInfo);
+            m_fileNameIndex.insert(imageInfo->fileName(), imageInfo);
         m_images.appendList(newImages);
     } else if (m_images.isSorted()) {
         // case 3: The lists overlaps, and the existsing list is sorted
         for (const DB::ImageInfoPtr &imageInfo : std::as_const(newImages))
-            m_imageCache.insert(imageInfo->fileName().absolute(), imageInfo);
+            m_fileNameIndex.insert(imageInfo->fileName(), imageInfo);
         m_images.mergeIn(newImages);
     } else {
         // case 4: The lists overlaps, and the existsing list is not sorted in the overlapping range.
         for (const DB::ImageInfoPtr &imageInfo : std::as_const(newImages))
-            m_imageCache.insert(imageInfo->fileName().absolute(), imageInfo);
+            m_fileNameIndex.insert(imageInfo->fileName(), imageInfo);
         m_images.appendList(newImages);
     }
 }
@@ -179,15 +212,25 @@ DB::FileNameList ImageDB::currentScope(bool requireOnDisk) const
 
 void ImageDB::renameItem(Category *category, const QString &oldName, const QString &newName)
 {
-    for (DB::ImageInfoListIterator it = m_images.begin(); it != m_images.end(); ++it) {
-        (*it)->renameItem(category->name(), oldName, newName);
+    m_journal->requireFullSave();
+    // Only the images carrying the tag are affected.
+    // Updating the index in one go first turns the per-image index updates into no-ops.
+    const TagIndex::PostingList affected = m_tagIndex.postings(category->name(), oldName);
+    m_tagIndex.renameTag(category->name(), oldName, newName);
+    for (const auto ordinal : affected) {
+        if (ImageInfo *imageInfo = m_tagIndex.image(ordinal))
+            imageInfo->renameItem(category->name(), oldName, newName);
     }
 }
 
 void ImageDB::deleteItem(Category *category, const QString &value)
 {
-    for (DB::ImageInfoListIterator it = m_images.begin(); it != m_images.end(); ++it) {
-        (*it)->removeCategoryInfo(category->name(), value);
+    m_journal->requireFullSave();
+    const TagIndex::PostingList affected = m_tagIndex.postings(category->name(), value);
+    m_tagIndex.removeTag(category->name(), value);
+    for (const auto ordinal : affected) {
+        if (ImageInfo *imageInfo = m_tagIndex.image(ordinal))
+            imageInfo->removeCategoryInfo(category->name(), value);
     }
 }
 
@@ -208,6 +251,8 @@ void ImageDB::lockDB(bool lock, bool exclude)
 
 void ImageDB::markDirty()
 {
+    // tag groups are not recorded in the journal:
+    m_journal->requireFullSave();
     Q_EMIT dirty();
 }
 
@@ -234,10 +279,19 @@ ImageDB::ImageDB(const QString &configFile, UIDelegate &delegate)
     , m_untaggedTag()
     , m_fileName(configFile)
 {
-    checkForBackupFile(configFile, uiDelegate());
+    const bool usedAutoSave = checkForBackupFile(configFile, uiDelegate());
     DB::FileReader reader(this);
     reader.read(configFile);
     m_nextStackId = reader.nextStackId();
+    m_journal = std::make_unique<DB::Journal>(this, configFile);
+    // the user was already asked whether the autosave file should be used:
+    m_journalReplayed = m_journal->replay(!usedAutoSave);
+    // Loaded images are marked dirty when they are created.
+    // Everything loaded so far is covered by the database file and the journal, so only later changes go into the journal:
+    for (const DB::ImageInfoPtr &imageInfo : std::as_const(m_images)) {
+        imageInfo->attachToTagIndex(&m_tagIndex);
+        imageInfo->m_dirty = false;
+    }
 
     // if reading an XML database file version < 9, the untaggedTag is stored in the settings, not the database
     if (!untaggedCategoryFeatureConfigured()) {
@@ -267,6 +321,14 @@ ImageDB::ImageDB(const QString &configFile, UIDelegate &delegate)
             &m_members, &DB::MemberMap::renameItem);
     connect(categoryCollection(), &DB::CategoryCollection::categoryRemoved,
             &m_members, &DB::MemberMap::deleteCategory);
+
+    // changes to the categories are not recorded in the journal:
+    connect(categoryCollection(), &DB::CategoryCollection::categoryCollectionChanged,
+            this, [this]() { m_journal->requireFullSave(); });
+
+    connect(&m_saveWatcher, &QFutureWatcher<bool>::progressValueChanged,
+            this, [this](int value) { Q_EMIT saveProgress(value, m_saveWatcher.progressMaximum()); });
+    connect(&m_saveWatcher, &QFutureWatcher<bool>::finished, this, &ImageDB::finishBackgroundSave);
 }
 
 bool ImageDB::rangeInclude(ImageInfoPtr info) const
@@ -308,7 +370,7 @@ ImageInfoList ImageDB::takeImagesFromSelection(const FileNameList &selection)
             ++it;
         } else {
             result << *it;
-            m_imageCache.remove((*it)->fileName().absolute());
+            m_fileNameIndex.remove((*it)->fileName());
             it = m_images.erase(it);
         }
         // if all images from selection are in result (size of lists is equal) break.
@@ -333,7 +395,7 @@ void ImageDB::insertList(const FileName &fileName, const ImageInfoList &list, bo
     for (DB::ImageInfoListConstIterator it = list.begin(); it != list.end(); ++it) {
         // the call to insert() destroys the given iterator so use the new one after the call
         imageIt = m_images.insert(imageIt, *it);
-        m_imageCache.insert((*it)->fileName().absolute(), *it);
+        m_fileNameIndex.insert((*it)->fileName(), *it);
         // increment always to retain order of selected images
         imageIt++;
     }
@@ -364,8 +426,9 @@ void ImageDB::readOptions(ImageInfoPtr info, DB::ReaderPtr reader, const QMap<QS
             while (reader->readNextStartOrStopElement(_value_).isStartToken) {
                 QString value = reader->attribute(_value_);
                 if (!value.isNull()) {
-                    if (reader->hasAttribute(_area_)) {
-                        info->addCategoryInfo(name, value, parseAreaData(reader->attribute(_area_)));
+                    const QStringView area = reader->attributeView(_area_);
+                    if (!area.isNull()) {
+                        info->addCategoryInfo(name, value, parseAreaData(area));
                     } else {
                         info->addCategoryInfo(name, value);
                     }
@@ -464,19 +527,57 @@ ImageInfoList ImageDB::search(const ImageSearchInfo &searchInfo, DB::SearchOptio
 
     // When searching for images counts for the datebar, we want matches outside the range too.
     // When searching for images for the thumbnail view, we only want matches inside the range.
-    DB::ImageInfoList result;
-    for (DB::ImageInfoListConstIterator it = m_images.constBegin(); it != m_images.constEnd(); ++it) {
-        bool match = !(*it)->isLocked() && searchInfo.match(*it) && (!onlyItemsMatchingRange || rangeInclude(*it));
-        match &= !requireOnDisk || DB::ImageInfo::imageOnDisk((*it)->fileName());
+    const RoaringBitmap categoryMatches = searchInfo.isNull() ? RoaringBitmap() : searchInfo.categoryMatches(m_tagIndex);
+    const auto searchChunk = [&](const ImageChunk &chunk) {
+        DB::ImageInfoList result;
+        for (qsizetype i = chunk.first; i < chunk.second; ++i) {
+            const auto &imageInfo = m_images.at(i);
+            bool match = !imageInfo->isLocked() && searchInfo.match(imageInfo, categoryMatches) && (!onlyItemsMatchingRange || rangeInclude(imageInfo));
+            match &= !requireOnDisk || DB::ImageInfo::imageOnDisk(imageInfo->fileName());
+
+            if (match)
+                result.append(imageInfo);
+        }
+        return result;
+    };
 
-        if (match)
-            result.append((*it));
-    }
+    // A null search matches everything, so there is no work worth distributing:
+    const auto chunks = imageChunks(!searchInfo.isNull() && searchInfo.canMatchConcurrently());
+    if (chunks.size() == 1)
+        return searchChunk(chunks.constFirst());
+
+    // blockingMapped keeps the order of the chunks, so the result is in database order:
+    const QList<DB::ImageInfoList> chunkResults = QtConcurrent::blockingMapped<QList<DB::ImageInfoList>>(chunks, searchChunk);
+    DB::ImageInfoList result;
+    qsizetype resultSize = 0;
+    for (const auto &chunkResult : chunkResults)
+        resultSize += chunkResult.size();
+    result.reserve(resultSize);
+    for (const auto &chunkResult : chunkResults)
+        result.append(chunkResult);
     return result;
 }
 
+QList<ImageDB::ImageChunk> ImageDB::imageChunks(bool concurrent) const
+{
+    // Chunks are large enough to make the per-chunk overhead negligible:
+    constexpr qsizetype minimumChunkSize = 2048;
+    const qsizetype imageCount = m_images.size();
+    qsizetype chunkCount = 1;
+    if (concurrent)
+        chunkCount = std::clamp<qsizetype>(imageCount / minimumChunkSize, 1, 4 * QThread::idealThreadCount());
+
+    QList<ImageChunk> chunks;
+    chunks.reserve(chunkCount);
+    for (qsizetype chunk = 0; chunk < chunkCount; ++chunk)
+        chunks.append({ imageCount * chunk / chunkCount, imageCount * (chunk + 1) / chunkCount });
+    return chunks;
+}
+
 void ImageDB::renameCategory(const QString &oldName, const QString newName)
 {
+    m_journal->requireFullSave();
+    m_tagIndex.renameCategory(oldName, newName);
     for (DB::ImageInfoListIterator it = m_images.begin(); it != m_images.end(); ++it) {
         (*it)->renameCategory(oldName, newName);
     }
@@ -491,55 +592,151 @@ void ImageDB::renameCategory(const QString &oldName, const QString newName)
  */
 QMap<QString, CountWithRange> ImageDB::classify(const ImageSearchInfo &info, const QString &category, MediaType typemask, ClassificationMode mode)
 {
-    QElapsedTimer timer;
-    timer.start();
-    QMap<QString, DB::CountWithRange> map;
-    DB::GroupCounter counter(category);
-    Utilities::StringSet alreadyMatched = info.findAlreadyMatched(category);
-
-    DB::ImageSearchInfo noMatchInfo = info;
-    QString currentMatchTxt = noMatchInfo.categoryMatchText(category);
-    if (currentMatchTxt.isEmpty())
-        noMatchInfo.setCategoryMatchText(category, DB::ImageDB::NONE());
-    else
-        noMatchInfo.setCategoryMatchText(category, QString::fromLatin1("%1 & %2").arg(currentMatchTxt, DB::ImageDB::NONE()));
-    noMatchInfo.setCacheable(false);
-
-    // Iterate through the whole database of images.
-    for (const auto &imageInfo : std::as_const(m_images)) {
-        bool match = ((imageInfo)->mediaType() & typemask) && !(imageInfo)->isLocked() && info.match(imageInfo) && rangeInclude(imageInfo);
-        if (match) { // If the given image is currently matched.
-
-            // Now iterate through all the categories the current image
-            // contains, and increase them in the map mapping from category
-            // to count.
-            StringSet items = (imageInfo)->itemsOfCategory(category);
-            counter.count(items, imageInfo->date());
-            for (const auto &categoryName : std::as_const(items)) {
-                if (!alreadyMatched.contains(categoryName)) // We do not want to match "Jesper & Jesper"
-                    map[categoryName].add(imageInfo->date());
-            }
+    return classifyAll(info, QStringList { category }, typemask, mode).value(category);
+}
 
-            // Find those with no other matches
-            if (noMatchInfo.match(imageInfo))
-                map[DB::ImageDB::NONE()].count++;
+QMap<QString, QMap<QString, CountWithRange>> ImageDB::classifyAll(const ImageSearchInfo &info, const QStringList &categories, MediaType typemask, ClassificationMode mode)
+{
+    if (categories.isEmpty())
+        return {};
 
-            // this is a shortcut for the browser overview page,
-            // where we are only interested whether there are sub-categories to a category
-            if (mode == DB::ClassificationMode::PartialCount && map.size() > 1) {
-                qCInfo(TimingLog) << "ImageDB::classify(partial): " << timer.restart() << "ms.";
-                return map;
-            }
+    QElapsedTimer timer;
+    timer.start();
+    const bool partial = (mode == DB::ClassificationMode::PartialCount);
+
+    // Evaluate the category part of the search for all images at once:
+    const RoaringBitmap categoryMatches = info.isNull() ? RoaringBitmap() : info.categoryMatches(m_tagIndex);
+    bool concurrent = info.canMatchConcurrently();
+
+    auto &dictionary = TagDictionary::instance();
+    struct CategoryContext {
+        QString category;
+        TagId categoryId = 0;
+        TagIdList alreadyMatched;
+        DB::ImageSearchInfo noMatchInfo;
+        RoaringBitmap noMatchCategoryMatches;
+    };
+    QList<CategoryContext> contexts;
+    QList<DB::GroupCounter> counters;
+    contexts.reserve(categories.size());
+    counters.reserve(categories.size());
+    for (const QString &category : categories) {
+        CategoryContext context;
+        context.category = category;
+        context.categoryId = dictionary.lookup(category);
+        const auto alreadyMatched = info.findAlreadyMatched(category);
+        for (const QString &item : alreadyMatched) {
+            if (const TagId tag = dictionary.lookup(item))
+                TagDictionary::insertSorted(context.alreadyMatched, tag);
         }
+        context.noMatchInfo = info;
+        const QString currentMatchTxt = context.noMatchInfo.categoryMatchText(category);
+        if (currentMatchTxt.isEmpty())
+            context.noMatchInfo.setCategoryMatchText(category, DB::ImageDB::NONE());
+        else
+            context.noMatchInfo.setCategoryMatchText(category, QString::fromLatin1("%1 & %2").arg(currentMatchTxt, DB::ImageDB::NONE()));
+        context.noMatchCategoryMatches = context.noMatchInfo.categoryMatches(m_tagIndex);
+        concurrent = concurrent && context.noMatchInfo.canMatchConcurrently();
+        contexts.append(context);
+        counters.append(DB::GroupCounter(category));
     }
+    const qsizetype categoryCount = contexts.size();
+
+    // Tags are counted by id while scanning, and only resolved to names when merging the chunks:
+    struct CategoryCount {
+        QHash<TagId, DB::CountWithRange> tags;
+        uint noMatchCount = 0;
+        qsizetype size() const { return tags.size() + (noMatchCount != 0 ? 1 : 0); }
+    };
+    struct ChunkResult {
+        QList<CategoryCount> counts;
+        QList<DB::GroupCounter> counters;
+    };
+    // set as soon as one chunk has found more than one sub-category for all categories:
+    QAtomicInt partialCountDone;
+
+    const auto classifyChunk = [&](const ImageChunk &chunk) {
+        ChunkResult result;
+        result.counts.resize(categoryCount);
+        result.counters = counters;
+        QList<bool> saturated(categoryCount, false);
+        qsizetype saturatedCount = 0;
+
+        for (qsizetype i = chunk.first; i < chunk.second; ++i) {
+            if (partial && partialCountDone.loadRelaxed())
+                break;
+            const auto &imageInfo = m_images.at(i);
+            const bool match = (imageInfo->mediaType() & typemask) && !imageInfo->isLocked() && info.match(imageInfo, categoryMatches) && rangeInclude(imageInfo);
+            if (!match)
+                continue;
+
+            for (qsizetype c = 0; c < categoryCount; ++c) {
+                if (saturated.at(c))
+                    continue;
+                const CategoryContext &context = contexts.at(c);
+                CategoryCount &tagCount = result.counts[c];
+
+                // Now iterate through all the tags the current image
+                // contains, and increase them in the map mapping from tag
+                // to count.
+                const TagIdList tags = imageInfo->tagIds(context.categoryId);
+                result.counters[c].count(tags, imageInfo->date());
+                for (const TagId tag : tags) {
+                    if (!TagDictionary::containsSorted(context.alreadyMatched, tag)) // We do not want to match "Jesper & Jesper"
+                        tagCount.tags[tag].add(imageInfo->date());
+                }
 
-    QMap<QString, DB::CountWithRange> groups = counter.result();
-    for (QMap<QString, DB::CountWithRange>::iterator it = groups.begin(); it != groups.end(); ++it) {
-        map[it.key()] = it.value();
+                // Find those with no other matches.
+                // noMatchInfo only differs from info in the category part, which is fully covered by the bitmap:
+                const bool noMatch = imageInfo->ordinal() != 0
+                    ? context.noMatchCategoryMatches.contains(imageInfo->ordinal())
+                    : context.noMatchInfo.match(imageInfo, context.noMatchCategoryMatches);
+                if (noMatch)
+                    tagCount.noMatchCount++;
+
+                // this is a shortcut for the browser overview page,
+                // where we are only interested whether there are sub-categories to a category
+                if (partial && tagCount.size() > 1) {
+                    saturated[c] = true;
+                    if (++saturatedCount == categoryCount) {
+                        partialCountDone.storeRelaxed(1);
+                        return result;
+                    }
+                }
+            }
+        }
+        return result;
+    };
+
+    const auto chunks = imageChunks(concurrent);
+    const qsizetype chunkCount = chunks.size();
+    const QList<ChunkResult> chunkResults = (chunkCount == 1)
+        ? QList<ChunkResult> { classifyChunk(chunks.constFirst()) }
+        : QtConcurrent::blockingMapped<QList<ChunkResult>>(chunks, classifyChunk);
+
+    QMap<QString, QMap<QString, DB::CountWithRange>> result;
+    for (qsizetype c = 0; c < categoryCount; ++c) {
+        QMap<QString, DB::CountWithRange> map;
+        QMap<QString, DB::CountWithRange> groups;
+        for (const ChunkResult &chunkResult : chunkResults) {
+            const CategoryCount &chunkCount = chunkResult.counts.at(c);
+            for (auto it = chunkCount.tags.cbegin(); it != chunkCount.tags.cend(); ++it)
+                map[dictionary.name(it.key())].merge(it.value());
+            if (chunkCount.noMatchCount != 0)
+                map[DB::ImageDB::NONE()].count += chunkCount.noMatchCount;
+            const auto chunkGroups = chunkResult.counters[c].result();
+            for (auto it = chunkGroups.cbegin(); it != chunkGroups.cend(); ++it)
+                groups[it.key()].merge(it.value());
+        }
+        if (!(partial && map.size() > 1)) {
+            for (auto it = groups.cbegin(); it != groups.cend(); ++it)
+                map[it.key()] = it.value();
+        }
+        result.insert(contexts.at(c).category, map);
     }
 
-    qCInfo(TimingLog) << "ImageDB::classify(): " << timer.restart() << "ms.";
-    return map;
+    qCInfo(TimingLog) << "ImageDB::classifyAll(" << categoryCount << "categories," << chunkCount << "chunks" << (partial ? ", partial):" : "):") << timer.restart() << "ms.";
+    return result;
 }
 
 FileNameList ImageDB::files(MediaType type) const
@@ -557,8 +754,10 @@ void ImageDB::addImages(const ImageInfoList &images, bool doUpdate)
     for (const DB::ImageInfoPtr &info : images) {
         info->addCategoryInfo(i18n("Media Type"),
                               info->mediaType() == DB::Image ? i18n("Image") : i18n("Video"));
-        m_delayedCache.insert(info->fileName().absolute(), info);
+        m_delayedCache.insert(info->fileName(), info);
         m_delayedUpdate << info;
+        // new images need to be written to the journal:
+        info->markDirty();
     }
     if (doUpdate) {
         commitDelayedImages();
@@ -589,6 +788,14 @@ void ImageDB::clearDelayedImages()
 
 void ImageDB::renameImage(const ImageInfoPtr info, const FileName &newName)
 {
+    m_journal->recordRename(info->fileName(), newName);
+    if (m_fileNameIndex.remove(info->fileName()))
+        m_fileNameIndex.insert(newName, info);
+    if (info->isStacked()) {
+        StackMap::iterator found = m_stackMap.find(info->stackId());
+        if (found != m_stackMap.end())
+            std::replace(found->begin(), found->end(), info->fileName(), newName);
+    }
     info->setFileName(newName);
 }
 
@@ -596,6 +803,7 @@ void ImageDB::addToBlockList(const FileNameList &list)
 {
     for (const DB::FileName &fileName : list) {
         m_blockList.insert(fileName);
+        m_journal->recordBlock(fileName);
     }
     deleteList(list);
 }
@@ -611,26 +819,21 @@ void ImageDB::deleteList(const FileNameList &list)
         const DB::ImageInfoPtr imageInfo = info(fileName);
         StackMap::iterator found = m_stackMap.find(imageInfo->stackId());
         if (imageInfo->isStacked() && found != m_stackMap.end()) {
-            const DB::FileNameList origCache = found.value();
-            DB::FileNameList newCache;
-            for (const DB::FileName &cacheName : origCache) {
-                if (fileName != cacheName)
-                    newCache.append(cacheName);
-            }
-            if (newCache.size() <= 1) {
+            found->removeAll(fileName);
+            if (found->size() <= 1) {
                 // we're destroying a stack
-                for (const DB::FileName &cacheName : std::as_const(newCache)) {
-                    DB::ImageInfoPtr cacheInfo = info(cacheName);
-                    cacheInfo->setStackId(0);
-                    cacheInfo->setStackOrder(0);
+                for (const DB::FileName &remainingName : std::as_const(*found)) {
+                    DB::ImageInfoPtr remainingInfo = info(remainingName);
+                    remainingInfo->setStackId(0);
+                    remainingInfo->setStackOrder(0);
                 }
-                m_stackMap.remove(imageInfo->stackId());
-            } else {
-                m_stackMap.insert(imageInfo->stackId(), newCache);
+                m_stackMap.erase(found);
             }
         }
-        m_imageCache.remove(imageInfo->fileName().absolute());
+        m_fileNameIndex.remove(imageInfo->fileName());
         m_images.remove(imageInfo);
+        imageInfo->detachFromTagIndex();
+        m_journal->recordDelete(fileName);
     }
     exifDB()->remove(list);
     Q_EMIT totalChanged(m_images.count());
@@ -643,39 +846,114 @@ ImageInfoPtr ImageDB::info(const FileName &fileName) const
     if (fileName.isNull())
         return DB::ImageInfoPtr();
 
-    const QString name = fileName.absolute();
+    const auto it = m_fileNameIndex.constFind(fileName);
+    if (it != m_fileNameIndex.constEnd())
+        return it.value();
 
-    if (m_imageCache.contains(name))
-        return m_imageCache[name];
+    return m_delayedCache.value(fileName);
+}
 
-    if (m_delayedCache.contains(name))
-        return m_delayedCache[name];
+MemberMap &ImageDB::memberMap()
+{
+    return m_members;
+}
 
-    for (const DB::ImageInfoPtr &imageInfo : std::as_const(m_images))
-        m_imageCache.insert(imageInfo->fileName().absolute(), imageInfo);
+void ImageDB::save()
+{
+    // otherwise, the background save could overwrite the file afterwards:
+    waitForSave();
 
-    if (m_imageCache.contains(name)) {
-        return m_imageCache[name];
+    DB::FileWriter saver(this);
+    if (saver.save(m_fileName, false)) {
+        m_generation = saver.generation();
+        m_journal->reset();
     }
+}
 
-    return DB::ImageInfoPtr();
+struct ImageDB::BackgroundSave {
+    explicit BackgroundSave(DB::FileWriter::State state)
+        : writer(std::move(state), errors)
+    {
+    }
+    ErrorCollector errors;
+    DB::FileWriter writer;
+};
+
+void ImageDB::saveInBackground()
+{
+    if (isSaving())
+        return;
+
+    // The worker thread gets its own copy of the database, so that the user can continue working:
+    m_journal->beginSave();
+    m_saveJob = std::make_shared<BackgroundSave>(DB::FileWriter::takeState(this, DB::FileWriter::ImageCopyMode::CopyImages));
+    const int total = static_cast<int>(m_images.size() + m_clipboard.size());
+    Q_EMIT saveProgress(0, total);
+
+    m_saveWatcher.setFuture(QtConcurrent::run([job = m_saveJob, fileName = m_fileName, total](QPromise<bool> &promise) {
+        promise.setProgressRange(0, total);
+        const bool success = job->writer.save(fileName, false, [&promise](qsizetype count) { promise.setProgressValue(static_cast<int>(count)); });
+        promise.addResult(success);
+    }));
 }
 
-MemberMap &ImageDB::memberMap()
+bool ImageDB::isSaving() const
 {
-    return m_members;
+    return m_saveJob != nullptr;
 }
 
-void ImageDB::save()
+void ImageDB::waitForSave()
 {
-    DB::FileWriter saver(this);
-    saver.save(m_fileName, false);
+    if (!isSaving())
+        return;
+    m_saveWatcher.waitForFinished();
+    finishBackgroundSave();
+}
+
+void ImageDB::finishBackgroundSave()
+{
+    // waitForSave() may already have handled the result:
+    if (!m_saveJob)
+        return;
+
+    const bool success = m_saveWatcher.future().resultCount() > 0 && m_saveWatcher.result();
+    if (success)
+        m_generation = m_saveJob->writer.generation();
+    // errors are also reported when saving succeeded, e.g. when the numbered backup could not be made:
+    for (const ErrorCollector::Error &error : std::as_const(m_saveJob->errors.errors))
+        m_UI.error(DB::LogMessage { DBLog(), QStringLiteral("Saving in the background failed.") }, error.message, error.title);
+    m_journal->finishSave(success);
+    m_saveJob.reset();
+    // the last progress update is not guaranteed to be delivered before the watcher finishes:
+    Q_EMIT saveProgress(m_saveWatcher.progressMaximum(), m_saveWatcher.progressMaximum());
+    Q_EMIT saveFinished(success);
 }
 
 void ImageDB::autosave()
 {
+    // the journal must not be changed before the background save is finished:
+    if (isSaving())
+        return;
+
+    if (m_journal->append())
+        return;
+
     DB::FileWriter saver(this);
-    saver.save(autoSaveFileName(), true);
+    if (saver.save(autoSaveFileName(), true)) {
+        m_generation = saver.generation();
+        m_journal->reset();
+    }
+}
+
+void ImageDB::removeAutoSaveFiles()
+{
+    QDir().remove(autoSaveFileName());
+    m_journal->remove();
+}
+
+bool ImageDB::hasReplayedJournal() const
+{
+    return m_journalReplayed;
 }
 
 QString ImageDB::autoSaveFileName(const QString &xmlFilename)
@@ -696,8 +974,15 @@ MD5Map *ImageDB::md5Map()
     return &m_md5map;
 }
 
+const TagIndex &ImageDB::tagIndex() const
+{
+    return m_tagIndex;
+}
+
 void ImageDB::sortAndMergeBackIn(const FileNameList &fileNameList)
 {
+    // the order of the images is not recorded in the journal:
+    m_journal->requireFullSave();
     DB::ImageInfoList infoList;
     for (const DB::FileName &fileName : fileNameList)
         infoList.append(info(fileName));
@@ -717,6 +1002,7 @@ const CategoryCollection *ImageDB::categoryCollection() const
 void ImageDB::reorder(const FileName &item, const FileNameList &selection, bool after)
 {
     Q_ASSERT(!item.isNull());
+    m_journal->requireFullSave();
     DB::ImageInfoList list = takeImagesFromSelection(selection);
     insertList(item, list, after);
 }
@@ -794,24 +1080,7 @@ FileNameList ImageDB::getStackFor(const FileName &referenceImage) const
     if (!imageInfo || !imageInfo->isStacked())
         return DB::FileNameList();
 
-    StackMap::iterator found = m_stackMap.find(imageInfo->stackId());
-    if (found != m_stackMap.end())
-        return found.value();
-
-    // it wasn't in the cache -> rebuild it
-    m_stackMap.clear();
-    for (DB::ImageInfoListConstIterator it = m_images.constBegin(); it != m_images.constEnd(); ++it) {
-        if ((*it)->isStacked()) {
-            DB::StackID stackid = (*it)->stackId();
-            m_stackMap[stackid].append((*it)->fileName());
-        }
-    }
-
-    found = m_stackMap.find(imageInfo->stackId());
-    if (found != m_stackMap.end())
-        return found.value();
-    else
-        return DB::FileNameList();
+    return m_stackMap.value(imageInfo->stackId());
 }
 
 void ImageDB::copyData(const FileName &from, const FileName &to)
@@ -859,8 +1128,6 @@ ImageInfoPtr ImageDB::createImageInfo(const FileName &fileName, DB::ReaderPtr re
     static QString _stackOrder_ = QString::fromUtf8("stackOrder");
     static QString _videoLength_ = QString::fromUtf8("videoLength");
     static QString _options_ = QString::fromUtf8("options");
-    static QString _0_ = QString::fromUtf8("0");
-    static QString _minus1_ = QString::fromUtf8("-1");
     static QString _MediaType_ = i18n("Media Type");
     static QString _Image_ = i18n("Image");
     static QString _Video_ = i18n("Video");
@@ -878,51 +1145,53 @@ ImageInfoPtr ImageDB::createImageInfo(const FileName &fileName, DB::ReaderPtr re
     if (reader->hasAttribute(_startDate_)) {
         Utilities::FastDateTime start;
 
-        QString str = reader->attribute(_startDate_);
-        if (!str.isEmpty())
-            start = dateTimeFromString(str);
+        const QStringView startDate = reader->attributeView(_startDate_);
+        if (!startDate.isEmpty())
+            start = dateTimeFromString(startDate);
 
-        str = reader->attribute(_endDate_);
-        if (!str.isEmpty())
-            date = DB::ImageDate(start, dateTimeFromString(str));
+        const QStringView endDate = reader->attributeView(_endDate_);
+        if (!endDate.isEmpty())
+            date = DB::ImageDate(start, dateTimeFromString(endDate));
         else
             date = DB::ImageDate(start);
     } else {
         int yearFrom = 0, monthFrom = 0, dayFrom = 0, yearTo = 0, monthTo = 0, dayTo = 0, hourFrom = -1, minuteFrom = -1, secondFrom = -1;
 
-        yearFrom = reader->attribute(_yearFrom_, _0_).toInt();
-        monthFrom = reader->attribute(_monthFrom_, _0_).toInt();
-        dayFrom = reader->attribute(_dayFrom_, _0_).toInt();
-        hourFrom = reader->attribute(_hourFrom_, _minus1_).toInt();
-        minuteFrom = reader->attribute(_minuteFrom_, _minus1_).toInt();
-        secondFrom = reader->attribute(_secondFrom_, _minus1_).toInt();
+        yearFrom = reader->intAttribute(_yearFrom_, 0);
+        monthFrom = reader->intAttribute(_monthFrom_, 0);
+        dayFrom = reader->intAttribute(_dayFrom_, 0);
+        hourFrom = reader->intAttribute(_hourFrom_, -1);
+        minuteFrom = reader->intAttribute(_minuteFrom_, -1);
+        secondFrom = reader->intAttribute(_secondFrom_, -1);
 
-        yearTo = reader->attribute(_yearTo_, _0_).toInt();
-        monthTo = reader->attribute(_monthTo_, _0_).toInt();
-        dayTo = reader->attribute(_dayTo_, _0_).toInt();
+        yearTo = reader->intAttribute(_yearTo_, 0);
+        monthTo = reader->intAttribute(_monthTo_, 0);
+        dayTo = reader->intAttribute(_dayTo_, 0);
         date = DB::ImageDate(yearFrom, monthFrom, dayFrom, yearTo, monthTo, dayTo, hourFrom, minuteFrom, secondFrom);
     }
 
-    int angle = reader->attribute(_angle_, _0_).toInt();
-    DB::MD5 md5sum(reader->attribute(_md5sum_));
+    int angle = reader->intAttribute(_angle_, 0);
+    DB::MD5 md5sum(reader->attributeView(_md5sum_));
 
-    s_anyImageWithEmptySize |= !reader->hasAttribute(_width_);
+    if (!reader->hasAttribute(_width_))
+        s_anyImageWithEmptySize = true;
 
-    int w = reader->attribute(_width_, _minus1_).toInt();
-    int h = reader->attribute(_height_, _minus1_).toInt();
+    int w = reader->intAttribute(_width_, -1);
+    int h = reader->intAttribute(_height_, -1);
     QSize size = QSize(w, h);
 
     DB::MediaType mediaType = KPABase::isVideo(fileName) ? DB::Video : DB::Image;
 
-    short rating = reader->attribute(_rating_, _minus1_).toShort();
-    DB::StackID stackId = reader->attribute(_stackId_, _0_).toULong();
-    unsigned int stackOrder = reader->attribute(_stackOrder_, _0_).toULong();
+    const QStringView ratingString = reader->attributeView(_rating_);
+    short rating = ratingString.isNull() ? -1 : ratingString.toShort();
+    DB::StackID stackId = reader->attributeView(_stackId_).toULong();
+    unsigned int stackOrder = reader->attributeView(_stackOrder_).toULong();
 
     DB::ImageInfo *info = new DB::ImageInfo(fileName, label, description, date,
                                             angle, md5sum, size, mediaType, rating, stackId, stackOrder);
 
     if (reader->hasAttribute(_videoLength_))
-        info->setVideoLength(reader->attribute(_videoLength_).toInt());
+        info->setVideoLength(reader->intAttribute(_videoLength_));
 
     DB::ImageInfoPtr result(info);
 
@@ -938,7 +1207,7 @@ ImageInfoPtr ImageDB::createImageInfo(const FileName &fileName, DB::ReaderPtr re
     return result;
 }
 
-QRect ImageDB::parseAreaData(const QString &dataString)
+QRect ImageDB::parseAreaData(QStringView dataString)
 {
     const auto data = dataString.split(QLatin1Char(' '));
 
@@ -962,78 +1231,90 @@ void ImageDB::possibleLoadCompressedCategories(DB::ReaderPtr reader, ImageInfoPt
 
     const auto categories = db->m_categoryCollection.categories();
 
-    for (const DB::CategoryPtr &categoryPtr : categories) {
+    const auto loadTags = [&info](const DB::CategoryPtr &categoryPtr, QStringView str) {
         const QString categoryName = categoryPtr->name();
-        QString str;
-
-        if (reader->fileVersion() >= 11) {
-            // From version 11 on, we don't use category names as attributes anymore,
-            // but "tags_" followed by the category's ID:
-            if (categoryPtr->id() > 0) {
-                str = reader->attribute(QStringLiteral("tags_") % QString::number(categoryPtr->id()));
+        for (const QStringView tagString : str.tokenize(QLatin1Char(','), Qt::SkipEmptyParts)) {
+            QRect area;
+
+            // Additional information is split by the '+' character; e.g. '2+a=480 285 51 53' for localized tag areas
+            auto parts = tagString.tokenize(QLatin1Char('+'));
+            auto part = parts.begin();
+
+            // The number we want is always the first part.
+            int id = (*part).toInt();
+
+            // Process the additional information
+            for (++part; part != parts.end(); ++part) {
+                const QStringView addition = *part;
+                if (addition.startsWith(QStringLiteral("a="))) {
+                    // Area data was added
+                    area = parseAreaData(addition.sliced(2));
+                } else {
+                    qCWarning(DBLog) << "Unknown tag component" << addition << "in tag" << str;
+                }
             }
 
-        } else {
-            // Versions before 11 used escaped category names as attributes.
-            // We query those here:
-
-            QString oldCategoryName;
-            if (newToOldCategory) {
-                // translate to old categoryName, defaulting to the original name if not found:
-                oldCategoryName = newToOldCategory->value(categoryName, categoryName);
+            if (id != 0 || categoryPtr->isSpecialCategory()) {
+                const QString name = categoryPtr->nameForId(id);
+                info->addCategoryInfo(categoryName, name, area);
             } else {
-                oldCategoryName = categoryName;
+                QStringList tags = categoryPtr->namesForIdZero();
+                if (tags.size() == 1) {
+                    qCInfo(DBLog) << "Fixing tag " << categoryName << "/" << tags[0] << "with id=0 for image" << info->fileName().relative();
+                } else {
+                    // insert marker category
+                    QString markerTag = i18n("KPhotoAlbum - manual repair needed (%1)",
+                                             tags.join(i18nc("Separator in a list of tags", ", ")));
+                    categoryPtr->addItem(markerTag);
+                    info->addCategoryInfo(categoryName, markerTag);
+                    qCWarning(DBLog) << "Manual fix required for image" << info->fileName().relative();
+                    qCWarning(DBLog) << "Image was marked with tag " << categoryName << "/" << markerTag;
+                }
+                for (const auto &name : std::as_const(tags)) {
+                    info->addCategoryInfo(categoryName, name);
+                }
             }
-
-            str = reader->attribute(escapeAttributeName(oldCategoryName));
         }
+    };
+
+    if (reader->fileVersion() >= 11) {
+        // From version 11 on, we don't use category names as attributes anymore,
+        // but "tags_" followed by the category's ID.
+        // Looking at each attribute once is a lot cheaper than looking up an attribute name for each category:
+        static const QString tagsPrefix = QStringLiteral("tags_");
+        for (const QXmlStreamAttribute &attribute : reader->elementAttributes()) {
+            const QStringView name = attribute.name();
+            if (!name.startsWith(tagsPrefix) || attribute.value().isEmpty())
+                continue;
+            const int categoryId = name.sliced(tagsPrefix.size()).toInt();
+            if (categoryId <= 0)
+                continue;
+            const auto categoryIt = std::find_if(categories.cbegin(), categories.cend(), [categoryId](const DB::CategoryPtr &category) {
+                return category->id() == categoryId;
+            });
+            if (categoryIt != categories.cend())
+                loadTags(*categoryIt, attribute.value());
+        }
+        return;
+    }
 
-        if (!str.isEmpty()) {
-
-            const auto list = str.split(QLatin1Char(','), Qt::SkipEmptyParts);
-
-            for (const auto &tagString : list) {
-                QRect area;
-
-                // Additional information is split by the '+' character; e.g. '2+a=480 285 51 53' for localized tag areas
-                auto parts = tagString.split(QLatin1Char('+'));
-
-                // The number we want is always the first part.
-                // Remove it from the list and parse it
-                int id = parts.takeFirst().toInt();
+    for (const DB::CategoryPtr &categoryPtr : categories) {
+        const QString categoryName = categoryPtr->name();
 
-                // Process the additional information
-                for (const auto &addition : std::as_const(parts)) {
-                    if (addition.startsWith(QStringLiteral("a="))) {
-                        // Area data was added
-                        area = parseAreaData(addition.mid(2));
-                    } else {
-                        qCWarning(DBLog) << "Unknown tag component" << addition << "in tag" << str;
-                    }
-                }
+        // Versions before 11 used escaped category names as attributes.
+        // We query those here:
 
-                if (id != 0 || categoryPtr->isSpecialCategory()) {
-                    const QString name = categoryPtr->nameForId(id);
-                    info->addCategoryInfo(categoryName, name, area);
-                } else {
-                    QStringList tags = categoryPtr->namesForIdZero();
-                    if (tags.size() == 1) {
-                        qCInfo(DBLog) << "Fixing tag " << categoryName << "/" << tags[0] << "with id=0 for image" << info->fileName().relative();
-                    } else {
-                        // insert marker category
-                        QString markerTag = i18n("KPhotoAlbum - manual repair needed (%1)",
-                                                 tags.join(i18nc("Separator in a list of tags", ", ")));
-                        categoryPtr->addItem(markerTag);
-                        info->addCategoryInfo(categoryName, markerTag);
-                        qCWarning(DBLog) << "Manual fix required for image" << info->fileName().relative();
-                        qCWarning(DBLog) << "Image was marked with tag " << categoryName << "/" << markerTag;
-                    }
-                    for (const auto &name : std::as_const(tags)) {
-                        info->addCategoryInfo(categoryName, name);
-                    }
-                }
-            }
+        QString oldCategoryName;
+        if (newToOldCategory) {
+            // translate to old categoryName, defaulting to the original name if not found:
+            oldCategoryName = newToOldCategory->value(categoryName, categoryName);
+        } else {
+            oldCategoryName = categoryName;
         }
+
+        const QStringView str = reader->attributeView(escapeAttributeName(oldCategoryName));
+        if (!str.isEmpty())
+            loadTags(categoryPtr, str);
     }
 }
 
@@ -1043,6 +1324,9 @@ void ImageDB::setUntaggedTag(DB::TagInfo *tag)
         m_untaggedTag->deleteLater();
     }
     m_untaggedTag = tag;
+    // the journal does not exist yet while the database file is being read:
+    if (m_journal)
+        m_journal->requireFullSave();
     if (m_untaggedTag && m_untaggedTag->isValid()) {
         const QSignalBlocker signalBlocker { this };
         Settings::SettingsData::instance()->setUntaggedCategory(m_untaggedTag->categoryName());
@@ -18,6 +18,7 @@
 #include "ImageInfoList.h"
 #include "ImageInfoPtr.h"
 #include "MediaCount.h"
+#include "TagIndex.h"
 
 #include <DB/CategoryCollection.h>
 #include <DB/MD5Map.h>
@@ -26,15 +27,19 @@
 #include <DB/search/ImageSearchInfo.h>
 #include <kpabase/FileNameList.h>
 
+#include <QFutureWatcher>
 #include <QObject>
 #include <QPointer>
+#include <atomic>
 #include <memory>
+#include <utility>
 
 class QProgressBar;
 
 namespace DB
 {
 class FileWriter;
+class Journal;
 }
 namespace DB
 {
@@ -92,6 +97,11 @@ public:
 
     int totalCount() const;
     DB::ImageInfoList search(const ImageSearchInfo &, bool requireOnDisk) const;
+    /**
+     * @brief search returns all images matching \p searchInfo.
+     * If the search allows it (see ImageSearchInfo::canMatchConcurrently()), the images are matched concurrently.
+     * Either way, the result is in database order.
+     */
     DB::ImageInfoList search(const DB::ImageSearchInfo &searchInfo, DB::SearchOptions options = DB::SearchOption::NoOption) const;
 
     /**
@@ -111,6 +121,19 @@ public:
      * @return a mapping of sub-category (tags/tag-groups) to the number of images (and the associated date range)
      */
     QMap<QString, CountWithRange> classify(const ImageSearchInfo &info, const QString &category, MediaType typemask, ClassificationMode mode = ClassificationMode::FullCount);
+    /**
+     * @brief classifyAll computes the histograms of several categories at once.
+     * The result is the same as calling classify() for each category, but the database is traversed only once
+     * and each image is matched against \p info only once.
+     * If the search allows it, the images are classified concurrently.
+     *
+     * @param info ImageSearchInfo describing the current search context
+     * @param categories the categories for which images should be classified
+     * @param typemask images/videos/both
+     * @param mode whether accurate counts are required or not; a partial count stops once all categories have more than one sub-category
+     * @return a mapping of category to the result of classify() for that category
+     */
+    QMap<QString, QMap<QString, CountWithRange>> classifyAll(const ImageSearchInfo &info, const QStringList &categories, MediaType typemask, ClassificationMode mode = ClassificationMode::FullCount);
     FileNameList files(MediaType type = anyMediaType) const;
     ImageInfoList images() const;
     /**
@@ -146,14 +169,47 @@ public:
 
     /**
      * Saves the database to m_fileName.
+     * If the database is currently saved in the background, this waits for that save to finish first.
      */
     void save();
 
+    /**
+     * Saves the database to m_fileName in a background thread.
+     * The content of the database is copied before, so that the database can be changed while it is saved.
+     * The progress is reported by saveProgress(), the result by saveFinished().
+     * If the database is already saved in the background, nothing happens.
+     */
+    void saveInBackground();
+
+    /**
+     * @return \c true, while the database is saved in the background.
+     */
+    bool isSaving() const;
+
+    /**
+     * Blocks until saving in the background has finished.
+     */
+    void waitForSave();
+
     /**
      * Writes an auto-save file.  The filename is derived from m_fileName.
+     * If possible, only the changes since the last auto-save are appended to the change journal;
+     * the whole database is only written when the journal can't be used.
+     * Does nothing while the database is saved in the background.
+     * @see DB::Journal
      */
     void autosave();
 
+    /**
+     * Removes the auto-save file and the change journal, e.g. when the user chose not to save the database.
+     */
+    void removeAutoSaveFiles();
+
+    /**
+     * @return \c true, if unsaved changes from the change journal were restored when the database was loaded.
+     */
+    bool hasReplayedJournal() const;
+
     /**
      * Returns the auto-save filename derived from the given XML database
      * filename.
@@ -166,6 +222,11 @@ public:
     QString autoSaveFileName() const;
 
     MD5Map *md5Map();
+    /**
+     * @brief tagIndex
+     * @return the inverted index mapping tags to the images in the database
+     */
+    const TagIndex &tagIndex() const;
     void sortAndMergeBackIn(const DB::FileNameList &fileNameList);
 
     CategoryCollection *categoryCollection();
@@ -236,6 +297,13 @@ Q_SIGNALS:
     void totalChanged(int);
     void dirty();
     void imagesDeleted(const DB::FileNameList &);
+    /**
+     * @brief saveProgress is emitted while the database is saved in the background.
+     * @param value the number of images saved so far
+     * @param total the number of images to save
+     */
+    void saveProgress(int value, int total);
+    void saveFinished(bool success);
 
 protected:
     ImageDB(const QString &configFile, UIDelegate &delegate);
@@ -270,6 +338,7 @@ protected Q_SLOTS:
 private:
     friend class DB::FileReader;
     friend class DB::FileWriter;
+    friend class DB::Journal;
 
     static void connectSlots();
     static ImageDB *s_instance;
@@ -277,9 +346,35 @@ private:
     QPointer<DB::TagInfo> m_untaggedTag;
 
     void forceUpdate(const DB::ImageInfoList &images);
+    /// A half-open range [first, second) of indices into m_images.
+    using ImageChunk = std::pair<qsizetype, qsizetype>;
+    /**
+     * @brief imageChunks partitions m_images into consecutive chunks, in database order.
+     * @param concurrent if \c false, a single chunk covering all images is returned
+     * @return enough chunks to keep all threads of the global thread pool busy
+     */
+    QList<ImageChunk> imageChunks(bool concurrent) const;
+    void finishBackgroundSave();
 
     QString m_fileName;
+    /// Identifies the version of the database file that was last read or written; see DB::Journal.
+    QString m_generation;
+    std::unique_ptr<DB::Journal> m_journal;
+    bool m_journalReplayed = false;
+    struct BackgroundSave;
+    std::shared_ptr<BackgroundSave> m_saveJob;
+    QFutureWatcher<bool> m_saveWatcher;
+    // m_tagIndex is referenced by all images in m_images and must therefore outlive them:
+    DB::TagIndex m_tagIndex;
     DB::ImageInfoList m_images;
+    /// The copy of an image that was handed to the last background save; see DB::FileWriter::takeState().
+    struct SavedCopy {
+        DB::ImageInfoPtr original;
+        quint64 revision = 0;
+        DB::ImageInfoPtr copy;
+    };
+    /// Copies of unchanged images are reused by the next background save, so that only changed images need to be copied.
+    QHash<const DB::ImageInfo *, SavedCopy> m_savedCopies;
     QSet<DB::FileName> m_blockList;
     DB::ImageInfoList m_missingTimes;
     DB::CategoryCollection m_categoryCollection;
@@ -288,16 +383,18 @@ private:
     // QMap<QString, QString> m_settings;
 
     DB::StackID m_nextStackId;
-    typedef QMap<DB::StackID, DB::FileNameList> StackMap;
-    mutable StackMap m_stackMap;
+    typedef QHash<DB::StackID, DB::FileNameList> StackMap;
+    /// Maps each stack to its members; kept up to date whenever images are added, removed, renamed, stacked or unstacked.
+    StackMap m_stackMap;
     DB::ImageInfoList m_delayedUpdate;
-    mutable QHash<const QString, DB::ImageInfoPtr> m_imageCache;
-    mutable QHash<const QString, DB::ImageInfoPtr> m_delayedCache;
+    /// Maps the file names of all images in m_images to their ImageInfo; kept up to date whenever m_images is changed.
+    QHash<DB::FileName, DB::ImageInfoPtr> m_fileNameIndex;
+    QHash<DB::FileName, DB::ImageInfoPtr> m_delayedCache;
 
     // used for checking if any images are without image attribute from the database.
-    static bool s_anyImageWithEmptySize;
+    static std::atomic<bool> s_anyImageWithEmptySize;
 
-    static QRect parseAreaData(const QString &dataString);
+    static QRect parseAreaData(QStringView dataString);
 };
 }
 #endif /* IMAGEDB_H */
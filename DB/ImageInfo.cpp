@@ -26,6 +26,8 @@
 #include "FileInfo.h"
 #include "ImageDB.h"
 #include "MemberMap.h"
+#include "TagDictionary.h"
+#include "TagIndex.h"
 
 #include <kpabase/FileNameUtil.h>
 #include <kpabase/Logging.h>
@@ -39,6 +41,9 @@
 #include <QImageReader>
 #include <QStringList>
 
+#include <algorithm>
+#include <iterator>
+
 using namespace DB;
 
 ImageInfo::ImageInfo()
@@ -50,8 +55,6 @@ ImageInfo::ImageInfo()
     , m_stackId(0)
     , m_stackOrder(0)
     , m_videoLength(-1)
-    , m_isMatched(false)
-    , m_matchGeneration(-1)
     , m_locked(false)
     , m_dirty(false)
 {
@@ -66,8 +69,6 @@ ImageInfo::ImageInfo(const DB::FileName &fileName, MediaType type, FileInformati
     , m_stackId(0)
     , m_stackOrder(0)
     , m_videoLength(-1)
-    , m_isMatched(false)
-    , m_matchGeneration(-1)
     , m_locked(false)
 {
     QFileInfo fi(fileName.absolute());
@@ -93,26 +94,6 @@ ImageInfo::ImageInfo(const ImageInfo &other)
     *this = other;
 }
 
-void ImageInfo::setIsMatched(bool isMatched)
-{
-    m_isMatched = isMatched;
-}
-
-bool ImageInfo::isMatched() const
-{
-    return m_isMatched;
-}
-
-void ImageInfo::setMatchGeneration(int matchGeneration)
-{
-    m_matchGeneration = matchGeneration;
-}
-
-int ImageInfo::matchGeneration() const
-{
-    return m_matchGeneration;
-}
-
 void ImageInfo::setLabel(const QString &desc)
 {
     if (desc != m_label)
@@ -141,22 +122,54 @@ void ImageInfo::setCategoryInfo(const QString &key, const StringSet &value)
 {
     // Don't check if really changed, because it's too slow.
     markDirty();
-    m_categoryInfomation[key] = value;
+    auto &dictionary = TagDictionary::instance();
+    const TagId category = dictionary.intern(key);
+    const TagIdList tags = dictionary.intern(value);
+    if (m_tagIndex)
+        updateTagIndex(category, m_categoryInfomation.value(category), tags);
+    m_categoryInfomation[category] = tags;
 }
 
 bool ImageInfo::hasCategoryInfo(const QString &key, const QString &value) const
 {
-    return m_categoryInfomation[key].contains(value);
+    const auto &dictionary = TagDictionary::instance();
+    return hasCategoryInfo(dictionary.lookup(key), dictionary.lookup(value));
 }
 
 bool DB::ImageInfo::hasCategoryInfo(const QString &key, const StringSet &values) const
 {
-    return values.intersects(m_categoryInfomation[key]);
+    const auto &dictionary = TagDictionary::instance();
+    const auto it = m_categoryInfomation.constFind(dictionary.lookup(key));
+    if (it == m_categoryInfomation.constEnd())
+        return false;
+    for (const auto &value : values) {
+        if (TagDictionary::containsSorted(it.value(), dictionary.lookup(value)))
+            return true;
+    }
+    return false;
+}
+
+bool ImageInfo::hasCategoryInfo(TagId category, TagId tag) const
+{
+    const auto it = m_categoryInfomation.constFind(category);
+    return it != m_categoryInfomation.constEnd() && TagDictionary::containsSorted(it.value(), tag);
+}
+
+bool ImageInfo::hasCategoryInfo(TagId category, const TagIdList &tags) const
+{
+    const auto it = m_categoryInfomation.constFind(category);
+    return it != m_categoryInfomation.constEnd() && TagDictionary::intersectsSorted(it.value(), tags);
 }
 
 StringSet ImageInfo::itemsOfCategory(const QString &key) const
 {
-    return m_categoryInfomation[key];
+    const auto &dictionary = TagDictionary::instance();
+    return dictionary.names(m_categoryInfomation.value(dictionary.lookup(key)));
+}
+
+TagIdList ImageInfo::tagIds(TagId category) const
+{
+    return m_categoryInfomation.value(category);
 }
 
 void ImageInfo::renameItem(const QString &category, const QString &oldValue, const QString &newValue)
@@ -168,12 +181,18 @@ void ImageInfo::renameItem(const QString &category, const QString &oldValue, con
         }
     }
 
-    StringSet &set = m_categoryInfomation[category];
-    StringSet::iterator it = set.find(oldValue);
-    if (it != set.end()) {
+    auto &dictionary = TagDictionary::instance();
+    const TagId categoryId = dictionary.intern(category);
+    TagIdList &tags = m_categoryInfomation[categoryId];
+    const TagId oldId = dictionary.lookup(oldValue);
+    if (oldId != 0 && TagDictionary::removeSorted(tags, oldId)) {
         markDirty();
-        set.erase(it);
-        set.insert(newValue);
+        const TagId newId = dictionary.intern(newValue);
+        TagDictionary::insertSorted(tags, newId);
+        if (m_tagIndex) {
+            m_tagIndex->remove(categoryId, oldId, m_ordinal);
+            m_tagIndex->add(categoryId, newId, m_ordinal);
+        }
     }
 }
 
@@ -350,9 +369,12 @@ bool ImageInfo::operator==(const ImageInfo &other) const
     bool changed = (m_fileName != other.m_fileName || m_label != other.m_label || (!m_description.isEmpty() && !other.m_description.isEmpty() && m_description != other.m_description) || // one might be isNull.
                     m_date != other.m_date || m_angle != other.m_angle || m_rating != other.m_rating || (m_stackId != other.m_stackId || !((m_stackId == 0) ? true : (m_stackOrder == other.m_stackOrder))));
     if (!changed) {
+        const auto &dictionary = TagDictionary::instance();
         QStringList keys = DB::ImageDB::instance()->categoryCollection()->categoryNames();
-        for (QStringList::ConstIterator it = keys.constBegin(); it != keys.constEnd(); ++it)
-            changed |= m_categoryInfomation[*it] != other.m_categoryInfomation[*it];
+        for (QStringList::ConstIterator it = keys.constBegin(); it != keys.constEnd(); ++it) {
+            const TagId category = dictionary.lookup(*it);
+            changed |= m_categoryInfomation.value(category) != other.m_categoryInfomation.value(category);
+        }
     }
     return !changed;
 }
@@ -361,8 +383,13 @@ void ImageInfo::renameCategory(const QString &oldName, const QString &newName)
 {
     markDirty();
 
-    m_categoryInfomation[newName] = m_categoryInfomation[oldName];
-    m_categoryInfomation.remove(oldName);
+    auto &dictionary = TagDictionary::instance();
+    const TagId oldId = dictionary.intern(oldName);
+    const TagId newId = dictionary.intern(newName);
+    const CategoryInformation oldCategoryInformation = m_categoryInfomation;
+    const TagIdList tags = m_categoryInfomation.take(oldId);
+    m_categoryInfomation[newId] = tags;
+    updateTagIndex(oldCategoryInformation);
 
     m_taggedAreas[newName] = m_taggedAreas[oldName];
     m_taggedAreas.remove(oldName);
@@ -464,7 +491,12 @@ void ImageInfo::readExif(const DB::FileName &fullPath, DB::ExifMode mode)
 
 QStringList ImageInfo::availableCategories() const
 {
-    return m_categoryInfomation.keys();
+    const auto &dictionary = TagDictionary::instance();
+    QStringList result;
+    result.reserve(m_categoryInfomation.size());
+    for (auto it = m_categoryInfomation.cbegin(); it != m_categoryInfomation.cend(); ++it)
+        result.append(dictionary.name(it.key()));
+    return result;
 }
 
 QSize ImageInfo::size() const
@@ -515,7 +547,6 @@ ImageInfo::ImageInfo(const DB::FileName &fileName,
     m_stackId = stackId;
     m_stackOrder = stackOrder;
     m_videoLength = -1;
-    m_matchGeneration = -1;
 }
 
 // Note: we need this operator because the base class QSharedData hides
@@ -523,6 +554,7 @@ ImageInfo::ImageInfo(const DB::FileName &fileName,
 // copied.
 ImageInfo &ImageInfo::operator=(const ImageInfo &other)
 {
+    const CategoryInformation oldCategoryInformation = m_categoryInfomation;
     m_fileName = other.m_fileName;
     m_label = other.m_label;
     m_description = other.m_description;
@@ -539,14 +571,15 @@ ImageInfo &ImageInfo::operator=(const ImageInfo &other)
     m_stackId = other.m_stackId;
     m_stackOrder = other.m_stackOrder;
     m_videoLength = other.m_videoLength;
-    m_isMatched = other.m_isMatched;
-    m_matchGeneration = other.m_matchGeneration;
 #ifdef HAVE_KGEOMAP
     m_coordinates = other.m_coordinates;
     m_coordsIsSet = other.m_coordsIsSet;
 #endif
     m_locked = other.m_locked;
     m_dirty = other.m_dirty;
+    ++m_revision;
+    // m_tagIndex and m_ordinal stay untouched: they belong to this instance, not to its content
+    updateTagIndex(oldCategoryInformation);
 
     return *this;
 }
@@ -583,12 +616,19 @@ void DB::ImageInfo::createFolderCategoryItem(DB::CategoryPtr folderCategory, DB:
         folderCategory->addItem(folderName);
     }
 
-    m_categoryInfomation.insert(folderCategory->name(), StringSet() << folderName);
+    auto &dictionary = TagDictionary::instance();
+    const TagId category = dictionary.intern(folderCategory->name());
+    const TagIdList folderTags { dictionary.intern(folderName) };
+    if (m_tagIndex)
+        updateTagIndex(category, m_categoryInfomation.value(category), folderTags);
+    m_categoryInfomation.insert(category, folderTags);
 }
 
 void DB::ImageInfo::copyExtraData(const DB::ImageInfo &from, bool copyAngle)
 {
+    const CategoryInformation oldCategoryInformation = m_categoryInfomation;
     m_categoryInfomation = from.m_categoryInfomation;
+    updateTagIndex(oldCategoryInformation);
     m_description = from.m_description;
     // Hmm...  what should the date be?  orig or modified?
     // _date = from._date;
@@ -599,7 +639,9 @@ void DB::ImageInfo::copyExtraData(const DB::ImageInfo &from, bool copyAngle)
 
 void DB::ImageInfo::removeExtraData()
 {
+    const CategoryInformation oldCategoryInformation = m_categoryInfomation;
     m_categoryInfomation.clear();
+    updateTagIndex(oldCategoryInformation);
     m_description.clear();
     m_rating = -1;
 }
@@ -632,23 +674,30 @@ void ImageInfo::merge(const ImageInfo &other)
     }
 
     // Clear untagged tag if only one of the images was untagged
-    const QString untaggedCategory = Settings::SettingsData::instance()->untaggedCategory();
-    const QString untaggedTag = Settings::SettingsData::instance()->untaggedTag();
-    const bool isCompleted = !m_categoryInfomation[untaggedCategory].contains(untaggedTag) || !other.m_categoryInfomation[untaggedCategory].contains(untaggedTag);
+    auto &dictionary = TagDictionary::instance();
+    const TagId untaggedCategory = dictionary.intern(Settings::SettingsData::instance()->untaggedCategory());
+    const TagId untaggedTag = dictionary.intern(Settings::SettingsData::instance()->untaggedTag());
+    const bool isCompleted = !hasCategoryInfo(untaggedCategory, untaggedTag) || !other.hasCategoryInfo(untaggedCategory, untaggedTag);
 
     // Merge tags
-    const auto categoryInfomationKeys = m_categoryInfomation.keys();
-    QSet<QString> keys(categoryInfomationKeys.begin(), categoryInfomationKeys.end());
-    const auto otherCategoryInfomationKeys = other.m_categoryInfomation.keys();
-    const QSet<QString> otherCategoryInfomationKeysSet(otherCategoryInfomationKeys.begin(), otherCategoryInfomationKeys.end());
-    keys.unite(otherCategoryInfomationKeysSet);
-    for (const QString &key : keys) {
-        m_categoryInfomation[key].unite(other.m_categoryInfomation[key]);
+    const CategoryInformation oldCategoryInformation = m_categoryInfomation;
+    for (auto it = other.m_categoryInfomation.cbegin(); it != other.m_categoryInfomation.cend(); ++it) {
+        TagIdList &tags = m_categoryInfomation[it.key()];
+        if (tags.isEmpty()) {
+            tags = it.value();
+            continue;
+        }
+        TagIdList merged;
+        merged.reserve(tags.size() + it.value().size());
+        std::set_union(tags.cbegin(), tags.cend(), it.value().cbegin(), it.value().cend(), std::back_inserter(merged));
+        tags = merged;
     }
 
     // Clear untagged tag if only one of the images was untagged
     if (isCompleted)
-        m_categoryInfomation[untaggedCategory].remove(untaggedTag);
+        TagDictionary::removeSorted(m_categoryInfomation[untaggedCategory], untaggedTag);
+
+    updateTagIndex(oldCategoryInformation);
 
     // merge stacks:
     if (isStacked() || other.isStacked()) {
@@ -667,36 +716,54 @@ void ImageInfo::merge(const ImageInfo &other)
 
 void DB::ImageInfo::addCategoryInfo(const QString &category, const StringSet &values)
 {
+    auto &dictionary = TagDictionary::instance();
+    const TagId categoryId = dictionary.intern(category);
+    TagIdList &tags = m_categoryInfomation[categoryId];
     for (StringSet::const_iterator valueIt = values.constBegin(); valueIt != values.constEnd(); ++valueIt) {
-        if (!m_categoryInfomation[category].contains(*valueIt)) {
+        const TagId tag = dictionary.intern(*valueIt);
+        if (TagDictionary::insertSorted(tags, tag)) {
             markDirty();
-            m_categoryInfomation[category].insert(*valueIt);
+            if (m_tagIndex)
+                m_tagIndex->add(categoryId, tag, m_ordinal);
         }
     }
 }
 
 void DB::ImageInfo::clearAllCategoryInfo()
 {
+    const CategoryInformation oldCategoryInformation = m_categoryInfomation;
+    if (!m_categoryInfomation.isEmpty() || !m_taggedAreas.isEmpty())
+        markDirty();
     m_categoryInfomation.clear();
     m_taggedAreas.clear();
+    updateTagIndex(oldCategoryInformation);
 }
 
 void DB::ImageInfo::removeCategoryInfo(const QString &category, const StringSet &values)
 {
+    auto &dictionary = TagDictionary::instance();
+    const TagId categoryId = dictionary.intern(category);
+    TagIdList &tags = m_categoryInfomation[categoryId];
     for (StringSet::const_iterator valueIt = values.constBegin(); valueIt != values.constEnd(); ++valueIt) {
-        if (m_categoryInfomation[category].contains(*valueIt)) {
+        const TagId tag = dictionary.lookup(*valueIt);
+        if (tag != 0 && TagDictionary::removeSorted(tags, tag)) {
             markDirty();
-            m_categoryInfomation[category].remove(*valueIt);
             m_taggedAreas[category].remove(*valueIt);
+            if (m_tagIndex)
+                m_tagIndex->remove(categoryId, tag, m_ordinal);
         }
     }
 }
 
 void DB::ImageInfo::addCategoryInfo(const QString &category, const QString &value, const QRect &area)
 {
-    if (!m_categoryInfomation[category].contains(value)) {
+    auto &dictionary = TagDictionary::instance();
+    const TagId categoryId = dictionary.intern(category);
+    const TagId tag = dictionary.intern(value);
+    if (TagDictionary::insertSorted(m_categoryInfomation[categoryId], tag)) {
         markDirty();
-        m_categoryInfomation[category].insert(value);
+        if (m_tagIndex)
+            m_tagIndex->add(categoryId, tag, m_ordinal);
 
         if (area.isValid()) {
             m_taggedAreas[category][value] = area;
@@ -706,10 +773,14 @@ void DB::ImageInfo::addCategoryInfo(const QString &category, const QString &valu
 
 void DB::ImageInfo::removeCategoryInfo(const QString &category, const QString &value)
 {
-    if (m_categoryInfomation[category].contains(value)) {
+    auto &dictionary = TagDictionary::instance();
+    const TagId categoryId = dictionary.intern(category);
+    const TagId tag = dictionary.lookup(value);
+    if (tag != 0 && TagDictionary::removeSorted(m_categoryInfomation[categoryId], tag)) {
         markDirty();
-        m_categoryInfomation[category].remove(value);
         m_taggedAreas[category].remove(value);
+        if (m_tagIndex)
+            m_tagIndex->remove(categoryId, tag, m_ordinal);
     }
 }
 
@@ -819,7 +890,62 @@ Map::GeoCoordinates DB::ImageInfo::coordinates() const
 void ImageInfo::markDirty()
 {
     m_dirty = true;
-    m_matchGeneration = -1;
+    ++m_revision;
+}
+
+void ImageInfo::attachToTagIndex(TagIndex *index)
+{
+    Q_ASSERT(index);
+    if (m_tagIndex)
+        return;
+    m_tagIndex = index;
+    m_ordinal = index->attach(this);
+    updateTagIndex(CategoryInformation());
+}
+
+void ImageInfo::detachFromTagIndex()
+{
+    if (!m_tagIndex)
+        return;
+    for (auto it = m_categoryInfomation.cbegin(); it != m_categoryInfomation.cend(); ++it) {
+        for (const auto tag : it.value())
+            m_tagIndex->remove(it.key(), tag, m_ordinal);
+    }
+    m_tagIndex->detach(m_ordinal);
+    m_tagIndex = nullptr;
+    m_ordinal = 0;
+}
+
+void ImageInfo::updateTagIndex(TagId category, const TagIdList &oldTags, const TagIdList &newTags)
+{
+    Q_ASSERT(m_tagIndex);
+    // both lists are sorted, so a single merge pass finds the differences:
+    auto oldIt = oldTags.cbegin();
+    auto newIt = newTags.cbegin();
+    while (oldIt != oldTags.cend() || newIt != newTags.cend()) {
+        if (newIt == newTags.cend() || (oldIt != oldTags.cend() && *oldIt < *newIt)) {
+            m_tagIndex->remove(category, *oldIt, m_ordinal);
+            ++oldIt;
+        } else if (oldIt == oldTags.cend() || *newIt < *oldIt) {
+            m_tagIndex->add(category, *newIt, m_ordinal);
+            ++newIt;
+        } else {
+            ++oldIt;
+            ++newIt;
+        }
+    }
+}
+
+void ImageInfo::updateTagIndex(const CategoryInformation &oldCategoryInformation)
+{
+    if (!m_tagIndex)
+        return;
+    for (auto it = oldCategoryInformation.cbegin(); it != oldCategoryInformation.cend(); ++it)
+        updateTagIndex(it.key(), it.value(), m_categoryInfomation.value(it.key()));
+    for (auto it = m_categoryInfomation.cbegin(); it != m_categoryInfomation.cend(); ++it) {
+        if (!oldCategoryInformation.contains(it.key()))
+            updateTagIndex(it.key(), TagIdList(), it.value());
+    }
 }
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
@@ -21,6 +21,7 @@
 #include "ExifMode.h"
 #include "ImageDate.h"
 #include "MD5.h"
+#include "TagDictionary.h"
 
 #ifdef HAVE_MARBLE
 #include <Map/GeoCoordinates.h>
@@ -52,8 +53,11 @@ enum RotationMode {
 };
 
 using Utilities::StringSet;
+class FileWriter;
 class ImageDB;
+class Journal;
 class MemberMap;
+class TagIndex;
 
 /**
  * @brief The FileInformation enum controls the behaviour of the ImageInfo constructor.
@@ -74,7 +78,7 @@ typedef QHash<QString, QRect> PositionTags;
 typedef QHashIterator<QString, QRect> PositionTagsIterator;
 typedef QHash<QString, PositionTags> TaggedAreas;
 typedef QHashIterator<QString, PositionTags> TaggedAreasIterator;
-typedef QHash<QString, StringSet> CategoryInformation;
+typedef QHash<TagId, TagIdList> CategoryInformation;
 
 class ImageInfo : public QSharedData
 {
@@ -203,8 +207,25 @@ public:
     bool hasCategoryInfo(const QString &key, const QString &value) const;
     bool hasCategoryInfo(const QString &key, const StringSet &values) const;
 
+    /**
+     * @brief hasCategoryInfo is a faster variant of hasCategoryInfo(const QString &, const QString &) for interned names.
+     * @see DB::TagDictionary
+     */
+    bool hasCategoryInfo(TagId category, TagId tag) const;
+    /**
+     * @brief hasCategoryInfo
+     * @param category
+     * @param tags a sorted list of tag ids
+     * @return \c true, if the image has at least one of the given tags.
+     */
+    bool hasCategoryInfo(TagId category, const TagIdList &tags) const;
+
     QStringList availableCategories() const;
     StringSet itemsOfCategory(const QString &category) const;
+    /**
+     * @return the sorted tag ids of all tags in the category
+     */
+    TagIdList tagIds(TagId category) const;
     void renameItem(const QString &key, const QString &oldValue, const QString &newValue);
     void renameCategory(const QString &oldName, const QString &newName);
 
@@ -246,7 +267,7 @@ public:
     void setMediaType(MediaType type)
     {
         if (type != m_type)
-            m_dirty = true;
+            markDirty();
         m_type = type;
     }
     bool isVideo() const;
@@ -269,10 +290,11 @@ public:
      * @return the associated area, or <code>QRect()</code> if no association exists.
      */
     QRect areaForTag(QString category, QString tag) const;
-    void setIsMatched(bool isMatched);
-    bool isMatched() const;
-    void setMatchGeneration(int matchGeneration);
-    int matchGeneration() const;
+    /**
+     * @brief ordinal
+     * @return the ordinal of the image within the DB::TagIndex, or 0 if the image is not part of the database.
+     */
+    quint32 ordinal() const { return m_ordinal; }
 #ifdef HAVE_MARBLE
     Map::GeoCoordinates coordinates() const;
 #endif
@@ -287,6 +309,13 @@ protected:
         return m_dirty;
     }
     void markDirty();
+    /**
+     * @return a number that changes whenever the content of the image information changes
+     */
+    quint64 revision() const
+    {
+        return m_revision;
+    }
     bool updateDateInformation(int mode) const;
 
     /**
@@ -297,14 +326,31 @@ protected:
      */
     void setStackId(const StackID stackId);
 
+    /**
+     * @brief attachToTagIndex adds the image and all of its tags to the index.
+     * From then on, all changes to the category information are reflected in the index.
+     * Copies of an attached ImageInfo are not attached.
+     */
+    void attachToTagIndex(TagIndex *index);
+    /**
+     * @brief detachFromTagIndex removes the image and all of its tags from the index.
+     */
+    void detachFromTagIndex();
+
     friend class XMLDB::Database;
+    friend class DB::FileWriter;
     friend class DB::ImageDB;
+    friend class DB::Journal;
 
 private:
+    void updateTagIndex(TagId category, const TagIdList &oldTags, const TagIdList &newTags);
+    void updateTagIndex(const CategoryInformation &oldCategoryInformation);
+
     DB::FileName m_fileName;
     QString m_label;
     QString m_description;
     ImageDate m_date;
+    // Tags are stored as sorted lists of interned ids, keyed by the interned category name
     CategoryInformation m_categoryInfomation;
     TaggedAreas m_taggedAreas;
     int m_angle;
@@ -331,8 +377,6 @@ private:
      */
     unsigned int m_stackOrder;
     int m_videoLength;
-    bool m_isMatched = false;
-    int m_matchGeneration;
 #ifdef HAVE_MARBLE
     mutable Map::GeoCoordinates m_coordinates;
     mutable bool m_coordsIsSet = false;
@@ -341,8 +385,14 @@ private:
     // Cache information
     bool m_locked = false;
 
+    // Not copied by the assignment operator; see attachToTagIndex()
+    TagIndex *m_tagIndex = nullptr;
+    quint32 m_ordinal = 0;
+
     // Will be set to true after every change
     bool m_dirty = false;
+    // Incremented after every change; not copied by the assignment operator
+    quint64 m_revision = 0;
 };
 }
 
@@ -24,7 +24,7 @@ DB::MD5::MD5()
 {
 }
 
-DB::MD5::MD5(const QString &md5str)
+DB::MD5::MD5(QStringView md5str)
     : m_isNull(md5str.isEmpty())
     , m_v0(md5str.left(16).toULongLong(nullptr, 16))
     , m_v1(md5str.mid(16, 16).toULongLong(nullptr, 16))
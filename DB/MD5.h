@@ -19,6 +19,7 @@
 #define DB_MD5_H
 
 #include <QString>
+#include <QStringView>
 #include <qglobal.h>
 
 namespace DB
@@ -30,7 +31,7 @@ class MD5
 public:
     MD5();
 
-    explicit MD5(const QString &md5str);
+    explicit MD5(QStringView md5str);
 
     bool isNull() const;
 
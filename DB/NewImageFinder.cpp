@@ -382,6 +382,18 @@ bool canReadImage(const DB::FileName &fileName)
     return QImageReader::supportedMimeTypes().contains(mimeType.name().toUtf8())
         || ImageManager::ImageDecoder::mightDecode(fileName);
 }
+
+/**
+ * @brief With content-addressed thumbnails, an image that is identical to another image
+ * or that was moved may already have a thumbnail.
+ * @return \c true if a thumbnail needs to be built for the image.
+ */
+bool needsThumbnail(const DB::ImageInfoPtr &info)
+{
+    return !Settings::SettingsData::instance()->contentAddressedThumbnails()
+        || info->isVideo()
+        || !MainWindow::Window::theMainWindow()->thumbnailCache()->contains(info->fileName());
+}
 }
 
 QMutex NewImageFinder::s_imageFinderLock;
@@ -649,7 +661,9 @@ void NewImageFinder::loadExtraFile(const DB::FileName &newFileName, DB::MediaTyp
     }
 
     markUnTagged(info);
-    ImageManager::ThumbnailBuilder::instance()->buildOneThumbnail(info);
+    ImageManager::ThumbnailBuilder::instance()->updateContentKey(info);
+    if (needsThumbnail(info))
+        ImageManager::ThumbnailBuilder::instance()->buildOneThumbnail(info);
     if (info->isVideo() && MainWindow::FeatureDialog::hasVideoThumbnailer()) {
         // needs to be done *after* insertion into database
         BackgroundTaskManager::JobManager::instance()->addJob(
@@ -684,7 +698,9 @@ bool NewImageFinder::handleIfImageHasBeenMoved(const FileName &newFileName, cons
 
                 DB::ImageDB::instance()->exifDB()->remove(matchedFileName);
                 DB::ImageDB::instance()->exifDB()->add(newFileName);
-                ImageManager::ThumbnailBuilder::instance()->buildOneThumbnail(info);
+                ImageManager::ThumbnailBuilder::instance()->updateContentKey(info);
+                if (needsThumbnail(info))
+                    ImageManager::ThumbnailBuilder::instance()->buildOneThumbnail(info);
                 return true;
             }
         }
@@ -735,6 +751,7 @@ bool NewImageFinder::calculateMD5sums(
             dirty = true;
             MainWindow::Window::theMainWindow()->thumbnailCache()->removeThumbnail(fileName);
             MainWindow::Window::theMainWindow()->videoThumbnailCache()->removeThumbnail(fileName);
+            ImageManager::ThumbnailBuilder::instance()->updateContentKey(info);
         }
 
         md5Map->insert(md5, fileName);
@@ -0,0 +1,457 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "RoaringBitmap.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+using namespace DB;
+
+namespace
+{
+// Above this cardinality, a bitset (8KiB) is smaller than an array:
+constexpr int ArrayMaxSize = 4096;
+constexpr int BitsetWords = (1 << 16) / 64;
+
+inline quint16 highBits(RoaringBitmap::Value value)
+{
+    return static_cast<quint16>(value >> 16);
+}
+
+inline quint16 lowBits(RoaringBitmap::Value value)
+{
+    return static_cast<quint16>(value & 0xFFFF);
+}
+
+inline bool testBit(const QList<quint64> &bitset, quint16 low)
+{
+    return bitset.at(low >> 6) & (quint64(1) << (low & 63));
+}
+
+int bitsetCardinality(const QList<quint64> &bitset)
+{
+    int result = 0;
+    for (const quint64 word : bitset)
+        result += std::popcount(word);
+    return result;
+}
+}
+
+bool RoaringBitmap::Container::contains(quint16 low) const
+{
+    if (isBitset())
+        return testBit(bitset, low);
+    return std::binary_search(array.cbegin(), array.cend(), low);
+}
+
+bool RoaringBitmap::Container::add(quint16 low)
+{
+    if (isBitset()) {
+        quint64 &word = bitset[low >> 6];
+        const quint64 mask = quint64(1) << (low & 63);
+        if (word & mask)
+            return false;
+        word |= mask;
+        ++cardinality;
+        return true;
+    }
+    // appending is the common case when building a bitmap in ascending order:
+    if (array.isEmpty() || array.constLast() < low) {
+        array.append(low);
+    } else {
+        const auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low)
+            return false;
+        array.insert(it, low);
+    }
+    ++cardinality;
+    if (cardinality > ArrayMaxSize)
+        toBitset();
+    return true;
+}
+
+bool RoaringBitmap::Container::remove(quint16 low)
+{
+    if (isBitset()) {
+        quint64 &word = bitset[low >> 6];
+        const quint64 mask = quint64(1) << (low & 63);
+        if (!(word & mask))
+            return false;
+        word &= ~mask;
+        --cardinality;
+        if (cardinality <= ArrayMaxSize)
+            toArray();
+        return true;
+    }
+    const auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low)
+        return false;
+    array.erase(it);
+    --cardinality;
+    return true;
+}
+
+void RoaringBitmap::Container::toBitset()
+{
+    if (isBitset())
+        return;
+    bitset.fill(0, BitsetWords);
+    for (const quint16 low : std::as_const(array))
+        bitset[low >> 6] |= quint64(1) << (low & 63);
+    array.clear();
+}
+
+void RoaringBitmap::Container::toArray()
+{
+    if (!isBitset())
+        return;
+    array.clear();
+    array.reserve(cardinality);
+    for (int wordIndex = 0; wordIndex < BitsetWords; ++wordIndex) {
+        quint64 word = bitset.at(wordIndex);
+        while (word) {
+            const int bit = std::countr_zero(word);
+            array.append(static_cast<quint16>(wordIndex * 64 + bit));
+            word &= word - 1;
+        }
+    }
+    bitset.clear();
+}
+
+void RoaringBitmap::Container::normalize()
+{
+    if (isBitset() && cardinality <= ArrayMaxSize)
+        toArray();
+    else if (!isBitset() && cardinality > ArrayMaxSize)
+        toBitset();
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container &a, const Container &b)
+{
+    Container result;
+    result.key = a.key;
+    if (a.isBitset() && b.isBitset()) {
+        result.bitset.resize(BitsetWords);
+        for (int i = 0; i < BitsetWords; ++i)
+            result.bitset[i] = a.bitset.at(i) & b.bitset.at(i);
+        result.cardinality = bitsetCardinality(result.bitset);
+        result.normalize();
+    } else if (a.isBitset() || b.isBitset()) {
+        const Container &arrayContainer = a.isBitset() ? b : a;
+        const Container &bitsetContainer = a.isBitset() ? a : b;
+        result.array.reserve(arrayContainer.cardinality);
+        for (const quint16 low : arrayContainer.array) {
+            if (testBit(bitsetContainer.bitset, low))
+                result.array.append(low);
+        }
+        result.cardinality = result.array.size();
+    } else {
+        result.array.reserve(std::min(a.cardinality, b.cardinality));
+        std::set_intersection(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(), std::back_inserter(result.array));
+        result.cardinality = result.array.size();
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container &a, const Container &b)
+{
+    Container result;
+    result.key = a.key;
+    if (a.isBitset() && b.isBitset()) {
+        result.bitset.resize(BitsetWords);
+        for (int i = 0; i < BitsetWords; ++i)
+            result.bitset[i] = a.bitset.at(i) | b.bitset.at(i);
+        result.cardinality = bitsetCardinality(result.bitset);
+    } else if (a.isBitset() || b.isBitset()) {
+        const Container &arrayContainer = a.isBitset() ? b : a;
+        result = a.isBitset() ? a : b;
+        for (const quint16 low : arrayContainer.array)
+            result.add(low);
+    } else {
+        result.array.reserve(a.cardinality + b.cardinality);
+        std::set_union(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(), std::back_inserter(result.array));
+        result.cardinality = result.array.size();
+        result.normalize();
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::subtract(const Container &a, const Container &b)
+{
+    Container result;
+    result.key = a.key;
+    if (a.isBitset() && b.isBitset()) {
+        result.bitset.resize(BitsetWords);
+        for (int i = 0; i < BitsetWords; ++i)
+            result.bitset[i] = a.bitset.at(i) & ~b.bitset.at(i);
+        result.cardinality = bitsetCardinality(result.bitset);
+        result.normalize();
+    } else if (a.isBitset()) {
+        result = a;
+        for (const quint16 low : b.array) {
+            quint64 &word = result.bitset[low >> 6];
+            const quint64 mask = quint64(1) << (low & 63);
+            if (word & mask) {
+                word &= ~mask;
+                --result.cardinality;
+            }
+        }
+        result.normalize();
+    } else if (b.isBitset()) {
+        result.array.reserve(a.cardinality);
+        for (const quint16 low : a.array) {
+            if (!testBit(b.bitset, low))
+                result.array.append(low);
+        }
+        result.cardinality = result.array.size();
+    } else {
+        result.array.reserve(a.cardinality);
+        std::set_difference(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(), std::back_inserter(result.array));
+        result.cardinality = result.array.size();
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::fromRange(Value first, Value last)
+{
+    RoaringBitmap result;
+    Value value = first;
+    while (value < last) {
+        // fill one container at a time:
+        const quint16 key = highBits(value);
+        const Value containerEnd = std::min<quint64>(last, (quint64(key) + 1) << 16);
+        Container container;
+        container.key = key;
+        container.cardinality = static_cast<int>(containerEnd - value);
+        if (container.cardinality > ArrayMaxSize) {
+            container.bitset.fill(0, BitsetWords);
+            for (Value v = value; v < containerEnd; ++v)
+                container.bitset[lowBits(v) >> 6] |= quint64(1) << (lowBits(v) & 63);
+        } else {
+            container.array.reserve(container.cardinality);
+            for (Value v = value; v < containerEnd; ++v)
+                container.array.append(lowBits(v));
+        }
+        result.m_containers.append(container);
+        value = containerEnd;
+    }
+    return result;
+}
+
+qsizetype RoaringBitmap::findContainer(quint16 key) const
+{
+    const auto it = std::lower_bound(m_containers.cbegin(), m_containers.cend(), key,
+                                     [](const Container &container, quint16 key) { return container.key < key; });
+    return std::distance(m_containers.cbegin(), it);
+}
+
+bool RoaringBitmap::add(Value value)
+{
+    const quint16 key = highBits(value);
+    qsizetype index;
+    if (m_containers.isEmpty() || m_containers.constLast().key < key)
+        index = m_containers.size();
+    else
+        index = findContainer(key);
+    if (index == m_containers.size() || m_containers.at(index).key != key) {
+        Container container;
+        container.key = key;
+        m_containers.insert(index, container);
+    }
+    return m_containers[index].add(lowBits(value));
+}
+
+bool RoaringBitmap::remove(Value value)
+{
+    const quint16 key = highBits(value);
+    const qsizetype index = findContainer(key);
+    if (index == m_containers.size() || m_containers.at(index).key != key)
+        return false;
+    Container &container = m_containers[index];
+    if (!container.remove(lowBits(value)))
+        return false;
+    if (container.cardinality == 0)
+        m_containers.removeAt(index);
+    return true;
+}
+
+bool RoaringBitmap::contains(Value value) const
+{
+    const quint16 key = highBits(value);
+    const qsizetype index = findContainer(key);
+    return index != m_containers.size() && m_containers.at(index).key == key && m_containers.at(index).contains(lowBits(value));
+}
+
+bool RoaringBitmap::isEmpty() const
+{
+    return m_containers.isEmpty();
+}
+
+qsizetype RoaringBitmap::cardinality() const
+{
+    qsizetype result = 0;
+    for (const Container &container : m_containers)
+        result += container.cardinality;
+    return result;
+}
+
+void RoaringBitmap::clear()
+{
+    m_containers.clear();
+}
+
+RoaringBitmap &RoaringBitmap::operator&=(const RoaringBitmap &other)
+{
+    *this = *this & other;
+    return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator|=(const RoaringBitmap &other)
+{
+    *this = *this | other;
+    return *this;
+}
+
+RoaringBitmap &RoaringBitmap::operator-=(const RoaringBitmap &other)
+{
+    *this = *this - other;
+    return *this;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap &other) const
+{
+    RoaringBitmap result;
+    auto itA = m_containers.cbegin();
+    auto itB = other.m_containers.cbegin();
+    while (itA != m_containers.cend() && itB != other.m_containers.cend()) {
+        if (itA->key < itB->key) {
+            ++itA;
+        } else if (itB->key < itA->key) {
+            ++itB;
+        } else {
+            Container container = intersect(*itA, *itB);
+            if (container.cardinality > 0)
+                result.m_containers.append(container);
+            ++itA;
+            ++itB;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap &other) const
+{
+    if (isEmpty())
+        return other;
+    if (other.isEmpty())
+        return *this;
+    RoaringBitmap result;
+    result.m_containers.reserve(std::max(m_containers.size(), other.m_containers.size()));
+    auto itA = m_containers.cbegin();
+    auto itB = other.m_containers.cbegin();
+    while (itA != m_containers.cend() || itB != other.m_containers.cend()) {
+        if (itB == other.m_containers.cend() || (itA != m_containers.cend() && itA->key < itB->key)) {
+            result.m_containers.append(*itA);
+            ++itA;
+        } else if (itA == m_containers.cend() || itB->key < itA->key) {
+            result.m_containers.append(*itB);
+            ++itB;
+        } else {
+            result.m_containers.append(unite(*itA, *itB));
+            ++itA;
+            ++itB;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator-(const RoaringBitmap &other) const
+{
+    if (isEmpty() || other.isEmpty())
+        return *this;
+    RoaringBitmap result;
+    auto itB = other.m_containers.cbegin();
+    for (const Container &container : m_containers) {
+        while (itB != other.m_containers.cend() && itB->key < container.key)
+            ++itB;
+        if (itB == other.m_containers.cend() || itB->key != container.key) {
+            result.m_containers.append(container);
+            continue;
+        }
+        Container difference = subtract(container, *itB);
+        if (difference.cardinality > 0)
+            result.m_containers.append(difference);
+    }
+    return result;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap &other) const
+{
+    // containers are always normalized, so equal sets have equal representations:
+    if (m_containers.size() != other.m_containers.size())
+        return false;
+    for (qsizetype i = 0; i < m_containers.size(); ++i) {
+        const Container &a = m_containers.at(i);
+        const Container &b = other.m_containers.at(i);
+        if (a.key != b.key || a.cardinality != b.cardinality || a.array != b.array || a.bitset != b.bitset)
+            return false;
+    }
+    return true;
+}
+
+QList<RoaringBitmap::Value> RoaringBitmap::toList() const
+{
+    QList<Value> result;
+    result.reserve(cardinality());
+    for (const Value value : *this)
+        result.append(value);
+    return result;
+}
+
+RoaringBitmap::const_iterator::const_iterator(const RoaringBitmap *bitmap, qsizetype container)
+    : m_bitmap(bitmap)
+    , m_container(container)
+{
+    seek();
+}
+
+void RoaringBitmap::const_iterator::seek()
+{
+    // find the next value at or after the current position:
+    while (m_container < m_bitmap->m_containers.size()) {
+        const Container &container = m_bitmap->m_containers.at(m_container);
+        const Value high = Value(container.key) << 16;
+        if (container.isBitset()) {
+            int wordIndex = m_position >> 6;
+            if (wordIndex < BitsetWords) {
+                quint64 word = container.bitset.at(wordIndex) & (~quint64(0) << (m_position & 63));
+                while (!word && ++wordIndex < BitsetWords)
+                    word = container.bitset.at(wordIndex);
+                if (word) {
+                    m_position = wordIndex * 64 + std::countr_zero(word);
+                    m_value = high | Value(m_position);
+                    return;
+                }
+            }
+        } else if (m_position < container.array.size()) {
+            m_value = high | container.array.at(m_position);
+            return;
+        }
+        ++m_container;
+        m_position = 0;
+    }
+    m_position = 0;
+    m_value = 0;
+}
+
+RoaringBitmap::const_iterator &RoaringBitmap::const_iterator::operator++()
+{
+    ++m_position;
+    seek();
+    return *this;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,140 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef DB_ROARINGBITMAP_H
+#define DB_ROARINGBITMAP_H
+
+#include <QList>
+#include <QtGlobal>
+
+#include <iterator>
+
+namespace DB
+{
+
+/**
+ * @brief The RoaringBitmap class is a compressed set of 32 bit integers.
+ *
+ * The value range is split into chunks of 2^16 values, keyed by the upper 16 bits of the values.
+ * Each non-empty chunk is stored in a container that is either a sorted array of the lower 16 bits
+ * (for sparse chunks) or a bitset of 2^16 bits (for dense chunks).
+ * This is the layout described in "Better bitmap performance with Roaring bitmaps" (Chambi et al.),
+ * without run containers.
+ *
+ * Set operations work container by container, so intersecting a small set with a large one is cheap.
+ * RoaringBitmap is used to represent sets of image ordinals (see DB::TagIndex).
+ */
+class RoaringBitmap
+{
+public:
+    using Value = quint32;
+
+    RoaringBitmap() = default;
+    /**
+     * @brief fromRange creates a bitmap containing all values in the half-open interval [first, last).
+     */
+    static RoaringBitmap fromRange(Value first, Value last);
+
+    /**
+     * @brief add a value to the set.
+     * @return \c true, if the value was not yet contained
+     */
+    bool add(Value value);
+    /**
+     * @brief remove a value from the set.
+     * @return \c true, if the value was contained
+     */
+    bool remove(Value value);
+    bool contains(Value value) const;
+    bool isEmpty() const;
+    /**
+     * @return the number of values in the set
+     */
+    qsizetype cardinality() const;
+    void clear();
+
+    RoaringBitmap &operator&=(const RoaringBitmap &other);
+    RoaringBitmap &operator|=(const RoaringBitmap &other);
+    /// Remove all values contained in \p other.
+    RoaringBitmap &operator-=(const RoaringBitmap &other);
+    RoaringBitmap operator&(const RoaringBitmap &other) const;
+    RoaringBitmap operator|(const RoaringBitmap &other) const;
+    RoaringBitmap operator-(const RoaringBitmap &other) const;
+    bool operator==(const RoaringBitmap &other) const;
+    bool operator!=(const RoaringBitmap &other) const { return !(*this == other); }
+
+    /**
+     * @return all values in ascending order
+     */
+    QList<Value> toList() const;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = qptrdiff;
+        using pointer = const Value *;
+        using reference = Value;
+
+        const_iterator() = default;
+        Value operator*() const { return m_value; }
+        const_iterator &operator++();
+        const_iterator operator++(int)
+        {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        bool operator==(const const_iterator &other) const { return m_container == other.m_container && m_position == other.m_position; }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+    private:
+        friend class RoaringBitmap;
+        const_iterator(const RoaringBitmap *bitmap, qsizetype container);
+        void seek();
+
+        const RoaringBitmap *m_bitmap = nullptr;
+        qsizetype m_container = 0;
+        /// index into the array, or bit number in the bitset
+        int m_position = 0;
+        Value m_value = 0;
+    };
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_containers.size()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+private:
+    struct Container {
+        quint16 key = 0;
+        int cardinality = 0;
+        /// Sorted lower 16 bits of the values; used if the container is sparse.
+        QList<quint16> array;
+        /// One bit for each of the 2^16 values; used if the container is dense.
+        QList<quint64> bitset;
+
+        bool isBitset() const { return !bitset.isEmpty(); }
+        bool contains(quint16 low) const;
+        bool add(quint16 low);
+        bool remove(quint16 low);
+        void toBitset();
+        void toArray();
+        void normalize();
+    };
+    static Container intersect(const Container &a, const Container &b);
+    static Container unite(const Container &a, const Container &b);
+    static Container subtract(const Container &a, const Container &b);
+
+    qsizetype findContainer(quint16 key) const;
+
+    /// Non-empty containers, sorted by key.
+    QList<Container> m_containers;
+};
+
+}
+
+#endif /* DB_ROARINGBITMAP_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,141 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "TagDictionary.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+using namespace DB;
+
+TagDictionary &TagDictionary::instance()
+{
+    static TagDictionary s_instance;
+    return s_instance;
+}
+
+TagDictionary::TagDictionary()
+    : m_names { QString() }
+{
+}
+
+TagId TagDictionary::intern(const QString &name)
+{
+    {
+        QReadLocker locker(&m_lock);
+        const auto it = m_ids.constFind(name);
+        if (it != m_ids.constEnd())
+            return it.value();
+    }
+    QWriteLocker locker(&m_lock);
+    return internLocked(name);
+}
+
+TagIdList TagDictionary::intern(const StringSet &names)
+{
+    TagIdList result;
+    result.reserve(names.size());
+    // Most tags are already known, so only take the write lock for the missing ones:
+    QList<QString> missing;
+    {
+        QReadLocker locker(&m_lock);
+        for (const auto &name : names) {
+            const auto it = m_ids.constFind(name);
+            if (it != m_ids.constEnd())
+                result.append(it.value());
+            else
+                missing.append(name);
+        }
+    }
+    if (!missing.isEmpty()) {
+        QWriteLocker locker(&m_lock);
+        for (const auto &name : std::as_const(missing))
+            result.append(internLocked(name));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+TagId TagDictionary::internLocked(const QString &name)
+{
+    const auto it = m_ids.constFind(name);
+    if (it != m_ids.constEnd())
+        return it.value();
+    const auto id = static_cast<TagId>(m_names.size());
+    m_names.append(name);
+    m_ids.insert(name, id);
+    return id;
+}
+
+TagId TagDictionary::lookup(const QString &name) const
+{
+    QReadLocker locker(&m_lock);
+    return m_ids.value(name, 0);
+}
+
+QString TagDictionary::name(TagId id) const
+{
+    QReadLocker locker(&m_lock);
+    if (id == 0 || id >= TagId(m_names.size()))
+        return QString();
+    return m_names.at(id);
+}
+
+StringSet TagDictionary::names(const TagIdList &ids) const
+{
+    StringSet result;
+    result.reserve(ids.size());
+    QReadLocker locker(&m_lock);
+    for (const auto id : ids) {
+        if (id != 0 && id < TagId(m_names.size()))
+            result.insert(m_names.at(id));
+    }
+    return result;
+}
+
+bool TagDictionary::insertSorted(TagIdList &list, TagId id)
+{
+    if (list.isEmpty() || list.constLast() < id) {
+        list.append(id);
+        return true;
+    }
+    const auto it = std::lower_bound(list.begin(), list.end(), id);
+    if (it != list.end() && *it == id)
+        return false;
+    list.insert(it, id);
+    return true;
+}
+
+bool TagDictionary::removeSorted(TagIdList &list, TagId id)
+{
+    const auto it = std::lower_bound(list.begin(), list.end(), id);
+    if (it == list.end() || *it != id)
+        return false;
+    list.erase(it);
+    return true;
+}
+
+bool TagDictionary::containsSorted(const TagIdList &list, TagId id)
+{
+    return std::binary_search(list.cbegin(), list.cend(), id);
+}
+
+bool TagDictionary::intersectsSorted(const TagIdList &a, const TagIdList &b)
+{
+    auto itA = a.cbegin();
+    auto itB = b.cbegin();
+    while (itA != a.cend() && itB != b.cend()) {
+        if (*itA < *itB)
+            ++itA;
+        else if (*itB < *itA)
+            ++itB;
+        else
+            return true;
+    }
+    return false;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
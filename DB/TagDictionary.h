@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef DB_TAGDICTIONARY_H
+#define DB_TAGDICTIONARY_H
+
+#include <kpabase/StringSet.h>
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <QString>
+
+namespace DB
+{
+using Utilities::StringSet;
+
+/**
+ * @brief A TagId is the interned representation of a category or tag name.
+ * The id 0 is never assigned and denotes an unknown name.
+ */
+using TagId = quint32;
+/**
+ * @brief A sorted list of tag ids without duplicates.
+ */
+using TagIdList = QList<TagId>;
+
+/**
+ * @brief The TagDictionary class interns category and tag names.
+ *
+ * Every distinct name gets a unique, non-zero TagId for the lifetime of the process.
+ * Ids are never reused or removed, so renaming a tag leaves the old name in the dictionary.
+ * This is cheap enough, since the number of distinct names is small compared to the number of images.
+ *
+ * Unlike the ids managed by DB::Category (which are per category and only assigned when saving the database),
+ * TagIds are global and available as soon as a name is interned.
+ *
+ * The dictionary is thread-safe.
+ */
+class TagDictionary
+{
+public:
+    static TagDictionary &instance();
+
+    /**
+     * @brief intern returns the id of a name, assigning a new id if the name is unknown.
+     */
+    TagId intern(const QString &name);
+    /**
+     * @brief intern interns all names.
+     * @return a sorted list of the ids
+     */
+    TagIdList intern(const StringSet &names);
+    /**
+     * @brief lookup returns the id of a name without interning it.
+     * @return the id, or 0 if the name is unknown
+     */
+    TagId lookup(const QString &name) const;
+    /**
+     * @return the name for an id, or a null QString if the id is unknown
+     */
+    QString name(TagId id) const;
+    StringSet names(const TagIdList &ids) const;
+
+    /**
+     * @brief insertSorted inserts an id into a sorted TagIdList, unless it is already present.
+     * @return \c true, if the id was inserted
+     */
+    static bool insertSorted(TagIdList &list, TagId id);
+    /**
+     * @brief removeSorted removes an id from a sorted TagIdList.
+     * @return \c true, if the id was removed
+     */
+    static bool removeSorted(TagIdList &list, TagId id);
+    static bool containsSorted(const TagIdList &list, TagId id);
+    /**
+     * @return \c true, if the sorted lists have at least one id in common
+     */
+    static bool intersectsSorted(const TagIdList &a, const TagIdList &b);
+
+private:
+    TagDictionary();
+    TagId internLocked(const QString &name);
+
+    mutable QReadWriteLock m_lock;
+    QHash<QString, TagId> m_ids;
+    /// Names by id; the entry at index 0 is unused.
+    QList<QString> m_names;
+};
+
+}
+
+#endif /* DB_TAGDICTIONARY_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,182 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "TagIndex.h"
+
+#include <algorithm>
+
+using namespace DB;
+
+TagIndex::Ordinal TagIndex::attach(ImageInfo *info)
+{
+    Q_ASSERT(info);
+    const auto ordinal = static_cast<Ordinal>(m_images.size());
+    m_images.append(info);
+    m_attached.add(ordinal);
+    return ordinal;
+}
+
+void TagIndex::detach(Ordinal ordinal)
+{
+    if (ordinal == 0 || ordinal >= Ordinal(m_images.size()) || !m_images[ordinal])
+        return;
+    m_images[ordinal] = nullptr;
+    m_attached.remove(ordinal);
+}
+
+ImageInfo *TagIndex::image(Ordinal ordinal) const
+{
+    if (ordinal >= Ordinal(m_images.size()))
+        return nullptr;
+    return m_images[ordinal];
+}
+
+int TagIndex::imageCount() const
+{
+    return static_cast<int>(m_attached.cardinality());
+}
+
+const TagIndex::PostingList &TagIndex::allImages() const
+{
+    return m_attached;
+}
+
+void TagIndex::add(TagId category, TagId tag, Ordinal ordinal)
+{
+    m_postings[category][tag].add(ordinal);
+}
+
+void TagIndex::remove(TagId category, TagId tag, Ordinal ordinal)
+{
+    auto categoryIt = m_postings.find(category);
+    if (categoryIt == m_postings.end())
+        return;
+    auto tagIt = categoryIt->find(tag);
+    if (tagIt == categoryIt->end())
+        return;
+
+    tagIt->remove(ordinal);
+    if (tagIt->isEmpty())
+        categoryIt->erase(tagIt);
+}
+
+void TagIndex::renameTag(const QString &category, const QString &oldTag, const QString &newTag)
+{
+    if (oldTag == newTag)
+        return;
+    auto &dictionary = TagDictionary::instance();
+    auto categoryIt = m_postings.find(dictionary.lookup(category));
+    if (categoryIt == m_postings.end())
+        return;
+    const PostingList moved = categoryIt->take(dictionary.lookup(oldTag));
+    if (moved.isEmpty())
+        return;
+    (*categoryIt)[dictionary.intern(newTag)] |= moved;
+}
+
+void TagIndex::removeTag(const QString &category, const QString &tag)
+{
+    auto &dictionary = TagDictionary::instance();
+    auto categoryIt = m_postings.find(dictionary.lookup(category));
+    if (categoryIt != m_postings.end())
+        categoryIt->remove(dictionary.lookup(tag));
+}
+
+void TagIndex::renameCategory(const QString &oldName, const QString &newName)
+{
+    auto &dictionary = TagDictionary::instance();
+    const TagId oldId = dictionary.lookup(oldName);
+    if (oldName == newName || !m_postings.contains(oldId))
+        return;
+    const auto moved = m_postings.take(oldId);
+    auto &target = m_postings[dictionary.intern(newName)];
+    for (auto it = moved.cbegin(); it != moved.cend(); ++it)
+        target[it.key()] |= it.value();
+}
+
+void TagIndex::clear()
+{
+    m_postings.clear();
+    m_images = { nullptr };
+    m_attached.clear();
+}
+
+TagIndex::PostingList TagIndex::postings(TagId category, TagId tag) const
+{
+    const auto categoryIt = m_postings.constFind(category);
+    if (categoryIt == m_postings.constEnd())
+        return {};
+    return categoryIt->value(tag);
+}
+
+TagIndex::PostingList TagIndex::postings(const QString &category, const QString &tag) const
+{
+    const auto &dictionary = TagDictionary::instance();
+    return postings(dictionary.lookup(category), dictionary.lookup(tag));
+}
+
+TagIndex::PostingList TagIndex::postings(TagId category, const TagIdList &tags) const
+{
+    PostingList result;
+    const auto categoryIt = m_postings.constFind(category);
+    if (categoryIt == m_postings.constEnd())
+        return result;
+    for (const auto tag : tags) {
+        const auto tagIt = categoryIt->constFind(tag);
+        if (tagIt != categoryIt->constEnd())
+            result |= tagIt.value();
+    }
+    return result;
+}
+
+TagIndex::PostingList TagIndex::postings(const QString &category, const StringSet &tags) const
+{
+    const auto &dictionary = TagDictionary::instance();
+    TagIdList ids;
+    ids.reserve(tags.size());
+    for (const auto &tag : tags) {
+        const TagId id = dictionary.lookup(tag);
+        if (id != 0)
+            ids.append(id);
+    }
+    return postings(dictionary.lookup(category), ids);
+}
+
+TagIndex::PostingList TagIndex::postingsForCategory(TagId category) const
+{
+    PostingList result;
+    const auto categoryIt = m_postings.constFind(category);
+    if (categoryIt == m_postings.constEnd())
+        return result;
+    for (const auto &list : *categoryIt)
+        result |= list;
+    return result;
+}
+
+TagIndex::PostingList TagIndex::postingsForCategory(const QString &category) const
+{
+    return postingsForCategory(TagDictionary::instance().lookup(category));
+}
+
+QStringList TagIndex::tags(const QString &category) const
+{
+    const auto &dictionary = TagDictionary::instance();
+    QStringList result;
+    const auto categoryIt = m_postings.constFind(dictionary.lookup(category));
+    if (categoryIt == m_postings.constEnd())
+        return result;
+    result.reserve(categoryIt->size());
+    for (auto it = categoryIt->cbegin(); it != categoryIt->cend(); ++it)
+        result.append(dictionary.name(it.key()));
+    return result;
+}
+
+TagIdList TagIndex::tagIds(TagId category) const
+{
+    TagIdList result = m_postings.value(category).keys();
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
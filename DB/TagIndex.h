@@ -0,0 +1,123 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef DB_TAGINDEX_H
+#define DB_TAGINDEX_H
+
+#include "RoaringBitmap.h"
+#include "TagDictionary.h"
+
+#include <kpabase/StringSet.h>
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace DB
+{
+class ImageInfo;
+
+using Utilities::StringSet;
+
+/**
+ * @brief The TagIndex class is an inverted index over the tags of all images in the database.
+ *
+ * Every image that is part of the database gets a stable, non-zero ordinal when it is attached to the index.
+ * For every (category, tag) pair, the index keeps a posting list of the ordinals of all images carrying that tag.
+ * Posting lists are stored as RoaringBitmap, so that queries can be answered using fast set operations.
+ * Categories and tags are keyed by their TagId (see DB::TagDictionary); the QString overloads are provided for convenience.
+ * This allows answering questions like "which images are tagged People/Jesper" without looking at every image.
+ *
+ * The index is kept up-to-date by ImageInfo itself: all methods changing the category information of an attached
+ * ImageInfo notify the index. Adding and removing postings is idempotent, which allows bulk operations
+ * (like renaming or deleting a tag) to update the index first and then fix up the affected images one by one.
+ *
+ * @note Ordinals are never reused. They are not related to the position of an image within the database.
+ */
+class TagIndex
+{
+public:
+    using Ordinal = quint32;
+    /// A set of image ordinals.
+    using PostingList = RoaringBitmap;
+
+    /**
+     * @brief attach assigns a new ordinal to the image and remembers it.
+     * The caller is responsible for adding the postings for the image's tags.
+     * @return the ordinal for the image
+     */
+    Ordinal attach(ImageInfo *info);
+    /**
+     * @brief detach forgets about the image with the given ordinal.
+     * The caller is responsible for removing the postings for the image's tags.
+     */
+    void detach(Ordinal ordinal);
+    /**
+     * @brief image
+     * @return the image for the ordinal, or \c nullptr if no image is attached with that ordinal.
+     */
+    ImageInfo *image(Ordinal ordinal) const;
+    /**
+     * @brief imageCount
+     * @return the number of currently attached images
+     */
+    int imageCount() const;
+    /**
+     * @brief allImages
+     * @return the ordinals of all attached images
+     */
+    const PostingList &allImages() const;
+
+    void add(TagId category, TagId tag, Ordinal ordinal);
+    void remove(TagId category, TagId tag, Ordinal ordinal);
+
+    /**
+     * @brief renameTag moves all postings of a tag to a new tag name.
+     * If the new tag already has postings, the posting lists are merged.
+     */
+    void renameTag(const QString &category, const QString &oldTag, const QString &newTag);
+    /**
+     * @brief removeTag drops all postings of a tag.
+     */
+    void removeTag(const QString &category, const QString &tag);
+    /**
+     * @brief renameCategory moves all postings of a category to a new category name.
+     */
+    void renameCategory(const QString &oldName, const QString &newName);
+    void clear();
+
+    /**
+     * @return the posting list for a single tag
+     */
+    PostingList postings(TagId category, TagId tag) const;
+    PostingList postings(const QString &category, const QString &tag) const;
+    /**
+     * @return the union of the posting lists of all given tags
+     */
+    PostingList postings(TagId category, const TagIdList &tags) const;
+    PostingList postings(const QString &category, const StringSet &tags) const;
+    /**
+     * @return the union of the posting lists of all tags within the category, i.e. all images with at least one tag in the category
+     */
+    PostingList postingsForCategory(TagId category) const;
+    PostingList postingsForCategory(const QString &category) const;
+    /**
+     * @return all tags with non-empty posting lists in the given category
+     */
+    QStringList tags(const QString &category) const;
+    TagIdList tagIds(TagId category) const;
+
+private:
+    QHash<TagId, QHash<TagId, PostingList>> m_postings;
+    /// Images by ordinal; the entry at index 0 is unused.
+    QList<ImageInfo *> m_images { nullptr };
+    PostingList m_attached;
+};
+
+}
+
+#endif /* DB_TAGINDEX_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,233 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "DatabaseSnapshot.h"
+
+#include <DB/Category.h>
+#include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
+#include <kpabase/FileExtensions.h>
+#include <kpabase/Logging.h>
+
+#include <KLocalizedString>
+#include <QByteArrayView>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <utility>
+
+using namespace DB;
+
+namespace
+{
+constexpr quint32 SNAPSHOT_MAGIC = 0x4b504153; // "KPAS"
+// Bump this whenever the snapshot format changes; snapshots with a different version are ignored.
+constexpr quint32 SNAPSHOT_VERSION = 1;
+constexpr QDataStream::Version STREAM_VERSION = QDataStream::Qt_6_0;
+const QByteArray EMPTY_IMAGES_ELEMENT = QByteArrayLiteral("<images/>");
+
+qint64 modificationTime(const QString &fileName)
+{
+    return QFileInfo(fileName).lastModified().toMSecsSinceEpoch();
+}
+
+bool isImagesElement(const QByteArray &xmlData, qint64 begin, qint64 end)
+{
+    if (begin < 0 || begin > end || end > xmlData.size())
+        return false;
+    const QByteArrayView element = QByteArrayView(xmlData).sliced(begin, end - begin).trimmed();
+    return element.startsWith("<images") && (element.endsWith("</images>") || element.endsWith("/>"));
+}
+
+void writeImage(QDataStream &stream, const ImageInfo &info, const QHash<QString, bool> &shouldSave)
+{
+    const ImageDate date = info.date();
+    stream << info.fileName().relative() << info.label() << info.description()
+           << date.start().date() << date.start().time()
+           << date.end().date() << date.end().time()
+           << qint32(info.angle()) << info.MD5Sum().toHexString() << info.size()
+           << qint16(info.rating()) << quint32(info.stackId()) << quint32(info.stackOrder())
+           << qint32(info.videoLength());
+
+    // Like in the XML file, special categories (folder, media type) are not stored:
+    QList<std::pair<QString, StringSet>> savedCategories;
+    const QStringList categoryNames = info.availableCategories();
+    for (const QString &categoryName : categoryNames) {
+        if (!shouldSave.value(categoryName, false))
+            continue;
+        const StringSet items = info.itemsOfCategory(categoryName);
+        if (!items.isEmpty())
+            savedCategories.append({ categoryName, items });
+    }
+
+    stream << quint32(savedCategories.size());
+    for (const auto &[categoryName, items] : std::as_const(savedCategories)) {
+        stream << categoryName << quint32(items.size());
+        for (const QString &item : items)
+            stream << item << info.areaForTag(categoryName, item);
+    }
+}
+
+ImageInfoPtr readImage(QDataStream &stream)
+{
+    QString relativeFileName;
+    QString label;
+    QString description;
+    QDate startDate;
+    QTime startTime;
+    QDate endDate;
+    QTime endTime;
+    qint32 angle = 0;
+    QString md5sum;
+    QSize size;
+    qint16 rating = -1;
+    quint32 stackId = 0;
+    quint32 stackOrder = 0;
+    qint32 videoLength = -1;
+    stream >> relativeFileName >> label >> description
+        >> startDate >> startTime
+        >> endDate >> endTime
+        >> angle >> md5sum >> size
+        >> rating >> stackId >> stackOrder
+        >> videoLength;
+
+    const auto fileName = DB::FileName::fromRelativePath(relativeFileName);
+    const ImageDate date(Utilities::FastDateTime(startDate, startTime), Utilities::FastDateTime(endDate, endTime));
+    const MediaType mediaType = KPABase::isVideo(fileName) ? DB::Video : DB::Image;
+    ImageInfoPtr info(new ImageInfo(fileName, label, description, date,
+                                    angle, MD5(md5sum), size, mediaType, rating, stackId, stackOrder));
+    if (mediaType == DB::Video)
+        info->setVideoLength(videoLength);
+
+    quint32 categoryCount = 0;
+    stream >> categoryCount;
+    for (quint32 category = 0; category < categoryCount && stream.status() == QDataStream::Ok; ++category) {
+        QString categoryName;
+        quint32 itemCount = 0;
+        stream >> categoryName >> itemCount;
+        for (quint32 item = 0; item < itemCount && stream.status() == QDataStream::Ok; ++item) {
+            QString value;
+            QRect area;
+            stream >> value >> area;
+            info->addCategoryInfo(categoryName, value, area);
+        }
+    }
+
+    static const QString mediaTypeCategory = i18n("Media Type");
+    static const QString imageTag = i18n("Image");
+    static const QString videoTag = i18n("Video");
+    info->addCategoryInfo(mediaTypeCategory, mediaType == DB::Image ? imageTag : videoTag);
+    return info;
+}
+}
+
+QString DatabaseSnapshot::fileNameFor(const QString &xmlFileName)
+{
+    return xmlFileName + QStringLiteral(".snapshot");
+}
+
+bool DatabaseSnapshot::write(const QString &xmlFileName, const ByteRange &imagesElement, const ImageInfoList &images, const QHash<QString, bool> &shouldSave)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile xmlFile(xmlFileName);
+    if (!xmlFile.open(QIODevice::ReadOnly)) {
+        qCWarning(DBLog) << "Not writing database snapshot: could not read" << xmlFileName << "-" << xmlFile.errorString();
+        return false;
+    }
+    QCryptographicHash xmlChecksum(QCryptographicHash::Md5);
+    xmlChecksum.addData(&xmlFile);
+
+    QSaveFile out(fileNameFor(xmlFileName));
+    if (!out.open(QIODevice::WriteOnly)) {
+        qCWarning(DBLog) << "Could not write database snapshot" << out.fileName() << "-" << out.errorString();
+        return false;
+    }
+    QDataStream stream(&out);
+    stream.setVersion(STREAM_VERSION);
+    stream << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << qint32(DB::ImageDB::fileVersion())
+           << xmlFile.size() << modificationTime(xmlFileName) << xmlChecksum.result()
+           << imagesElement.begin << imagesElement.end
+           << quint32(images.size());
+    for (const ImageInfoPtr &info : images)
+        writeImage(stream, *info, shouldSave);
+
+    if (stream.status() != QDataStream::Ok || !out.commit()) {
+        qCWarning(DBLog) << "Could not write database snapshot" << out.fileName() << "-" << out.errorString();
+        return false;
+    }
+    qCDebug(TimingLog) << "DB::DatabaseSnapshot::write(): Writing" << images.size() << "images took" << timer.elapsed() << "ms";
+    return true;
+}
+
+void DatabaseSnapshot::remove(const QString &xmlFileName)
+{
+    QFile::remove(fileNameFor(xmlFileName));
+}
+
+bool DatabaseSnapshot::load(const QString &xmlFileName, QByteArray &xmlData, ImageInfoList &images)
+{
+    QFile in(fileNameFor(xmlFileName));
+    if (!in.open(QIODevice::ReadOnly))
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    QDataStream stream(&in);
+    stream.setVersion(STREAM_VERSION);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+        qCInfo(DBLog) << "Ignoring database snapshot" << in.fileName() << "with unknown format version" << version;
+        return false;
+    }
+
+    qint32 fileVersion = 0;
+    qint64 xmlSize = 0;
+    qint64 xmlModified = 0;
+    QByteArray xmlChecksum;
+    ByteRange imagesElement;
+    quint32 imageCount = 0;
+    stream >> fileVersion >> xmlSize >> xmlModified >> xmlChecksum
+        >> imagesElement.begin >> imagesElement.end
+        >> imageCount;
+    if (stream.status() != QDataStream::Ok || fileVersion != DB::ImageDB::fileVersion() || xmlSize != xmlData.size()) {
+        qCInfo(DBLog) << "Ignoring outdated database snapshot" << in.fileName();
+        return false;
+    }
+    // Checking the modification time is cheap, but it changes when the file is copied.
+    // The checksum is only computed if the modification time doesn't match:
+    if (xmlModified != modificationTime(xmlFileName)
+        && xmlChecksum != QCryptographicHash::hash(xmlData, QCryptographicHash::Md5)) {
+        qCInfo(DBLog) << "Ignoring outdated database snapshot" << in.fileName();
+        return false;
+    }
+    if (!isImagesElement(xmlData, imagesElement.begin, imagesElement.end)) {
+        qCWarning(DBLog) << "Ignoring database snapshot" << in.fileName() << "- images element not found at the recorded position.";
+        return false;
+    }
+
+    ImageInfoList result;
+    for (quint32 i = 0; i < imageCount && stream.status() == QDataStream::Ok; ++i)
+        result.append(readImage(stream));
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(DBLog) << "Ignoring corrupt database snapshot" << in.fileName();
+        return false;
+    }
+
+    xmlData.replace(imagesElement.begin, imagesElement.end - imagesElement.begin, EMPTY_IMAGES_ELEMENT);
+    images = result;
+    qCDebug(TimingLog) << "DB::DatabaseSnapshot::load(): Reading" << images.size() << "images took" << timer.elapsed() << "ms";
+    return true;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef XMLDB_DATABASESNAPSHOT_H
+#define XMLDB_DATABASESNAPSHOT_H
+
+#include <DB/ImageInfoList.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+namespace DB
+{
+/**
+ * @brief The DatabaseSnapshot class reads and writes a binary copy of the images section of the XML database file.
+ *
+ * Parsing the images section is by far the most expensive part of loading a large XML database file.
+ * Whenever the database is saved, the images are also written to a snapshot file next to the XML file.
+ * When the database is loaded, the snapshot is used instead of the images section of the XML file,
+ * provided that the snapshot was written for exactly this XML file.
+ * This is the case if the size and modification time of the XML file are unchanged, or, failing that,
+ * if the checksum of the XML file matches.
+ *
+ * The XML file remains the single source of truth: the snapshot is only a cache
+ * and can be deleted at any time.
+ */
+class DatabaseSnapshot
+{
+public:
+    /**
+     * @brief The ByteRange struct describes the position of the images element within the XML file.
+     * The range is half-open, i.e. \c end is the position of the first byte after the element.
+     */
+    struct ByteRange {
+        qint64 begin = 0;
+        qint64 end = 0;
+    };
+
+    /**
+     * @return the file name of the snapshot belonging to the given XML database file
+     */
+    static QString fileNameFor(const QString &xmlFileName);
+
+    /**
+     * @brief write a snapshot for an XML database file that was just saved.
+     * @param xmlFileName the XML database file
+     * @param imagesElement the position of the images element within the XML file
+     * @param images the images, in the same order as they were written to the XML file
+     * @param shouldSave maps each category name to whether the category is saved
+     * @return \c true, if the snapshot was written successfully
+     */
+    static bool write(const QString &xmlFileName, const ByteRange &imagesElement, const DB::ImageInfoList &images, const QHash<QString, bool> &shouldSave);
+
+    /**
+     * @brief remove the snapshot belonging to the given XML database file, if there is one.
+     */
+    static void remove(const QString &xmlFileName);
+
+    /**
+     * @brief load the images from the snapshot belonging to an XML database file.
+     * If the snapshot can be used, the images element is removed from \p xmlData,
+     * so that only the remaining (small) sections need to be parsed as XML.
+     * Otherwise, \p xmlData is left untouched and the XML file needs to be read as usual.
+     *
+     * @param xmlFileName the XML database file
+     * @param xmlData the content of the XML database file
+     * @param images the images read from the snapshot
+     * @return \c true, if the snapshot was used
+     */
+    static bool load(const QString &xmlFileName, QByteArray &xmlData, DB::ImageInfoList &images);
+};
+
+}
+
+#endif /* XMLDB_DATABASESNAPSHOT_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -22,11 +22,14 @@
 
 #include "AttributeEscaping.h"
 #include "CompressFileInfo.h"
+#include "DatabaseSnapshot.h"
+#include "ParallelImageLoader.h"
 
 #include <DB/Category.h>
 #include <DB/ImageDB.h>
 #include <DB/MD5Map.h>
 #include <kpabase/Logging.h>
+#include <kpabase/SettingsData.h>
 #include <kpabase/UIDelegate.h>
 
 // KDE includes
@@ -44,6 +47,7 @@ void DB::FileReader::read(const QString &configFile)
 {
     static QString versionString = QString::fromUtf8("version");
     static QString compressedString = QString::fromUtf8("compressed");
+    static QString generationString = QString::fromUtf8("generation");
 
     ReaderPtr reader = readConfigFile(configFile);
 
@@ -66,12 +70,18 @@ void DB::FileReader::read(const QString &configFile)
     }
 
     setUseCompressedFileFormat(reader->attribute(compressedString).toInt());
+    m_db->m_generation = reader->attribute(generationString);
     qCDebug(DBLog) << "Reading" << (useCompressedFileFormat() ? "compressed" : "uncompressed") << "file format.";
 
     m_db->m_members.setLoading(true);
 
     loadCategories(reader);
     loadImages(reader);
+    loadTakenImages();
+    // the taken image elements were the last thing referring to the mapped file:
+    m_imageLoader = DB::ParallelImageLoader();
+    m_xmlFile.close();
+    loadSnapshotImages();
     loadBlockList(reader);
     loadMemberGroups(reader);
     // loadSettings(reader);
@@ -296,29 +306,89 @@ void DB::FileReader::loadImages(ReaderPtr reader)
         const DB::FileName dbFileName = DB::FileName::fromRelativePath(fileNameStr);
 
         DB::ImageInfoPtr info = load(dbFileName, reader);
-        if (m_db->md5Map()->containsFile(dbFileName)) {
-            if (m_db->md5Map()->contains(info->MD5Sum())) {
-                qCWarning(DBLog) << "Merging duplicate entry for file" << dbFileName.relative();
-                DB::ImageInfoPtr existingInfo = m_db->info(dbFileName);
-                existingInfo->merge(*info);
-            } else {
-                m_db->uiDelegate().error(
-                    DB::LogMessage { DBLog(), QString::fromUtf8("Conflicting information for file '%1': duplicate entry with different MD5 sum! Bailing out...").arg(dbFileName.relative()) },
-                    i18n("<p>Line %1, column %2: duplicate entry for file '%3' with different MD5 sum.</p>"
-                         "<p>Manual repair required!</p>",
-                         reader->lineNumber(),
-                         reader->columnNumber(),
-                         dbFileName.relative()),
-                    i18n("Error in database file"));
-                exit(-1);
-            }
+        addLoadedImage(info, [&reader] { return reader->lineNumber(); }, reader->columnNumber());
+    }
+}
+
+void DB::FileReader::loadTakenImages()
+{
+    if (m_imageLoader.isEmpty())
+        return;
+
+    std::optional<DB::ImageInfoList> images;
+    // Older files need the escaping of category names, which is not thread-safe,
+    // and repairing tags with id 0 changes the categories:
+    if (m_fileVersion >= 11 && !m_repairTagsWithNullIds) {
+        images = m_imageLoader.load(m_fileVersion, [this](const DB::FileName &fileName, DB::ReaderPtr reader) {
+            return DB::ImageDB::createImageInfo(fileName, reader, m_db);
+        });
+    }
+
+    if (!images) {
+        DB::ReaderPtr reader = m_imageLoader.reader(m_db->uiDelegate(), m_fileName);
+        reader->setFileVersion(m_fileVersion);
+        loadImages(reader);
+        return;
+    }
+
+    for (qsizetype index = 0; index < images->size(); ++index) {
+        const DB::ImageInfoPtr &info = images->at(index);
+        // the folder category and the member map are not thread-safe, so this part is done sequentially:
+        m_nextStackId = qMax(m_nextStackId, info->stackId() + 1);
+        info->createFolderCategoryItem(m_folderCategory, m_db->m_members);
+        addLoadedImage(info, [this, index] { return m_imageLoader.lineNumber(index); }, 1);
+    }
+}
+
+void DB::FileReader::addLoadedImage(const DB::ImageInfoPtr &info, const std::function<qint64()> &lineNumber, qint64 columnNumber)
+{
+    const DB::FileName dbFileName = info->fileName();
+    if (m_db->md5Map()->containsFile(dbFileName)) {
+        if (m_db->md5Map()->contains(info->MD5Sum())) {
+            qCWarning(DBLog) << "Merging duplicate entry for file" << dbFileName.relative();
+            DB::ImageInfoPtr existingInfo = m_db->info(dbFileName);
+            existingInfo->merge(*info);
         } else {
-            m_db->m_images.append(info);
-            m_db->m_md5map.insert(info->MD5Sum(), dbFileName);
+            m_db->uiDelegate().error(
+                DB::LogMessage { DBLog(), QString::fromUtf8("Conflicting information for file '%1': duplicate entry with different MD5 sum! Bailing out...").arg(dbFileName.relative()) },
+                i18n("<p>Line %1, column %2: duplicate entry for file '%3' with different MD5 sum.</p>"
+                     "<p>Manual repair required!</p>",
+                     lineNumber(),
+                     columnNumber,
+                     dbFileName.relative()),
+                i18n("Error in database file"));
+            exit(-1);
         }
+    } else {
+        addImage(info);
     }
 }
 
+void DB::FileReader::loadSnapshotImages()
+{
+    for (const DB::ImageInfoPtr &snapshotInfo : std::as_const(m_snapshotImages)) {
+        m_nextStackId = qMax(m_nextStackId, snapshotInfo->stackId() + 1);
+        snapshotInfo->createFolderCategoryItem(m_folderCategory, m_db->m_members);
+        const DB::FileName fileName = snapshotInfo->fileName();
+        if (m_db->md5Map()->containsFile(fileName)) {
+            // the snapshot is written from a consistent database, so this should not happen:
+            qCWarning(DBLog) << "Ignoring duplicate entry in database snapshot for file" << fileName.relative();
+            continue;
+        }
+        addImage(snapshotInfo);
+    }
+    m_snapshotImages.clear();
+}
+
+void DB::FileReader::addImage(const DB::ImageInfoPtr &info)
+{
+    m_db->m_images.append(info);
+    m_db->m_fileNameIndex.insert(info->fileName(), info);
+    if (info->isStacked())
+        m_db->m_stackMap[info->stackId()].append(info->fileName());
+    m_db->m_md5map.insert(info->MD5Sum(), info->fileName());
+}
+
 void DB::FileReader::loadBlockList(ReaderPtr reader)
 {
     static QString fileString = QString::fromUtf8("file");
@@ -522,9 +592,10 @@ DB::ImageInfoPtr DB::FileReader::load(const DB::FileName &fileName, ReaderPtr re
 
 DB::ReaderPtr DB::FileReader::readConfigFile(const QString &configFile)
 {
+    m_fileName = configFile;
     ReaderPtr reader = ReaderPtr(new XmlReader(m_db->uiDelegate(), configFile));
-    QFile file(configFile);
-    if (!file.exists()) {
+    m_xmlFile.setFileName(configFile);
+    if (!m_xmlFile.exists()) {
         // Load a default setup
         QFile file(QStandardPaths::locate(QStandardPaths::AppLocalDataLocation, QString::fromLatin1("default-setup")));
         if (!file.open(QIODevice::ReadOnly)) {
@@ -555,14 +626,32 @@ DB::ReaderPtr DB::FileReader::readConfigFile(const QString &configFile)
             reader->addData(str);
         }
     } else {
-        if (!file.open(QIODevice::ReadOnly)) {
+        if (!m_xmlFile.open(QIODevice::ReadOnly)) {
             m_db->uiDelegate().error(
                 DB::LogMessage { DBLog(), QString::fromLatin1("Unable to open '%1' for reading").arg(configFile) },
                 i18n("Unable to open '%1' for reading", configFile), i18n("Error Running Demo"));
             exit(-1);
         }
 
-        reader->addData(file.readAll());
+        // The file is mapped instead of read, so that the image elements are parsed right from the page cache.
+        // The mapping is released by read() once all images are loaded.
+        QByteArray data;
+        const qint64 size = m_xmlFile.size();
+        if (const uchar *mapped = m_xmlFile.map(0, size))
+            data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), size);
+        else
+            data = m_xmlFile.readAll();
+        bool usedSnapshot = false;
+        if (Settings::SettingsData::instance()->useDatabaseSnapshot()) {
+            // if the snapshot can be used, the images are taken from there and removed from data:
+            usedSnapshot = DB::DatabaseSnapshot::load(configFile, data, m_snapshotImages);
+            if (usedSnapshot)
+                qCInfo(DBLog) << "Using database snapshot for" << configFile;
+        }
+        // Otherwise, the images are taken from data as well, so that they can be parsed in parallel:
+        if (!usedSnapshot)
+            m_imageLoader.takeImages(data);
+        reader->addData(data);
 #if 0
         QString errMsg;
         int errLine;
@@ -595,7 +684,6 @@ DB::ReaderPtr DB::FileReader::readConfigFile(const QString &configFile)
     }
 #endif
 
-    file.close();
     return reader;
 }
 
@@ -10,13 +10,18 @@
 #ifndef XMLDB_FILEREADER_H
 #define XMLDB_FILEREADER_H
 
+#include "ParallelImageLoader.h"
 #include "XmlReader.h"
 
 #include <DB/ImageInfo.h>
+#include <DB/ImageInfoList.h>
 #include <DB/ImageInfoPtr.h>
 
+#include <QFile>
 #include <QSharedPointer>
 
+#include <functional>
+
 class QXmlStreamReader;
 
 namespace DB
@@ -39,12 +44,29 @@ public:
 protected:
     void loadCategories(ReaderPtr reader);
     void loadImages(ReaderPtr reader);
+    /**
+     * @brief loadTakenImages adds the images that were taken from the XML file for parallel parsing, if any.
+     * @see DB::ParallelImageLoader
+     */
+    void loadTakenImages();
+    /**
+     * @brief loadSnapshotImages adds the images that were read from the database snapshot, if any.
+     * @see DB::DatabaseSnapshot
+     */
+    void loadSnapshotImages();
     void loadBlockList(ReaderPtr reader);
     void loadMemberGroups(ReaderPtr reader);
     // void loadSettings(ReaderPtr reader);
     void loadGlobalSortOrder(ReaderPtr reader);
 
     DB::ImageInfoPtr load(const DB::FileName &filename, ReaderPtr reader);
+    void addImage(const DB::ImageInfoPtr &info);
+    /**
+     * @brief addLoadedImage adds an image that was read from the XML file, merging duplicate entries.
+     * The position of the image element is used for error messages.
+     * Since determining the line number can be expensive, \p lineNumber is only called when an error is reported.
+     */
+    void addLoadedImage(const DB::ImageInfoPtr &info, const std::function<qint64()> &lineNumber, qint64 columnNumber);
     ReaderPtr readConfigFile(const QString &configFile);
 
     void createSpecialCategories();
@@ -67,6 +89,13 @@ private:
     DB::ImageDB *const m_db;
     int m_fileVersion;
     DB::StackID m_nextStackId;
+    /// Images read from the database snapshot, if it was used instead of the images section of the XML file.
+    DB::ImageInfoList m_snapshotImages;
+    /// Image elements taken from the XML file for parallel parsing.
+    DB::ParallelImageLoader m_imageLoader;
+    QString m_fileName;
+    /// The XML database file, which stays open while its mapped content is in use.
+    QFile m_xmlFile;
 
     // During profilation I found that it was rather expensive to look this up over and over again (once for each image)
     DB::CategoryPtr m_folderCategory;
@@ -15,6 +15,7 @@
 #include "FileWriter.h"
 
 #include "CompressFileInfo.h"
+#include "DatabaseSnapshot.h"
 #include "ElementWriter.h"
 #include "NumberedBackup.h"
 
@@ -32,10 +33,15 @@
 #include <QFileInfo>
 #include <QMutexLocker>
 #include <QRegularExpression>
+#include <QUuid>
 #include <QXmlStreamWriter>
 
 #include <utility>
 
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
 //
 //
 //
@@ -60,27 +66,141 @@ using Utilities::StringSet;
 namespace
 {
 constexpr QFileDevice::Permissions FILE_PERMISSIONS { QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::WriteGroup | QFile::ReadOther };
+// report the progress every so many images:
+constexpr qsizetype PROGRESS_INTERVAL = 1000;
+
+/**
+ * @brief syncToDisk makes sure that the file content actually reached the disk
+ * before the previous version of the file is replaced.
+ */
+bool syncToDisk(QFile &file)
+{
+    if (!file.flush())
+        return false;
+#ifdef Q_OS_UNIX
+    return ::fsync(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
 }
 
-void DB::FileWriter::save(const QString &fileName, bool isAutoSave)
+DB::FileWriter::State DB::FileWriter::takeState(DB::ImageDB *db, ImageCopyMode mode)
 {
-    setUseCompressedFileFormat(Settings::SettingsData::instance()->useCompressedIndexXML());
-    qCDebug(DBLog) << "Saving" << (useCompressedFileFormat() ? "compressed" : "uncompressed") << "file format.";
+    QElapsedTimer timer;
+    if (TimingLog().isDebugEnabled())
+        timer.start();
 
-    if (!isAutoSave)
-        NumberedBackup(m_db->uiDelegate(), fileName).makeNumberedBackup();
+    State state;
+    state.generation = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    setUseCompressedFileFormat(Settings::SettingsData::instance()->useCompressedIndexXML());
+    state.compressed = useCompressedFileFormat();
+    state.backupCount = Settings::SettingsData::instance()->backupCount();
+    state.compressBackup = Settings::SettingsData::instance()->compressBackup();
+    state.writeDatabaseSnapshot = Settings::SettingsData::instance()->useDatabaseSnapshot();
 
     // prepare XML document for saving:
-    m_db->m_categoryCollection.initIdMap();
+    db->m_categoryCollection.initIdMap();
+
+    const DB::CategoryPtr tokensCategory = db->m_categoryCollection.categoryForSpecial(DB::Category::TokensCategory);
+    const DB::TagInfo *untaggedTag = db->untaggedTag();
+    const auto categories = db->m_categoryCollection.categories();
+    for (const DB::CategoryPtr &category : categories) {
+        state.shouldSave.insert(category->name(), category->shouldSave());
+        if (!category->shouldSave())
+            continue;
+
+        State::Category savedCategory;
+        savedCategory.name = category->name();
+        savedCategory.id = category->id();
+        savedCategory.iconName = category->iconName();
+        savedCategory.show = category->doShow();
+        savedCategory.viewType = category->viewType();
+        savedCategory.thumbnailSize = category->thumbnailSize();
+        savedCategory.positionable = category->positionable();
+        savedCategory.isTokensCategory = (category == tokensCategory);
+
+        // As bug 423334 shows, it is easy to forget to add a group to the respective category
+        // when it's created. We can not enforce correct creation of member groups in our API,
+        // but we can prevent incorrect data from entering the XML file.
+        const auto categoryItems = Utilities::mergeListsUniqly(category->items(), db->memberMap().groups(category->name()));
+        for (const QString &tagName : categoryItems) {
+            const bool isUntagged = untaggedTag && untaggedTag->category() == category.data() && untaggedTag->tagName() == tagName;
+            const int id = category->idForName(tagName);
+            savedCategory.tags.append({ tagName, id, category->birthDate(tagName), isUntagged });
+            savedCategory.ids.insert(tagName, id);
+        }
+        state.categories.append(savedCategory);
+    }
+
+    // Copy files from clipboard to end of overview, so we don't loose them
+    DB::ImageInfoList images = db->m_images;
+    images.append(db->m_clipboard);
+    qsizetype copiedImages = 0;
+    if (mode == ImageCopyMode::CopyImages) {
+        // The copies are never changed, so the copy of an image that did not change since the last save can be used again:
+        QHash<const DB::ImageInfo *, DB::ImageDB::SavedCopy> savedCopies;
+        savedCopies.reserve(images.size());
+        state.images.reserve(images.size());
+        for (const DB::ImageInfoPtr &info : std::as_const(images)) {
+            const auto previous = db->m_savedCopies.constFind(info.data());
+            DB::ImageInfoPtr copy;
+            if (previous != db->m_savedCopies.constEnd() && previous->revision == info->revision()) {
+                copy = previous->copy;
+            } else {
+                copy = DB::ImageInfoPtr(new DB::ImageInfo(*info));
+                ++copiedImages;
+            }
+            state.images.append(copy);
+            savedCopies.insert(info.data(), { info, info->revision(), copy });
+        }
+        db->m_savedCopies = std::move(savedCopies);
+    } else {
+        state.images = images;
+    }
+
+    state.blockList = QList<DB::FileName>(db->m_blockList.begin(), db->m_blockList.end());
+    // sort blocklist to get diffable files
+    std::sort(state.blockList.begin(), state.blockList.end());
+    state.memberGroups = db->m_members.memberMap();
+    state.sortOrder = db->categoryCollection()->globalSortOrder()->modifiedSortOrder();
+
+    qCDebug(TimingLog) << "DB::FileWriter::takeState(): Taking" << state.images.size() << "images (" << copiedImages << "copied) took" << timer.elapsed() << "ms";
+    return state;
+}
+
+DB::FileWriter::FileWriter(DB::ImageDB *db)
+    : m_state(takeState(db, ImageCopyMode::ShareImages))
+    , m_ui(db->uiDelegate())
+{
+}
+
+DB::FileWriter::FileWriter(State state, DB::UIDelegate &ui)
+    : m_state(std::move(state))
+    , m_ui(ui)
+{
+}
+
+QString DB::FileWriter::generation() const
+{
+    return m_state.generation;
+}
+
+bool DB::FileWriter::save(const QString &fileName, bool isAutoSave, const std::function<void(qsizetype)> &progress)
+{
+    qCDebug(DBLog) << "Saving" << (m_state.compressed ? "compressed" : "uncompressed") << "file format.";
+
+    if (!isAutoSave)
+        NumberedBackup(m_ui, fileName, m_state.backupCount, m_state.compressBackup).makeNumberedBackup();
 
     QFile out(fileName + QStringLiteral(".tmp"));
     if (!out.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        m_db->uiDelegate().error(
+        m_ui.error(
             DB::LogMessage { DBLog(), QStringLiteral("Error saving to file '%1': %2").arg(out.fileName(), out.errorString()) }, i18n("<p>Could not save the image database to XML.</p>"
                                                                                                                                      "File %1 could not be opened because of the following error: %2",
                                                                                                                                      out.fileName(), out.errorString()),
             i18n("Error while saving..."));
-        return;
+        return false;
     }
     if (!out.setPermissions(FILE_PERMISSIONS)) {
         qCWarning(DBLog, "Could not set permissions on file %s!", qPrintable(out.fileName()));
@@ -92,115 +212,119 @@ void DB::FileWriter::save(const QString &fileName, bool isAutoSave)
     writer.setAutoFormatting(true);
     writer.writeStartDocument();
 
+    DB::DatabaseSnapshot::ByteRange imagesElement;
+
     {
         ElementWriter dummy(writer, QStringLiteral("KPhotoAlbum"));
         writer.writeAttribute(QStringLiteral("version"), QString::number(DB::ImageDB::fileVersion()));
-        writer.writeAttribute(QStringLiteral("compressed"), QString::number(useCompressedFileFormat()));
+        writer.writeAttribute(QStringLiteral("compressed"), QString::number(m_state.compressed));
+        // identifies this version of the file, so that the change journal can be matched to it:
+        writer.writeAttribute(QStringLiteral("generation"), m_state.generation);
 
         saveCategories(writer);
-        saveImages(writer);
+        // QXmlStreamWriter writes directly to the device, so the file position can be used to locate the images element:
+        imagesElement.begin = out.pos();
+        saveImages(writer, progress);
+        imagesElement.end = out.pos();
         saveBlockList(writer);
         saveMemberGroups(writer);
         // saveSettings(writer);
         saveGlobalSortOrder(writer);
     }
     writer.writeEndDocument();
+    if (writer.hasError() || !syncToDisk(out)) {
+        m_ui.error(
+            DB::LogMessage { DBLog(), QStringLiteral("Error writing file '%1': %2").arg(out.fileName(), out.errorString()) }, i18n("<p>Could not save the image database to XML.</p>"
+                                                                                                                                   "File %1 could not be written because of the following error: %2",
+                                                                                                                                   out.fileName(), out.errorString()),
+            i18n("Error while saving..."));
+        return false;
+    }
+    out.close();
     qCDebug(TimingLog) << "DB::FileWriter::save(): Saving took" << timer.elapsed() << "ms";
 
     // State: XML file has previous DB version, temp file has the current version.
 
     // original file can be safely deleted
     if ((!QFile::remove(fileName)) && QFile::exists(fileName)) {
-        m_db->uiDelegate().error(
+        m_ui.error(
             DB::LogMessage { DBLog(), QStringLiteral("Removal of file '%1' failed.").arg(fileName) }, i18n("<p>Failed to remove old version of image database.</p>"
                                                                                                            "<p>Please try again or replace the file %1 with file %2 manually!</p>",
                                                                                                            fileName, out.fileName()),
             i18n("Error while saving..."));
-        return;
+        return false;
     }
     // State: XML file doesn't exist, temp file has the current version.
     if (!out.rename(fileName)) {
-        m_db->uiDelegate().error(
+        m_ui.error(
             DB::LogMessage { DBLog(), QStringLiteral("Renaming '%1' to '%2' failed.").arg(out.fileName().arg(fileName)) }, i18n("<p>Failed to move temporary XML file to permanent location.</p>"
                                                                                                                                 "<p>Please try again or rename file %1 to %2 manually!</p>",
                                                                                                                                 out.fileName(), fileName),
             i18n("Error while saving..."));
         // State: temp file has the current version.
-        return;
+        return false;
     }
     // State: XML file has the current version.
+
+    // The snapshot is only a cache for faster loading, so failing to write it is not an error.
+    // Autosave files are only read after a crash, so writing a snapshot for them is not worth it.
+    if (isAutoSave)
+        return true;
+    if (m_state.writeDatabaseSnapshot)
+        DB::DatabaseSnapshot::write(fileName, imagesElement, m_state.images, m_state.shouldSave);
+    else
+        DB::DatabaseSnapshot::remove(fileName);
+    return true;
 }
 
 void DB::FileWriter::saveCategories(QXmlStreamWriter &writer)
 {
-    const QStringList categories = DB::ImageDB::instance()->categoryCollection()->categoryNames();
     ElementWriter dummy(writer, QStringLiteral("Categories"));
 
-    DB::CategoryPtr tokensCategory = DB::ImageDB::instance()->categoryCollection()->categoryForSpecial(DB::Category::TokensCategory);
-    const DB::TagInfo *untaggedTag = DB::ImageDB::instance()->untaggedTag();
-    for (const QString &name : categories) {
-        DB::CategoryPtr category = DB::ImageDB::instance()->categoryCollection()->categoryForName(name);
-
-        if (!shouldSaveCategory(name)) {
-            continue;
-        }
-
+    for (const State::Category &category : std::as_const(m_state.categories)) {
         ElementWriter dummy(writer, QStringLiteral("Category"));
-        writer.writeAttribute(QStringLiteral("name"), name);
-        writer.writeAttribute(QStringLiteral("id"), QString::number(category->id()));
-        writer.writeAttribute(QStringLiteral("icon"), category->iconName());
-        writer.writeAttribute(QStringLiteral("show"), QString::number(category->doShow()));
-        writer.writeAttribute(QStringLiteral("viewtype"), QString::number(category->viewType()));
-        writer.writeAttribute(QStringLiteral("thumbnailsize"), QString::number(category->thumbnailSize()));
-        writer.writeAttribute(QStringLiteral("positionable"), QString::number(category->positionable()));
-        if (category == tokensCategory) {
+        writer.writeAttribute(QStringLiteral("name"), category.name);
+        writer.writeAttribute(QStringLiteral("id"), QString::number(category.id));
+        writer.writeAttribute(QStringLiteral("icon"), category.iconName);
+        writer.writeAttribute(QStringLiteral("show"), QString::number(category.show));
+        writer.writeAttribute(QStringLiteral("viewtype"), QString::number(category.viewType));
+        writer.writeAttribute(QStringLiteral("thumbnailsize"), QString::number(category.thumbnailSize));
+        writer.writeAttribute(QStringLiteral("positionable"), QString::number(category.positionable));
+        if (category.isTokensCategory) {
             writer.writeAttribute(QStringLiteral("meta"), QStringLiteral("tokens"));
         }
 
-        // As bug 423334 shows, it is easy to forget to add a group to the respective category
-        // when it's created. We can not enforce correct creation of member groups in our API,
-        // but we can prevent incorrect data from entering the XML file.
-        const auto categoryItems = Utilities::mergeListsUniqly(category->items(), m_db->memberMap().groups(name));
-        for (const QString &tagName : categoryItems) {
+        for (const State::Tag &tag : category.tags) {
             ElementWriter dummy(writer, QStringLiteral("value"));
-            writer.writeAttribute(QStringLiteral("value"), tagName);
-            writer.writeAttribute(QStringLiteral("id"), QString::number(category->idForName(tagName)));
-            QDate birthDate = category->birthDate(tagName);
-            if (!birthDate.isNull())
-                writer.writeAttribute(QStringLiteral("birthDate"), birthDate.toString(Qt::ISODate));
-            if (untaggedTag && untaggedTag->category() == category.data() && untaggedTag->tagName() == tagName) {
+            writer.writeAttribute(QStringLiteral("value"), tag.name);
+            writer.writeAttribute(QStringLiteral("id"), QString::number(tag.id));
+            if (!tag.birthDate.isNull())
+                writer.writeAttribute(QStringLiteral("birthDate"), tag.birthDate.toString(Qt::ISODate));
+            if (tag.isUntagged) {
                 writer.writeAttribute(QStringLiteral("meta"), QStringLiteral("mark-untagged"));
             }
         }
     }
 }
 
-void DB::FileWriter::saveImages(QXmlStreamWriter &writer)
+void DB::FileWriter::saveImages(QXmlStreamWriter &writer, const std::function<void(qsizetype)> &progress)
 {
-    DB::ImageInfoList list = m_db->m_images;
-
-    // Copy files from clipboard to end of overview, so we don't loose them
-    const auto clipBoardImages = m_db->m_clipboard;
-    for (const DB::ImageInfoPtr &infoPtr : clipBoardImages) {
-        list.append(infoPtr);
-    }
+    ElementWriter dummy(writer, QStringLiteral("images"));
 
-    {
-        ElementWriter dummy(writer, QStringLiteral("images"));
-
-        for (const DB::ImageInfoPtr &infoPtr : std::as_const(list)) {
-            save(writer, infoPtr);
-        }
+    qsizetype count = 0;
+    for (const DB::ImageInfoPtr &infoPtr : std::as_const(m_state.images)) {
+        save(writer, infoPtr);
+        if (progress && ++count % PROGRESS_INTERVAL == 0)
+            progress(count);
     }
+    if (progress)
+        progress(count);
 }
 
 void DB::FileWriter::saveBlockList(QXmlStreamWriter &writer)
 {
     ElementWriter dummy(writer, QStringLiteral("blocklist"));
-    QList<DB::FileName> blockList(m_db->m_blockList.begin(), m_db->m_blockList.end());
-    // sort blocklist to get diffable files
-    std::sort(blockList.begin(), blockList.end());
-    for (const DB::FileName &block : std::as_const(blockList)) {
+    for (const DB::FileName &block : std::as_const(m_state.blockList)) {
         ElementWriter dummy(writer, QStringLiteral("block"));
         writer.writeAttribute(QStringLiteral("file"), block.relative());
     }
@@ -208,12 +332,12 @@ void DB::FileWriter::saveBlockList(QXmlStreamWriter &writer)
 
 void DB::FileWriter::saveMemberGroups(QXmlStreamWriter &writer)
 {
-    if (m_db->m_members.isEmpty())
+    if (m_state.memberGroups.isEmpty())
         return;
 
     ElementWriter dummy(writer, QStringLiteral("member-groups"));
-    for (QMap<QString, QMap<QString, StringSet>>::ConstIterator memberMapIt = m_db->m_members.memberMap().constBegin();
-         memberMapIt != m_db->m_members.memberMap().constEnd(); ++memberMapIt) {
+    for (QMap<QString, QMap<QString, StringSet>>::ConstIterator memberMapIt = m_state.memberGroups.constBegin();
+         memberMapIt != m_state.memberGroups.constEnd(); ++memberMapIt) {
         const QString categoryName = memberMapIt.key();
 
         // FIXME (l3u): This can happen when an empty sub-category (group) is present.
@@ -225,7 +349,7 @@ void DB::FileWriter::saveMemberGroups(QXmlStreamWriter &writer)
         if (!shouldSaveCategory(categoryName))
             continue;
 
-        QMap<QString, StringSet> groupMap = memberMapIt.value();
+        const QMap<QString, StringSet> &groupMap = memberMapIt.value();
         for (QMap<QString, StringSet>::ConstIterator groupMapIt = groupMap.constBegin(); groupMapIt != groupMap.constEnd(); ++groupMapIt) {
 
             // FIXME (l3u): This can happen when an empty sub-category (group) is present.
@@ -234,17 +358,18 @@ void DB::FileWriter::saveMemberGroups(QXmlStreamWriter &writer)
                 continue;
             }
 
-            if (useCompressedFileFormat()) {
+            if (m_state.compressed) {
                 const StringSet members = groupMapIt.value();
                 ElementWriter dummy(writer, QStringLiteral("member"));
                 writer.writeAttribute(QStringLiteral("category"), categoryName);
                 writer.writeAttribute(QStringLiteral("group-name"), groupMapIt.key());
+                const QHash<QString, int> ids = idsForCategory(categoryName);
                 QStringList idList;
                 for (const QString &member : members) {
-                    DB::CategoryPtr catPtr = m_db->m_categoryCollection.categoryForName(categoryName);
-                    if (catPtr->idForName(member) == 0)
+                    const int id = ids.value(member);
+                    if (id == 0)
                         qCWarning(DBLog) << "Member" << member << "in group" << categoryName << "->" << groupMapIt.key() << "has no id!";
-                    idList.append(QString::number(catPtr->idForName(member)));
+                    idList.append(QString::number(id));
                 }
                 std::sort(idList.begin(), idList.end());
                 writer.writeAttribute(QStringLiteral("members"), idList.join(QStringLiteral(",")));
@@ -274,7 +399,7 @@ void DB::FileWriter::saveMemberGroups(QXmlStreamWriter &writer)
 void DB::FileWriter::saveGlobalSortOrder(QXmlStreamWriter &writer)
 {
     ElementWriter dummy(writer, QStringLiteral("global-sort-order"));
-    for (const auto &item : m_db->categoryCollection()->globalSortOrder()->modifiedSortOrder()) {
+    for (const auto &item : std::as_const(m_state.sortOrder)) {
         ElementWriter dummy(writer, QStringLiteral("item"));
         writer.writeAttribute(QStringLiteral("category"), item.category);
         writer.writeAttribute(QStringLiteral("item"), item.item);
@@ -304,8 +429,9 @@ void DB::FileWriter::saveSettings(QXmlStreamWriter& writer)
 }
 */
 
-static const QString &stdDateTimeToString(const Utilities::FastDateTime &date)
+static QString stdDateTimeToString(const Utilities::FastDateTime &date)
 {
+    // the cached string is returned by value, because the database may be saved from several threads at once:
     static QString s_lastDateTimeString;
     static Utilities::FastDateTime s_lastDateTime;
     static QMutex s_lastDateTimeLocker;
@@ -352,7 +478,7 @@ void DB::FileWriter::save(QXmlStreamWriter &writer, const DB::ImageInfoPtr &info
     if (info->isVideo())
         writer.writeAttribute(QStringLiteral("videoLength"), QString::number(info->videoLength()));
 
-    if (useCompressedFileFormat())
+    if (m_state.compressed)
         writeCategoriesCompressed(writer, info);
     else
         writeCategories(writer, info);
@@ -404,21 +530,15 @@ void DB::FileWriter::writeCategories(QXmlStreamWriter &writer, const DB::ImageIn
 
 void DB::FileWriter::writeCategoriesCompressed(QXmlStreamWriter &writer, const DB::ImageInfoPtr &info)
 {
-    const QList<DB::CategoryPtr> categoryList = DB::ImageDB::instance()->categoryCollection()->categories();
-    for (const DB::CategoryPtr &category : categoryList) {
-        QString categoryName = category->name();
-
-        if (!shouldSaveCategory(categoryName))
-            continue;
-
-        const StringSet items = info->itemsOfCategory(categoryName);
+    for (const State::Category &category : std::as_const(m_state.categories)) {
+        const StringSet items = info->itemsOfCategory(category.name);
         if (!items.empty()) {
             QStringList idList;
 
             for (const QString &itemValue : items) {
-                auto idString = QString::number(category->idForName(itemValue));
+                auto idString = QString::number(category.ids.value(itemValue));
 
-                const auto area = info->areaForTag(categoryName, itemValue);
+                const auto area = info->areaForTag(category.name, itemValue);
                 if (area.isValid()) {
                     idString.append(QStringLiteral("+a=%1").arg(areaToString(area)));
                 }
@@ -427,7 +547,7 @@ void DB::FileWriter::writeCategoriesCompressed(QXmlStreamWriter &writer, const D
             }
 
             std::sort(idList.begin(), idList.end());
-            writer.writeAttribute(QStringLiteral("tags_%1").arg(category->id()),
+            writer.writeAttribute(QStringLiteral("tags_%1").arg(category.id),
                                   idList.join(QStringLiteral(",")));
         }
     }
@@ -435,23 +555,22 @@ void DB::FileWriter::writeCategoriesCompressed(QXmlStreamWriter &writer, const D
 
 bool DB::FileWriter::shouldSaveCategory(const QString &categoryName) const
 {
-    // Profiling indicated that this function was a hotspot, so this cache improved saving speed with 25%
-    static QHash<QString, bool> cache;
-    if (cache.contains(categoryName))
-        return cache[categoryName];
-
+    const auto it = m_state.shouldSave.constFind(categoryName);
     // A few bugs has shown up, where an invalid category name has crashed KPA. It therefore checks for such invalid names here.
-    if (!m_db->m_categoryCollection.categoryForName(categoryName)) {
+    if (it == m_state.shouldSave.constEnd()) {
         qCWarning(DBLog, "Invalid category name: %s", qPrintable(categoryName));
-        cache.insert(categoryName, false);
         return false;
     }
+    return it.value();
+}
 
-    const auto category = m_db->m_categoryCollection.categoryForName(categoryName).data();
-    Q_ASSERT(category);
-    const bool shouldSave = category->shouldSave();
-    cache.insert(categoryName, shouldSave);
-    return shouldSave;
+QHash<QString, int> DB::FileWriter::idsForCategory(const QString &categoryName) const
+{
+    for (const State::Category &category : m_state.categories) {
+        if (category.name == categoryName)
+            return category.ids;
+    }
+    return {};
 }
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
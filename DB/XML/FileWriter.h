@@ -10,31 +10,112 @@
 #ifndef XMLDB_FILEWRITER_H
 #define XMLDB_FILEWRITER_H
 
+#include <DB/GlobalCategorySortOrder.h>
+#include <DB/ImageInfoList.h>
 #include <DB/ImageInfoPtr.h>
+#include <kpabase/FileName.h>
+#include <kpabase/StringSet.h>
 
+#include <QDate>
+#include <QHash>
+#include <QMap>
 #include <QRect>
 #include <QString>
 
+#include <functional>
+
 class QXmlStreamWriter;
 
 namespace DB
 {
 class ImageDB;
+class UIDelegate;
 
 class Database;
 
 class FileWriter
 {
 public:
-    explicit FileWriter(DB::ImageDB *db)
-        : m_db(db)
-    {
-    }
-    void save(const QString &fileName, bool isAutoSave);
+    /**
+     * @brief The State struct holds a copy of everything that is written to the XML database file.
+     *
+     * Once taken, the state does not refer to the database any more.
+     * If the images are copied as well, the state can be written in a background thread while the database is changed.
+     * Copying is cheap, because the copied containers and most of the ImageInfo data are implicitly shared.
+     */
+    struct State {
+        struct Tag {
+            QString name;
+            int id = 0;
+            QDate birthDate;
+            bool isUntagged = false;
+        };
+        struct Category {
+            QString name;
+            int id = 0;
+            QString iconName;
+            bool show = true;
+            int viewType = 0;
+            int thumbnailSize = 0;
+            bool positionable = false;
+            bool isTokensCategory = false;
+            QList<Tag> tags;
+            QHash<QString, int> ids;
+        };
+
+        /// Identifies the written file; see DB::Journal.
+        QString generation;
+        bool compressed = false;
+        /// All categories that are saved, in the order of the category collection.
+        QList<Category> categories;
+        /// Whether a category is saved, for all categories of the database.
+        QHash<QString, bool> shouldSave;
+        DB::ImageInfoList images;
+        QList<DB::FileName> blockList;
+        QMap<QString, QMap<QString, Utilities::StringSet>> memberGroups;
+        QList<DB::GlobalCategorySortOrder::Item> sortOrder;
+        int backupCount = 0;
+        bool compressBackup = false;
+        bool writeDatabaseSnapshot = false;
+    };
+
+    enum class ImageCopyMode {
+        ShareImages, ///< The state refers to the ImageInfo objects of the database.
+        CopyImages ///< The state gets its own copies of the ImageInfo objects.
+    };
+
+    /**
+     * @brief takeState copies the content of the database.
+     * This must be called in the thread the database lives in.
+     */
+    static State takeState(DB::ImageDB *db, ImageCopyMode mode);
+
+    /**
+     * @brief Create a FileWriter for the current state of the database.
+     * Errors are reported to the UIDelegate of the database.
+     */
+    explicit FileWriter(DB::ImageDB *db);
+    /**
+     * @brief Create a FileWriter for a previously taken state.
+     * If the state has its own copies of the images, the FileWriter can be used in any thread,
+     * as long as \p ui can be used in that thread.
+     */
+    FileWriter(State state, DB::UIDelegate &ui);
+
+    /**
+     * @brief save the whole database to \p fileName.
+     * @param progress if set, this is called with the number of images written so far
+     * @return \c true, if the file was saved successfully
+     */
+    bool save(const QString &fileName, bool isAutoSave, const std::function<void(qsizetype)> &progress = {});
+    /**
+     * @return the generation attribute of the written file
+     */
+    QString generation() const;
 
 protected:
     void saveCategories(QXmlStreamWriter &);
-    void saveImages(QXmlStreamWriter &);
+    void saveImages(QXmlStreamWriter &, const std::function<void(qsizetype)> &progress);
     void saveBlockList(QXmlStreamWriter &);
     void saveMemberGroups(QXmlStreamWriter &);
     void saveGlobalSortOrder(QXmlStreamWriter &);
@@ -42,10 +123,12 @@ protected:
     void writeCategories(QXmlStreamWriter &, const DB::ImageInfoPtr &info);
     void writeCategoriesCompressed(QXmlStreamWriter &, const DB::ImageInfoPtr &info);
     bool shouldSaveCategory(const QString &categoryName) const;
+    QHash<QString, int> idsForCategory(const QString &categoryName) const;
     // void saveSettings(QXmlStreamWriter&);
 
 private:
-    DB::ImageDB *const m_db;
+    State m_state;
+    DB::UIDelegate &m_ui;
     QString areaToString(QRect area) const;
 };
 
@@ -0,0 +1,395 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "Journal.h"
+
+#include "ElementWriter.h"
+#include "FileWriter.h"
+#include "XmlReader.h"
+
+#include <DB/Category.h>
+#include <DB/CategoryCollection.h>
+#include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
+#include <kpabase/Logging.h>
+#include <kpabase/UIDelegate.h>
+
+#include <KLocalizedString>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QXmlStreamWriter>
+
+#include <utility>
+
+using namespace DB;
+
+namespace
+{
+// Bump this whenever the journal format changes; journals with a different version are ignored.
+constexpr int JOURNAL_VERSION = 1;
+// Once the journal grows beyond this size, the whole database is saved instead:
+constexpr qint64 MAX_JOURNAL_SIZE = 16 * 1024 * 1024;
+
+const QString batchString = QStringLiteral("batch");
+const QString renameString = QStringLiteral("rename");
+const QString deleteString = QStringLiteral("delete");
+const QString blockString = QStringLiteral("block");
+const QString imageString = QStringLiteral("image");
+const QString fileString = QStringLiteral("file");
+const QString fromString = QStringLiteral("from");
+const QString toString = QStringLiteral("to");
+
+QByteArray journalHeader(const QString &generation)
+{
+    return QByteArrayLiteral("KPhotoAlbum journal ") + QByteArray::number(JOURNAL_VERSION) + ' ' + generation.toLatin1() + '\n';
+}
+
+/**
+ * @brief The ImageWriter class gives access to the image serialization of the FileWriter.
+ */
+class ImageWriter : public DB::FileWriter
+{
+public:
+    using FileWriter::FileWriter;
+    void write(QXmlStreamWriter &writer, const DB::ImageInfoPtr &info)
+    {
+        save(writer, info);
+    }
+};
+
+/**
+ * @brief addMissingTags adds the tags of an image to their categories.
+ * Tags that were added since the database file was written are only known from the image records.
+ */
+void addMissingTags(const DB::ImageInfoPtr &info, DB::CategoryCollection &categories)
+{
+    const QStringList categoryNames = info->availableCategories();
+    for (const QString &categoryName : categoryNames) {
+        const DB::CategoryPtr category = categories.categoryForName(categoryName);
+        if (!category || !category->shouldSave())
+            continue;
+        const QStringList knownItems = category->items();
+        const auto items = info->itemsOfCategory(categoryName);
+        for (const QString &item : items) {
+            if (!knownItems.contains(item))
+                category->addItem(item);
+        }
+    }
+}
+}
+
+Journal::Journal(ImageDB *db, const QString &xmlFileName)
+    : m_db(db)
+    , m_fileName(fileName(xmlFileName))
+{
+}
+
+QString Journal::fileName(const QString &xmlFileName)
+{
+    return ImageDB::autoSaveFileName(xmlFileName) + QStringLiteral(".journal");
+}
+
+QString Journal::fileName() const
+{
+    return m_fileName;
+}
+
+void Journal::recordRename(const FileName &oldName, const FileName &newName)
+{
+    m_changes.append({ Operation::Rename, oldName, newName });
+}
+
+void Journal::recordDelete(const FileName &fileName)
+{
+    m_changes.append({ Operation::Delete, fileName, {} });
+}
+
+void Journal::recordBlock(const FileName &fileName)
+{
+    m_changes.append({ Operation::Block, fileName, {} });
+}
+
+void Journal::requireFullSave()
+{
+    m_fullSaveRequired = true;
+}
+
+bool Journal::append()
+{
+    // Without a generation, the journal can't be matched to the database file it belongs to:
+    if (m_fullSaveRequired || m_db->m_generation.isEmpty())
+        return false;
+    if (QFileInfo(m_fileName).size() > MAX_JOURNAL_SIZE) {
+        qCDebug(DBLog) << "Journal" << m_fileName << "is too large, saving the whole database instead.";
+        return false;
+    }
+
+    QElapsedTimer timer;
+    if (TimingLog().isDebugEnabled())
+        timer.start();
+
+    DB::ImageInfoList changedImages;
+    for (const DB::ImageInfoPtr &info : std::as_const(m_db->m_images)) {
+        if (info->isDirty())
+            changedImages.append(info);
+    }
+    if (changedImages.isEmpty() && m_changes.isEmpty())
+        return true;
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(DBLog) << "Could not open journal" << m_fileName << ":" << file.errorString();
+        return false;
+    }
+    const qint64 oldSize = file.size();
+    const QByteArray batch = createBatch(changedImages);
+    QByteArray data;
+    if (oldSize == 0)
+        data = journalHeader(m_db->m_generation);
+    data += QByteArray::number(batch.size()) + ' ' + QByteArray::number(qChecksum(batch)) + '\n';
+    data += batch;
+    data += '\n';
+    if (file.write(data) != data.size() || !file.flush()) {
+        qCWarning(DBLog) << "Could not write journal" << m_fileName << ":" << file.errorString();
+        // don't leave a partial batch behind; the changes are saved in full instead:
+        file.resize(oldSize);
+        return false;
+    }
+
+    m_changes.clear();
+    for (const DB::ImageInfoPtr &info : std::as_const(changedImages))
+        info->m_dirty = false;
+    qCDebug(TimingLog) << "DB::Journal::append(): Writing" << changedImages.size() << "images took" << timer.elapsed() << "ms";
+    return true;
+}
+
+void Journal::reset()
+{
+    beginSave();
+    finishSave(true);
+}
+
+void Journal::beginSave()
+{
+    m_savingChanges = m_changes;
+    m_changes.clear();
+    m_savingFullSaveRequired = m_fullSaveRequired;
+    m_fullSaveRequired = false;
+    m_savingImages.clear();
+    for (const DB::ImageInfoPtr &info : std::as_const(m_db->m_images)) {
+        if (info->isDirty()) {
+            m_savingImages.append(info);
+            info->m_dirty = false;
+        }
+    }
+}
+
+void Journal::finishSave(bool success)
+{
+    if (success) {
+        // the journal belongs to the previous version of the database file:
+        remove();
+    } else {
+        // the journal still matches the database file; the changes go into the next autosave:
+        m_changes = m_savingChanges + m_changes;
+        m_fullSaveRequired = m_fullSaveRequired || m_savingFullSaveRequired;
+        for (const DB::ImageInfoPtr &info : std::as_const(m_savingImages))
+            info->m_dirty = true;
+    }
+    m_savingChanges.clear();
+    m_savingFullSaveRequired = false;
+    m_savingImages.clear();
+}
+
+bool Journal::replay(bool askUser)
+{
+    QFile file(m_fileName);
+    if (!file.exists())
+        return false;
+    if (!file.open(QIODevice::ReadWrite)) {
+        qCWarning(DBLog) << "Could not open journal" << m_fileName << ":" << file.errorString();
+        return false;
+    }
+
+    const QByteArray header = file.readLine();
+    if (m_db->m_generation.isEmpty() || header != journalHeader(m_db->m_generation)) {
+        qCInfo(DBLog) << "Removing journal" << m_fileName << "because it does not belong to the database file.";
+        file.close();
+        remove();
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    QList<QByteArray> batches;
+    qsizetype pos = 0;
+    while (pos < data.size()) {
+        const qsizetype lineEnd = data.indexOf('\n', pos);
+        if (lineEnd < 0)
+            break;
+        const QList<QByteArray> sizeAndChecksum = data.sliced(pos, lineEnd - pos).split(' ');
+        if (sizeAndChecksum.size() != 2)
+            break;
+        bool sizeOk = false;
+        bool checksumOk = false;
+        const qsizetype size = sizeAndChecksum.at(0).toLongLong(&sizeOk);
+        const quint16 checksum = sizeAndChecksum.at(1).toUShort(&checksumOk);
+        const qsizetype batchBegin = lineEnd + 1;
+        if (!sizeOk || !checksumOk || size < 0 || batchBegin + size >= data.size() || data.at(batchBegin + size) != '\n')
+            break;
+        const QByteArray batch = data.sliced(batchBegin, size);
+        if (qChecksum(batch) != checksum)
+            break;
+        batches.append(batch);
+        pos = batchBegin + size + 1;
+    }
+    if (pos < data.size()) {
+        // KPhotoAlbum probably crashed while writing the last batch:
+        qCWarning(DBLog) << "Ignoring incomplete changes at the end of journal" << m_fileName;
+        file.resize(header.size() + pos);
+    }
+    file.close();
+    if (batches.isEmpty())
+        return false;
+
+    if (askUser) {
+        const DB::UserFeedback choice = m_db->uiDelegate().questionYesNo(
+            DB::LogMessage { DBLog(), QStringLiteral("Journal file found: '%1', %2 changes.").arg(m_fileName).arg(batches.size()) },
+            i18n("The journal file '%1' contains changes that were not saved to '%2'. "
+                 "Should these changes be restored?",
+                 m_fileName, m_db->m_fileName),
+            i18n("Found Unsaved Changes"));
+        if (choice != DB::UserFeedback::Confirm) {
+            remove();
+            return false;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    DB::ImageInfoList addedImages;
+    QSet<const DB::ImageInfo *> removedImages;
+    for (const QByteArray &batch : std::as_const(batches))
+        replayBatch(batch, addedImages, removedImages);
+
+    if (!removedImages.isEmpty())
+        m_db->m_images.removeIf([&removedImages](const DB::ImageInfoPtr &info) { return removedImages.contains(info.data()); });
+    m_db->forceUpdate(addedImages);
+
+    // Any image may have changed its stack or checksum, so these are rebuilt from scratch:
+    m_db->m_stackMap.clear();
+    m_db->m_md5map.clear();
+    for (const DB::ImageInfoPtr &info : std::as_const(m_db->m_images)) {
+        if (info->isStacked())
+            m_db->m_stackMap[info->stackId()].append(info->fileName());
+        m_db->m_md5map.insert(info->MD5Sum(), info->fileName());
+    }
+    qCInfo(DBLog) << "Replayed" << batches.size() << "changes from journal" << m_fileName << "in" << timer.elapsed() << "ms.";
+    return true;
+}
+
+void Journal::remove()
+{
+    if (QFile::exists(m_fileName) && !QFile::remove(m_fileName))
+        qCWarning(DBLog) << "Could not remove journal" << m_fileName;
+}
+
+QByteArray Journal::createBatch(const ImageInfoList &images) const
+{
+    QByteArray batch;
+    QXmlStreamWriter writer(&batch);
+    writer.setAutoFormatting(true);
+    // The journal always uses the uncompressed format, because tags that were added since the last save have no ids yet.
+    // Only the saved categories are needed to write the image records, so the rest of the state is left empty:
+    DB::FileWriter::State state;
+    state.compressed = false;
+    const auto categories = m_db->m_categoryCollection.categories();
+    for (const DB::CategoryPtr &category : categories)
+        state.shouldSave.insert(category->name(), category->shouldSave());
+    {
+        ElementWriter dummy(writer, batchString);
+        for (const Change &change : std::as_const(m_changes)) {
+            switch (change.operation) {
+            case Operation::Rename: {
+                ElementWriter dummy(writer, renameString);
+                writer.writeAttribute(fromString, change.fileName.relative());
+                writer.writeAttribute(toString, change.newFileName.relative());
+                break;
+            }
+            case Operation::Delete: {
+                ElementWriter dummy(writer, deleteString);
+                writer.writeAttribute(fileString, change.fileName.relative());
+                break;
+            }
+            case Operation::Block: {
+                ElementWriter dummy(writer, blockString);
+                writer.writeAttribute(fileString, change.fileName.relative());
+                break;
+            }
+            }
+        }
+        ImageWriter imageWriter(std::move(state), m_db->uiDelegate());
+        for (const DB::ImageInfoPtr &info : images)
+            imageWriter.write(writer, info);
+    }
+    return batch;
+}
+
+void Journal::replayBatch(const QByteArray &batch, ImageInfoList &addedImages, QSet<const ImageInfo *> &removedImages)
+{
+    ReaderPtr reader = ReaderPtr(new XmlReader(m_db->uiDelegate(), m_fileName));
+    reader->addData(batch);
+    reader->setFileVersion(DB::ImageDB::fileVersion());
+    if (!reader->readNextStartOrStopElement(batchString).isStartToken)
+        reader->complainStartElementExpected(batchString);
+
+    const DB::CategoryPtr folderCategory = m_db->m_categoryCollection.categoryForSpecial(DB::Category::FolderCategory);
+    for (ElementInfo info = reader->readNextStartOrStopElement(QString()); info.isStartToken; info = reader->readNextStartOrStopElement(QString())) {
+        if (info.tokenName == imageString) {
+            const DB::FileName fileName = DB::FileName::fromRelativePath(reader->attribute(fileString));
+            if (fileName.isNull()) {
+                reader->skipCurrentElement();
+                continue;
+            }
+            // reads up to and including the end of the image element:
+            const DB::ImageInfoPtr image = DB::ImageDB::createImageInfo(fileName, reader, m_db);
+            image->createFolderCategoryItem(folderCategory, m_db->m_members);
+            addMissingTags(image, m_db->m_categoryCollection);
+            m_db->m_nextStackId = qMax(m_db->m_nextStackId, image->stackId() + 1);
+            if (const DB::ImageInfoPtr existing = m_db->m_fileNameIndex.value(fileName)) {
+                *existing = *image;
+            } else {
+                m_db->m_fileNameIndex.insert(fileName, image);
+                addedImages.append(image);
+            }
+        } else if (info.tokenName == renameString) {
+            const DB::FileName oldName = DB::FileName::fromRelativePath(reader->attribute(fromString));
+            const DB::FileName newName = DB::FileName::fromRelativePath(reader->attribute(toString));
+            reader->readEndElement();
+            const DB::ImageInfoPtr image = m_db->m_fileNameIndex.take(oldName);
+            if (!image) {
+                qCWarning(DBLog) << "Journal: can't rename unknown file" << oldName.relative();
+                continue;
+            }
+            // ImageInfo::setFileName() can't be used while the database is still being loaded:
+            image->m_fileName = newName;
+            image->createFolderCategoryItem(folderCategory, m_db->m_members);
+            m_db->m_fileNameIndex.insert(newName, image);
+        } else if (info.tokenName == deleteString) {
+            const DB::FileName fileName = DB::FileName::fromRelativePath(reader->attribute(fileString));
+            reader->readEndElement();
+            const DB::ImageInfoPtr image = m_db->m_fileNameIndex.take(fileName);
+            if (image && !addedImages.removeOne(image))
+                removedImages.insert(image.data());
+        } else if (info.tokenName == blockString) {
+            m_db->m_blockList.insert(DB::FileName::fromRelativePath(reader->attribute(fileString)));
+            reader->readEndElement();
+        } else {
+            qCWarning(DBLog) << "Journal: ignoring unknown element" << info.tokenName;
+            reader->skipCurrentElement();
+        }
+    }
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef XMLDB_JOURNAL_H
+#define XMLDB_JOURNAL_H
+
+#include <DB/ImageInfoList.h>
+#include <kpabase/FileName.h>
+
+#include <QByteArray>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+namespace DB
+{
+class ImageDB;
+class ImageInfo;
+
+/**
+ * @brief The Journal class records changes to the database in an append-only file next to the XML database file.
+ *
+ * Writing the whole XML database file takes a long time for large databases.
+ * Instead of rewriting it on every autosave, only the changes since the last autosave are appended to the journal:
+ * renamed, deleted and blocked files, followed by the complete records of all images that were changed or added.
+ * The image records use the same (uncompressed) format as the XML database file.
+ *
+ * The journal always belongs to one version of the XML database or autosave file, identified by its generation.
+ * When the database is loaded after a crash, the journal is replayed on top of the matching file.
+ * Changes that are not covered by the journal (e.g. changes to categories or tag groups)
+ * require a full save instead; see requireFullSave().
+ *
+ * Each batch of changes is written as a separate XML document, preceded by its size and checksum.
+ * That way, a batch that was only partially written when KPhotoAlbum crashed is detected and ignored.
+ */
+class Journal
+{
+public:
+    Journal(DB::ImageDB *db, const QString &xmlFileName);
+
+    /**
+     * @return the file name of the journal belonging to the given XML database file
+     */
+    static QString fileName(const QString &xmlFileName);
+    QString fileName() const;
+
+    void recordRename(const DB::FileName &oldName, const DB::FileName &newName);
+    void recordDelete(const DB::FileName &fileName);
+    void recordBlock(const DB::FileName &fileName);
+    /**
+     * @brief requireFullSave marks a change that can't be recorded in the journal.
+     * The next call to append() will fail, so that the whole database is saved instead.
+     */
+    void requireFullSave();
+
+    /**
+     * @brief append all changes since the last call to append() or reset() to the journal file.
+     * @return \c true if the changes were written, \c false if a full save is needed instead
+     */
+    bool append();
+    /**
+     * @brief reset the journal after the whole database was saved.
+     * All pending changes are discarded and the journal file is removed.
+     */
+    void reset();
+    /**
+     * @brief beginSave is called before the whole database is saved in the background.
+     * The pending changes are set aside, so that changes made while saving are recorded separately.
+     */
+    void beginSave();
+    /**
+     * @brief finishSave is called when saving in the background has finished.
+     * If saving failed, the changes that were set aside by beginSave() are pending again.
+     * Otherwise, the journal file is removed.
+     */
+    void finishSave(bool success);
+    /**
+     * @brief replay the journal on top of the freshly loaded database.
+     * Must be called after the XML database file was read, but before the images are attached to the tag index.
+     * @param askUser if \c true, ask the user whether the changes in the journal should be used
+     * @return \c true, if any changes were replayed
+     */
+    bool replay(bool askUser);
+    /**
+     * @brief remove the journal file without touching the pending changes.
+     */
+    void remove();
+
+private:
+    enum class Operation {
+        Rename,
+        Delete,
+        Block
+    };
+    struct Change {
+        Operation operation;
+        DB::FileName fileName;
+        DB::FileName newFileName;
+    };
+    QByteArray createBatch(const DB::ImageInfoList &images) const;
+    void replayBatch(const QByteArray &batch, DB::ImageInfoList &addedImages, QSet<const DB::ImageInfo *> &removedImages);
+
+    DB::ImageDB *const m_db;
+    const QString m_fileName;
+    QList<Change> m_changes;
+    bool m_fullSaveRequired = false;
+    // changes that are covered by a save that is still in progress:
+    QList<Change> m_savingChanges;
+    bool m_savingFullSaveRequired = false;
+    DB::ImageInfoList m_savingImages;
+};
+
+}
+
+#endif /* XMLDB_JOURNAL_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -11,7 +11,6 @@
 
 #include <kpabase/FileUtil.h>
 #include <kpabase/Logging.h>
-#include <kpabase/SettingsData.h>
 #include <kpabase/UIDelegate.h>
 
 #include <KLocalizedString>
@@ -19,9 +18,11 @@
 #include <QDir>
 #include <QRegularExpression>
 
-DB::NumberedBackup::NumberedBackup(DB::UIDelegate &ui, const QString &xmlFileName)
+DB::NumberedBackup::NumberedBackup(DB::UIDelegate &ui, const QString &xmlFileName, int backupCount, bool compress)
     : m_ui(ui)
     , m_xmlFileInfo(xmlFileName)
+    , m_backupCount(backupCount)
+    , m_compress(compress)
 {
 }
 
@@ -35,7 +36,7 @@ void DB::NumberedBackup::makeNumberedBackup()
     const QString fileName = QStringLiteral("%1~%2~").arg(m_xmlFileInfo.fileName()).arg(getMaxId() + 1, 4, 10, QLatin1Char('0'));
     const QDir dir = m_xmlFileInfo.dir();
 
-    if (Settings::SettingsData::instance()->compressBackup()) {
+    if (m_compress) {
         const QString zipName = fileName + QLatin1String(".zip");
         const QString zipPath = dir.filePath(zipName);
         KZip zip(zipPath);
@@ -86,7 +87,7 @@ int DB::NumberedBackup::idForFile(const QString &fileName, bool &OK) const
 void DB::NumberedBackup::deleteOldBackupFiles()
 {
     int maxId = getMaxId();
-    int maxBackupFiles = Settings::SettingsData::instance()->backupCount();
+    const int maxBackupFiles = m_backupCount;
     if (maxBackupFiles == -1)
         return;
 
@@ -21,13 +21,18 @@ class UIDelegate;
  * with an embedded sequential number.
  *
  * The number of backup files to keep is configurable.  Each backup file can
- * optionally be compressed.  These options are configured using the
- * KPhotoAlbum configuration file.
+ * optionally be compressed.  These options are passed to the constructor, so
+ * that backups can be made without access to the KPhotoAlbum configuration
+ * (e.g. when saving in a background thread).
  */
 class NumberedBackup
 {
 public:
-    explicit NumberedBackup(DB::UIDelegate &ui, const QString &xmlFileName);
+    /**
+     * @param backupCount the number of backup files to keep (-1 for unlimited)
+     * @param compress if \c true, backup files are compressed
+     */
+    NumberedBackup(DB::UIDelegate &ui, const QString &xmlFileName, int backupCount, bool compress);
 
     /**
      * Attempts to create a numbered backup file of the XML database file
@@ -80,6 +85,9 @@ private:
      * Info for the XML database file.
      */
     QFileInfo m_xmlFileInfo;
+
+    const int m_backupCount;
+    const bool m_compress;
 };
 }
 
@@ -0,0 +1,288 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "ParallelImageLoader.h"
+
+#include <kpabase/FileName.h>
+#include <kpabase/Logging.h>
+#include <kpabase/UIDelegate.h>
+
+#include <QByteArrayView>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QXmlStreamReader>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <array>
+
+using namespace DB;
+using namespace Qt::StringLiterals;
+
+namespace
+{
+// Chunks are large enough to make the per-chunk overhead negligible:
+constexpr qsizetype MINIMUM_CHUNK_SIZE = 512;
+
+const QString imagesString = QStringLiteral("images");
+const QString imageString = QStringLiteral("image");
+const QString fileString = QStringLiteral("file");
+
+// The elements that may occur within the images element, by nesting depth:
+constexpr std::array<QLatin1StringView, 5> ELEMENT_NAMES { "images"_L1, "image"_L1, "options"_L1, "option"_L1, "value"_L1 };
+
+bool isXmlWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * @brief isTagAt checks if the tag at \p pos has exactly the given name.
+ * @param tag the beginning of the tag, e.g. "<image" or "</images"
+ */
+bool isTagAt(QByteArrayView data, qsizetype pos, QByteArrayView tag)
+{
+    if (!data.sliced(pos).startsWith(tag))
+        return false;
+    const qsizetype next = pos + tag.size();
+    return next < data.size() && (isXmlWhitespace(data[next]) || data[next] == '>' || data[next] == '/');
+}
+
+/**
+ * @brief startTagEnd finds the end of the start tag beginning at \p pos.
+ * @return the position of the closing '>', or -1 if the tag is malformed
+ */
+qsizetype startTagEnd(QByteArrayView data, qsizetype pos)
+{
+    char quote = 0;
+    for (; pos < data.size(); ++pos) {
+        const char c = data[pos];
+        if (quote) {
+            if (c == quote)
+                quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return pos;
+        } else if (c == '<') {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief hasNullTagId checks the value of a tags attribute for tags with id 0.
+ * Loading such tags changes the categories, so they can't be loaded in parallel.
+ * @see DB::ImageDB::possibleLoadCompressedCategories
+ */
+bool hasNullTagId(QStringView tags)
+{
+    for (const QStringView tag : tags.tokenize(u',', Qt::SkipEmptyParts)) {
+        const qsizetype additions = tag.indexOf(u'+');
+        if ((additions < 0 ? tag : tag.first(additions)).toInt() == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief checkElements checks that the image elements can be read without errors.
+ * XmlReader reports errors to the user and exits, which must not happen in a worker thread.
+ * @return \c true, if \p xml contains exactly \p imageCount image elements that can be read safely
+ */
+bool checkElements(const QByteArray &xml, qsizetype imageCount)
+{
+    QXmlStreamReader reader(xml);
+    qsizetype depth = 0;
+    qsizetype images = 0;
+    while (!reader.atEnd()) {
+        switch (reader.readNext()) {
+        case QXmlStreamReader::StartDocument:
+        case QXmlStreamReader::EndDocument:
+            break;
+        case QXmlStreamReader::StartElement: {
+            if (depth >= qsizetype(ELEMENT_NAMES.size()) || reader.name() != ELEMENT_NAMES[depth])
+                return false;
+            const QXmlStreamAttributes attributes = reader.attributes();
+            if (depth == 1) {
+                ++images;
+                if (attributes.value(fileString).isEmpty())
+                    return false;
+                for (const QXmlStreamAttribute &attribute : attributes) {
+                    if (attribute.name().startsWith("tags_"_L1) && hasNullTagId(attribute.value()))
+                        return false;
+                }
+            } else if (depth == 3 && !attributes.hasAttribute(u"name"_s)) {
+                // values of options without a name are not read
+                return false;
+            }
+            ++depth;
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            --depth;
+            break;
+        case QXmlStreamReader::Characters:
+            if (!reader.isWhitespace())
+                return false;
+            break;
+        default:
+            return false;
+        }
+    }
+    return !reader.hasError() && images == imageCount;
+}
+}
+
+bool ParallelImageLoader::takeImages(QByteArray &data)
+{
+    const QByteArrayView view(data);
+    const qsizetype imagesBegin = view.indexOf("<images");
+    if (imagesBegin < 0 || !isTagAt(view, imagesBegin, "<images"))
+        return false;
+    const qsizetype imagesStartTagEnd = startTagEnd(view, imagesBegin);
+    // an empty images element has nothing to take:
+    if (imagesStartTagEnd < 0 || view[imagesStartTagEnd - 1] == '/')
+        return false;
+
+    const qsizetype contentBegin = imagesStartTagEnd + 1;
+    qsizetype contentEnd = -1;
+    QList<ElementRange> elements;
+    qsizetype pos = contentBegin;
+    while (contentEnd < 0) {
+        while (pos < view.size() && isXmlWhitespace(view[pos]))
+            ++pos;
+        if (pos >= view.size())
+            return false;
+
+        if (isTagAt(view, pos, "</images")) {
+            contentEnd = pos;
+        } else if (isTagAt(view, pos, "<image")) {
+            const qsizetype tagEnd = startTagEnd(view, pos);
+            if (tagEnd < 0)
+                return false;
+            qsizetype elementEnd = tagEnd + 1;
+            if (view[tagEnd - 1] != '/') {
+                // attribute values can't contain '<', so the first end tag belongs to this element:
+                const qsizetype endTag = view.indexOf("</image>", tagEnd);
+                if (endTag < 0)
+                    return false;
+                elementEnd = endTag + qsizetype(sizeof("</image>") - 1);
+            }
+            elements.append({ pos - contentBegin, elementEnd - contentBegin });
+            pos = elementEnd;
+        } else {
+            // e.g. comments; the regular reader takes care of these
+            return false;
+        }
+    }
+    if (elements.isEmpty())
+        return false;
+
+    m_firstLine = 1 + view.first(contentBegin).count('\n');
+    m_fileData = data;
+    m_data = QByteArrayView(m_fileData).sliced(contentBegin, contentEnd - contentBegin);
+    m_elements = std::move(elements);
+    // data may not own its content (e.g. if it was mapped from the file), so removing the image elements in place would copy all of it:
+    QByteArray remainder;
+    remainder.reserve(data.size() - m_data.size());
+    remainder.append(view.first(contentBegin));
+    remainder.append(view.sliced(contentEnd));
+    data = remainder;
+    qCDebug(DBLog) << "Found" << m_elements.size() << "image elements for parallel loading.";
+    return true;
+}
+
+bool ParallelImageLoader::isEmpty() const
+{
+    return m_elements.isEmpty();
+}
+
+std::optional<ImageInfoList> ParallelImageLoader::load(int fileVersion, const CreateFunction &createImageInfo) const
+{
+    QElapsedTimer timer;
+    if (TimingLog().isDebugEnabled())
+        timer.start();
+
+    const qsizetype imageCount = m_elements.size();
+    const qsizetype chunkCount = std::clamp<qsizetype>(imageCount / MINIMUM_CHUNK_SIZE, 1, 4 * QThread::idealThreadCount());
+    QList<ElementRange> chunks;
+    chunks.reserve(chunkCount);
+    for (qsizetype chunk = 0; chunk < chunkCount; ++chunk)
+        chunks.append({ imageCount * chunk / chunkCount, imageCount * (chunk + 1) / chunkCount });
+
+    const auto loadChunk = [this, fileVersion, &createImageInfo](const ElementRange &chunk) -> std::optional<DB::ImageInfoList> {
+        const QByteArray xml = wrapElements(chunk.first, chunk.second);
+        if (!checkElements(xml, chunk.second - chunk.first))
+            return std::nullopt;
+
+        // the elements were checked, so the reader doesn't run into errors:
+        DB::DummyUIDelegate ui;
+        ReaderPtr reader(new XmlReader(ui, QString()));
+        reader->setFileVersion(fileVersion);
+        reader->addData(xml);
+        reader->readNextStartOrStopElement(imagesString);
+
+        DB::ImageInfoList images;
+        images.reserve(chunk.second - chunk.first);
+        for (qsizetype element = chunk.first; element < chunk.second; ++element) {
+            reader->readNextStartOrStopElement(imageString);
+            const DB::FileName fileName = DB::FileName::fromRelativePath(reader->attribute(fileString));
+            if (fileName.isNull())
+                return std::nullopt;
+            images.append(createImageInfo(fileName, reader));
+        }
+        return images;
+    };
+
+    // blockingMapped keeps the order of the chunks, so the images are in file order:
+    const QList<std::optional<DB::ImageInfoList>> chunkResults = (chunkCount == 1)
+        ? QList<std::optional<DB::ImageInfoList>> { loadChunk(chunks.constFirst()) }
+        : QtConcurrent::blockingMapped<QList<std::optional<DB::ImageInfoList>>>(chunks, loadChunk);
+
+    DB::ImageInfoList result;
+    result.reserve(imageCount);
+    for (const auto &chunkResult : chunkResults) {
+        if (!chunkResult) {
+            qCInfo(DBLog) << "Could not load images in parallel, falling back to sequential loading.";
+            return std::nullopt;
+        }
+        result.append(*chunkResult);
+    }
+    qCDebug(TimingLog) << "DB::ParallelImageLoader::load(): Loading" << imageCount << "images in" << chunkCount << "chunks took" << timer.elapsed() << "ms";
+    return result;
+}
+
+ReaderPtr ParallelImageLoader::reader(UIDelegate &ui, const QString &friendlyStreamName) const
+{
+    // padding with empty lines makes the line numbers match the XML file:
+    QByteArray xml(m_firstLine - 1, '\n');
+    xml += "<images>";
+    xml.append(m_data);
+    xml += "</images>";
+
+    ReaderPtr reader(new XmlReader(ui, friendlyStreamName));
+    reader->addData(xml);
+    return reader;
+}
+
+qint64 ParallelImageLoader::lineNumber(qsizetype index) const
+{
+    return m_firstLine + m_data.first(m_elements.at(index).first).count('\n');
+}
+
+QByteArray ParallelImageLoader::wrapElements(qsizetype first, qsizetype last) const
+{
+    const qsizetype begin = m_elements.at(first).first;
+    const qsizetype end = m_elements.at(last - 1).second;
+    QByteArray xml;
+    xml.reserve(end - begin + 32);
+    xml += "<images>";
+    xml.append(m_data.sliced(begin, end - begin));
+    xml += "</images>";
+    return xml;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
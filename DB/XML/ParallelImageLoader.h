@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef XMLDB_PARALLELIMAGELOADER_H
+#define XMLDB_PARALLELIMAGELOADER_H
+
+#include "XmlReader.h"
+
+#include <DB/ImageInfoList.h>
+#include <DB/ImageInfoPtr.h>
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+
+#include <functional>
+#include <optional>
+#include <utility>
+
+namespace DB
+{
+class FileName;
+class UIDelegate;
+
+/**
+ * @brief The ParallelImageLoader class parses the images section of the XML database file using several threads.
+ *
+ * Loading works in two phases:
+ * First, takeImages() scans the raw bytes of the XML file for the boundaries of the image elements
+ * and takes the image elements out of the file, leaving an empty images element for the regular reader.
+ * Then, load() parses the image elements in parallel and assembles the images in file order.
+ *
+ * Each thread checks its share of the image elements before parsing them.
+ * If anything unexpected shows up, load() fails and the images must be read sequentially using reader(),
+ * which reports errors the same way as the regular reader.
+ */
+class ParallelImageLoader
+{
+public:
+    using CreateFunction = std::function<DB::ImageInfoPtr(const DB::FileName &, DB::ReaderPtr)>;
+
+    /**
+     * @brief takeImages removes the content of the images element from \p data.
+     * The image elements are not copied, so if \p data does not own its content (see QByteArray::fromRawData()),
+     * the content must stay valid for as long as the image elements are in use.
+     * @param data the content of the XML database file
+     * @return \c true, if the image elements were taken; otherwise, \p data is left unchanged
+     */
+    bool takeImages(QByteArray &data);
+    /**
+     * @return \c true, if takeImages() did not take any image elements
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief load parses the image elements in parallel.
+     * The images are not added to any database, so \p createImageInfo must be safe to call from several threads at once.
+     * @param fileVersion the version of the XML database file
+     * @param createImageInfo creates the image for an image element; see DB::ImageDB::createImageInfo()
+     * @return the images in file order, or an empty optional if the image elements could not be parsed in parallel
+     */
+    std::optional<DB::ImageInfoList> load(int fileVersion, const CreateFunction &createImageInfo) const;
+
+    /**
+     * @brief reader creates a reader for sequential parsing of all image elements.
+     * The line numbers of the reader match those of the XML database file.
+     */
+    DB::ReaderPtr reader(DB::UIDelegate &ui, const QString &friendlyStreamName) const;
+
+    /**
+     * The lines are counted on each call, which takes time proportional to the size of the file.
+     * Only use this for error messages.
+     * @return the line number of the image element with the given index within the XML database file
+     */
+    qint64 lineNumber(qsizetype index) const;
+
+private:
+    /// The position of an image element within m_data; the range is half-open.
+    using ElementRange = std::pair<qsizetype, qsizetype>;
+    QByteArray wrapElements(qsizetype first, qsizetype last) const;
+
+    /// The content of the XML database file, as passed to takeImages().
+    QByteArray m_fileData;
+    /// The content of the images element within m_fileData.
+    QByteArrayView m_data;
+    QList<ElementRange> m_elements;
+    /// The line number of the images element.
+    qint64 m_firstLine = 1;
+};
+
+}
+
+#endif /* XMLDB_PARALLELIMAGELOADER_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -23,13 +23,31 @@ XmlReader::XmlReader(DB::UIDelegate &ui, const QString &friendlyStreamName)
 
 QString XmlReader::attribute(const QString &name, const QString &defaultValue)
 {
-    const auto ref = attributes().value(name);
+    const auto ref = attributeView(name);
     if (ref.isNull())
         return defaultValue;
     else
         return ref.toString();
 }
 
+QStringView XmlReader::attributeView(const QString &name) const
+{
+    return m_attributes.value(name);
+}
+
+int XmlReader::intAttribute(const QString &name, int defaultValue) const
+{
+    const auto ref = attributeView(name);
+    if (ref.isNull())
+        return defaultValue;
+    return ref.toInt();
+}
+
+const QXmlStreamAttributes &XmlReader::elementAttributes() const
+{
+    return m_attributes;
+}
+
 ElementInfo XmlReader::readNextStartOrStopElement(const QString &expectedStart)
 {
     if (m_peek.isValid) {
@@ -62,9 +80,9 @@ void XmlReader::readEndElement(bool readNextElement)
         reportError(i18n("Expected to read an end element but read %1", tokenString()));
 }
 
-bool XmlReader::hasAttribute(const QString &name)
+bool XmlReader::hasAttribute(const QString &name) const
 {
-    return attributes().hasAttribute(name);
+    return m_attributes.hasAttribute(name);
 }
 
 ElementInfo XmlReader::peekNext()
@@ -97,6 +115,8 @@ void XmlReader::reportError(const QString &text)
 
 QXmlStreamReader::TokenType XmlReader::readNextInternal()
 {
+    // Holding on to the attributes while reading would make QXmlStreamReader copy them:
+    m_attributes.clear();
     for (;;) {
         TokenType type = readNext();
         if (type == Comment || type == StartDocument)
@@ -104,8 +124,11 @@ QXmlStreamReader::TokenType XmlReader::readNextInternal()
         else if (type == Characters) {
             if (isWhitespace())
                 continue;
-        } else
+        } else {
+            if (type == StartElement)
+                m_attributes = attributes();
             return type;
+        }
     }
 }
 
@@ -7,6 +7,7 @@
 #define XMLREADER_H
 
 #include <QSharedPointer>
+#include <QStringView>
 #include <QXmlStreamReader>
 
 namespace DB
@@ -42,6 +43,22 @@ public:
     explicit XmlReader(DB::UIDelegate &ui, const QString &friendlyStreamName);
 
     QString attribute(const QString &name, const QString &defaultValue = QString());
+    /**
+     * @brief attributeView returns the value of an attribute of the current element without copying it.
+     * The view is only valid until the next element is read,
+     * so values that are stored must be converted to QString.
+     * @return the value, or a null view if the attribute does not exist
+     */
+    QStringView attributeView(const QString &name) const;
+    /**
+     * @brief intAttribute parses the value of an attribute as an integer, like QString::toInt().
+     * @return the value, or \p defaultValue if the attribute does not exist
+     */
+    int intAttribute(const QString &name, int defaultValue = 0) const;
+    /**
+     * @return all attributes of the current element
+     */
+    const QXmlStreamAttributes &elementAttributes() const;
     ElementInfo readNextStartOrStopElement(const QString &expectedStart);
     /**
      * Read the next element and ensure that it's an EndElement.
@@ -52,7 +69,7 @@ public:
      * @param readNextElement if set to false, don't read the next element.
      */
     void readEndElement(bool readNextElement = true);
-    bool hasAttribute(const QString &name);
+    bool hasAttribute(const QString &name) const;
     ElementInfo peekNext();
     [[noreturn]] void complainStartElementExpected(const QString &name);
     void setFileVersion(int version);
@@ -65,6 +82,8 @@ private:
 
     DB::UIDelegate &m_ui;
     ElementInfo m_peek;
+    /// The attributes of the current element.
+    QXmlStreamAttributes m_attributes;
     const QString m_streamName;
     int m_fileVersion;
 };
@@ -6,6 +6,7 @@
 #include "AndCategoryMatcher.h"
 
 #include <DB/ImageInfo.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 #include <utility>
@@ -19,6 +20,17 @@ bool DB::AndCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSet> &a
     return true;
 }
 
+DB::RoaringBitmap DB::AndCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    RoaringBitmap result = index.allImages();
+    for (const CategoryMatcher *subMatcher : std::as_const(mp_elements)) {
+        result &= subMatcher->evalAll(index, alreadyMatched);
+        if (result.isEmpty())
+            break;
+    }
+    return result;
+}
+
 void DB::AndCategoryMatcher::debug(int level) const
 {
     qCDebug(DBCategoryMatcherLog, "%sAND:", qPrintable(spaces(level)));
@@ -7,13 +7,20 @@
 #define CATEGORYMATCHER_H
 
 #include <DB/ImageInfoPtr.h>
+#include <DB/RoaringBitmap.h>
+#include <DB/TagDictionary.h>
 #include <kpabase/StringSet.h>
 
+#include <QHash>
 #include <QMap>
 
 namespace DB
 {
 class ImageInfo;
+class TagIndex;
+
+/// The matched tags of the set-based evaluation, as a sorted list of tag ids for each category id.
+using MatchedTags = QHash<TagId, TagIdList>;
 
 using Utilities::StringSet;
 
@@ -28,6 +35,9 @@ using Utilities::StringSet;
    however, is rather expensive, so this collection is only turned on in
    that case.
 
+   Alternatively, \ref evalAll computes the set of all matching images at once,
+   using the posting lists of the DB::TagIndex. Both evaluation modes must give the same result.
+
 */
 class CategoryMatcher
 {
@@ -37,6 +47,13 @@ public:
     virtual void debug(int level) const = 0;
 
     virtual bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) = 0;
+    /**
+     * @brief evalAll evaluates the matcher for all images in the tag index.
+     * @param index the tag index of the image database
+     * @param alreadyMatched collects the matched tags if setShouldCreateMatchedSet() was set
+     * @return the ordinals of all matching images
+     */
+    virtual RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const = 0;
     virtual void setShouldCreateMatchedSet(bool);
 
 protected:
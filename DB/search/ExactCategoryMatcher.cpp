@@ -5,10 +5,12 @@
 #include "ExactCategoryMatcher.h"
 
 #include <DB/ImageInfo.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 DB::ExactCategoryMatcher::ExactCategoryMatcher(const QString category)
     : m_category(category)
+    , m_categoryId(TagDictionary::instance().intern(category))
     , m_matcher(nullptr)
 {
 }
@@ -50,6 +52,30 @@ bool DB::ExactCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSet>
     return true;
 }
 
+DB::RoaringBitmap DB::ExactCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    Q_UNUSED(alreadyMatched);
+
+    if (!m_matcher)
+        return {};
+
+    MatchedTags matchedTags;
+    RoaringBitmap result = m_matcher->evalAll(index, matchedTags);
+
+    if (result.isEmpty())
+        return result;
+
+    // remove all images that have a tag in the category which was not contained in the matcher:
+    const TagIdList matchedIds = matchedTags.value(m_categoryId);
+    TagIdList otherIds;
+    for (const TagId tag : index.tagIds(m_categoryId)) {
+        if (!TagDictionary::containsSorted(matchedIds, tag))
+            otherIds.append(tag);
+    }
+    result -= index.postings(m_categoryId, otherIds);
+    return result;
+}
+
 void DB::ExactCategoryMatcher::debug(int level) const
 {
     qCDebug(DBCategoryMatcherLog, "%sEXACT:", qPrintable(spaces(level)));
@@ -33,12 +33,14 @@ public:
     ~ExactCategoryMatcher() override;
     void setMatcher(CategoryMatcher *subMatcher);
     bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) override;
+    RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const override;
     void debug(int level) const override;
     /// shouldCreateMatchedSet is _always_ set for the sub-matcher of ExactCategoryMatcher.
     void setShouldCreateMatchedSet(bool) override;
 
 private:
     const QString m_category;
+    const TagId m_categoryId;
     CategoryMatcher *m_matcher;
 };
 
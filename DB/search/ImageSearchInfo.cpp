@@ -25,6 +25,7 @@
 #include "WildcardCategoryMatcher.h"
 
 #include <DB/ImageDB.h>
+#include <DB/TagIndex.h>
 #include <ImageManager/RawImageDecoder.h>
 #include <kpabase/FileExtensions.h>
 #include <kpabase/Logging.h>
@@ -36,16 +37,11 @@
 #include <QApplication>
 #include <QRegularExpression>
 
-using namespace DB;
+#include <utility>
 
-static QAtomicInt s_matchGeneration;
-static int nextGeneration()
-{
-    return s_matchGeneration++;
-}
+using namespace DB;
 
 ImageSearchInfo::ImageSearchInfo()
-    : m_matchGeneration(nextGeneration())
 {
 }
 
@@ -55,7 +51,6 @@ ImageSearchInfo::ImageSearchInfo(const ImageDate &date,
     , m_label(label)
     , m_description(description)
     , m_isNull(false)
-    , m_matchGeneration(nextGeneration())
 {
 }
 
@@ -67,7 +62,6 @@ ImageSearchInfo::ImageSearchInfo(const ImageDate &date,
     , m_description(description)
     , m_fnPattern(fnPattern)
     , m_isNull(false)
-    , m_matchGeneration(nextGeneration())
 {
 }
 
@@ -107,38 +101,60 @@ bool ImageSearchInfo::isNull() const
     return m_isNull;
 }
 
-bool ImageSearchInfo::isCacheable() const
+bool ImageSearchInfo::match(ImageInfoPtr info) const
 {
-    return m_isCacheable;
+    if (m_isNull)
+        return true;
+
+    return doMatch(info, nullptr);
 }
 
-void ImageSearchInfo::setCacheable(bool cacheable)
+RoaringBitmap ImageSearchInfo::categoryMatches(const TagIndex &index) const
 {
-    m_isCacheable = cacheable;
+    if (!m_compiled.valid)
+        compile();
+
+    RoaringBitmap result = index.allImages();
+    MatchedTags alreadyMatched;
+    for (const CategoryMatcher *optionMatcher : std::as_const(m_compiled.categoryMatchers)) {
+        result &= optionMatcher->evalAll(index, alreadyMatched);
+        if (result.isEmpty())
+            break;
+    }
+    return result;
 }
 
-bool ImageSearchInfo::match(ImageInfoPtr info) const
+bool ImageSearchInfo::match(ImageInfoPtr info, const RoaringBitmap &categoryMatches) const
 {
     if (m_isNull)
         return true;
 
-    if (m_isCacheable && info->matchGeneration() == m_matchGeneration)
-        return info->isMatched();
-
-    bool ok = doMatch(info);
+    return doMatch(info, &categoryMatches);
+}
 
-    if (m_isCacheable) {
-        info->setMatchGeneration(m_matchGeneration);
-        info->setIsMatched(ok);
-    }
-    return ok;
+bool ImageSearchInfo::canMatchConcurrently() const
+{
+    if (m_isNull)
+        return true;
+    if (m_searchRAW)
+        return false;
+#ifdef HAVE_MARBLE
+    if (!m_regionSelection.isNull())
+        return false;
+#endif
+    return true;
 }
 
-bool ImageSearchInfo::doMatch(ImageInfoPtr info) const
+bool ImageSearchInfo::doMatch(ImageInfoPtr info, const RoaringBitmap *categoryMatches) const
 {
     if (!m_compiled.valid)
         compile();
 
+    // the pre-computed category match is the cheapest test, so do it first:
+    const bool useCategoryMatches = categoryMatches && info->ordinal() != 0;
+    if (useCategoryMatches && !categoryMatches->contains(info->ordinal()))
+        return false;
+
     // -------------------------------------------------- Rating
 
     // ok = ok && (_rating == -1 ) || ( _rating == info->rating() );
@@ -214,10 +230,12 @@ bool ImageSearchInfo::doMatch(ImageInfoPtr info) const
     // -------------------------------------------------- Options
     // alreadyMatched map is used to make it possible to search for
     // Jesper & None
-    QMap<QString, StringSet> alreadyMatched;
-    for (CategoryMatcher *optionMatcher : m_compiled.categoryMatchers) {
-        if (!optionMatcher->eval(info, alreadyMatched))
-            return false;
+    if (!useCategoryMatches) {
+        QMap<QString, StringSet> alreadyMatched;
+        for (CategoryMatcher *optionMatcher : m_compiled.categoryMatchers) {
+            if (!optionMatcher->eval(info, alreadyMatched))
+                return false;
+        }
     }
 
     // -------------------------------------------------- Text
@@ -262,7 +280,6 @@ void ImageSearchInfo::setCategoryMatchText(const QString &name, const QString &v
     }
     m_isNull = false;
     m_compiled.valid = false;
-    m_matchGeneration = nextGeneration();
 }
 
 void ImageSearchInfo::addAnd(const QString &category, const QString &value)
@@ -280,39 +297,33 @@ void ImageSearchInfo::addAnd(const QString &category, const QString &value)
     setCategoryMatchText(category, val);
     m_isNull = false;
     m_compiled.valid = false;
-    m_matchGeneration = nextGeneration();
 }
 
 void ImageSearchInfo::setRating(short rating)
 {
     m_rating = rating;
     m_isNull = false;
-    m_matchGeneration = nextGeneration();
     // compiled data is not affected
 }
 
 void ImageSearchInfo::setMegaPixel(short megapixel)
 {
     m_megapixel = megapixel;
-    m_matchGeneration = nextGeneration();
 }
 
 void ImageSearchInfo::setMaxMegaPixel(short max_megapixel)
 {
     m_max_megapixel = max_megapixel;
-    m_matchGeneration = nextGeneration();
 }
 
 void ImageSearchInfo::setSearchMode(int index)
 {
     m_ratingSearchMode = index;
-    m_matchGeneration = nextGeneration();
 }
 
 void ImageSearchInfo::setSearchRAW(bool searchRAW)
 {
     m_searchRAW = searchRAW;
-    m_matchGeneration = nextGeneration();
 }
 
 QString ImageSearchInfo::toString() const
@@ -581,7 +592,6 @@ QString ImageSearchInfo::freeformMatchText() const
 
 void ImageSearchInfo::setFreeformMatchText(const QString &freeformMatchText)
 {
-    setCacheable(false);
     QRegularExpression re { freeformMatchText, QRegularExpression::CaseInsensitiveOption };
     m_freeformMatcher.setRegularExpression(re);
     m_isNull = m_isNull && freeformMatchText.isEmpty();
@@ -601,7 +611,6 @@ void ImageSearchInfo::addExifSearchInfo(const Exif::SearchInfo info)
 {
     m_exifSearchInfo = info;
     m_isNull = false;
-    m_matchGeneration = nextGeneration();
 }
 
 void DB::ImageSearchInfo::renameCategory(const QString &oldName, const QString &newName)
@@ -609,7 +618,6 @@ void DB::ImageSearchInfo::renameCategory(const QString &oldName, const QString &
     m_categoryMatchText[newName] = m_categoryMatchText[oldName];
     m_categoryMatchText.remove(oldName);
     m_compiled.valid = false;
-    m_matchGeneration = nextGeneration();
 }
 
 #ifdef HAVE_MARBLE
@@ -624,7 +632,6 @@ void ImageSearchInfo::setRegionSelection(const Map::GeoCoordinates::LatLonBox &a
     if (!m_regionSelection.isNull()) {
         m_isNull = false;
     }
-    m_matchGeneration = nextGeneration();
     // compiled data is not affected
 }
 #endif
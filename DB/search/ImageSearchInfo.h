@@ -9,6 +9,7 @@
 
 #include <DB/ImageDate.h>
 #include <DB/ImageInfoPtr.h>
+#include <DB/RoaringBitmap.h>
 #include <DB/search/WildcardCategoryMatcher.h>
 #include <kpabase/StringSet.h>
 #include <kpabase/config-kpa-marble.h>
@@ -26,6 +27,7 @@ namespace DB
 class SimpleCategoryMatcher;
 class ImageInfo;
 class CategoryMatcher;
+class TagIndex;
 
 class ImageSearchInfo
 {
@@ -57,6 +59,27 @@ public:
     void checkIfNull();
     bool isNull() const;
     bool match(ImageInfoPtr) const;
+    /**
+     * @brief categoryMatches evaluates the category part of the search for all images at once.
+     * This is much faster than matching the categories image by image, but it does not cover any
+     * other search criteria (like date or rating).
+     * @param index the tag index of the image database
+     * @return the ordinals of all images matching the category part of the search
+     * @see match(ImageInfoPtr, const RoaringBitmap &)
+     */
+    RoaringBitmap categoryMatches(const TagIndex &index) const;
+    /**
+     * @brief match an image using the pre-computed result of categoryMatches().
+     * Images that are not part of the tag index are matched normally.
+     */
+    bool match(ImageInfoPtr, const RoaringBitmap &categoryMatches) const;
+    /**
+     * @brief canMatchConcurrently checks whether match() may be called from several threads at once.
+     * Matching has no side effects on the images, but some criteria load data lazily
+     * (i.e. RAW file detection and GPS region selection) and can only be matched from one thread.
+     * The search must have been compiled before, e.g. by calling categoryMatches().
+     */
+    bool canMatchConcurrently() const;
     QList<QList<SimpleCategoryMatcher *>> query() const;
 
     void addAnd(const QString &category, const QString &value);
@@ -84,12 +107,6 @@ public:
 
     void addExifSearchInfo(const Exif::SearchInfo info);
 
-    // By default, an ImageSearchInfo is cacheable, but only one search
-    // is cached per image.  For a search that's only going to be
-    // performed once, don't try to cache the result.
-    void setCacheable(bool cacheable);
-    bool isCacheable() const;
-
 #ifdef HAVE_MARBLE
     Map::GeoCoordinates::LatLonBox regionSelection() const;
     void setRegionSelection(const Map::GeoCoordinates::LatLonBox &actRegionSelection);
@@ -146,22 +163,11 @@ private:
     int m_ratingSearchMode = 0;
     bool m_searchRAW = false;
     bool m_isNull = true;
-    /**
-     * @brief If a search is cacheable, its match result is stored in the ImageInfo.
-     * Only one match result can be cached.
-     * The matchGeneration is increased whenever the search info is changed, preventing stale results.
-     */
-    bool m_isCacheable = true;
-    /**
-     * @brief m_matchGeneration is used to determine whether a cached match result is still valid.
-     * Remember to set it to nextGeneration() whenever the search info was changed and is cacheable!
-     */
-    int m_matchGeneration;
     mutable CompiledDataPrivate m_compiled;
 
     Exif::SearchInfo m_exifSearchInfo;
 
-    bool doMatch(ImageInfoPtr) const;
+    bool doMatch(ImageInfoPtr, const RoaringBitmap *categoryMatches) const;
 
 #ifdef HAVE_MARBLE
     Map::GeoCoordinates::LatLonBox m_regionSelection;
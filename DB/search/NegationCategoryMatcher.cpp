@@ -5,6 +5,7 @@
 #include "NegationCategoryMatcher.h"
 
 #include <DB/ImageInfo.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 DB::NegationCategoryMatcher::NegationCategoryMatcher(CategoryMatcher *child)
@@ -27,6 +28,11 @@ bool DB::NegationCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSe
     return !m_child->eval(info, alreadyMatched);
 }
 
+DB::RoaringBitmap DB::NegationCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    return index.allImages() - m_child->evalAll(index, alreadyMatched);
+}
+
 void DB::NegationCategoryMatcher::debug(int level) const
 {
     qCDebug(DBCategoryMatcherLog, "%sNOT:", qPrintable(spaces(level)));
@@ -22,6 +22,7 @@ public:
     explicit NegationCategoryMatcher(CategoryMatcher *child);
     ~NegationCategoryMatcher() override;
     bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) override;
+    RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const override;
     void debug(int level) const override;
     void setShouldCreateMatchedSet(bool b) override;
 
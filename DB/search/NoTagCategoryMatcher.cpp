@@ -5,10 +5,12 @@
 #include "NoTagCategoryMatcher.h"
 
 #include <DB/ImageInfo.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 DB::NoTagCategoryMatcher::NoTagCategoryMatcher(const QString &category)
     : m_category(category)
+    , m_categoryId(TagDictionary::instance().intern(category))
 {
 }
 
@@ -19,7 +21,13 @@ DB::NoTagCategoryMatcher::~NoTagCategoryMatcher()
 bool DB::NoTagCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSet> &alreadyMatched)
 {
     Q_UNUSED(alreadyMatched);
-    return info->itemsOfCategory(m_category).isEmpty();
+    return info->tagIds(m_categoryId).isEmpty();
+}
+
+DB::RoaringBitmap DB::NoTagCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    Q_UNUSED(alreadyMatched);
+    return index.allImages() - index.postingsForCategory(m_categoryId);
 }
 
 void DB::NoTagCategoryMatcher::debug(int level) const
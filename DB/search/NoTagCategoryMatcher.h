@@ -8,6 +8,8 @@
 
 #include "CategoryMatcher.h"
 
+#include <DB/TagDictionary.h>
+
 namespace DB
 {
 
@@ -20,10 +22,12 @@ public:
     explicit NoTagCategoryMatcher(const QString &category);
     ~NoTagCategoryMatcher() override;
     bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) override;
+    RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const override;
     void debug(int level) const override;
 
 private:
     const QString m_category;
+    const TagId m_categoryId;
 };
 
 }
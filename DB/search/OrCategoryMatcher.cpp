@@ -6,6 +6,7 @@
 #include "OrCategoryMatcher.h"
 
 #include <DB/ImageInfo.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 #include <utility>
@@ -19,6 +20,14 @@ bool DB::OrCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSet> &al
     return false;
 }
 
+DB::RoaringBitmap DB::OrCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    RoaringBitmap result;
+    for (const CategoryMatcher *subMatcher : std::as_const(mp_elements))
+        result |= subMatcher->evalAll(index, alreadyMatched);
+    return result;
+}
+
 void DB::OrCategoryMatcher::debug(int level) const
 {
     qCDebug(DBCategoryMatcherLog, "%sOR:", qPrintable(spaces(level)));
@@ -15,6 +15,7 @@ class OrCategoryMatcher : public ContainerCategoryMatcher
 {
 public:
     bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) override;
+    RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const override;
     void debug(int level) const override;
 };
 
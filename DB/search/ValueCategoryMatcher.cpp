@@ -7,6 +7,7 @@
 
 #include <DB/ImageDB.h>
 #include <DB/MemberMap.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 void DB::ValueCategoryMatcher::debug(int level) const
@@ -26,6 +27,13 @@ DB::ValueCategoryMatcher::ValueCategoryMatcher(const QString &category, const QS
     const MemberMap &map = DB::ImageDB::instance()->memberMap();
     const QStringList members = map.members(m_category, m_option, true);
     m_members = StringSet(members.begin(), members.end());
+
+    auto &dictionary = TagDictionary::instance();
+    m_categoryId = dictionary.intern(m_category);
+    m_optionId = dictionary.intern(m_option);
+    StringSet tags = m_members;
+    tags.insert(m_option);
+    m_tagIds = dictionary.intern(tags);
 }
 
 bool DB::ValueCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSet> &alreadyMatched)
@@ -35,13 +43,15 @@ bool DB::ValueCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSet>
     if (m_shouldPrepareMatchedSet)
         alreadyMatched[m_category].insert(m_option);
 
-    if (info->hasCategoryInfo(m_category, m_option)) {
-        return true;
-    }
+    return info->hasCategoryInfo(m_categoryId, m_tagIds);
+}
+
+DB::RoaringBitmap DB::ValueCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    if (m_shouldPrepareMatchedSet)
+        TagDictionary::insertSorted(alreadyMatched[m_categoryId], m_optionId);
 
-    if (info->hasCategoryInfo(m_category, m_members))
-        return true;
-    return false;
+    return index.postings(m_categoryId, m_tagIds);
 }
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
@@ -8,6 +8,8 @@
 
 #include "SimpleCategoryMatcher.h"
 
+#include <DB/TagDictionary.h>
+
 namespace DB
 {
 
@@ -16,10 +18,17 @@ class ValueCategoryMatcher : public SimpleCategoryMatcher
 public:
     ValueCategoryMatcher(const QString &category, const QString &value);
     bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) override;
+    RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const override;
     void debug(int level) const override;
 
     QString m_option;
     StringSet m_members;
+
+private:
+    TagId m_categoryId;
+    TagId m_optionId;
+    /// The interned m_option and m_members, sorted
+    TagIdList m_tagIds;
 };
 
 }
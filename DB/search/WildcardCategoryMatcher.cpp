@@ -6,6 +6,7 @@
 
 #include <DB/CategoryCollection.h>
 #include <DB/ImageDB.h>
+#include <DB/TagIndex.h>
 #include <kpabase/Logging.h>
 
 void DB::WildcardCategoryMatcher::debug(int level) const
@@ -39,6 +40,15 @@ bool DB::WildcardCategoryMatcher::eval(ImageInfoPtr info, QMap<QString, StringSe
     return eval(info);
 }
 
+DB::RoaringBitmap DB::WildcardCategoryMatcher::evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const
+{
+    Q_UNUSED(alreadyMatched)
+    RoaringBitmap result;
+    for (auto it = m_matchingTags.constKeyValueBegin(); it != m_matchingTags.constKeyValueEnd(); ++it)
+        result |= index.postings((*it).first, (*it).second);
+    return result;
+}
+
 bool DB::WildcardCategoryMatcher::eval(const DB::ImageInfoPtr info) const
 {
     for (auto it = m_matchingTags.constKeyValueBegin(); it != m_matchingTags.constKeyValueEnd(); ++it) {
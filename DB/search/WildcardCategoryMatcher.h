@@ -33,6 +33,7 @@ public:
      */
     void setRegularExpression(const QRegularExpression &re);
     bool eval(ImageInfoPtr, QMap<QString, StringSet> &alreadyMatched) override;
+    RoaringBitmap evalAll(const TagIndex &index, MatchedTags &alreadyMatched) const override;
     /**
      * @brief evaluate the matcher for an image
      * @param info
@@ -585,6 +585,8 @@ QString HTMLGenerator::Generator::createImage(const DB::FileName &fileName, int
         ImageManager::ImageRequest *request = new ImageManager::ImageRequest(fileName, QSize(size, size),
                                                                              info->angle(), this);
         request->setPriority(ImageManager::BatchTask);
+        // thumbnails can be taken from the thumbnail cache; the full images are always created from the original:
+        request->setUseThumbnailTiers(size == m_setup.thumbSize());
         ImageManager::AsyncLoader::instance()->load(request);
         m_generatedFiles.insert(qMakePair(fileName, size));
     }
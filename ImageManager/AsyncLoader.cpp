@@ -67,8 +67,9 @@ void ImageManager::AsyncLoader::init()
         desiredThreads = qMax(1, qMin(16, QThread::idealThreadCount() - 1));
     }
 
+    m_loadList = std::make_unique<RequestQueue>(desiredThreads);
     for (int i = 0; i < desiredThreads; ++i) {
-        ImageLoaderThread *imageLoader = new ImageLoaderThread();
+        ImageLoaderThread *imageLoader = new ImageLoaderThread(i);
         // The thread is set to the lowest priority to ensure that it doesn't starve the GUI thread.
         m_threadList << imageLoader;
         imageLoader->start(QThread::IdlePriority);
@@ -120,40 +121,20 @@ bool ImageManager::AsyncLoader::loadVideo(ImageRequest *request)
 
 void ImageManager::AsyncLoader::loadImage(ImageRequest *request)
 {
-    QMutexLocker dummy(&m_lock);
     if (m_exitRequested)
         return;
-    auto req = m_currentLoading.constFind(request);
-    if (req != m_currentLoading.cend() && m_loadList.isRequestStillValid(request)) {
-        // The last part of the test above is needed to not fail on a race condition from AnnotationDialog::ImagePreview, where the preview
-        // at startup request the same image numerous time (likely from resize event).
-        Q_ASSERT(*req != request);
+    if (m_loadList->isLoading(*request)) {
         delete request;
-
         return; // We are currently loading it, calm down and wait please ;-)
     }
 
-    // Try harder to find a pending request.  Unfortunately, we can't simply use
-    // m_currentLoading.contains() because that will compare pointers
-    // when we want to compare values.
-    for (req = m_currentLoading.cbegin(); req != m_currentLoading.cend(); req++) {
-        ImageRequest *r = *req;
-        if (*request == *r) {
-            delete request;
-            return; // We are currently loading it, calm down and wait please ;-)
-        }
-    }
-
-    // if request is "fresh" (not yet pending):
-    if (m_loadList.addRequest(request))
-        m_sleepers.wakeOne();
+    m_loadList->addRequest(request);
 }
 
 void ImageManager::AsyncLoader::stop(ImageClientInterface *client, StopAction action)
 {
-    // remove from pending map.
-    QMutexLocker requestLocker(&m_lock);
-    m_loadList.cancelRequests(client, action);
+    // cancel pending and currently loading requests.
+    m_loadList->cancelRequests(client, action);
 
     // PENDING(blackie) Reintroduce this
     // VideoManager::instance().stop( client, action );
@@ -163,8 +144,7 @@ void ImageManager::AsyncLoader::stop(ImageClientInterface *client, StopAction ac
 
 int ImageManager::AsyncLoader::activeCount() const
 {
-    QMutexLocker dummy(&m_lock);
-    return m_currentLoading.count();
+    return m_loadList->activeCount();
 }
 
 bool ImageManager::AsyncLoader::isExiting() const
@@ -172,13 +152,11 @@ bool ImageManager::AsyncLoader::isExiting() const
     return m_exitRequested;
 }
 
-ImageManager::ImageRequest *ImageManager::AsyncLoader::next()
+ImageManager::ImageRequest *ImageManager::AsyncLoader::next(int worker)
 {
-    QMutexLocker dummy(&m_lock);
     ImageRequest *request = nullptr;
-    while (!(request = m_loadList.popNext()))
-        m_sleepers.wait(&m_lock);
-    m_currentLoading.insert(request);
+    while (!(request = m_loadList->popNext(worker)))
+        m_loadList->waitForRequests();
 
     return request;
 }
@@ -187,7 +165,7 @@ void ImageManager::AsyncLoader::requestExit()
 {
     m_exitRequested = true;
     ImageManager::ThumbnailBuilder::instance()->cancelRequests();
-    m_sleepers.wakeAll();
+    m_loadList->wakeAll();
 
     // TODO(jzarl): check if we can just connect the finished() signal of the threads to deleteLater()
     //              and exit this function without waiting
@@ -210,11 +188,7 @@ void ImageManager::AsyncLoader::customEvent(QEvent *ev)
 
         ImageRequest *request = iev->loadInfo();
 
-        QMutexLocker requestLocker(&m_lock);
-        const bool requestStillNeeded = m_loadList.isRequestStillValid(request);
-        m_loadList.removeRequest(request);
-        m_currentLoading.remove(request);
-        requestLocker.unlock();
+        const bool requestStillNeeded = m_loadList->finishRequest(request);
 
         QImage image = iev->image();
         if (!request->loadedOK()) {
@@ -230,7 +204,8 @@ void ImageManager::AsyncLoader::customEvent(QEvent *ev)
             image = m_brokenImage;
         }
 
-        if (request->isThumbnailRequest())
+        // thumbnails that were loaded successfully have already been stored by the ImageLoaderThread:
+        if (request->isThumbnailRequest() && !request->loadedOK())
             MainWindow::Window::theMainWindow()->thumbnailCache()->insert(request->databaseFileName(), image);
 
         if (requestStillNeeded && request->client()) {
@@ -13,8 +13,9 @@
 
 #include <QImage>
 #include <QList>
-#include <QMutex>
-#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
 
 class QEvent;
 
@@ -52,20 +53,16 @@ private:
     friend class MainWindow::Window; // may call 'requestExit()'
     void init();
 
-    ImageRequest *next();
+    ImageRequest *next(int worker);
 
     void requestExit();
 
     static AsyncLoader *s_instance;
 
-    RequestQueue m_loadList;
-    QWaitCondition m_sleepers;
-    // m_lock protects m_loadList and m_currentLoading
-    mutable QMutex m_lock;
-    QSet<ImageRequest *> m_currentLoading;
+    std::unique_ptr<RequestQueue> m_loadList;
     QImage m_brokenImage;
     QList<ImageLoaderThread *> m_threadList;
-    bool m_exitRequested = false;
+    std::atomic<bool> m_exitRequested = false;
 };
 }
 
@@ -21,9 +21,13 @@
 #include "ImageEvent.h"
 #include "RawImageDecoder.h"
 
+#include <MainWindow/Window.h>
 #include <Utilities/FastJpeg.h>
+#include <kpabase/FileExtensions.h>
 #include <kpabase/ImageUtil.h>
 #include <kpabase/Logging.h>
+#include <kpabase/SettingsData.h>
+#include <kpaexif/Info.h>
 #include <kpathumbnails/ThumbnailCache.h>
 
 #include <QApplication>
@@ -36,8 +40,9 @@ namespace ImageManager
 RAWImageDecoder rawdecoder;
 }
 
-ImageManager::ImageLoaderThread::ImageLoaderThread(size_t bufsize)
-    : m_imageLoadBuffer(new char[bufsize])
+ImageManager::ImageLoaderThread::ImageLoaderThread(int worker, size_t bufsize)
+    : m_worker(worker)
+    , m_imageLoadBuffer(new char[bufsize])
     , m_bufSize(bufsize)
 {
 }
@@ -50,17 +55,29 @@ ImageManager::ImageLoaderThread::~ImageLoaderThread()
 void ImageManager::ImageLoaderThread::run()
 {
     while (true) {
-        ImageRequest *request = AsyncLoader::instance()->next();
+        ImageRequest *request = AsyncLoader::instance()->next(m_worker);
         Q_ASSERT(request);
         if (request->isExitRequest()) {
             return;
         }
-        bool ok;
-
-        QImage img = loadImage(request, ok);
+        bool ok = false;
+        QImage img;
+        if (request->useThumbnailTiers())
+            img = loadFromThumbnailTier(request, ok);
+        if (!ok && request->isThumbnailRequest())
+            img = loadFromEmbeddedPreview(request, ok);
+        if (!ok) {
+            img = loadImage(request, ok);
+            if (ok && request->useThumbnailTiers())
+                storeInThumbnailTiers(request, img);
+        }
 
         if (ok) {
             img = scaleAndRotate(request, img);
+            // Encoding and storing the thumbnail here keeps it off the GUI thread,
+            // and lets the ThumbnailCache write thumbnails from several loader threads in one go:
+            if (request->isThumbnailRequest())
+                MainWindow::Window::theMainWindow()->thumbnailCache()->insert(request->databaseFileName(), img);
         }
 
         request->setLoadedOK(ok);
@@ -105,6 +122,88 @@ QImage ImageManager::ImageLoaderThread::loadImage(ImageRequest *request, bool &o
     return img;
 }
 
+QImage ImageManager::ImageLoaderThread::loadFromThumbnailTier(ImageRequest *request, bool &ok)
+{
+    ok = false;
+    ThumbnailCache *thumbnailCache = MainWindow::Window::theMainWindow()->thumbnailCache();
+    const int size = calcLoadSize(request);
+    const int tierSize = thumbnailCache->tierFor(request->databaseFileName(), size);
+    // never scale up a thumbnail:
+    if (tierSize < size)
+        return QImage();
+
+    const ThumbnailData data = thumbnailCache->lookupData(request->databaseFileName(), tierSize);
+    QImage img = data.isNull() ? QImage() : QImage::fromData(data.view(), "JPG");
+    ok = !img.isNull();
+    if (!ok)
+        return img;
+
+    // thumbnails are stored with the rotation applied:
+    request->setImageIsPreRotated(true);
+
+    // The smaller tiers are filled lazily: if the best tier for the request is missing, fill it from the larger thumbnail.
+    const auto tierSizes = thumbnailCache->tierSizes();
+    for (const int smallerTierSize : tierSizes) {
+        if (smallerTierSize < size)
+            continue;
+        if (smallerTierSize < tierSize && smallerTierSize < thumbnailCache->thumbnailSize()) {
+            const bool fits = img.width() <= smallerTierSize && img.height() <= smallerTierSize;
+            thumbnailCache->insert(request->databaseFileName(),
+                                   fits ? img : img.scaled(smallerTierSize, smallerTierSize, Qt::KeepAspectRatio, Qt::SmoothTransformation),
+                                   smallerTierSize);
+        }
+        break;
+    }
+    return img;
+}
+
+QImage ImageManager::ImageLoaderThread::loadFromEmbeddedPreview(ImageRequest *request, bool &ok)
+{
+    ok = false;
+    const DB::FileName &fileName = request->fileSystemFileName();
+    if (!Settings::SettingsData::instance()->useRawThumbnail() || !KPABase::isUsableRawImage(fileName))
+        return QImage();
+
+    const int dim = calcLoadSize(request);
+    QByteArray previewData;
+    QString mimeType;
+    QSize fullSize;
+    if (!Exif::loadEmbeddedPreview(fileName, dim, &previewData, &mimeType, &fullSize))
+        return QImage();
+
+    QImage img;
+    if (mimeType == QLatin1String("image/jpeg")) {
+        QSize previewSize;
+        ok = Utilities::loadJPEG(&img, previewData, &previewSize, dim);
+    } else {
+        ok = img.loadFromData(previewData);
+    }
+    if (ok) {
+        qCDebug(ImageManagerLog) << "Using embedded preview of size" << img.size() << "as thumbnail for raw file" << fileName.relative();
+        request->setFullSize(fullSize.isValid() ? fullSize : img.size());
+    }
+    return img;
+}
+
+void ImageManager::ImageLoaderThread::storeInThumbnailTiers(ImageRequest *request, const QImage &img)
+{
+    ThumbnailCache *thumbnailCache = MainWindow::Window::theMainWindow()->thumbnailCache();
+    const int imageSize = qMax(img.width(), img.height());
+    const auto tierSizes = thumbnailCache->tierSizes();
+    for (const int tierSize : tierSizes) {
+        // the smaller tiers are filled from the regular thumbnails, see loadFromThumbnailTier():
+        if (tierSize <= thumbnailCache->thumbnailSize() || tierSize > imageSize || thumbnailCache->contains(request->databaseFileName(), tierSize))
+            continue;
+        QImage thumbnail = img.scaled(tierSize, tierSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        if (request->angle() != 0 && !request->imageIsPreRotated()) {
+            QTransform matrix;
+            matrix.rotate(request->angle());
+            thumbnail = thumbnail.transformed(matrix);
+        }
+        thumbnailCache->insert(request->databaseFileName(), thumbnail, tierSize);
+    }
+}
+
 int ImageManager::ImageLoaderThread::calcLoadSize(ImageRequest *request)
 {
     return qMax(request->width(), request->height());
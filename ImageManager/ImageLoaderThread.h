@@ -20,17 +20,37 @@ static const int maxJPEGMemorySize = (20 * 1024 * 1024);
 class ImageLoaderThread : public QThread
 {
 public:
-    ImageLoaderThread(size_t bufsize = maxJPEGMemorySize);
+    /**
+     * @param worker the index of the thread in the RequestQueue of the AsyncLoader
+     */
+    explicit ImageLoaderThread(int worker, size_t bufsize = maxJPEGMemorySize);
     ~ImageLoaderThread() override;
 
 protected:
     void run() override;
     QImage loadImage(ImageRequest *request, bool &ok);
+    /**
+     * @brief loadFromThumbnailTier loads the image from the smallest thumbnail size tier that is large enough for the request.
+     * The returned image is already rotated.
+     * If a smaller tier would suffice for the request but does not contain the thumbnail yet, it is filled from the returned image.
+     */
+    QImage loadFromThumbnailTier(ImageRequest *request, bool &ok);
+    /**
+     * @brief loadFromEmbeddedPreview loads the image from the smallest preview embedded in a raw file that is large enough for the request.
+     * This is a lot faster than decoding the raw file, and is only done if the user prefers embedded raw thumbnails.
+     */
+    QImage loadFromEmbeddedPreview(ImageRequest *request, bool &ok);
+    /**
+     * @brief storeInThumbnailTiers stores the image in the size tiers above the regular thumbnail size that it is large enough for.
+     * @param img the loaded, not yet rotated image
+     */
+    void storeInThumbnailTiers(ImageRequest *request, const QImage &img);
     static int calcLoadSize(ImageRequest *request);
     QImage scaleAndRotate(ImageRequest *request, QImage img);
     bool shouldImageBeScale(const QImage &img, ImageRequest *request);
 
 private:
+    const int m_worker;
     char *m_imageLoadBuffer;
     size_t m_bufSize;
 };
@@ -19,6 +19,7 @@ ImageManager::ImageRequest::ImageRequest(const DB::FileName &fileName,
     , m_dontUpScale(false)
     , m_isThumbnailRequest(false)
     , m_imageIsPreRotated(false)
+    , m_useThumbnailTiers(false)
 {
 }
 
@@ -33,6 +34,7 @@ ImageManager::ImageRequest::ImageRequest(RequestType type)
     , m_dontUpScale(false)
     , m_isThumbnailRequest(false)
     , m_imageIsPreRotated(false)
+    , m_useThumbnailTiers(false)
 {
     Q_ASSERT(type == RequestType::ExitRequest);
 }
@@ -52,6 +54,16 @@ void ImageManager::ImageRequest::setImageIsPreRotated(bool imageIsPreRotated)
     m_imageIsPreRotated = imageIsPreRotated;
 }
 
+bool ImageManager::ImageRequest::useThumbnailTiers() const
+{
+    return m_useThumbnailTiers;
+}
+
+void ImageManager::ImageRequest::setUseThumbnailTiers(bool useThumbnailTiers)
+{
+    m_useThumbnailTiers = useThumbnailTiers;
+}
+
 bool ImageManager::ImageRequest::loadedOK() const
 {
     return m_loadedOK;
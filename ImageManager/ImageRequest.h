@@ -90,6 +90,16 @@ public:
     bool imageIsPreRotated() const;
     void setImageIsPreRotated(bool imageIsPreRotated);
 
+    /**
+     * @brief useThumbnailTiers is set for requests that may be served from a size tier of the thumbnail cache.
+     * Such a request is loaded from the smallest tier that is at least as large as the requested size.
+     * If there is no such tier, the image is loaded from the file, and the larger tiers are filled on the way.
+     * Since the tiers are JPEG-compressed thumbnails, this is meant for thumbnail-like requests only.
+     * @return \c true, if the request may be served from the thumbnail cache
+     */
+    bool useThumbnailTiers() const;
+    void setUseThumbnailTiers(bool useThumbnailTiers);
+
 private:
     const RequestType m_type;
     DB::FileName m_fileName;
@@ -104,6 +114,7 @@ private:
     bool m_dontUpScale;
     bool m_isThumbnailRequest;
     bool m_imageIsPreRotated;
+    bool m_useThumbnailTiers;
 };
 
 inline uint qHash(const ImageRequest &ir)
@@ -9,98 +9,312 @@
 #include "CancelEvent.h"
 #include "ImageClientInterface.h"
 #include "ImageRequest.h"
+#include "StorageDevice.h"
 
 #include <QApplication>
 
+#include <algorithm>
+
+namespace
+{
+/**
+ * @brief isBulkPriority
+ * @return \c true for the priorities of requests that are scheduled by storage device
+ */
+bool isBulkPriority(int priority)
+{
+    return priority == ImageManager::BuildThumbnails || priority == ImageManager::BuildScopeThumbnails || priority == ImageManager::BatchTask;
+}
+}
+
+ImageManager::RequestQueue::RequestQueue(int workerCount)
+{
+    Q_ASSERT(workerCount > 0);
+    for (int i = 0; i < workerCount; ++i)
+        m_workers.push_back(std::make_unique<Worker>());
+}
+
 bool ImageManager::RequestQueue::addRequest(ImageRequest *request)
 {
     const ImageRequestReference ref(request);
-    if (m_uniquePending.contains(ref)) {
-        // We have this very same request already in the queue. Ignore this one.
-        delete request;
-        return false;
+    PendingShard &shard = pendingShard(*request);
+    QMutexLocker shardLocker(&shard.lock);
+    const auto pending = shard.requests.find(ref);
+    if (pending != shard.requests.end()) {
+        if (!isCancelled(pending->request, pending->sequence)) {
+            // We have this very same request already in the queue. Ignore this one.
+            delete request;
+            return false;
+        }
+        // The cancelled request stays queued until it is dropped, but it must not block the new one:
+        shard.requests.erase(pending);
     }
 
-    m_queues[request->priority()].enqueue(request);
-    m_uniquePending.insert(ref);
+    ++m_outstanding;
+    QueuedRequest entry { request, ++m_sequence };
+    shard.requests.insert(ref, entry);
+    shardLocker.unlock();
 
-    if (request->client())
-        m_activeRequests.insert(request);
+    const int priority = request->priority();
+    if (isBulkPriority(priority)) {
+        entry.device = deviceIndex(request);
+        QMutexLocker locker(&m_deviceLock);
+        ++m_queuedCount[priority];
+        m_devices[entry.device].lanes[priority].enqueue(entry);
+        updateDeviceRequestsAvailable();
+    } else {
+        // Count the request before it can be dequeued, so that the counters never become negative:
+        ++m_queuedCount[priority];
+        ++m_queuedTotal;
+        Worker &worker = *m_workers[m_nextWorker++ % m_workers.size()];
+        QMutexLocker locker(&worker.lock);
+        worker.lanes[priority].enqueue(entry);
+    }
 
+    wakeOne();
     return true;
 }
 
-ImageManager::ImageRequest *ImageManager::RequestQueue::popNext()
+ImageManager::ImageRequest *ImageManager::RequestQueue::popNext(int worker)
 {
-    QueueType::iterator it = m_queues.end(); // m_queues is initialized to non-zero size
-    do {
-        --it;
-        while (!it->empty()) {
-            ImageRequest *request = it->dequeue();
+    if (AsyncLoader::instance()->isExiting())
+        return new ImageRequest(ImageRequest::RequestType::ExitRequest);
 
-            if (!request->stillNeeded()) {
-                removeRequest(request);
+    for (int priority = LastPriority - 1; priority >= 0; --priority) {
+        while (m_queuedCount[priority] > 0) {
+            const QueuedRequest entry = isBulkPriority(priority) ? takeDeviceRequest(priority) : takeRequest(worker, priority);
+            ImageRequest *request = entry.request;
+            if (!request)
+                break;
+
+            if (isCancelled(request, entry.sequence)) {
+                removePending(entry);
+                releaseDevice(entry);
+                --m_outstanding;
+                delete request;
+            } else if (!request->stillNeeded()) {
+                removePending(entry);
+                releaseDevice(entry);
+                --m_outstanding;
                 request->setLoadedOK(false);
                 CancelEvent *event = new CancelEvent(request);
                 QApplication::postEvent(AsyncLoader::instance(), event);
             } else {
-                const ImageRequestReference ref(request);
-                m_uniquePending.remove(ref);
+                // Mark the request as loading before it stops being pending,
+                // so that an equal request is never accepted in between:
+                Worker &self = *m_workers[worker];
+                {
+                    QMutexLocker locker(&self.lock);
+                    self.loading.insert(request, entry);
+                }
+                removePending(entry);
                 return request;
             }
         }
-        if (AsyncLoader::instance()->isExiting())
-            return new ImageRequest(ImageRequest::RequestType::ExitRequest);
-    } while (it != m_queues.begin());
-
+    }
     return nullptr;
 }
 
+void ImageManager::RequestQueue::waitForRequests()
+{
+    QMutexLocker locker(&m_sleepLock);
+    // wakeOne() only takes m_sleepLock if a worker is sleeping. Announcing that before
+    // checking for requests ensures that either we see the new request, or we are woken up:
+    ++m_sleeping;
+    if (m_queuedTotal == 0 && !m_deviceRequestsAvailable && !AsyncLoader::instance()->isExiting())
+        m_sleepers.wait(&m_sleepLock);
+    --m_sleeping;
+}
+
+void ImageManager::RequestQueue::wakeAll()
+{
+    QMutexLocker locker(&m_sleepLock);
+    m_sleepers.wakeAll();
+}
+
 void ImageManager::RequestQueue::cancelRequests(ImageClientInterface *client, StopAction action)
 {
-    // remove from active map
-    for (auto it = m_activeRequests.begin(); it != m_activeRequests.end();) {
-        ImageRequest *request = *it;
-        ++it; // We need to increase it before removing the element.
-        if (client == request->client() && (action == StopAll || (request->priority() < ThumbnailVisible))) {
-            m_activeRequests.remove(request);
-            // active requests are not deleted - they might already have been
-            // popNext()ed and are being processed. They will be deleted
-            // in Manger::customEvent().
+    QWriteLocker locker(&m_tombstoneLock);
+    if (m_outstanding == 0) {
+        // There are no requests that a tombstone could apply to, and requests added
+        // from now on are not affected by the old tombstones anyway:
+        m_tombstones.clear();
+        return;
+    }
+
+    // Queued requests are dropped by popNext(); requests that are being loaded
+    // are not deleted - they will be deleted in AsyncLoader::customEvent().
+    const quint64 sequence = m_sequence;
+    Tombstone &tombstone = m_tombstones[client];
+    if (action == StopAll)
+        tombstone.stopAll = sequence;
+    else
+        tombstone.stopNonPriority = sequence;
+    m_lastStop = sequence;
+}
+
+bool ImageManager::RequestQueue::isLoading(const ImageRequest &request) const
+{
+    for (const auto &worker : m_workers) {
+        QMutexLocker locker(&worker->lock);
+        for (auto it = worker->loading.cbegin(); it != worker->loading.cend(); ++it) {
+            if (*it.key() == request && !isCancelled(it.key(), it->sequence))
+                return true;
         }
     }
+    return false;
+}
 
-    for (QueueType::iterator qit = m_queues.begin(); qit != m_queues.end(); ++qit) {
-        for (QQueue<ImageRequest *>::iterator it = qit->begin(); it != qit->end(); /* no increment here */) {
-            ImageRequest *request = *it;
-            if (request->client() == client && (action == StopAll || request->priority() < ThumbnailVisible)) {
-                it = qit->erase(it);
-                const ImageRequestReference ref(request);
-                m_uniquePending.remove(ref);
-                delete request;
-            } else {
-                ++it;
-            }
+bool ImageManager::RequestQueue::finishRequest(ImageRequest *request)
+{
+    for (const auto &worker : m_workers) {
+        QMutexLocker locker(&worker->lock);
+        const auto it = worker->loading.constFind(request);
+        if (it == worker->loading.cend())
+            continue;
+        const QueuedRequest entry = it.value();
+        worker->loading.erase(it);
+        locker.unlock();
+
+        releaseDevice(entry);
+        --m_outstanding;
+        return request->client() && !isCancelled(request, entry.sequence);
+    }
+    return false;
+}
+
+int ImageManager::RequestQueue::activeCount() const
+{
+    int count = 0;
+    for (const auto &worker : m_workers) {
+        QMutexLocker locker(&worker->lock);
+        count += worker->loading.size();
+    }
+    return count;
+}
+
+ImageManager::RequestQueue::PendingShard &ImageManager::RequestQueue::pendingShard(const ImageRequest &request)
+{
+    return m_uniquePending[qHash(request) % PENDING_SHARD_COUNT];
+}
+
+ImageManager::RequestQueue::QueuedRequest ImageManager::RequestQueue::takeRequest(int worker, int priority)
+{
+    // Start with the own queue, then try to steal from the other workers.
+    // Stolen requests are taken from the front as well, to keep the requests roughly in order:
+    const int workerCount = static_cast<int>(m_workers.size());
+    for (int i = 0; i < workerCount; ++i) {
+        Worker &victim = *m_workers[(worker + i) % workerCount];
+        QMutexLocker locker(&victim.lock);
+        auto &lane = victim.lanes[priority];
+        if (!lane.isEmpty()) {
+            --m_queuedCount[priority];
+            --m_queuedTotal;
+            return lane.dequeue();
+        }
+    }
+    return {};
+}
+
+ImageManager::RequestQueue::QueuedRequest ImageManager::RequestQueue::takeDeviceRequest(int priority)
+{
+    QMutexLocker locker(&m_deviceLock);
+    // Take turns between the devices, so that all of them are kept busy:
+    const int deviceCount = static_cast<int>(m_devices.size());
+    for (int i = 0; i < deviceCount; ++i) {
+        const int index = (m_nextDevice + i) % deviceCount;
+        DeviceQueue &device = m_devices[index];
+        auto &lane = device.lanes[priority];
+        if (!lane.isEmpty() && device.canLoad()) {
+            m_nextDevice = (index + 1) % deviceCount;
+            --m_queuedCount[priority];
+            ++device.loading;
+            const QueuedRequest entry = lane.dequeue();
+            updateDeviceRequestsAvailable();
+            return entry;
         }
     }
+    return {};
 }
 
-bool ImageManager::RequestQueue::isRequestStillValid(ImageRequest *request)
+int ImageManager::RequestQueue::deviceIndex(const ImageRequest *request)
 {
-    return m_activeRequests.contains(request);
+    // Determine the device before taking the lock, as this may need to access the file system:
+    const StorageDevice device = StorageDevice::forFile(request->fileSystemFileName());
+    QMutexLocker locker(&m_deviceLock);
+    const auto it = m_deviceIndex.constFind(device.id());
+    if (it != m_deviceIndex.cend())
+        return *it;
+
+    const int index = static_cast<int>(m_devices.size());
+    m_devices.emplace_back();
+    m_devices.back().maxLoading = device.maxConcurrentLoads();
+    m_deviceIndex.insert(device.id(), index);
+    return index;
 }
 
-void ImageManager::RequestQueue::removeRequest(ImageRequest *request)
+void ImageManager::RequestQueue::releaseDevice(const QueuedRequest &entry)
 {
-    const ImageRequestReference ref(request);
-    m_activeRequests.remove(request);
-    m_uniquePending.remove(ref);
+    if (entry.device < 0)
+        return;
+    {
+        QMutexLocker locker(&m_deviceLock);
+        --m_devices[entry.device].loading;
+        updateDeviceRequestsAvailable();
+    }
+    // a request that waited for the device may be loaded now:
+    wakeOne();
 }
 
-ImageManager::RequestQueue::RequestQueue()
+void ImageManager::RequestQueue::updateDeviceRequestsAvailable()
 {
-    for (int i = 0; i < LastPriority; ++i)
-        m_queues.append(QQueue<ImageRequest *>());
+    m_deviceRequestsAvailable = std::any_of(m_devices.cbegin(), m_devices.cend(), [](const DeviceQueue &device) {
+        return device.canLoad() && device.hasRequests();
+    });
+}
+
+void ImageManager::RequestQueue::wakeOne()
+{
+    if (m_sleeping > 0) {
+        QMutexLocker locker(&m_sleepLock);
+        m_sleepers.wakeOne();
+    }
+}
+
+void ImageManager::RequestQueue::removePending(const QueuedRequest &entry)
+{
+    const ImageRequestReference ref(entry.request);
+    PendingShard &shard = pendingShard(*entry.request);
+    QMutexLocker locker(&shard.lock);
+    const auto it = shard.requests.constFind(ref);
+    // an equal request may have replaced this one after it was cancelled:
+    if (it != shard.requests.cend() && it->request == entry.request)
+        shard.requests.erase(it);
+}
+
+bool ImageManager::RequestQueue::DeviceQueue::canLoad() const
+{
+    return maxLoading == 0 || loading < maxLoading;
+}
+
+bool ImageManager::RequestQueue::DeviceQueue::hasRequests() const
+{
+    return std::any_of(lanes.cbegin(), lanes.cend(), [](const auto &lane) {
+        return !lane.isEmpty();
+    });
+}
+
+bool ImageManager::RequestQueue::isCancelled(const ImageRequest *request, quint64 sequence) const
+{
+    // Nothing has been cancelled since the request was added:
+    if (sequence > m_lastStop)
+        return false;
+
+    QReadLocker locker(&m_tombstoneLock);
+    const auto tombstone = m_tombstones.constFind(request->client());
+    if (tombstone == m_tombstones.cend())
+        return false;
+    return sequence <= tombstone->stopAll || (request->priority() < ThumbnailVisible && sequence <= tombstone->stopNonPriority);
 }
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
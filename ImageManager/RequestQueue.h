@@ -8,35 +8,85 @@
 #include "ImageRequest.h"
 #include "enums.h"
 
+#include <QHash>
+#include <QMutex>
 #include <QQueue>
-#include <QSet>
+#include <QReadWriteLock>
+#include <QWaitCondition>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace ImageManager
 {
 class ImageClientInterface;
 
-// RequestQueue for ImageRequests. Non-synchronized, locking has to be
-// provided by the user.
+/**
+ * @brief The RequestQueue hands out ImageRequests to the image loader threads.
+ *
+ * Each loader thread ("worker") has a queue for each priority level.
+ * New requests are distributed among the workers; a worker that has no request of a given priority
+ * steals one from the other workers before it turns to requests of a lower priority.
+ * That way, the loader threads don't contend for a single lock, and requests are still
+ * loaded in the order of their priority.
+ *
+ * Bulk requests (building thumbnails, exporting, generating HTML pages) are not queued per worker,
+ * but per storage device. They are loaded in the order they were added, which should be the on-disk order
+ * (see DB::OptimizedFileList), and only as many of them are loaded at once from a device as it can handle
+ * without thrashing (see StorageDevice::maxConcurrentLoads()).
+ *
+ * Cancelling the requests of a client does not search the queues. Instead, a "tombstone" is recorded
+ * for the client, and the cancelled requests are dropped when a worker dequeues them.
+ *
+ * All methods are thread-safe.
+ */
 class RequestQueue
 {
 
 public:
-    RequestQueue();
+    explicit RequestQueue(int workerCount);
 
     // Add a new request to the input queue in the right priority level.
     // @return 'true', if this is not a request already pending.
     bool addRequest(ImageRequest *request);
 
-    // Return the next needed ImageRequest from the queue or nullptr if there
+    // Return the next needed ImageRequest for the given worker or nullptr if there
     // is none. The ownership is returned back to the caller so it has to
     // delete it.
-    ImageRequest *popNext();
+    ImageRequest *popNext(int worker);
+
+    /**
+     * @brief waitForRequests blocks the calling worker until there are requests in the queue.
+     * It returns immediately if there are requests or if the AsyncLoader is exiting.
+     */
+    void waitForRequests();
+    /**
+     * @brief wakeAll wakes up all workers that are waiting for requests.
+     */
+    void wakeAll();
 
-    // Remove all pending requests from the given client.
+    // Cancel all pending requests from the given client.
     void cancelRequests(ImageClientInterface *client, StopAction action);
 
-    bool isRequestStillValid(ImageRequest *request);
-    void removeRequest(ImageRequest *);
+    /**
+     * @brief isLoading
+     * @return \c true, if an equal request is currently being loaded and has not been cancelled.
+     */
+    bool isLoading(const ImageRequest &request) const;
+
+    /**
+     * @brief finishRequest removes a request returned by popNext() after it has been loaded.
+     * @return \c true, if the request has not been cancelled in the meantime.
+     */
+    bool finishRequest(ImageRequest *request);
+
+    /**
+     * @brief activeCount
+     * @return the number of requests that are currently being loaded.
+     */
+    int activeCount() const;
 
 private:
     // A Reference to a ImageRequest with value semantic.
@@ -72,12 +122,74 @@ private:
         const ImageRequest *m_ptr;
     };
 
-    typedef QList<QQueue<ImageRequest *>> QueueType;
+    struct QueuedRequest {
+        ImageRequest *request = nullptr;
+        /// The value of m_sequence when the request was added.
+        quint64 sequence = 0;
+        /// Index into m_devices for bulk requests, -1 otherwise.
+        int device = -1;
+    };
 
-    /** @short Priotized list of queues (= 1 priority queue) of image requests
-     * that are waiting for processing
+    struct Worker {
+        /// Protects lanes and loading.
+        mutable QMutex lock;
+        /// One queue per priority level.
+        std::array<QQueue<QueuedRequest>, LastPriority> lanes;
+        /// Requests returned by popNext() that have not been finished yet.
+        QHash<ImageRequest *, QueuedRequest> loading;
+    };
+
+    struct DeviceQueue {
+        /// One queue per priority level; only the bulk priorities are used.
+        std::array<QQueue<QueuedRequest>, LastPriority> lanes;
+        /// Number of requests from the device that are being loaded.
+        int loading = 0;
+        /// See StorageDevice::maxConcurrentLoads()
+        int maxLoading = 0;
+        bool canLoad() const;
+        bool hasRequests() const;
+    };
+
+    /**
+     * The set of unique pending requests is split into shards by the request hash,
+     * so that adding a request and dequeuing another one rarely take the same lock.
      */
-    QueueType m_queues;
+    struct PendingShard {
+        QMutex lock;
+        QHash<ImageRequestReference, QueuedRequest> requests;
+    };
+    static constexpr int PENDING_SHARD_COUNT = 16;
+
+    /**
+     * A tombstone cancels all requests of a client that were added up to the given sequence numbers.
+     */
+    struct Tombstone {
+        quint64 stopAll = 0;
+        quint64 stopNonPriority = 0;
+    };
+
+    PendingShard &pendingShard(const ImageRequest &request);
+    /**
+     * @brief takeRequest dequeues a request of the given priority, stealing it from another worker if necessary.
+     * @return the request, or an empty QueuedRequest if there is no request of that priority
+     */
+    QueuedRequest takeRequest(int worker, int priority);
+    /**
+     * @brief takeDeviceRequest dequeues a bulk request of the given priority from a device that has not reached its limit.
+     * @return the request, or an empty QueuedRequest if there is no such request
+     */
+    QueuedRequest takeDeviceRequest(int priority);
+    int deviceIndex(const ImageRequest *request);
+    /// Marks a bulk request as no longer being loaded.
+    void releaseDevice(const QueuedRequest &entry);
+    /// Must be called with m_deviceLock held.
+    void updateDeviceRequestsAvailable();
+    void wakeOne();
+    void removePending(const QueuedRequest &entry);
+    bool isCancelled(const ImageRequest *request, quint64 sequence) const;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<unsigned int> m_nextWorker { 0 };
 
     /**
      * Set of unique requests currently pending; used to discard the exact
@@ -86,10 +198,32 @@ private:
      * handled in different places in kpa but sometimes in a snakeoil
      * way (it compares pointers instead of the content -> clean up that).
      */
-    QSet<ImageRequestReference> m_uniquePending;
-
-    // All active requests that have a client
-    QSet<ImageRequest *> m_activeRequests;
+    std::array<PendingShard, PENDING_SHARD_COUNT> m_uniquePending;
+
+    QMutex m_deviceLock;
+    std::vector<DeviceQueue> m_devices;
+    QHash<quint64, int> m_deviceIndex;
+    int m_nextDevice = 0;
+    /// Whether a worker could take a bulk request from m_devices right now.
+    std::atomic<bool> m_deviceRequestsAvailable { false };
+
+    /// Number of queued requests per priority, including cancelled ones that have not been dropped yet.
+    std::array<std::atomic<int>, LastPriority> m_queuedCount;
+    /// Number of requests queued in the worker lanes.
+    std::atomic<int> m_queuedTotal { 0 };
+    /// Number of requests that have been added and are not finished or dropped yet.
+    std::atomic<int> m_outstanding { 0 };
+    /// Incremented for every added request.
+    std::atomic<quint64> m_sequence { 0 };
+    /// The highest sequence number covered by a tombstone.
+    std::atomic<quint64> m_lastStop { 0 };
+
+    mutable QReadWriteLock m_tombstoneLock;
+    QHash<ImageClientInterface *, Tombstone> m_tombstones;
+
+    QMutex m_sleepLock;
+    QWaitCondition m_sleepers;
+    std::atomic<int> m_sleeping { 0 };
 };
 
 }
@@ -0,0 +1,139 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "StorageDevice.h"
+
+#include <kpabase/Logging.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+
+extern "C" {
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+#endif
+}
+
+namespace
+{
+// A hard disk delivers the most data if it is not forced to seek between too many files:
+constexpr int MAX_ROTATIONAL_LOADS = 2;
+// Network file systems need some parallelism to hide the latency, but not so much that the server is swamped:
+constexpr int MAX_NETWORK_LOADS = 4;
+
+#ifdef __linux__
+// see statfs(2):
+constexpr long NFS_MAGIC = 0x6969;
+constexpr long SMB_MAGIC = 0x517B;
+constexpr long CIFS_MAGIC = 0xFF534D42;
+constexpr long SMB2_MAGIC = 0xFE534D42;
+
+bool isNetworkFileSystem(const QByteArray &path)
+{
+    struct statfs buf;
+    if (statfs(path.constData(), &buf) != 0)
+        return false;
+    const long type = static_cast<long>(buf.f_type);
+    return type == NFS_MAGIC || type == SMB_MAGIC || type == CIFS_MAGIC || type == SMB2_MAGIC;
+}
+
+/**
+ * @brief isRotational checks the "rotational" flag of the block device in sysfs.
+ * For a partition, the flag is found in the parent device.
+ * @return 1 for a rotational device, 0 for a non-rotational device, and -1 if the flag could not be read.
+ */
+int isRotational(dev_t device)
+{
+    const QString base = QStringLiteral("/sys/dev/block/%1:%2/").arg(major(device)).arg(minor(device));
+    for (const auto &candidate : { QStringLiteral("queue/rotational"), QStringLiteral("../queue/rotational") }) {
+        QFile file(base + candidate);
+        if (file.open(QIODevice::ReadOnly))
+            return file.readAll().trimmed() == "1" ? 1 : 0;
+    }
+    return -1;
+}
+#endif
+
+ImageManager::StorageDevice::Type deviceType(const QByteArray &path, dev_t device)
+{
+#ifdef __linux__
+    if (isNetworkFileSystem(path))
+        return ImageManager::StorageDevice::Type::Network;
+    switch (isRotational(device)) {
+    case 0:
+        return ImageManager::StorageDevice::Type::SolidState;
+    case 1:
+        return ImageManager::StorageDevice::Type::Rotational;
+    default:
+        return ImageManager::StorageDevice::Type::Unknown;
+    }
+#else
+    Q_UNUSED(path);
+    Q_UNUSED(device);
+    return ImageManager::StorageDevice::Type::Unknown;
+#endif
+}
+}
+
+ImageManager::StorageDevice ImageManager::StorageDevice::forFile(const DB::FileName &fileName)
+{
+    static QMutex lock;
+    static QHash<QString, StorageDevice> devicesByDirectory;
+    static QHash<quint64, Type> typesById;
+
+    const QString directory = QFileInfo(fileName.absolute()).absolutePath();
+    QMutexLocker locker(&lock);
+    const auto cached = devicesByDirectory.constFind(directory);
+    if (cached != devicesByDirectory.cend())
+        return *cached;
+
+    StorageDevice result;
+    const QByteArray path = QFile::encodeName(directory);
+    struct stat statbuf;
+    if (stat(path.constData(), &statbuf) == 0) {
+        result.m_id = static_cast<quint64>(statbuf.st_dev);
+        const auto type = typesById.constFind(result.m_id);
+        if (type != typesById.cend()) {
+            result.m_type = *type;
+        } else {
+            result.m_type = deviceType(path, statbuf.st_dev);
+            typesById.insert(result.m_id, result.m_type);
+            qCDebug(ImageManagerLog) << "Storage device of" << directory << "has type" << static_cast<int>(result.m_type)
+                                     << "- loading up to" << result.maxConcurrentLoads() << "images at once (0: no limit)";
+        }
+    }
+    devicesByDirectory.insert(directory, result);
+    return result;
+}
+
+quint64 ImageManager::StorageDevice::id() const
+{
+    return m_id;
+}
+
+ImageManager::StorageDevice::Type ImageManager::StorageDevice::type() const
+{
+    return m_type;
+}
+
+int ImageManager::StorageDevice::maxConcurrentLoads() const
+{
+    switch (m_type) {
+    case Type::Rotational:
+        return MAX_ROTATIONAL_LOADS;
+    case Type::Network:
+        return MAX_NETWORK_LOADS;
+    case Type::SolidState:
+    case Type::Unknown:
+        break;
+    }
+    return 0;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
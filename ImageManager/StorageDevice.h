@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IMAGEMANAGER_STORAGEDEVICE_H
+#define IMAGEMANAGER_STORAGEDEVICE_H
+
+#include <kpabase/FileName.h>
+
+#include <QtGlobal>
+
+namespace ImageManager
+{
+
+/**
+ * @brief The StorageDevice class describes the device that a file is stored on.
+ * It is used to schedule bulk image requests so that a slow device is not hit by too many concurrent reads.
+ */
+class StorageDevice
+{
+public:
+    enum class Type {
+        Unknown, ///< The device type could not be determined (e.g. on non-Linux systems).
+        SolidState, ///< A local, non-rotational device.
+        Rotational, ///< A local hard disk.
+        Network ///< A network file system, e.g. NFS or SMB.
+    };
+
+    /**
+     * @brief forFile returns the device that the file is stored on.
+     * The device is determined once per directory and cached, so that it is cheap to call this for every file.
+     * This method is thread-safe.
+     */
+    static StorageDevice forFile(const DB::FileName &fileName);
+
+    /**
+     * @brief id
+     * @return an identifier that is unique for each mounted file system.
+     */
+    quint64 id() const;
+    Type type() const;
+
+    /**
+     * @brief maxConcurrentLoads
+     * @return the number of images that should be loaded from the device at the same time, or 0 if there is no limit.
+     */
+    int maxConcurrentLoads() const;
+
+private:
+    quint64 m_id = 0;
+    Type m_type = Type::Unknown;
+};
+
+}
+
+#endif /* IMAGEMANAGER_STORAGEDEVICE_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
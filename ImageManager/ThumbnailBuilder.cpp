@@ -9,6 +9,7 @@
 #include "PreloadRequest.h"
 
 #include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
 #include <DB/ImageInfoPtr.h>
 #include <DB/OptimizedFileList.h>
 #include <MainWindow/StatusBar.h>
@@ -34,6 +35,18 @@ QSize preferredThumbnailSize()
     int width = Settings::SettingsData::instance()->thumbnailSize();
     return QSize(width, width);
 }
+
+/**
+ * @brief The content key for the thumbnail of an image.
+ * Video thumbnails are not content-addressed, because the user can choose the frame that is shown.
+ * @return the content key, or an empty string if the image has none.
+ */
+QString contentKey(const DB::ImageInfoPtr &info)
+{
+    if (info->isVideo() || info->MD5Sum().isNull())
+        return {};
+    return ImageManager::contentKeyFor(info->MD5Sum().toHexString(), info->angle());
+}
 }
 
 ImageManager::ThumbnailBuilder *ImageManager::ThumbnailBuilder::s_instance = nullptr;
@@ -157,6 +170,28 @@ void ImageManager::ThumbnailBuilder::buildOneThumbnail(const DB::ImageInfoPtr &i
     ImageManager::AsyncLoader::instance()->load(request);
 }
 
+void ImageManager::ThumbnailBuilder::updateContentKey(const DB::ImageInfoPtr &info)
+{
+    if (!Settings::SettingsData::instance()->contentAddressedThumbnails())
+        return;
+    m_thumbnailCache->setContentKey(info->fileName(), contentKey(info));
+}
+
+void ImageManager::ThumbnailBuilder::updateContentKeys()
+{
+    QHash<DB::FileName, QString> contentKeys;
+    if (Settings::SettingsData::instance()->contentAddressedThumbnails()) {
+        const auto images = DB::ImageDB::instance()->images();
+        contentKeys.reserve(images.size());
+        for (const auto &info : images) {
+            const QString key = contentKey(info);
+            if (!key.isEmpty())
+                contentKeys.insert(info->fileName(), key);
+        }
+    }
+    m_thumbnailCache->setContentKeys(contentKeys);
+}
+
 void ImageManager::ThumbnailBuilder::doThumbnailBuild()
 {
     m_isBuilding = true;
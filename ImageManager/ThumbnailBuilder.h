@@ -42,6 +42,13 @@ public:
     ~ThumbnailBuilder() override;
     void pixmapLoaded(ImageRequest *request, const QImage &image) override;
     void requestCanceled() override;
+    /**
+     * @brief updateContentKey sets the content key of the thumbnail for the given image.
+     * Call this whenever the checksum or the rotation of the image changes, or when it was renamed.
+     * If content-addressed thumbnails are disabled, this does nothing.
+     * @see ThumbnailCache::setContentKey()
+     */
+    void updateContentKey(const DB::ImageInfoPtr &info);
 
 public Q_SLOTS:
     void buildAll(ThumbnailBuildStart when = ImageManager::StartDelayed);
@@ -49,6 +56,11 @@ public Q_SLOTS:
     void cancelRequests();
     void scheduleThumbnailBuild(const DB::FileNameList &list, ThumbnailBuildStart when);
     void buildOneThumbnail(const DB::ImageInfoPtr &fileName);
+    /**
+     * @brief updateContentKeys sets the content keys of the thumbnails for all images in the database,
+     * or removes them if content-addressed thumbnails are disabled.
+     */
+    void updateContentKeys();
     void doThumbnailBuild();
     void save();
 
@@ -24,6 +24,7 @@
 
 #include <DB/ImageDB.h>
 #include <DB/ImageInfo.h>
+#include <DB/OptimizedFileList.h>
 #include <ImageManager/AsyncLoader.h>
 #include <ImageManager/RawImageDecoder.h>
 #include <kpabase/FileExtensions.h>
@@ -319,7 +320,9 @@ void Export::generateThumbnails(const DB::FileNameList &list)
     m_loopEntered = false;
     m_subdir = QLatin1String("Thumbnails/");
     m_filesRemaining = list.size(); // Used to break the event loop.
-    for (const DB::FileName &fileName : list) {
+    // request the images in on-disk order:
+    const DB::FileNameList files = DB::OptimizedFileList(list).optimizedDbFiles();
+    for (const DB::FileName &fileName : files) {
         const auto info = DB::ImageDB::instance()->info(fileName);
         ImageManager::ImageRequest *request = new ImageManager::ImageRequest(fileName, QSize(128, 128), info->angle(), this);
         request->setPriority(ImageManager::BatchTask);
@@ -341,7 +344,9 @@ void Export::copyImages(const DB::FileNameList &list)
     m_progressDialog->setLabelText(i18n("Copying image files"));
 
     m_filesRemaining = 0;
-    for (const DB::FileName &fileName : list) {
+    // copy and request the images in on-disk order:
+    const DB::FileNameList files = DB::OptimizedFileList(list).optimizedDbFiles();
+    for (const DB::FileName &fileName : files) {
         QString file = fileName.absolute();
         QString zippedName = m_filenameMapper.uniqNameFor(fileName);
 
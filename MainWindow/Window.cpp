@@ -280,7 +280,7 @@ void MainWindow::Window::delayedInit()
     splash->done();
     if (Options::the()->saveAndQuit()) {
         qCInfo(MainWindowLog) << "Saving the database and quitting...";
-        slotSave();
+        saveAndWait();
         close();
     }
     show();
@@ -312,6 +312,9 @@ bool MainWindow::Window::queryClose()
         return false;
     }
 
+    // A background save that is still running or that failed must be reflected by the dirty indicator:
+    DB::ImageDB::instance()->waitForSave();
+
     bool deleteDemoDB = false;
     if (Options::the()->demoMode() && !Options::the()->saveAndQuit()) {
         const QString question = i18n("<p><b>Delete Your Temporary Demo Database</b></p>"
@@ -332,7 +335,7 @@ bool MainWindow::Window::queryClose()
         else if (answer == KMessageBox::PrimaryAction) {
             deleteDemoDB = true;
         } else {
-            slotSave();
+            saveAndWait();
         }
     } else if (m_statusBar->mp_dirtyIndicator->isSaveDirty()) {
         const QString question = i18n("Do you want to save the changes?");
@@ -349,10 +352,10 @@ bool MainWindow::Window::queryClose()
             return false;
         }
         if (answer == REPLY_SAVE) {
-            slotSave();
+            saveAndWait();
         }
         if (answer == REPLY_DONTSAVE) {
-            QDir().remove(DB::ImageDB::instance()->autoSaveFileName());
+            DB::ImageDB::instance()->removeAutoSaveFiles();
         }
     }
 
@@ -536,13 +539,44 @@ void MainWindow::Window::createAnnotationDialog()
 }
 
 void MainWindow::Window::slotSave()
+{
+    DB::ImageDB *db = DB::ImageDB::instance();
+    // the running save doesn't contain the latest changes:
+    db->waitForSave();
+
+    m_statusBar->showMessage(i18n("Saving..."));
+    thumbnailCache()->save();
+    // changes made while the database is saved in the background mark it dirty again:
+    m_statusBar->mp_dirtyIndicator->saved();
+    const auto progressConnection = connect(db, &DB::ImageDB::saveProgress, this, [this](int value, int total) {
+        if (value == 0)
+            m_statusBar->startProgress(i18n("Saving"), total);
+        else
+            m_statusBar->setProgress(value);
+    });
+    connect(
+        db, &DB::ImageDB::saveFinished, this, [this, progressConnection](bool success) {
+            disconnect(progressConnection);
+            if (success) {
+                DB::ImageDB::instance()->removeAutoSaveFiles();
+                m_statusBar->showMessage(i18n("Saving... Done"), 5000);
+            } else {
+                DirtyIndicator::markDirty();
+                m_statusBar->showMessage(i18n("Saving... Failed"), 5000);
+            }
+        },
+        Qt::SingleShotConnection);
+    db->saveInBackground();
+}
+
+void MainWindow::Window::saveAndWait()
 {
     Utilities::ShowBusyCursor dummy;
     m_statusBar->showMessage(i18n("Saving..."), 5000);
     DB::ImageDB::instance()->save();
     thumbnailCache()->save();
     m_statusBar->mp_dirtyIndicator->saved();
-    QDir().remove(DB::ImageDB::instance()->autoSaveFileName());
+    DB::ImageDB::instance()->removeAutoSaveFiles();
     m_statusBar->showMessage(i18n("Saving... Done"), 5000);
 }
 
@@ -1112,6 +1146,9 @@ void MainWindow::Window::startAutoSaveTimer()
 
 void MainWindow::Window::slotAutoSave()
 {
+    // the changes are auto-saved once saving in the background has finished:
+    if (DB::ImageDB::instance()->isSaving())
+        return;
     if (m_statusBar->mp_dirtyIndicator->isAutoSaveDirty()) {
         Utilities::ShowBusyCursor dummy;
         m_statusBar->showMessage(i18n("Auto saving...."));
@@ -1243,6 +1280,9 @@ bool MainWindow::Window::load()
     // window size and position saving and restoring ...
 
     DB::ImageDB::setupXMLDB(configFile, *this);
+    // the restored changes are not saved to the database file yet:
+    if (DB::ImageDB::instance()->hasReplayedJournal())
+        DirtyIndicator::markDirty();
 
     // When a fresh demo is started, the EXIF database does not exist.  Create it so
     // eg. geolocation data is available.
@@ -1442,8 +1482,10 @@ void MainWindow::Window::rotateSelected(int angle)
                            i18n("No Selection"));
     } else {
         for (const DB::FileName &fileName : list) {
-            DB::ImageDB::instance()->info(fileName)->rotate(angle);
+            const auto info = DB::ImageDB::instance()->info(fileName);
+            info->rotate(angle);
             thumbnailCache()->removeThumbnail(fileName);
+            ImageManager::ThumbnailBuilder::instance()->updateContentKey(info);
         }
         m_statusBar->mp_dirtyIndicator->markDirty();
     }
@@ -1597,7 +1639,9 @@ void MainWindow::Window::slotImagesChanged(const QList<QUrl> &urls)
             thumbnailCache()->removeThumbnail(fileName);
             // update MD5sum:
             MD5 md5sum = MD5Sum(fileName);
-            DB::ImageDB::instance()->info(fileName)->setMD5Sum(md5sum, DB::ImageInfo::UpdateMetaData::All);
+            const auto info = DB::ImageDB::instance()->info(fileName);
+            info->setMD5Sum(md5sum, DB::ImageInfo::UpdateMetaData::All);
+            ImageManager::ThumbnailBuilder::instance()->updateContentKey(info);
         }
     }
     m_statusBar->mp_dirtyIndicator->markDirty();
@@ -1881,6 +1925,9 @@ void MainWindow::Window::executeStartupActions()
 {
     Q_ASSERT(m_thumbnailCache);
     new ImageManager::ThumbnailBuilder(m_statusBar, this, m_thumbnailCache);
+    ImageManager::ThumbnailBuilder::instance()->updateContentKeys();
+    connect(Settings::SettingsData::instance(), &Settings::SettingsData::contentAddressedThumbnailsChanged,
+            ImageManager::ThumbnailBuilder::instance(), &ImageManager::ThumbnailBuilder::updateContentKeys);
     if (!Settings::SettingsData::instance()->incrementalThumbnails())
         ImageManager::ThumbnailBuilder::instance()->buildMissing();
     connect(m_thumbnailCache, &ImageManager::ThumbnailCache::cacheInvalidated,
@@ -1935,6 +1982,8 @@ void MainWindow::Window::slotImageRotated(const DB::FileName &fileName)
     // An image has been rotated by the annotation dialog or the viewer.
     // We have to reload the respective thumbnail to get it in the right angle
     thumbnailCache()->removeThumbnail(fileName);
+    if (const auto info = DB::ImageDB::instance()->info(fileName))
+        ImageManager::ThumbnailBuilder::instance()->updateContentKey(info);
 }
 
 bool MainWindow::Window::dbIsDirty() const
@@ -141,6 +141,9 @@ public Q_SLOTS:
     void reloadThumbnails(ThumbnailView::SelectionUpdateMethod method = ThumbnailView::MaintainSelection);
     void runDemo();
     void slotImageRotated(const DB::FileName &fileName);
+    /**
+     * @brief slotSave saves the database in the background.
+     */
     void slotSave();
 
 protected Q_SLOTS:
@@ -238,6 +241,11 @@ protected:
     void checkIfVideoThumbnailerIsInstalled();
     bool anyVideosSelected() const;
     bool queryClose() override;
+    /**
+     * @brief saveAndWait saves the database in the foreground, e.g. before quitting.
+     * In contrast to slotSave(), this only returns when saving has finished.
+     */
+    void saveAndWait();
 
 private:
     static Window *s_instance;
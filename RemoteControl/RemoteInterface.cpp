@@ -198,6 +198,8 @@ void RemoteInterface::requestThumbnail(const ThumbnailRequest &command)
         }
         RemoteImageRequest *request
             = new RemoteImageRequest(fileName, size, angle, command.type, this);
+        // thumbnails don't need to be decoded from the original image if the thumbnail cache has a suitable one:
+        request->setUseThumbnailTiers(command.type == ViewType::Thumbnails);
 
         ImageManager::AsyncLoader::instance()->load(request);
     }
@@ -24,6 +24,10 @@ Settings::DatabaseBackendPage::DatabaseBackendPage(QWidget *parent)
     topLayout->addWidget(m_compressedIndexXML);
     connect(m_compressedIndexXML, &QCheckBox::clicked, this, &DatabaseBackendPage::markDirty);
 
+    // Binary snapshot of the XML database file.
+    m_databaseSnapshot = new QCheckBox(i18n("Keep a snapshot of the XML database file for faster startup"), this);
+    topLayout->addWidget(m_databaseSnapshot);
+
     m_compressBackup = new QCheckBox(i18n("Compress backup files"), this);
     topLayout->addWidget(m_compressBackup);
 
@@ -69,11 +73,19 @@ Settings::DatabaseBackendPage::DatabaseBackendPage(QWidget *parent)
                "a long time to read this file. You may cut down this time to approximately half, by checking this check box. "
                "The disadvantage is that the XML database file is less readable by human eyes.</p>");
     m_compressedIndexXML->setWhatsThis(txt);
+
+    txt = i18n("<p>When saving, KPhotoAlbum can additionally store the image information in a binary snapshot file next to "
+               "the XML database file (for example, index.xml.snapshot for a database file named index.xml). "
+               "Reading the snapshot is much faster than reading the XML database file.</p>"
+               "<p>The XML database file is still the authoritative copy of your data: if it was changed after the snapshot was written, "
+               "the snapshot is ignored.</p>");
+    m_databaseSnapshot->setWhatsThis(txt);
 }
 
 void Settings::DatabaseBackendPage::loadSettings(Settings::SettingsData *opt)
 {
     m_compressedIndexXML->setChecked(opt->useCompressedIndexXML());
+    m_databaseSnapshot->setChecked(opt->useDatabaseSnapshot());
     m_autosave->setValue(opt->autoSave());
     m_backupCount->setValue(opt->backupCount());
     m_compressBackup->setChecked(opt->compressBackup());
@@ -84,6 +96,7 @@ void Settings::DatabaseBackendPage::saveSettings(Settings::SettingsData *opt)
     opt->setBackupCount(m_backupCount->value());
     opt->setCompressBackup(m_compressBackup->isChecked());
     opt->setUseCompressedIndexXML(m_compressedIndexXML->isChecked());
+    opt->setUseDatabaseSnapshot(m_databaseSnapshot->isChecked());
     opt->setAutoSave(m_autosave->value());
 }
 
@@ -30,6 +30,7 @@ private:
     QSpinBox *m_backupCount;
     QCheckBox *m_compressBackup;
     QCheckBox *m_compressedIndexXML;
+    QCheckBox *m_databaseSnapshot;
 };
 
 }
@@ -47,6 +47,11 @@ Settings::ThumbnailsPage::ThumbnailsPage(QWidget *parent)
     m_incrementalThumbnails = new QCheckBox(i18n("Build thumbnails on demand"));
     lay->addWidget(m_incrementalThumbnails, row, 0, 1, 2);
 
+    // Content-addressed thumbnails
+    ++row;
+    m_contentAddressedThumbnails = new QCheckBox(i18n("Share thumbnails between identical images"));
+    lay->addWidget(m_contentAddressedThumbnails, row, 0, 1, 2);
+
     // Thumbnail aspect ratio
     ++row;
     QLabel *thumbnailAspectRatioLabel = new QLabel(i18n("Thumbnail table cells aspect ratio:"));
@@ -114,6 +119,12 @@ Settings::ThumbnailsPage::ThumbnailsPage(QWidget *parent)
                "for them and you won't have a delay later while browsing.</p>");
     m_incrementalThumbnails->setWhatsThis(txt);
 
+    txt = i18n("<p>If this is set, thumbnails are stored by the checksum of the image file instead of its file name. "
+               "Identical images share a single thumbnail, and images that are moved or renamed keep their thumbnail "
+               "instead of having it rebuilt.</p>"
+               "<p>This does not apply to videos.</p>");
+    m_contentAddressedThumbnails->setWhatsThis(txt);
+
     txt = i18n("<p>Choose what aspect ratio the cells holding thumbnails should have.</p>");
     m_thumbnailAspectRatio->setWhatsThis(txt);
 
@@ -154,6 +165,7 @@ void Settings::ThumbnailsPage::loadSettings(Settings::SettingsData *opt)
     connect(opt, &Settings::SettingsData::displayCategoriesChanged, m_displayCategories, &QCheckBox::setChecked);
     m_autoShowThumbnailView->setValue(opt->autoShowThumbnailView());
     m_incrementalThumbnails->setChecked(opt->incrementalThumbnails());
+    m_contentAddressedThumbnails->setChecked(opt->contentAddressedThumbnails());
 }
 
 void Settings::ThumbnailsPage::saveSettings(Settings::SettingsData *opt)
@@ -171,6 +183,7 @@ void Settings::ThumbnailsPage::saveSettings(Settings::SettingsData *opt)
     opt->setDisplayCategories(m_displayCategories->isChecked());
     opt->setAutoShowThumbnailView(m_autoShowThumbnailView->value());
     opt->setIncrementalThumbnails(m_incrementalThumbnails->isChecked());
+    opt->setContentAddressedThumbnails(m_contentAddressedThumbnails->isChecked());
 }
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
@@ -33,6 +33,7 @@ private:
     QCheckBox *m_displayCategories;
     QSpinBox *m_autoShowThumbnailView;
     QCheckBox *m_incrementalThumbnails;
+    QCheckBox *m_contentAddressedThumbnails;
 };
 
 }
@@ -29,17 +29,46 @@
 
 #include <KLocalizedString>
 #include <QElapsedTimer>
+#include <QFuture>
 #include <QIcon>
 #include <QLoggingCategory>
+#include <QSet>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <utility>
 
+namespace
+{
+// Memory budget for decoded thumbnails, in KiB:
+constexpr int PIXMAP_CACHE_BUDGET = 64 * 1024;
+
+int pixmapCost(const QPixmap &pixmap)
+{
+    return qMax(1, static_cast<int>(qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8 / 1024));
+}
+
+/**
+ * @brief loadThumbnail decodes the thumbnail from the smallest size tier that is large enough and scales it to the icon size.
+ * This function is thread-safe.
+ */
+QImage loadThumbnail(const ImageManager::ThumbnailCache *thumbnailCache, const DB::FileName &fileName, const QSize &iconSize)
+{
+    const int tierSize = thumbnailCache->tierFor(fileName, qMax(iconSize.width(), iconSize.height()));
+    if (tierSize == -1)
+        return {};
+    const ImageManager::ThumbnailData data = thumbnailCache->lookupData(fileName, tierSize);
+    const QImage image = data.isNull() ? QImage() : QImage::fromData(data.view(), "JPG");
+    return image.isNull() ? image : image.scaled(iconSize, Qt::KeepAspectRatio);
+}
+}
+
 ThumbnailView::ThumbnailModel::ThumbnailModel(ThumbnailFactory *factory, const ImageManager::ThumbnailCache *thumbnailCache)
     : ThumbnailComponent(factory)
     , m_sortDirection(Settings::SettingsData::instance()->showNewestThumbnailFirst() ? NewestFirst : OldestFirst)
     , m_firstVisibleRow(-1)
     , m_lastVisibleRow(-1)
     , m_thumbnailCache(thumbnailCache)
+    , m_pixmapCache(PIXMAP_CACHE_BUDGET)
 {
     connect(DB::ImageDB::instance(), SIGNAL(imagesDeleted(DB::FileNameList)), this, SLOT(imagesDeletedFromDB(DB::FileNameList)));
     m_ImagePlaceholder = QIcon::fromTheme(QLatin1String("image-x-generic")).pixmap(cellGeometryInfo()->preferredIconSize());
@@ -47,7 +76,11 @@ ThumbnailView::ThumbnailModel::ThumbnailModel(ThumbnailFactory *factory, const I
 
     m_filter.setSearchMode(0);
     connect(this, &ThumbnailModel::filterChanged, this, &ThumbnailModel::updateDisplayModel);
+    // the cached pixmap needs to be dropped before the cell is repainted:
+    connect(m_thumbnailCache, &ImageManager::ThumbnailCache::thumbnailUpdated, this, &ThumbnailModel::invalidatePixmap);
     connect(m_thumbnailCache, &ImageManager::ThumbnailCache::thumbnailUpdated, this, qOverload<const DB::FileName &>(&ThumbnailModel::updateCell));
+    connect(m_thumbnailCache, &ImageManager::ThumbnailCache::cacheInvalidated, this, &ThumbnailModel::invalidatePixmapCache);
+    connect(m_thumbnailCache, &ImageManager::ThumbnailCache::cacheFlushed, this, &ThumbnailModel::invalidatePixmapCache);
 }
 
 static bool stackOrderComparator(const DB::FileName &a, const DB::FileName &b)
@@ -97,9 +130,10 @@ void ThumbnailView::ThumbnailModel::updateDisplayModel()
      */
     m_displayList = DB::FileNameList();
     QSet<DB::StackID> alreadyShownStacks;
+    const DB::RoaringBitmap filterMatches = m_filter.isNull() ? DB::RoaringBitmap() : m_filter.categoryMatches(DB::ImageDB::instance()->tagIndex());
     for (const DB::FileName &fileName : std::as_const(m_imageList)) {
         const DB::ImageInfoPtr imageInfo = DB::ImageDB::instance()->info(fileName);
-        if (!m_filter.match(imageInfo))
+        if (!m_filter.match(imageInfo, filterMatches))
             continue;
         if (imageInfo && imageInfo->isStacked()) {
             DB::StackID stackid = imageInfo->stackId();
@@ -341,6 +375,7 @@ void ThumbnailView::ThumbnailModel::pixmapLoaded(ImageManager::ImageRequest *req
     if (fullSize.isValid() && imageInfo) {
         imageInfo->setSize(fullSize);
     }
+    invalidatePixmap(fileName);
 
     Q_EMIT dataChanged(fileNameToIndex(fileName), fileNameToIndex(fileName));
 }
@@ -437,8 +472,13 @@ QPixmap ThumbnailView::ThumbnailModel::pixmap(const DB::FileName &fileName) cons
         return QPixmap();
 
     if (m_thumbnailCache->contains(fileName)) {
+        syncPixmapCacheIconSize();
+        if (const QPixmap *cached = m_pixmapCache.object(fileName))
+            return *cached;
         // the cached thumbnail needs to be scaled to the actual thumbnail size:
-        return m_thumbnailCache->lookup(fileName).scaled(cellGeometryInfo()->preferredIconSize(), Qt::KeepAspectRatio);
+        const QPixmap scaled = QPixmap::fromImage(loadThumbnail(m_thumbnailCache, fileName, m_pixmapCacheIconSize));
+        cachePixmap(fileName, scaled);
+        return scaled;
     }
 
     const_cast<ThumbnailView::ThumbnailModel *>(this)->requestThumbnail(fileName, ImageManager::ThumbnailVisible);
@@ -478,6 +518,13 @@ void ThumbnailView::ThumbnailModel::updateVisibleRowInfo()
     // the cellGeometry has changed -> update placeholders
     m_ImagePlaceholder = QIcon::fromTheme(QLatin1String("image-x-generic")).pixmap(cellGeometryInfo()->preferredIconSize());
     m_VideoPlaceholder = QIcon::fromTheme(QLatin1String("video-x-generic")).pixmap(cellGeometryInfo()->preferredIconSize());
+
+    // decode the rows of the previous and the next page before they are scrolled into view:
+    if (m_firstVisibleRow >= 0) {
+        const int pageSize = m_lastVisibleRow - m_firstVisibleRow;
+        prefetchPixmaps(m_lastVisibleRow + 1, m_lastVisibleRow + pageSize);
+        prefetchPixmaps(m_firstVisibleRow - pageSize, m_firstVisibleRow - 1);
+    }
 }
 
 void ThumbnailView::ThumbnailModel::toggleFilter(bool enable)
@@ -566,6 +613,81 @@ void ThumbnailView::ThumbnailModel::preloadThumbnails()
     }
 }
 
+void ThumbnailView::ThumbnailModel::syncPixmapCacheIconSize() const
+{
+    const QSize iconSize = cellGeometryInfo()->preferredIconSize();
+    if (iconSize == m_pixmapCacheIconSize)
+        return;
+    m_pixmapCache.clear();
+    m_pendingPrefetches.clear();
+    m_pixmapCacheIconSize = iconSize;
+    ++m_pixmapCacheGeneration;
+}
+
+void ThumbnailView::ThumbnailModel::cachePixmap(const DB::FileName &fileName, const QPixmap &pixmap) const
+{
+    if (pixmap.isNull())
+        return;
+    m_pixmapCache.insert(fileName, new QPixmap(pixmap), pixmapCost(pixmap));
+}
+
+void ThumbnailView::ThumbnailModel::invalidatePixmap(const DB::FileName &fileName)
+{
+    m_pixmapCache.remove(fileName);
+    if (m_pendingPrefetches.contains(fileName)) {
+        // the prefetch may already have decoded the old thumbnail:
+        m_pendingPrefetches.clear();
+        ++m_pixmapCacheGeneration;
+    }
+}
+
+void ThumbnailView::ThumbnailModel::invalidatePixmapCache()
+{
+    m_pixmapCache.clear();
+    m_pendingPrefetches.clear();
+    ++m_pixmapCacheGeneration;
+}
+
+void ThumbnailView::ThumbnailModel::prefetchPixmaps(int firstRow, int lastRow)
+{
+    syncPixmapCacheIconSize();
+    DB::FileNameList fileNames;
+    for (int row = qMax(firstRow, 0); row <= qMin(lastRow, imageCount() - 1); ++row) {
+        const DB::FileName &fileName = m_displayList.at(row);
+        if (m_pixmapCache.contains(fileName) || m_pendingPrefetches.contains(fileName) || !m_thumbnailCache->contains(fileName))
+            continue;
+        fileNames.append(fileName);
+        m_pendingPrefetches.insert(fileName);
+    }
+    if (fileNames.isEmpty())
+        return;
+
+    // QPixmap can only be used in the GUI thread, so the worker only decodes and scales QImages:
+    const ImageManager::ThumbnailCache *thumbnailCache = m_thumbnailCache;
+    const QSize iconSize = m_pixmapCacheIconSize;
+    const int generation = m_pixmapCacheGeneration;
+    QtConcurrent::run([thumbnailCache, fileNames, iconSize] {
+        PrefetchedImages images;
+        images.reserve(fileNames.size());
+        for (const DB::FileName &fileName : fileNames)
+            images.append({ fileName, loadThumbnail(thumbnailCache, fileName, iconSize) });
+        return images;
+    }).then(this, [this, generation, iconSize](const PrefetchedImages &images) {
+        insertPrefetchedPixmaps(generation, iconSize, images);
+    });
+}
+
+void ThumbnailView::ThumbnailModel::insertPrefetchedPixmaps(int generation, const QSize &iconSize, const PrefetchedImages &images)
+{
+    if (generation != m_pixmapCacheGeneration || iconSize != m_pixmapCacheIconSize)
+        return;
+    for (const auto &[fileName, image] : images) {
+        m_pendingPrefetches.remove(fileName);
+        if (!m_pixmapCache.contains(fileName))
+            cachePixmap(fileName, QPixmap::fromImage(image));
+    }
+}
+
 // vi:expandtab:tabstop=4 shiftwidth=4:
 
 #include "moc_ThumbnailModel.cpp"
@@ -23,7 +23,12 @@
 #include <kpabase/FileNameList.h>
 
 #include <QAbstractListModel>
+#include <QCache>
+#include <QImage>
 #include <QPixmap>
+#include <QSet>
+
+#include <utility>
 
 namespace ImageManager
 {
@@ -167,6 +172,22 @@ private: // Methods
     void requestThumbnail(const DB::FileName &mediaId, const ImageManager::Priority priority);
     void preloadThumbnails();
 
+    using PrefetchedImages = QList<std::pair<DB::FileName, QImage>>;
+    /**
+     * @brief Clears the pixmap cache if the icon size has changed since the pixmaps were scaled.
+     */
+    void syncPixmapCacheIconSize() const;
+    void cachePixmap(const DB::FileName &fileName, const QPixmap &pixmap) const;
+    void invalidatePixmap(const DB::FileName &fileName);
+    void invalidatePixmapCache();
+    /**
+     * @brief Decodes and scales the cached thumbnails for the given rows in a worker thread.
+     * The results are added to the pixmap cache, so that the rows can be painted without
+     * decoding when they are scrolled into view.
+     */
+    void prefetchPixmaps(int firstRow, int lastRow);
+    void insertPrefetchedPixmaps(int generation, const QSize &iconSize, const PrefetchedImages &images);
+
 private Q_SLOTS:
     void imagesDeletedFromDB(const DB::FileNameList &);
 
@@ -226,6 +247,17 @@ private: // Instance variables.
     DB::ImageSearchInfo m_previousFilter;
 
     const ImageManager::ThumbnailCache *m_thumbnailCache;
+
+    /**
+     * Thumbnails that have been decoded and scaled to m_pixmapCacheIconSize.
+     * The cost of an entry is the size of the pixmap in KiB.
+     */
+    mutable QCache<DB::FileName, QPixmap> m_pixmapCache;
+    mutable QSize m_pixmapCacheIconSize;
+    /** Incremented whenever the pixmap cache is invalidated, so that outdated prefetch results can be discarded. */
+    mutable int m_pixmapCacheGeneration = 0;
+    /** Files for which a prefetch is currently running. */
+    mutable QSet<DB::FileName> m_pendingPrefetches;
 };
 
 }
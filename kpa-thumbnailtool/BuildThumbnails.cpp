@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "BuildThumbnails.h"
+
+#include <kpabase/FileExtensions.h>
+#include <kpabase/SettingsData.h>
+#include <kpathumbnails/ThumbnailCache.h>
+#include <kpathumbnails/ThumbnailPipeline.h>
+
+#include <KLocalizedString>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+#include <QXmlStreamReader>
+
+namespace
+{
+// print progress at most every 2 seconds:
+constexpr qint64 PROGRESS_INTERVAL_MS = 2000;
+
+ImageManager::ThumbnailPipeline::Configuration pipelineConfiguration(int threads, int thumbnailSize)
+{
+    // Decoding is by far the most expensive stage, so it gets most of the threads:
+    ImageManager::ThumbnailPipeline::Configuration configuration;
+    configuration.thumbnailSize = thumbnailSize;
+    configuration.scaleThreads = qMax(1, threads / 4);
+    configuration.storeThreads = qMax(1, threads / 4);
+    configuration.decodeThreads = qMax(1, threads - configuration.scaleThreads - configuration.storeThreads);
+    configuration.queueCapacity = 4 * threads;
+    return configuration;
+}
+
+/**
+ * @brief The content key for the thumbnail of an image.
+ * Like in KPhotoAlbum, videos and images without a checksum have none.
+ * @return the content key, or an empty string if the image has none.
+ */
+QString contentKey(const KPAThumbnailTool::ImageListEntry &image)
+{
+    if (KPABase::isVideo(image.fileName) || image.md5sum.isEmpty())
+        return {};
+    return ImageManager::contentKeyFor(image.md5sum, image.angle);
+}
+
+double perSecond(qint64 count, qint64 milliseconds)
+{
+    return count * 1000.0 / qMax<qint64>(1, milliseconds);
+}
+}
+
+bool KPAThumbnailTool::readImageList(const QString &indexFilename, QList<ImageListEntry> &images, QTextStream &err)
+{
+    QFile file { indexFilename };
+    if (!file.open(QIODevice::ReadOnly)) {
+        err << i18nc("@info:shell", "Could not open database file %1!\n", indexFilename);
+        return false;
+    }
+
+    QXmlStreamReader reader { &file };
+    if (!reader.readNextStartElement() || reader.name() != QLatin1String("KPhotoAlbum")) {
+        err << i18nc("@info:shell", "%1 is not a KPhotoAlbum database file!\n", indexFilename);
+        return false;
+    }
+    while (reader.readNextStartElement()) {
+        if (reader.name() != QLatin1String("images")) {
+            reader.skipCurrentElement();
+            continue;
+        }
+        while (reader.readNextStartElement()) {
+            if (reader.name() == QLatin1String("image")) {
+                const auto attributes = reader.attributes();
+                const auto fileName = attributes.value(QLatin1String("file"));
+                if (!fileName.isEmpty())
+                    images.append({ DB::FileName::fromRelativePath(fileName.toString()),
+                                    attributes.value(QLatin1String("angle")).toInt(),
+                                    attributes.value(QLatin1String("md5sum")).toString() });
+            }
+            reader.skipCurrentElement();
+        }
+        // the images are all we need:
+        break;
+    }
+    if (reader.hasError()) {
+        err << i18nc("@info:shell", "Error reading database file %1: %2\n", indexFilename, reader.errorString());
+        return false;
+    }
+    return true;
+}
+
+int KPAThumbnailTool::buildThumbnails(ImageManager::ThumbnailCache &cache, const QString &indexFilename, BuildMode mode, int threads, QTextStream *console, QTextStream &err)
+{
+    QList<ImageListEntry> images;
+    if (!readImageList(indexFilename, images, err))
+        return 1;
+
+    if (mode == BuildMode::Rebuild)
+        cache.flush();
+
+    if (Settings::SettingsData::instance()->contentAddressedThumbnails()) {
+        // without the content keys, contains() would not find thumbnails that are stored by content key:
+        QHash<DB::FileName, QString> contentKeys;
+        contentKeys.reserve(images.size());
+        for (const auto &image : std::as_const(images)) {
+            const QString key = contentKey(image);
+            if (!key.isEmpty())
+                contentKeys.insert(image.fileName, key);
+        }
+        cache.setContentKeys(contentKeys);
+    }
+
+    QList<ImageListEntry> toBuild;
+    int skipped = 0;
+    int missing = 0;
+    for (const auto &image : std::as_const(images)) {
+        if (KPABase::isVideo(image.fileName) || KPABase::isUsableRawImage(image.fileName)) {
+            ++skipped;
+        } else if (!QFileInfo::exists(image.fileName.absolute())) {
+            ++missing;
+        } else if (!cache.contains(image.fileName)) {
+            toBuild.append(image);
+        }
+    }
+    if (console) {
+        *console << i18nc("@info:shell", "Images in database: %1\n", images.size());
+        *console << i18nc("@info:shell", "Videos and raw images (skipped): %1\n", skipped);
+        *console << i18nc("@info:shell", "Missing image files: %1\n", missing);
+        *console << i18nc("@info:shell", "Thumbnails to build: %1\n", toBuild.size());
+        console->flush();
+    }
+    if (toBuild.isEmpty())
+        return 0;
+
+    ImageManager::ThumbnailPipeline pipeline { &cache, pipelineConfiguration(threads, cache.thumbnailSize()) };
+    QElapsedTimer progressTimer;
+    progressTimer.start();
+    for (const auto &image : std::as_const(toBuild)) {
+        pipeline.add(image.fileName, image.angle);
+        if (console && progressTimer.elapsed() >= PROGRESS_INTERVAL_MS) {
+            progressTimer.restart();
+            const qint64 done = pipeline.statistics().constLast().items;
+            *console << i18nc("@info:shell", "Built %1 of %2 thumbnails (%3 thumbnails per second)\n",
+                              done, toBuild.size(), QString::number(perSecond(done, pipeline.elapsedMilliseconds()), 'f', 1));
+            console->flush();
+        }
+    }
+    pipeline.finish();
+    cache.save();
+    pipeline.logStatistics();
+
+    const int failed = pipeline.failedCount();
+    if (console) {
+        *console << i18nc("@info:shell", "Built %1 thumbnails in %2 seconds (%3 thumbnails per second).\n",
+                          toBuild.size() - failed, QString::number(pipeline.elapsedMilliseconds() / 1000.0, 'f', 1),
+                          QString::number(perSecond(toBuild.size(), pipeline.elapsedMilliseconds()), 'f', 1));
+        const auto stages = pipeline.statistics();
+        for (const auto &stage : stages) {
+            *console << i18nc("@info:shell %1 is the name of a processing stage, e.g. 'decode'", "  Stage %1: %2 threads, %3 images per second\n",
+                              stage.name, stage.threads, QString::number(stage.throughput(), 'f', 1));
+        }
+        console->flush();
+    }
+    if (failed > 0) {
+        err << i18ncp("@info:shell", "Could not build 1 thumbnail.\n", "Could not build %1 thumbnails.\n", failed);
+        return 1;
+    }
+    return 0;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
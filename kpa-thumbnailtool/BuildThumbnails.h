@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPA_THUMBNAILTOOL_BUILDTHUMBNAILS_H
+#define KPA_THUMBNAILTOOL_BUILDTHUMBNAILS_H
+
+#include <kpabase/FileName.h>
+
+#include <QList>
+#include <QString>
+
+class QTextStream;
+
+namespace ImageManager
+{
+class ThumbnailCache;
+}
+
+namespace KPAThumbnailTool
+{
+struct ImageListEntry {
+    DB::FileName fileName;
+    int angle = 0;
+    QString md5sum; ///< the checksum as hex string, or an empty string if the database has none
+};
+
+/**
+ * @brief Read the list of images from a KPhotoAlbum database file (index.xml).
+ * Only the file name, checksum and rotation angle of each image are read; everything else is skipped.
+ *
+ * This function does not use the database code of KPhotoAlbum, so that the thumbnail tool
+ * does not need to load the complete database.
+ *
+ * @param indexFilename the database file
+ * @param images the images in the database
+ * @param err a stream for error messages
+ * @return \c true on success, \c false if the file could not be read.
+ */
+bool readImageList(const QString &indexFilename, QList<ImageListEntry> &images, QTextStream &err);
+
+enum class BuildMode {
+    BuildMissing, ///< Only build thumbnails for images that don't have one yet.
+    Rebuild ///< Flush the thumbnail cache and build all thumbnails.
+};
+
+/**
+ * @brief Build thumbnails for the images in a KPhotoAlbum database file, using all available cores.
+ *
+ * Thumbnails for videos and raw images are not built - KPhotoAlbum creates them when it needs them.
+ * If content-addressed thumbnails are enabled, the content keys of the thumbnail cache are set
+ * from the checksums in the database file before checking for missing thumbnails.
+ *
+ * @param cache the thumbnail cache
+ * @param indexFilename the database file
+ * @param mode
+ * @param threads the number of threads to use
+ * @param console a stream for progress information, or \c nullptr to be quiet
+ * @param err a stream for error messages
+ * @return 0 on success, 1 if the database could not be read or if thumbnails could not be built for some images.
+ */
+int buildThumbnails(ImageManager::ThumbnailCache &cache, const QString &indexFilename, BuildMode mode, int threads, QTextStream *console, QTextStream &err);
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -3,6 +3,7 @@
 //
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include "BuildThumbnails.h"
 #include "Logging.h"
 #include "ThumbnailCacheConverter.h"
 
@@ -22,6 +23,7 @@
 #include <QLocale>
 #include <QLoggingCategory>
 #include <QTextStream>
+#include <QThread>
 #include <QTimer>
 
 using namespace KPAThumbnailTool;
@@ -43,7 +45,7 @@ int main(int argc, char **argv)
         QStringLiteral("kpa-thumbnailtool"), // component name
         i18n("KPhotoAlbum Thumbnail Tool"), // display name
         QStringLiteral(KPA_VERSION),
-        i18n("Tool for inspecting and editing the KPhotoAlbum thumbnail cache"), // short description
+        i18n("Tool for inspecting, editing and building the KPhotoAlbum thumbnail cache"), // short description
         KAboutLicense::GPL,
         i18n("Copyright (C) 2020-2025 The KPhotoAlbum Development Team"), // copyright statement
         QString(), // other text
@@ -78,6 +80,15 @@ int main(int argc, char **argv)
     parser.addOption(fixOption);
     QCommandLineOption vacuumOption { QString::fromUtf8("vacuum"), i18nc("@info:shell", "Remove unreferenced thumbnails from the thumbnail data files.") };
     parser.addOption(vacuumOption);
+    QCommandLineOption buildMissingOption { QString::fromUtf8("build-missing"), i18nc("@info:shell", "Build thumbnails for all images in the database (index.xml) that don't have one yet.") };
+    parser.addOption(buildMissingOption);
+    QCommandLineOption rebuildOption { QString::fromUtf8("rebuild"), i18nc("@info:shell", "Remove all thumbnails and build them anew for all images in the database (index.xml).") };
+    parser.addOption(rebuildOption);
+    QCommandLineOption threadsOption { QString::fromUtf8("threads"),
+                                       i18nc("@info:shell", "Number of threads used to build thumbnails (default: number of processor cores)."),
+                                       i18nc("@info:shell Value name for the --threads option", "number"),
+                                       QString::number(QThread::idealThreadCount()) };
+    parser.addOption(threadsOption);
     QCommandLineOption quietOption { QString::fromUtf8("quiet"), i18nc("@info:shell", "Be less verbose.") };
     parser.addOption(quietOption);
 
@@ -91,6 +102,9 @@ int main(int argc, char **argv)
 
     checkConflictingOptions(parser, convertV5ToV4Option, infoOption, err);
     checkConflictingOptions(parser, convertV5ToV4Option, verifyOption, err);
+    checkConflictingOptions(parser, convertV5ToV4Option, buildMissingOption, err);
+    checkConflictingOptions(parser, convertV5ToV4Option, rebuildOption, err);
+    checkConflictingOptions(parser, buildMissingOption, rebuildOption, err);
 
     const auto args = parser.positionalArguments();
     if (args.empty()) {
@@ -117,6 +131,10 @@ int main(int argc, char **argv)
         console << i18nc("@info:shell", "Thumbnail index file version: %1\n", cache.actualFileVersion());
         console << i18nc("@info:shell", "Maximum supported thumbnailindex file version: %1\n", cache.preferredFileVersion());
         console << i18nc("@info:shell", "Thumbnail storage dimensions: %1 pixels\n", cache.thumbnailSize());
+        QStringList tierSizes;
+        for (const int tierSize : cache.tierSizes())
+            tierSizes.append(QString::number(tierSize));
+        console << i18nc("@info:shell", "Thumbnail size tiers: %1 pixels\n", tierSizes.join(QStringLiteral(", ")));
         if (cache.actualFileVersion() < 5 && !parser.isSet(quietOption)) {
             console << i18nc("@info:shell", "Note: Thumbnail storage dimensions are defined in the configuration file prior to v5.\n");
         }
@@ -145,6 +163,18 @@ int main(int argc, char **argv)
         }
         console.flush();
     }
+    if (parser.isSet(buildMissingOption) || parser.isSet(rebuildOption)) {
+        bool threadsOk = false;
+        const int threads = parser.value(threadsOption).toInt(&threadsOk);
+        if (!threadsOk || threads < 1) {
+            err << i18nc("@info:shell", "Invalid number of threads: %1\n", parser.value(threadsOption));
+            return 1;
+        }
+        const auto mode = parser.isSet(rebuildOption) ? BuildMode::Rebuild : BuildMode::BuildMissing;
+        const auto indexFile = imageDir.absoluteFilePath(QString::fromUtf8("index.xml"));
+        if (buildThumbnails(cache, indexFile, mode, threads, parser.isSet(quietOption) ? nullptr : &console, err) != 0)
+            returnValue = 1;
+    }
     if (parser.isSet(vacuumOption)) {
         cache.vacuum();
     }
@@ -178,8 +178,9 @@ bool KPABase::isVideo(const DB::FileName &fileName)
 
 const QSet<QString> &KPABase::videoExtensions()
 {
-    static QSet<QString> videoExtensions;
-    if (videoExtensions.empty()) {
+    // initializing a static variable is thread-safe, so the extensions can be looked up from any thread:
+    static const QSet<QString> videoExtensions = [] {
+        QSet<QString> videoExtensions;
         videoExtensions.insert(QString::fromLatin1("3g2"));
         videoExtensions.insert(QString::fromLatin1("3gp"));
         videoExtensions.insert(QString::fromLatin1("asf"));
@@ -209,7 +210,8 @@ const QSet<QString> &KPABase::videoExtensions()
         videoExtensions.insert(QString::fromLatin1("wmp"));
         videoExtensions.insert(QString::fromLatin1("wmv"));
         qCInfo(BaseLog) << "Recognized video file suffixes:" << videoExtensions;
-    }
+        return videoExtensions;
+    }();
     return videoExtensions;
 }
 // vi:expandtab:tabstop=4 shiftwidth=4:
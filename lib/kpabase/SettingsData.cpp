@@ -174,6 +174,7 @@ property_copy(skipRawIfOtherMatches, setSkipRawIfOtherMatches, bool, General, fa
 property_copy(useRawThumbnail, setUseRawThumbnail, bool, General, true)
 property_copy(useRawThumbnailSize, setUseRawThumbnailSize, QSize, General, QSize(1024, 768))
 property_copy(useCompressedIndexXML, setUseCompressedIndexXML, bool, General, true)
+property_copy(useDatabaseSnapshot, setUseDatabaseSnapshot, bool, General, true)
 property_copy(compressBackup, setCompressBackup, bool, General, true)
 property_copy(showSplashScreen, setShowSplashScreen, bool, General, true)
 property_copy(showHistogram, setShowHistogram, bool, General, true)
@@ -319,6 +320,8 @@ property_copy(minimumThumbnailSize, setMinimumThumbnailSize, int, Thumbnails, 32
 property_copy(maximumThumbnailSize, setMaximumThumbnailSize, int, Thumbnails, 4096)
 property_enum(thumbnailAspectRatio, setThumbnailAspectRatio, ThumbnailAspectRatio, Thumbnails, Aspect_3_2)
 property_copy(incrementalThumbnails, setIncrementalThumbnails, bool, Thumbnails, true)
+//property_copy(contentAddressedThumbnails, setContentAddressedThumbnails, bool, Thumbnails, false)
+getValueFunc(bool, contentAddressedThumbnails, Thumbnails, false)
 
 // database specific so that changing it doesn't invalidate the thumbnail cache for other databases:
 getValueFunc_(int, thumbnailSize, groupForDatabase("Thumbnails"), "thumbSize", 256)
@@ -334,6 +337,14 @@ getValueFunc_(int, thumbnailSize, groupForDatabase("Thumbnails"), "thumbSize", 2
     setValue(groupForDatabase("Thumbnails"), "thumbSize", value);
 }
 
+void SettingsData::setContentAddressedThumbnails(bool value)
+{
+    const bool changed = value != contentAddressedThumbnails();
+    setValue("Thumbnails"_L1, "contentAddressedThumbnails", value);
+    if (changed)
+        Q_EMIT contentAddressedThumbnailsChanged(value);
+}
+
 int SettingsData::actualThumbnailSize() const
 {
     // this is database specific since it's a derived value of thumbnailSize
@@ -127,6 +127,7 @@ public:
     property_copy(useRawThumbnail, setUseRawThumbnail, bool);
     property_copy(useRawThumbnailSize, setUseRawThumbnailSize, QSize);
     property_copy(useCompressedIndexXML, setUseCompressedIndexXML, bool);
+    property_copy(useDatabaseSnapshot, setUseDatabaseSnapshot, bool);
     property_copy(compressBackup, setCompressBackup, bool);
     property_copy(showSplashScreen, setShowSplashScreen, bool);
     property_copy(showHistogram, setShowHistogram, bool);
@@ -174,6 +175,7 @@ public:
     property_copy(previewSize, setPreviewSize, int);
     property_ref(colorScheme, setColorScheme, QString);
     property_copy(incrementalThumbnails, setIncrementalThumbnails, bool);
+    property_copy(contentAddressedThumbnails, setContentAddressedThumbnails, bool);
 
     // Border space around thumbnails.
     property_copy(thumbnailSpace, setThumbnailSpace, int);
@@ -295,6 +297,7 @@ Q_SIGNALS:
     void colorSchemeChanged();
     void displayLabelsChanged(bool);
     void displayCategoriesChanged(bool);
+    void contentAddressedThumbnailsChanged(bool);
     void viewerTagModeChanged(Settings::ViewerTagMode);
     /**
      * @brief untaggedTagChanged is emitted when untaggedCategory() or untaggedTag() changes.
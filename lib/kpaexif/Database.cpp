@@ -15,12 +15,20 @@
 #include <QCoreApplication>
 #include <QDir>
 #include <QFile>
+#include <QFuture>
 #include <QSqlDatabase>
 #include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentMap>
 #include <exiv2/exif.hpp>
 #include <exiv2/image.hpp>
+#include <exiv2/xmp_exiv2.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <optional>
 
 using namespace Exif;
 
@@ -87,6 +95,40 @@ bool isSQLiteDriverAvailable()
 }
 
 constexpr QFileDevice::Permissions FILE_PERMISSIONS { QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::WriteGroup | QFile::ReadOther };
+
+// SQLite versions before 3.32 allow at most 999 parameters per statement:
+constexpr qsizetype MAX_QUERY_PARAMETERS = 999;
+// When adding many files, the changes are committed after this many rows to keep the write-ahead log small:
+constexpr qsizetype COMMIT_INTERVAL = 10000;
+// Switching the journal mode forces a checkpoint and creates and deletes files, so bulk ingest mode only pays off for many files:
+constexpr qsizetype BULK_INGEST_THRESHOLD = 1000;
+
+/**
+ * @brief readExifRow reads the Exif data of a file and converts it into a row of the exif table.
+ * This is safe to call from several threads at once, as long as elements() has been called before.
+ * @return the values for all columns, starting with the file name, or an empty optional if the Exif data could not be read
+ */
+std::optional<QVariantList> readExifRow(const DB::FileName &fileName)
+{
+    try {
+        const auto image = Exiv2::ImageFactory::open(fileName.absolute().toLocal8Bit().data());
+        Q_ASSERT(image.get() != nullptr);
+        image->readMetadata();
+        Exiv2::ExifData &exifData = image->exifData();
+
+        const Database::ElementList allElements = elements();
+        QVariantList row;
+        row.reserve(1 + allElements.size());
+        row.append(fileName.absolute());
+        for (const DatabaseElement *e : allElements) {
+            row.append(e->valueFromExif(exifData));
+        }
+        return row;
+    } catch (...) {
+        qCWarning(ExifLog, "Error while reading exif information from %s", qPrintable(fileName.absolute()));
+        return std::nullopt;
+    }
+}
 }
 
 class Database::DatabasePrivate
@@ -113,7 +155,22 @@ protected:
     void createMetadataTable(DBSchemaChangeType change);
     static QString connectionName();
     bool insert(const DB::FileName &filename, Exiv2::ExifData);
-    bool insert(const QList<DBExifInfo> &);
+    /**
+     * @brief insertFiles reads the Exif data of the files and inserts them into the database.
+     * The Exif data is read by several threads, while the rows are inserted in batches by the calling thread.
+     * When inserting many files outside of an insert transaction, the database is put into bulk ingest mode while inserting (see setBulkIngest()).
+     * @param files
+     * @param progress is called after each batch with the number of files done so far; returning \c false cancels inserting
+     * @return \c true, if all rows were inserted, \c false if inserting failed or was canceled
+     */
+    bool insertFiles(const DB::FileNameList &files, const std::function<bool(qsizetype)> &progress = {});
+    bool insertRows(const QList<QVariantList> &rows);
+    /**
+     * @brief setBulkIngest switches the database into a mode that is better suited for inserting many rows.
+     * While in bulk ingest mode, the database uses a write-ahead log and syncs less often.
+     * Must not be called while a transaction is active.
+     */
+    void setBulkIngest(bool enabled);
 
 private:
     mutable bool m_isFailed = false;
@@ -128,6 +185,7 @@ private:
     void showErrorAndFail(QSqlQuery &query) const;
     void showErrorAndFail(const QString &errorMessage, const QString &technicalInfo) const;
     void init();
+    QString insertString(qsizetype rowCount) const;
     QSqlQuery *getInsertQuery();
     void concludeInsertQuery(QSqlQuery *);
 };
@@ -337,21 +395,8 @@ bool Exif::Database::add(const DB::FileNameList &list)
     if (!isUsable())
         return false;
 
-    QList<DBExifInfo> map;
-
-    for (const DB::FileName &fileName : list) {
-        try {
-            const auto image = Exiv2::ImageFactory::open(fileName.absolute().toLocal8Bit().data());
-            Q_ASSERT(image.get() != nullptr);
-            image->readMetadata();
-            map << DBExifInfo(fileName, image->exifData());
-        } catch (...) {
-            qCWarning(ExifLog, "Error while reading exif information from %s", qPrintable(fileName.absolute()));
-        }
-    }
     Q_D(Database);
-    d->insert(map);
-    return true;
+    return d->insertFiles(list);
 }
 
 void Exif::Database::remove(const DB::FileName &fileName)
@@ -387,20 +432,31 @@ void Exif::Database::remove(const DB::FileNameList &list)
     d->m_db.commit();
 }
 
+QString Exif::Database::DatabasePrivate::insertString(qsizetype rowCount) const
+{
+    QStringList formalList;
+    const Database::ElementList elms = elements();
+    for (const DatabaseElement *e : elms) {
+        formalList.append(e->queryString());
+    }
+    const QString row = QString::fromLatin1("(?, %1)").arg(formalList.join(QString::fromLatin1(", ")));
+
+    QStringList rows;
+    rows.reserve(rowCount);
+    for (qsizetype i = 0; i < rowCount; ++i) {
+        rows.append(row);
+    }
+    return QString::fromLatin1("INSERT OR REPLACE into exif values %1 ").arg(rows.join(QString::fromLatin1(", ")));
+}
+
 QSqlQuery *Exif::Database::DatabasePrivate::getInsertQuery()
 {
     if (!isUsable())
         return nullptr;
     if (m_insertTransaction)
         return m_insertTransaction;
-    if (m_queryString.isEmpty()) {
-        QStringList formalList;
-        const Database::ElementList elms = elements();
-        for (const DatabaseElement *e : elms) {
-            formalList.append(e->queryString());
-        }
-        m_queryString = QString::fromLatin1("INSERT OR REPLACE into exif values (?, %1) ").arg(formalList.join(QString::fromLatin1(", ")));
-    }
+    if (m_queryString.isEmpty())
+        m_queryString = insertString(1);
     QSqlQuery *query = new QSqlQuery(m_db);
     if (query)
         query->prepare(m_queryString);
@@ -476,28 +532,119 @@ bool Exif::Database::DatabasePrivate::insert(const DB::FileName &filename, Exiv2
     return status;
 }
 
-bool Exif::Database::DatabasePrivate::insert(const QList<DBExifInfo> &map)
+bool Exif::Database::DatabasePrivate::insertFiles(const DB::FileNameList &files, const std::function<bool(qsizetype)> &progress)
 {
     if (!isUsable())
         return false;
 
-    QSqlQuery *query = getInsertQuery();
-    // not a const reference because DatabaseElement::valueFromExif uses operator[] on the exif datum
-    for (DBExifInfo elt : map) {
-        query->bindValue(0, elt.first.absolute());
-        int i = 1;
-        for (const DatabaseElement *e : elements()) {
-            query->bindValue(i++, e->valueFromExif(elt.second));
+    // Initialize everything that is not thread-safe before reading in several threads:
+    elements();
+    Exiv2::XmpParser::initialize();
+
+    const bool ownTransaction = (m_insertTransaction == nullptr);
+    const bool bulkIngest = ownTransaction && files.size() >= BULK_INGEST_THRESHOLD;
+    if (bulkIngest)
+        setBulkIngest(true);
+    if (ownTransaction)
+        m_db.transaction();
+
+    // While the rows of one batch are inserted, the Exif data of the next batch is read:
+    const qsizetype batchSize = std::max(256, 32 * QThread::idealThreadCount());
+    const auto readBatch = [&files, batchSize](qsizetype first) {
+        return QtConcurrent::mapped(files.mid(first, batchSize), readExifRow);
+    };
+    QFuture<std::optional<QVariantList>> nextBatch = readBatch(0);
+
+    bool success = true;
+    qsizetype uncommittedRows = 0;
+    for (qsizetype first = 0; first < files.size(); first += batchSize) {
+        const QList<std::optional<QVariantList>> results = nextBatch.results();
+        const qsizetype done = std::min(first + batchSize, files.size());
+        if (done < files.size())
+            nextBatch = readBatch(done);
+
+        QList<QVariantList> rows;
+        rows.reserve(results.size());
+        for (const auto &result : results) {
+            if (result)
+                rows.append(*result);
+        }
+        if (!insertRows(rows)) {
+            success = false;
+            break;
+        }
+
+        uncommittedRows += rows.size();
+        if (ownTransaction && uncommittedRows >= COMMIT_INTERVAL) {
+            m_db.commit();
+            m_db.transaction();
+            uncommittedRows = 0;
         }
 
-        if (!query->exec()) {
-            showErrorAndFail(*query);
+        if (progress && !progress(done)) {
+            success = false;
+            break;
+        }
+    }
+    nextBatch.cancel();
+    nextBatch.waitForFinished();
+
+    if (ownTransaction) {
+        if (success)
+            m_db.commit();
+        else
+            m_db.rollback();
+    }
+    if (bulkIngest)
+        setBulkIngest(false);
+    return success;
+}
+
+bool Exif::Database::DatabasePrivate::insertRows(const QList<QVariantList> &rows)
+{
+    if (!isUsable())
+        return false;
+
+    // inserting several rows per statement saves a lot of overhead:
+    const qsizetype columnCount = 1 + elements().size();
+    const qsizetype rowsPerStatement = std::max<qsizetype>(1, MAX_QUERY_PARAMETERS / columnCount);
+
+    QSqlQuery query(m_db);
+    qsizetype preparedRowCount = 0;
+    for (qsizetype first = 0; first < rows.size(); first += rowsPerStatement) {
+        const qsizetype rowCount = std::min(rowsPerStatement, rows.size() - first);
+        if (rowCount != preparedRowCount) {
+            query.prepare(insertString(rowCount));
+            preparedRowCount = rowCount;
+        }
+        int i = 0;
+        for (const QVariantList &row : rows.sliced(first, rowCount)) {
+            for (const QVariant &value : row) {
+                query.bindValue(i++, value);
+            }
+        }
+        if (!query.exec()) {
+            showErrorAndFail(query);
+            return false;
         }
     }
-    concludeInsertQuery(query);
     return true;
 }
 
+void Exif::Database::DatabasePrivate::setBulkIngest(bool enabled)
+{
+    // Failing to change these settings only makes inserting slower, so it is not treated as an error.
+    // When done, the default rollback journal is used again, so that the database is a single file.
+    const QStringList pragmas = enabled
+        ? QStringList { QString::fromLatin1("PRAGMA journal_mode=WAL"), QString::fromLatin1("PRAGMA synchronous=NORMAL") }
+        : QStringList { QString::fromLatin1("PRAGMA synchronous=FULL"), QString::fromLatin1("PRAGMA journal_mode=DELETE") };
+    QSqlQuery query(m_db);
+    for (const QString &pragma : pragmas) {
+        if (!query.exec(pragma))
+            qCWarning(ExifLog) << "Could not execute" << pragma << "on the Exif database:" << query.lastError().text();
+    }
+}
+
 QString Exif::Database::DatabasePrivate::getFileName() const
 {
     return m_fileName;
@@ -701,30 +848,23 @@ void Exif::Database::recreate(const DB::FileNameList &allImageFiles, DB::Abstrac
     QDir().rename(d->getFileName(), origBackup);
     d->init();
 
-    // using a transaction here removes a *huge* overhead on the insert statements
-    startInsertTransaction();
-    int i = 0;
-    for (const auto &fileName : allImageFiles) {
-        progressIndicator.setValue(i++);
-        add(fileName);
-        if (i % 10) {
-            auto app = QCoreApplication::instance();
-            if (app)
-                app->processEvents();
-        }
-        if (progressIndicator.wasCanceled())
-            break;
-    }
+    // Reading the files in parallel, and inserting in large transactions with several rows per statement
+    // removes a *huge* overhead compared to adding one file at a time:
+    const bool success = d->insertFiles(allImageFiles, [&progressIndicator](qsizetype done) {
+        progressIndicator.setValue(static_cast<int>(done));
+        auto app = QCoreApplication::instance();
+        if (app)
+            app->processEvents();
+        return !progressIndicator.wasCanceled();
+    });
 
     // PENDING(blackie) We should count the amount of files that did not succeeded and warn the user.
-    if (progressIndicator.wasCanceled()) {
-        abortInsertTransaction();
+    if (!success) {
         d->m_db.close();
         QDir().remove(d->getFileName());
         QDir().rename(origBackup, d->getFileName());
         d->init();
     } else {
-        commitInsertTransaction();
         QDir().remove(origBackup);
     }
 }
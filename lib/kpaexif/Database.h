@@ -96,6 +96,7 @@ public:
     bool add(const DB::FileName &fileName);
     /**
      * @brief Adds a list of files to the exif database, reading the exif data from the files.
+     * The exif data is read using several threads.
      * @param list
      * @return \c true, if the operation succeeded, \c false otherwise
      */
@@ -136,6 +137,9 @@ public:
      * Exiv2 seems to accept both image and movie files without ill effects
      * (but does not actually return any usable metadata).
      *
+     * The exif data is read using several threads, and the database is written in large transactions
+     * using a write-ahead log.
+     *
      * Recreating the exif database can take a lot of time. To get a decent user experience in spite of that,
      * the method updates the given AbstractProgressIndicator and calls QCoreApplication::processEvents()
      * in regular intervals (if a QCoreApplication instance is available).
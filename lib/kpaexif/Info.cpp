@@ -12,10 +12,13 @@
 #include <kpabase/SettingsData.h>
 #include <kpabase/StringSet.h>
 
+#include <QByteArray>
 #include <QFile>
 #include <QFileInfo>
+#include <QSize>
 #include <exiv2/exv_conf.h>
 #include <exiv2/image.hpp>
+#include <exiv2/preview.hpp>
 
 #include <QStringDecoder>
 
@@ -32,6 +35,18 @@ QString cStringWithEncoding(const char *c_str, const QString &charset)
     return codec.decode(c_str);
 }
 
+// Embedded previews whose aspect ratio differs more than this from the image are assumed to have borders:
+constexpr double MAX_PREVIEW_ASPECT_RATIO_DIFFERENCE = 0.02;
+
+bool hasSameAspectRatio(const QSize &preview, const QSize &image)
+{
+    if (preview.isEmpty() || image.isEmpty())
+        return true;
+    const double previewRatio = double(preview.width()) / preview.height();
+    const double imageRatio = double(image.width()) / image.height();
+    return qAbs(previewRatio - imageRatio) <= MAX_PREVIEW_ASPECT_RATIO_DIFFERENCE * imageRatio;
+}
+
 } // namespace
 
 Info *Info::s_instance = nullptr;
@@ -215,4 +230,31 @@ Exif::Metadata Exif::Info::metadata(const DB::FileName &fileName)
     return Exif::Metadata();
 }
 
+bool Exif::loadEmbeddedPreview(const DB::FileName &fileName, int minimumSize, QByteArray *previewData, QString *mimeType, QSize *fullSize)
+{
+    try {
+        auto image = Exiv2::ImageFactory::open(QFile::encodeName(fileName.absolute()).data());
+        if (image.get() == nullptr)
+            return false;
+        image->readMetadata();
+        const QSize imageSize(static_cast<int>(image->pixelWidth()), static_cast<int>(image->pixelHeight()));
+
+        Exiv2::PreviewManager previewManager(*image);
+        // the previews are sorted by size, smallest first:
+        const Exiv2::PreviewPropertiesList previews = previewManager.getPreviewProperties();
+        for (const auto &properties : previews) {
+            const QSize previewSize(static_cast<int>(properties.width_), static_cast<int>(properties.height_));
+            if (qMax(previewSize.width(), previewSize.height()) < minimumSize || !hasSameAspectRatio(previewSize, imageSize))
+                continue;
+            const Exiv2::PreviewImage preview = previewManager.getPreviewImage(properties);
+            *previewData = QByteArray(reinterpret_cast<const char *>(preview.pData()), preview.size());
+            *mimeType = QString::fromStdString(preview.mimeType());
+            *fullSize = imageSize.isEmpty() ? QSize() : imageSize;
+            return !previewData->isEmpty();
+        }
+    } catch (...) {
+    }
+    return false;
+}
+
 // vi:expandtab:tabstop=4 shiftwidth=4:
@@ -12,6 +12,10 @@
 #include <qmap.h>
 #include <qstringlist.h>
 
+class QByteArray;
+class QSize;
+class QString;
+
 namespace DB
 {
 class FileName;
@@ -57,6 +61,21 @@ private:
  */
 void writeExifInfoToFile(const DB::FileName &srcName, const QString &destName, const QString &imageDescription);
 
+/**
+ * @brief Extracts a preview image that is embedded in an image file, e.g. the JPEG preview of a raw file.
+ * Of all previews with a longer side of at least \p minimumSize pixels, the smallest one is used.
+ * Previews that have a different aspect ratio than the image itself (e.g. because of black borders) are ignored.
+ *
+ * This function can be called from any thread.
+ * @param fileName the image file
+ * @param minimumSize the minimum size of the longer side of the preview
+ * @param previewData the encoded preview image
+ * @param mimeType the mime type of the preview image, usually "image/jpeg"
+ * @param fullSize the size of the image itself, or an invalid size if it is not known
+ * @return \c true if a suitable preview was found, \c false otherwise.
+ */
+bool loadEmbeddedPreview(const DB::FileName &fileName, int minimumSize, QByteArray *previewData, QString *mimeType, QSize *fullSize);
+
 }
 
 #endif /* EXIF_INFO_H */
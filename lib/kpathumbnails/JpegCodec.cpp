@@ -0,0 +1,165 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "JpegCodec.h"
+
+#include <kpabase/Logging.h>
+
+#include <csetjmp>
+#include <cstdlib>
+
+// clang-format off
+extern "C" {
+#define XMD_H // prevent INT32 clash from jpeglib
+#include <stdio.h>
+#include <jpeglib.h>
+}
+// clang-format on
+
+namespace
+{
+struct ErrorManager : public jpeg_error_mgr {
+    jmp_buf setjmpBuffer;
+};
+
+#ifdef JCS_EXTENSIONS
+// libjpeg-turbo can read and write QImage::Format_RGB32 directly, which saves a conversion:
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+constexpr J_COLOR_SPACE RGB32_COLOR_SPACE = JCS_EXT_BGRX;
+#else
+constexpr J_COLOR_SPACE RGB32_COLOR_SPACE = JCS_EXT_XRGB;
+#endif
+#endif
+}
+
+extern "C" {
+static void jpegCodecErrorExit(j_common_ptr cinfo)
+{
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    qCDebug(ImageManagerLog) << "libjpeg error:" << buffer;
+    longjmp(static_cast<ErrorManager *>(cinfo->err)->setjmpBuffer, 1);
+}
+}
+
+QImage ImageManager::decodeJpeg(const QByteArray &data, int minimumDimension, QSize *fullSize)
+{
+    jpeg_decompress_struct cinfo;
+    ErrorManager jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = jpegCodecErrorExit;
+    // The pixels are allocated between setjmp() and a possible longjmp(), so the pointer has to be volatile.
+    // A QImage cannot be used here, because longjmp() would skip its destructor:
+    uchar *volatile pixels = nullptr;
+
+    if (setjmp(jerr.setjmpBuffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(pixels);
+        return QImage();
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char *>(const_cast<char *>(data.constData())), data.size());
+    jpeg_read_header(&cinfo, TRUE);
+    if (fullSize)
+        *fullSize = QSize(cinfo.image_width, cinfo.image_height);
+
+#ifdef JCS_EXTENSIONS
+    const bool supportedColorSpace = cinfo.jpeg_color_space == JCS_YCbCr || cinfo.jpeg_color_space == JCS_RGB || cinfo.jpeg_color_space == JCS_GRAYSCALE;
+    cinfo.out_color_space = RGB32_COLOR_SPACE;
+    constexpr QImage::Format format = QImage::Format_RGB32;
+    constexpr int components = 4;
+#else
+    const bool supportedColorSpace = cinfo.jpeg_color_space == JCS_YCbCr || cinfo.jpeg_color_space == JCS_RGB;
+    cinfo.out_color_space = JCS_RGB;
+    constexpr QImage::Format format = QImage::Format_RGB888;
+    constexpr int components = 3;
+#endif
+    if (!supportedColorSpace) {
+        // e.g. CMYK - leave that to Qt
+        jpeg_destroy_decompress(&cinfo);
+        return QImage();
+    }
+
+    int scale = 1;
+    if (minimumDimension > 0) {
+        const int imageDimension = qMax(cinfo.image_width, cinfo.image_height);
+        while (scale < 8 && minimumDimension * scale * 2 <= imageDimension)
+            scale *= 2;
+    }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    // The image is scaled down afterwards, so the faster but less accurate algorithms are good enough:
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+
+    jpeg_start_decompress(&cinfo);
+    // QImage expects 32-bit aligned scan lines:
+    const qsizetype bytesPerLine = (qsizetype(cinfo.output_width) * components + 3) & ~qsizetype(3);
+    pixels = static_cast<uchar *>(malloc(bytesPerLine * cinfo.output_height));
+    if (!pixels) {
+        jpeg_destroy_decompress(&cinfo);
+        return QImage();
+    }
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW line = pixels + bytesPerLine * cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &line, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    const QImage image(pixels, cinfo.output_width, cinfo.output_height, bytesPerLine, format, free, pixels);
+    jpeg_destroy_decompress(&cinfo);
+    return image;
+}
+
+QByteArray ImageManager::encodeJpeg(const QImage &image, int quality)
+{
+    if (image.isNull())
+        return QByteArray();
+
+#ifdef JCS_EXTENSIONS
+    const QImage source = image.convertToFormat(QImage::Format_RGB32);
+    constexpr J_COLOR_SPACE colorSpace = RGB32_COLOR_SPACE;
+    constexpr int components = 4;
+#else
+    const QImage source = image.convertToFormat(QImage::Format_RGB888);
+    constexpr J_COLOR_SPACE colorSpace = JCS_RGB;
+    constexpr int components = 3;
+#endif
+
+    jpeg_compress_struct cinfo;
+    ErrorManager jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = jpegCodecErrorExit;
+    unsigned char *buffer = nullptr;
+    unsigned long bufferSize = 0;
+
+    if (setjmp(jerr.setjmpBuffer)) {
+        jpeg_destroy_compress(&cinfo);
+        free(buffer);
+        return QByteArray();
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buffer, &bufferSize);
+    cinfo.image_width = source.width();
+    cinfo.image_height = source.height();
+    cinfo.input_components = components;
+    cinfo.in_color_space = colorSpace;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW line = const_cast<uchar *>(source.constScanLine(cinfo.next_scanline));
+        jpeg_write_scanlines(&cinfo, &line, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    const QByteArray result(reinterpret_cast<const char *>(buffer), bufferSize);
+    jpeg_destroy_compress(&cinfo);
+    free(buffer);
+    return result;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef KPATHUMBNAILS_JPEGCODEC_H
+#define KPATHUMBNAILS_JPEGCODEC_H
+
+#include <QByteArray>
+#include <QImage>
+
+namespace ImageManager
+{
+
+/**
+ * @brief decodeJpeg decodes JPEG data using libjpeg, scaling the image down while decoding.
+ *
+ * libjpeg can decode an image at 1/2, 1/4 or 1/8 of its size by skipping the higher frequencies
+ * of the DCT, which is a lot faster than decoding the full image and scaling it afterwards.
+ * The largest of these scale factors is used that still yields an image with at least
+ * \p minimumDimension pixels on its longer side.
+ *
+ * @param data the JPEG data
+ * @param minimumDimension the minimum size of the longer side of the result, or -1 to decode in full size
+ * @param fullSize if not \c nullptr, receives the size of the image before scaling
+ * @return the decoded image, or a null QImage if the data could not be decoded by libjpeg
+ * (e.g. because it is no JPEG data or uses an unsupported color space).
+ */
+QImage decodeJpeg(const QByteArray &data, int minimumDimension = -1, QSize *fullSize = nullptr);
+
+/**
+ * @brief encodeJpeg encodes an image as baseline JPEG using libjpeg.
+ * @param image the image; any alpha channel is discarded
+ * @param quality the JPEG quality, between 0 and 100. The default is the same that Qt uses.
+ * @return the JPEG data, or a null QByteArray if the image could not be encoded
+ */
+QByteArray encodeJpeg(const QImage &image, int quality = 75);
+
+}
+
+#endif /* KPATHUMBNAILS_JPEGCODEC_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
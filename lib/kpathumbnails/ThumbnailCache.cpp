@@ -6,19 +6,22 @@
 
 #include "ThumbnailCache.h"
 
+#include "JpegCodec.h"
+
 #include <kpabase/Logging.h>
 #include <kpabase/SettingsData.h>
 
-#include <QBuffer>
 #include <QCache>
 #include <QDir>
 #include <QElapsedTimer>
 #include <QFile>
 #include <QMutexLocker>
 #include <QPixmap>
+#include <QSaveFile>
 #include <QTemporaryFile>
 #include <QTimer>
 
+#include <algorithm>
 #include <utility>
 
 namespace
@@ -32,6 +35,43 @@ constexpr size_t LRU_SIZE = 2;
 
 constexpr int THUMBNAIL_CACHE_SAVE_INTERNAL_MS = (5 * 1000);
 
+// A thumbnail file is compacted in the background when at least half of it is stale data...
+constexpr double COMPACTION_STALE_RATIO = 0.5;
+// ... and when compacting it frees a reasonable amount of disk space:
+constexpr qint64 COMPACTION_MIN_STALE_BYTES = 1024 * 1024;
+
+// A snapshot of the thumbnail index holds up to this many changes before the whole index is copied again:
+constexpr qsizetype MAX_SNAPSHOT_CHANGES = 1024;
+// Marks removed entries in a snapshot of the thumbnail index:
+constexpr int REMOVED_ENTRY_FILE_INDEX = -1;
+
+// Additional size tiers, stored in sub-directories of the thumbnail directory.
+// The tier size is thumbnailSize() * numerator / denominator.
+struct TierDefinition {
+    const char *directory;
+    int numerator;
+    int denominator;
+};
+constexpr TierDefinition TIERS[] = { { "small", 1, 2 }, { "large", 2, 1 } };
+
+int tierSize(int thumbnailSize, const TierDefinition &tier)
+{
+    return thumbnailSize * tier.numerator / tier.denominator;
+}
+
+// Thumbnails of files with a content key are stored under a name in this pseudo-directory:
+constexpr auto CONTENT_NAME_PREFIX = ".content/";
+
+DB::FileName contentName(const QString &contentKey)
+{
+    return DB::FileName::fromRelativePath(QString::fromLatin1(CONTENT_NAME_PREFIX) + contentKey);
+}
+
+bool isContentName(const DB::FileName &name)
+{
+    return name.relative().startsWith(QLatin1String(CONTENT_NAME_PREFIX));
+}
+
 constexpr auto INDEXFILE_NAME = "thumbnailindex";
 constexpr QFileDevice::Permissions FILE_PERMISSIONS { QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::WriteGroup | QFile::ReadOther };
 }
@@ -44,6 +84,11 @@ namespace ImageManager
  * and its contents mapped into memory (as a QByteArray).
  *
  * Deleting the ThumbnailMapping unmaps the memory and closes the file.
+ *
+ * Since thumbnail files are only ever appended to, a mapping stays valid when
+ * more thumbnails are written to the file - it just doesn't cover the new data.
+ * When a file is compacted, the compacted file replaces the old one under the same name,
+ * but the mapping keeps referring to the old data.
  */
 class ThumbnailMapping
 {
@@ -62,30 +107,82 @@ public:
             map = QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size());
         }
     }
-    bool isValid()
+    bool isValid() const
     {
         return !map.isEmpty();
     }
+    qint64 size() const
+    {
+        return map.size();
+    }
     // we need to keep the file around to keep the data mapped:
     QFile file;
     QByteArray map;
 };
 
+/**
+ * The ThumbnailIndexSnapshot is an immutable version of the thumbnail index.
+ *
+ * Lookups use a snapshot instead of the index itself, so they never have to wait for a writer.
+ * Writers publish a new snapshot after each change. To keep that cheap, a snapshot consists of
+ * an older version of the whole index, which is shared between snapshots, and the entries that
+ * have changed since then.
+ */
+class ThumbnailIndexSnapshot
+{
+public:
+    /**
+     * @return the index entry for the given name, or \c nullptr if there is none.
+     */
+    const CacheFileInfo *find(const DB::FileName &name) const
+    {
+        const auto change = changes.constFind(name);
+        if (change != changes.constEnd())
+            return change->fileIndex == REMOVED_ENTRY_FILE_INDEX ? nullptr : &change.value();
+        const auto entry = base->constFind(name);
+        return entry == base->constEnd() ? nullptr : &entry.value();
+    }
+    std::shared_ptr<const QHash<DB::FileName, CacheFileInfo>> base;
+    // removed entries have the file index REMOVED_ENTRY_FILE_INDEX:
+    QHash<DB::FileName, CacheFileInfo> changes;
+};
+
+ThumbnailData::ThumbnailData(std::shared_ptr<const ThumbnailMapping> mapping, QByteArrayView data)
+    : m_mapping(std::move(mapping))
+    , m_data(data)
+{
+}
+
 QString defaultThumbnailDirectory()
 {
     return QString::fromLatin1(".thumbnails");
 }
+
+QString contentKeyFor(const QString &md5Hex, int angle)
+{
+    return md5Hex + QLatin1Char('-') + QString::number(angle);
+}
 }
 
 ImageManager::ThumbnailCache::ThumbnailCache(const QString &baseDirectory)
+    : ThumbnailCache(baseDirectory, 0)
+{
+    for (const TierDefinition &tier : TIERS) {
+        const QString tierDirectory = m_baseDir.filePath(QString::fromLatin1(tier.directory));
+        m_tiers.emplace_back(new ThumbnailCache(tierDirectory, tierSize(m_thumbnailSize, tier)));
+    }
+}
+
+ImageManager::ThumbnailCache::ThumbnailCache(const QString &baseDirectory, int tierSize)
     : m_baseDir(baseDirectory)
     , m_currentFile(0)
     , m_currentOffset(0)
     , m_timer(new QTimer)
     , m_needsFullSave(true)
     , m_isDirty(false)
-    , m_memcache(new QCache<int, ThumbnailMapping>(LRU_SIZE))
+    , m_memcache(new QCache<int, std::shared_ptr<const ThumbnailMapping>>(LRU_SIZE))
     , m_currentWriter(nullptr)
+    , m_isTier(tierSize > 0)
 {
     if (!m_baseDir.exists()) {
         if (!QDir().mkpath(m_baseDir.path())) {
@@ -94,18 +191,27 @@ ImageManager::ThumbnailCache::ThumbnailCache(const QString &baseDirectory)
     }
 
     // set a default value for version 4 files and new databases:
-    m_thumbnailSize = Settings::SettingsData::instance()->thumbnailSize();
+    m_thumbnailSize = (tierSize > 0) ? tierSize : Settings::SettingsData::instance()->thumbnailSize();
 
     load();
+    QMutexLocker dataLocker(&m_dataLock);
+    publishIndex();
+    dataLocker.unlock();
     connect(this, &ImageManager::ThumbnailCache::doSave, this, &ImageManager::ThumbnailCache::saveImpl);
     connect(m_timer, &QTimer::timeout, this, &ImageManager::ThumbnailCache::saveImpl);
     m_timer->setInterval(THUMBNAIL_CACHE_SAVE_INTERNAL_MS);
     m_timer->setSingleShot(true);
     m_timer->start(THUMBNAIL_CACHE_SAVE_INTERNAL_MS);
+    m_compactionPool.setMaxThreadCount(1);
+    // the main cache was last used with a different thumbnail size:
+    if (tierSize > 0 && m_thumbnailSize != tierSize)
+        setThumbnailSize(tierSize);
 }
 
 ImageManager::ThumbnailCache::~ThumbnailCache()
 {
+    m_compactionCanceled = true;
+    m_compactionPool.waitForDone();
     m_needsFullSave = true;
     saveInternal();
     delete m_memcache;
@@ -121,88 +227,161 @@ void ImageManager::ThumbnailCache::insert(const DB::FileName &name, const QImage
         return;
     }
 
-    QByteArray data;
-    QBuffer buffer(&data);
-    bool OK = buffer.open(QIODevice::WriteOnly);
-    Q_ASSERT(OK);
-    Q_UNUSED(OK);
-
-    OK = image.save(&buffer, "JPG");
-    Q_ASSERT(OK);
+    const QByteArray data = encodeJpeg(image);
+    if (data.isNull()) {
+        qCWarning(ImageManagerLog) << "Could not encode thumbnail for file" << name.relative();
+        return;
+    }
 
     insert(name, data);
 }
 
-void ImageManager::ThumbnailCache::insert(const DB::FileName &name, const QByteArray &thumbnailData)
+void ImageManager::ThumbnailCache::insert(const DB::FileName &name, const QImage &image, int tierSize)
 {
-    if (thumbnailData.isNull()) {
-        qCWarning(ImageManagerLog) << "Thumbnail data for file" << name.relative() << "is invalid!";
+    if (tierSize == m_thumbnailSize) {
+        insert(name, image);
         return;
     }
-    QMutexLocker thumbnailLocker(&m_thumbnailWriterLock);
-    if (!m_currentWriter) {
-        m_currentWriter = new QFile(fileNameForIndex(m_currentFile));
-        if (!m_currentWriter->open(QIODevice::ReadWrite)) {
-            qCWarning(ImageManagerLog, "Failed to open thumbnail file for inserting");
-            return;
-        }
-        if (!m_currentWriter->setPermissions(FILE_PERMISSIONS)) {
-            qCWarning(ImageManagerLog) << "Could not set permissions on thumbnail file" << m_currentWriter->fileName();
-        }
-    }
-    if (!m_currentWriter->seek(m_currentOffset)) {
-        qCWarning(ImageManagerLog, "Failed to seek in thumbnail file");
+    ThumbnailCache *tier = tierCache(tierSize);
+    if (!tier) {
+        qCWarning(ImageManagerLog) << "No thumbnail tier with size" << tierSize;
         return;
     }
+    tier->insert(name, image);
+}
 
-    QMutexLocker dataLocker(&m_dataLock);
-    // purge in-memory cache for the current file:
-    m_memcache->remove(m_currentFile);
+void ImageManager::ThumbnailCache::invalidateTiers(const DB::FileName &name)
+{
+    for (const auto &tier : m_tiers) {
+        if (tier->contains(name))
+            tier->removeThumbnail(name);
+    }
+}
 
-    const int sizeBytes = thumbnailData.size();
-    if (!(m_currentWriter->write(thumbnailData.data(), sizeBytes) == sizeBytes && m_currentWriter->flush())) {
-        qCWarning(ImageManagerLog, "Failed to write image data to thumbnail file");
+ImageManager::ThumbnailCache *ImageManager::ThumbnailCache::tierCache(int tierSize) const
+{
+    for (const auto &tier : m_tiers) {
+        if (tier->thumbnailSize() == tierSize)
+            return tier.get();
+    }
+    return nullptr;
+}
+
+void ImageManager::ThumbnailCache::insert(const DB::FileName &name, const QByteArray &thumbnailData)
+{
+    if (thumbnailData.isNull()) {
+        qCWarning(ImageManagerLog) << "Thumbnail data for file" << name.relative() << "is invalid!";
         return;
     }
 
-    if (m_currentOffset + sizeBytes > MAX_FILE_SIZE) {
-        delete m_currentWriter;
-        m_currentWriter = nullptr;
+    insertStored(storageName(name), thumbnailData);
+    invalidateTiers(name);
+}
+
+void ImageManager::ThumbnailCache::insertStored(const DB::FileName &storedName, const QByteArray &thumbnailData)
+{
+    // Group commit: concurrent inserts are queued, and whichever thread finds no write in progress
+    // writes the whole queue at once. All other threads wait until their thumbnail has been written.
+    QMutexLocker queueLocker(&m_writeQueueLock);
+    m_writeQueue.append({ storedName, thumbnailData });
+    const quint64 ticket = ++m_queuedCount;
+    while (m_writerActive && m_writtenCount < ticket)
+        m_writeQueueCondition.wait(&m_writeQueueLock);
+    if (m_writtenCount >= ticket)
+        return;
+
+    m_writerActive = true;
+    const QList<PendingThumbnail> batch = std::exchange(m_writeQueue, {});
+    queueLocker.unlock();
+
+    writeThumbnails(batch);
+
+    queueLocker.relock();
+    m_writtenCount += batch.size();
+    m_writerActive = false;
+    m_writeQueueCondition.wakeAll();
+}
+
+void ImageManager::ThumbnailCache::writeThumbnails(const QList<PendingThumbnail> &batch)
+{
+    QMutexLocker thumbnailLocker(&m_thumbnailWriterLock);
+    QMutexLocker dataLocker(&m_dataLock);
+    int fileIndex = m_currentFile;
+    int offset = m_currentOffset;
+    dataLocker.unlock();
+
+    // Existing mappings of the current file stay valid, because we only append to the file.
+    // lookupData() maps the file again when it needs to access the new data.
+    // The data for each thumbnail file is written with a single write and flush:
+    QList<std::pair<DB::FileName, CacheFileInfo>> written;
+    written.reserve(batch.size());
+    qsizetype firstInBuffer = 0;
+    int bufferOffset = offset;
+    QByteArray buffer;
+    for (qsizetype i = 0; i < batch.size(); ++i) {
+        buffer.append(batch.at(i).data);
+        offset += batch.at(i).data.size();
+        const bool fileIsFull = offset > MAX_FILE_SIZE;
+        if (!fileIsFull && i + 1 < batch.size())
+            continue;
+
+        if (appendToThumbnailFile(fileIndex, bufferOffset, buffer)) {
+            int entryOffset = bufferOffset;
+            for (qsizetype j = firstInBuffer; j <= i; ++j) {
+                const int sizeBytes = batch.at(j).data.size();
+                written.append({ batch.at(j).name, CacheFileInfo(fileIndex, entryOffset, sizeBytes) });
+                entryOffset += sizeBytes;
+            }
+            if (fileIsFull) {
+                delete m_currentWriter;
+                m_currentWriter = nullptr;
+                fileIndex++;
+                offset = 0;
+            }
+        } else {
+            // the data will be overwritten by the next insert:
+            offset = bufferOffset;
+        }
+        firstInBuffer = i + 1;
+        bufferOffset = offset;
+        buffer.clear();
     }
     thumbnailLocker.unlock();
 
     // Only emit when a thumbnail is updated, not when a new thumbnail is
     // inserted.
-    bool emitThumbnailUpdated = false;
-
-    if (m_hash.contains(name)) {
-        CacheFileInfo info = m_hash[name];
-        if (info.fileIndex == m_currentFile && info.offset == m_currentOffset && info.size == sizeBytes) {
-            qCDebug(ImageManagerLog) << "Found duplicate thumbnail " << name.relative() << "but no change in information";
-            dataLocker.unlock();
-            return;
-        } else {
-            // File has moved; incremental save does no good.
-            // Either the image file has changed and with it the thumbnail, or
-            // this is a video file and a different frame has been selected as thumbnail
-            qCDebug(ImageManagerLog) << "Setting new thumbnail for image " << name.relative() << ", need full save! ";
-            QMutexLocker saveLocker(&m_saveLock);
-            m_needsFullSave = true;
-            emitThumbnailUpdated = true;
+    DB::FileNameList updatedThumbnails;
+
+    // all thumbnails of the batch become visible at once:
+    dataLocker.relock();
+    for (const auto &[name, info] : std::as_const(written)) {
+        const auto existing = m_hash.constFind(name);
+        if (existing != m_hash.constEnd()) {
+            const CacheFileInfo &oldInfo = existing.value();
+            if (oldInfo.fileIndex == info.fileIndex && oldInfo.offset == info.offset && oldInfo.size == info.size) {
+                qCDebug(ImageManagerLog) << "Found duplicate thumbnail " << name.relative() << "but no change in information";
+                continue;
+            } else {
+                // File has moved; incremental save does no good.
+                // Either the image file has changed and with it the thumbnail, or
+                // this is a video file and a different frame has been selected as thumbnail
+                qCDebug(ImageManagerLog) << "Setting new thumbnail for image " << name.relative() << ", need full save! ";
+                QMutexLocker saveLocker(&m_saveLock);
+                m_needsFullSave = true;
+                if (!updatedThumbnails.contains(name))
+                    updatedThumbnails.append(name);
+                markStale(oldInfo);
+            }
         }
-    }
 
-    m_hash.insert(name, CacheFileInfo(m_currentFile, m_currentOffset, sizeBytes));
-    m_isDirty = true;
-
-    m_unsavedHash.insert(name, CacheFileInfo(m_currentFile, m_currentOffset, sizeBytes));
+        setIndexEntry(name, info);
+        m_isDirty = true;
 
-    // Update offset
-    m_currentOffset += sizeBytes;
-    if (m_currentOffset > MAX_FILE_SIZE) {
-        m_currentFile++;
-        m_currentOffset = 0;
+        m_unsavedHash.insert(name, info);
     }
+    publishIndex();
+    m_currentFile = fileIndex;
+    m_currentOffset = offset;
     int unsaved = m_unsavedHash.count();
     dataLocker.unlock();
 
@@ -216,50 +395,143 @@ void ImageManager::ThumbnailCache::insert(const DB::FileName &name, const QByteA
         saveInternal();
     }
 
-    if (emitThumbnailUpdated) {
-        Q_EMIT thumbnailUpdated(name);
+    for (const DB::FileName &name : std::as_const(updatedThumbnails)) {
+        const auto files = filesFor(name);
+        for (const DB::FileName &file : files)
+            Q_EMIT thumbnailUpdated(file);
     }
 }
 
+bool ImageManager::ThumbnailCache::appendToThumbnailFile(int fileIndex, int offset, const QByteArray &data)
+{
+    if (!m_currentWriter) {
+        m_currentWriter = new QFile(fileNameForIndex(fileIndex));
+        if (!m_currentWriter->open(QIODevice::ReadWrite)) {
+            qCWarning(ImageManagerLog, "Failed to open thumbnail file for inserting");
+            delete m_currentWriter;
+            m_currentWriter = nullptr;
+            return false;
+        }
+        if (!m_currentWriter->setPermissions(FILE_PERMISSIONS)) {
+            qCWarning(ImageManagerLog) << "Could not set permissions on thumbnail file" << m_currentWriter->fileName();
+        }
+    }
+    if (!m_currentWriter->seek(offset)) {
+        qCWarning(ImageManagerLog, "Failed to seek in thumbnail file");
+        return false;
+    }
+    if (!(m_currentWriter->write(data) == data.size() && m_currentWriter->flush())) {
+        qCWarning(ImageManagerLog, "Failed to write image data to thumbnail file");
+        return false;
+    }
+    return true;
+}
+
 QString ImageManager::ThumbnailCache::fileNameForIndex(int index) const
 {
     return thumbnailPath(QString::fromLatin1("thumb-") + QString::number(index));
 }
 
+QString ImageManager::ThumbnailCache::compactionMarkerForIndex(int index) const
+{
+    return fileNameForIndex(index) + QString::fromLatin1(".compacted");
+}
+
+void ImageManager::ThumbnailCache::discardUnsavedCompactions()
+{
+    for (int i = 0; i <= m_currentFile; ++i) {
+        const QString marker = compactionMarkerForIndex(i);
+        if (!QFile::exists(marker))
+            continue;
+        qCWarning(ImageManagerLog) << "Thumbnail file" << fileNameForIndex(i) << "was compacted, but the index was not saved afterwards. Discarding its thumbnails...";
+        for (auto it = m_hash.begin(); it != m_hash.end();) {
+            if (it->fileIndex == i)
+                it = m_hash.erase(it);
+            else
+                ++it;
+        }
+        QFile::remove(fileNameForIndex(i));
+        QFile::remove(marker);
+        m_isDirty = true;
+        m_needsFullSave = true;
+    }
+}
+
 QPixmap ImageManager::ThumbnailCache::lookup(const DB::FileName &name) const
 {
-    auto array = lookupRawData(name);
-    if (array.isNull())
+    const ThumbnailData data = lookupData(name);
+    if (data.isNull())
         return QPixmap();
 
-    QBuffer buffer(&array);
-    buffer.open(QIODevice::ReadOnly);
-    QImage image;
-    image.load(&buffer, "JPG");
-
-    // Notice the above image is sharing the bits with the file, so I can't just return it as it then will be invalid when the file goes out of scope.
-    // PENDING(blackie) Is that still true?
-    return QPixmap::fromImage(image);
+    // The decoded image does not share any data with the mapped file:
+    return QPixmap::fromImage(QImage::fromData(data.view(), "JPG"));
 }
 
 QByteArray ImageManager::ThumbnailCache::lookupRawData(const DB::FileName &name) const
 {
-    m_dataLock.lock();
-    CacheFileInfo info = m_hash[name];
-    m_dataLock.unlock();
+    return lookupData(name).toByteArray();
+}
 
-    ThumbnailMapping *t = m_memcache->object(info.fileIndex);
-    if (!t || !t->isValid()) {
-        t = new ThumbnailMapping(fileNameForIndex(info.fileIndex));
-        if (!t->isValid()) {
-            delete t;
+ImageManager::ThumbnailData ImageManager::ThumbnailCache::lookupData(const DB::FileName &name) const
+{
+    const DB::FileName storedName = storageName(name);
+    while (true) {
+        const quint64 fileGeneration = m_fileGeneration;
+        if (fileGeneration % 2 == 1) {
+            // Thumbnail files are being replaced or removed, which happens while holding the data lock.
+            // This is rare, so just wait until it is done:
+            QMutexLocker dataLocker(&m_dataLock);
+            continue;
+        }
+        const auto snapshot = indexSnapshot();
+        const CacheFileInfo *info = snapshot->find(storedName);
+        if (!info)
+            return {};
+        // The index entry may refer to a thumbnail file that has been replaced in the meantime;
+        // in that case, try again with a current snapshot:
+        bool filesReplaced = false;
+        const auto mapping = mappingFor(info->fileIndex, qint64(info->offset) + info->size, fileGeneration, &filesReplaced);
+        if (filesReplaced)
+            continue;
+        if (!mapping) {
             qCWarning(ImageManagerLog, "Failed to map thumbnail file");
-            return QByteArray();
+            return {};
         }
-        m_memcache->insert(info.fileIndex, t);
+        if (mapping->size() < qint64(info->offset) + info->size) {
+            qCWarning(ImageManagerLog) << "Thumbnail file" << fileNameForIndex(info->fileIndex) << "is too short for thumbnail of" << name.relative();
+            return {};
+        }
+        return ThumbnailData(mapping, QByteArrayView(mapping->map).sliced(info->offset, info->size));
+    }
+}
+
+ImageManager::ThumbnailData ImageManager::ThumbnailCache::lookupData(const DB::FileName &name, int tierSize) const
+{
+    if (tierSize == m_thumbnailSize)
+        return lookupData(name);
+    const ThumbnailCache *tier = tierCache(tierSize);
+    return tier ? tier->lookupData(name) : ThumbnailData();
+}
+
+std::shared_ptr<const ImageManager::ThumbnailMapping> ImageManager::ThumbnailCache::mappingFor(int fileIndex, qint64 minimumSize, quint64 fileGeneration, bool *filesReplaced) const
+{
+    QMutexLocker memcacheLocker(&m_memcacheLock);
+    // Thumbnail files are only replaced while holding the memcache lock:
+    if (m_fileGeneration != fileGeneration) {
+        *filesReplaced = true;
+        return nullptr;
     }
-    QByteArray array(t->map.mid(info.offset, info.size));
-    return array;
+    const auto *cached = m_memcache->object(fileIndex);
+    if (cached && (*cached)->size() >= minimumSize)
+        return *cached;
+
+    // Not mapped yet, or the file has grown since it was mapped.
+    // Replacing the cached mapping does not affect any ThumbnailData still referencing the old one.
+    auto mapping = std::make_shared<const ThumbnailMapping>(fileNameForIndex(fileIndex));
+    if (!mapping->isValid())
+        return nullptr;
+    m_memcache->insert(fileIndex, new std::shared_ptr<const ThumbnailMapping>(mapping));
+    return mapping;
 }
 
 void ImageManager::ThumbnailCache::saveFull()
@@ -285,6 +557,7 @@ void ImageManager::ThumbnailCache::saveFull()
         return;
     }
     QHash<DB::FileName, CacheFileInfo> tempHash = m_hash;
+    const QSet<int> compactedFiles = std::exchange(m_unsavedCompactions, {});
 
     m_unsavedHash.clear();
     m_needsFullSave = false;
@@ -324,6 +597,9 @@ void ImageManager::ThumbnailCache::saveFull()
                 qCWarning(ImageManagerLog, "Could not set permissions on file %s!", qPrintable(realFileName));
             } else {
                 realFile.close();
+                // the index now matches the compacted files:
+                for (const int fileIndex : compactedFiles)
+                    QFile::remove(compactionMarkerForIndex(fileIndex));
                 qCDebug(ImageManagerLog) << "ThumbnailCache::saveFull(): cache saved.";
                 qCDebug(TimingLog, "Saved thumbnail cache with %d images in %f seconds", size(), timer.elapsed() / 1000.0);
                 Q_EMIT saveComplete();
@@ -335,6 +611,7 @@ void ImageManager::ThumbnailCache::saveFull()
         dataLocker.relock();
         m_isDirty = true;
         m_needsFullSave = true;
+        m_unsavedCompactions.unite(compactedFiles);
     }
 }
 
@@ -391,6 +668,7 @@ void ImageManager::ThumbnailCache::saveImpl()
 {
     m_timer->stop();
     saveInternal();
+    scheduleCompaction();
     m_timer->setInterval(THUMBNAIL_CACHE_SAVE_INTERNAL_MS);
     m_timer->setSingleShot(true);
     m_timer->start(THUMBNAIL_CACHE_SAVE_INTERNAL_MS);
@@ -402,13 +680,19 @@ void ImageManager::ThumbnailCache::save()
     m_needsFullSave = true;
     saveLocker.unlock();
     Q_EMIT doSave();
+    for (const auto &tier : m_tiers)
+        tier->save();
 }
 
 void ImageManager::ThumbnailCache::load()
 {
     QFile file(thumbnailPath(INDEXFILE_NAME));
     if (!file.exists()) {
-        qCWarning(ImageManagerLog) << "Thumbnail index file" << file.fileName() << "not found!";
+        // tiers are created on demand, so that's nothing to warn about:
+        if (m_isTier)
+            qCDebug(ImageManagerLog) << "Thumbnail index file" << file.fileName() << "not found!";
+        else
+            qCWarning(ImageManagerLog) << "Thumbnail index file" << file.fileName() << "not found!";
         return;
     }
 
@@ -469,14 +753,22 @@ void ImageManager::ThumbnailCache::load()
         }
         count++;
     }
+    discardUnsavedCompactions();
+    countStaleBytes();
     qCDebug(TimingLog, "Loaded %d (expected: %d) thumbnails in %f seconds", count, expectedCount, timer.elapsed() / 1000.0);
 }
 
 bool ImageManager::ThumbnailCache::contains(const DB::FileName &name) const
 {
-    QMutexLocker dataLocker(&m_dataLock);
-    bool answer = m_hash.contains(name);
-    return answer;
+    return indexSnapshot()->find(storageName(name)) != nullptr;
+}
+
+bool ImageManager::ThumbnailCache::contains(const DB::FileName &name, int tierSize) const
+{
+    if (tierSize == m_thumbnailSize)
+        return contains(name);
+    const ThumbnailCache *tier = tierCache(tierSize);
+    return tier && tier->contains(name);
 }
 
 QString ImageManager::ThumbnailCache::thumbnailPath(const char *utf8FileName) const
@@ -494,6 +786,29 @@ int ImageManager::ThumbnailCache::thumbnailSize() const
     return m_thumbnailSize;
 }
 
+QList<int> ImageManager::ThumbnailCache::tierSizes() const
+{
+    QList<int> sizes { m_thumbnailSize };
+    for (const auto &tier : m_tiers)
+        sizes.append(tier->thumbnailSize());
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+}
+
+int ImageManager::ThumbnailCache::tierFor(const DB::FileName &name, int size) const
+{
+    int largestTier = -1;
+    const auto sizes = tierSizes();
+    for (const int tierSize : sizes) {
+        if (!contains(name, tierSize))
+            continue;
+        if (tierSize >= size)
+            return tierSize;
+        largestTier = tierSize;
+    }
+    return largestTier;
+}
+
 int ImageManager::ThumbnailCache::actualFileVersion() const
 {
     return m_fileVersion;
@@ -516,13 +831,10 @@ DB::FileNameList ImageManager::ThumbnailCache::findIncorrectlySizedThumbnails()
     DB::FileNameList resultList;
     for (auto it = tempHash.constBegin(); it != tempHash.constEnd(); ++it) {
         const auto filename = it.key();
-        auto jpegData = lookupRawData(filename);
+        const auto jpegData = lookupData(filename);
         Q_ASSERT(!jpegData.isNull());
 
-        QBuffer buffer(&jpegData);
-        buffer.open(QIODevice::ReadOnly);
-        QImage image;
-        image.load(&buffer, "JPG");
+        const QImage image = QImage::fromData(jpegData.view(), "JPG");
         const auto size = image.size();
         if (size.width() != m_thumbnailSize && size.height() != m_thumbnailSize) {
             qCDebug(ImageManagerLog) << "Thumbnail for file " << filename.relative() << "has incorrect size:" << size;
@@ -541,6 +853,7 @@ int ImageManager::ThumbnailCache::size() const
 
 void ImageManager::ThumbnailCache::vacuum()
 {
+    QMutexLocker compactionLocker(&m_compactionLock);
     QMutexLocker dataLocker(&m_dataLock);
     while (m_isDirty) {
         dataLocker.unlock();
@@ -552,6 +865,9 @@ void ImageManager::ThumbnailCache::vacuum()
 
     long oldStorageSize = 0;
     const auto backupSuffix = QChar::fromLatin1('~');
+    // lookups must not use the old index with the new thumbnail files:
+    QMutexLocker memcacheLocker(&m_memcacheLock);
+    ++m_fileGeneration;
     // save what we need
     for (int i = 0; i <= m_currentFile; ++i) {
         const auto cacheFile = fileNameForIndex(i);
@@ -576,9 +892,13 @@ void ImageManager::ThumbnailCache::vacuum()
     m_currentFile = 0;
     m_currentOffset = 0;
     m_isDirty = true;
-    m_hash.clear();
+    clearIndex();
     m_unsavedHash.clear();
+    m_staleBytes.clear();
     m_memcache->clear();
+    memcacheLocker.unlock();
+    publishIndex();
+    ++m_fileGeneration;
     dataLocker.unlock();
 
     // rebuild
@@ -593,8 +913,10 @@ void ImageManager::ThumbnailCache::vacuum()
             currentFile = new ThumbnailMapping(fileNameForIndex(currentFileIndex) + backupSuffix);
         }
 
-        const QByteArray imageData(currentFile->map.mid(entry.info.offset, entry.info.size));
-        insert(entry.name, imageData);
+        // insertStored() writes the data right away, so there is no need to copy it.
+        // The thumbnails don't change, so the tiers stay valid:
+        const QByteArray imageData = QByteArray::fromRawData(currentFile->map.constData() + entry.info.offset, entry.info.size);
+        insertStored(entry.name, imageData);
     }
     if (currentFile)
         delete currentFile;
@@ -612,41 +934,391 @@ void ImageManager::ThumbnailCache::vacuum()
         QFile::remove(cacheFile + backupSuffix);
     }
     save();
+    compactionLocker.unlock();
+    for (const auto &tier : m_tiers)
+        tier->vacuum();
 }
 
 void ImageManager::ThumbnailCache::flush()
 {
+    QMutexLocker compactionLocker(&m_compactionLock);
     QMutexLocker dataLocker(&m_dataLock);
+    // lookups must not use the old index with new thumbnail files:
+    QMutexLocker memcacheLocker(&m_memcacheLock);
+    ++m_fileGeneration;
     for (int i = 0; i <= m_currentFile; ++i)
         QFile::remove(fileNameForIndex(i));
+    m_memcache->clear();
+    memcacheLocker.unlock();
     m_currentFile = 0;
     m_currentOffset = 0;
     m_isDirty = true;
-    m_hash.clear();
+    clearIndex();
     m_unsavedHash.clear();
-    m_memcache->clear();
+    m_staleBytes.clear();
+    publishIndex();
+    ++m_fileGeneration;
     dataLocker.unlock();
+    compactionLocker.unlock();
     save();
+    for (const auto &tier : m_tiers)
+        tier->flush();
     Q_EMIT cacheFlushed();
 }
 
 void ImageManager::ThumbnailCache::removeThumbnail(const DB::FileName &fileName)
 {
+    QMutexLocker contentKeyLocker(&m_contentKeyLock);
+    const DB::FileName storedName = m_contentNames.contains(fileName) ? releaseContentKey(fileName) : fileName;
     QMutexLocker dataLocker(&m_dataLock);
+    contentKeyLocker.unlock();
     m_isDirty = true;
-    m_hash.remove(fileName);
+    removeEntry(storedName);
+    publishIndex();
     dataLocker.unlock();
     save();
+    for (const auto &tier : m_tiers)
+        tier->removeThumbnail(fileName);
 }
 void ImageManager::ThumbnailCache::removeThumbnails(const DB::FileNameList &files)
 {
+    QMutexLocker contentKeyLocker(&m_contentKeyLock);
     QMutexLocker dataLocker(&m_dataLock);
     m_isDirty = true;
     for (const DB::FileName &fileName : files) {
-        m_hash.remove(fileName);
+        removeEntry(m_contentNames.contains(fileName) ? releaseContentKey(fileName) : fileName);
     }
+    publishIndex();
     dataLocker.unlock();
+    contentKeyLocker.unlock();
     save();
+    for (const auto &tier : m_tiers)
+        tier->removeThumbnails(files);
+}
+
+void ImageManager::ThumbnailCache::removeEntry(const DB::FileName &storageName)
+{
+    if (storageName.isNull())
+        return;
+    const auto it = m_hash.constFind(storageName);
+    if (it != m_hash.constEnd()) {
+        markStale(it.value());
+        removeIndexEntry(storageName);
+    }
+}
+
+void ImageManager::ThumbnailCache::setContentKey(const DB::FileName &name, const QString &contentKey)
+{
+    const DB::FileName newContentName = contentKey.isEmpty() ? DB::FileName() : contentName(contentKey);
+    QMutexLocker contentKeyLocker(&m_contentKeyLock);
+    if (m_contentNames.value(name) == newContentName)
+        return;
+    const DB::FileName unusedName = m_contentNames.contains(name) ? releaseContentKey(name) : DB::FileName();
+    if (!newContentName.isNull()) {
+        m_contentNames.insert(name, newContentName);
+        m_filesByContentName.insert(newContentName, name);
+    }
+    QMutexLocker dataLocker(&m_dataLock);
+    contentKeyLocker.unlock();
+    removeEntry(unusedName);
+    const bool adopted = !newContentName.isNull() && adoptThumbnail(name, newContentName);
+    publishIndex();
+    dataLocker.unlock();
+    if (adopted) {
+        QMutexLocker saveLocker(&m_saveLock);
+        m_needsFullSave = true;
+    }
+    for (const auto &tier : m_tiers)
+        tier->setContentKey(name, contentKey);
+}
+
+void ImageManager::ThumbnailCache::setContentKeys(const QHash<DB::FileName, QString> &contentKeys)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QHash<DB::FileName, DB::FileName> contentNames;
+    QMultiHash<DB::FileName, DB::FileName> filesByContentName;
+    contentNames.reserve(contentKeys.size());
+    filesByContentName.reserve(contentKeys.size());
+    for (auto it = contentKeys.constBegin(); it != contentKeys.constEnd(); ++it) {
+        if (it.value().isEmpty())
+            continue;
+        const DB::FileName newContentName = contentName(it.value());
+        contentNames.insert(it.key(), newContentName);
+        filesByContentName.insert(newContentName, it.key());
+    }
+
+    QMutexLocker contentKeyLocker(&m_contentKeyLock);
+    m_contentNames = contentNames;
+    m_filesByContentName = filesByContentName;
+    QMutexLocker dataLocker(&m_dataLock);
+    contentKeyLocker.unlock();
+    bool indexChanged = false;
+    for (auto it = contentNames.constBegin(); it != contentNames.constEnd(); ++it) {
+        if (adoptThumbnail(it.key(), it.value()))
+            indexChanged = true;
+    }
+    // drop the thumbnails of content that is no longer in use:
+    DB::FileNameList unusedNames;
+    for (auto it = m_hash.constBegin(); it != m_hash.constEnd(); ++it) {
+        if (isContentName(it.key()) && !filesByContentName.contains(it.key()))
+            unusedNames.append(it.key());
+    }
+    for (const DB::FileName &unusedName : std::as_const(unusedNames))
+        removeEntry(unusedName);
+    if (!unusedNames.isEmpty()) {
+        m_isDirty = true;
+        indexChanged = true;
+    }
+    publishIndex();
+    dataLocker.unlock();
+    if (indexChanged) {
+        QMutexLocker saveLocker(&m_saveLock);
+        m_needsFullSave = true;
+    }
+    qCDebug(TimingLog, "Set %lld thumbnail content keys in %f seconds", static_cast<long long>(contentKeys.size()), timer.elapsed() / 1000.0);
+    for (const auto &tier : m_tiers)
+        tier->setContentKeys(contentKeys);
+}
+
+bool ImageManager::ThumbnailCache::adoptThumbnail(const DB::FileName &name, const DB::FileName &contentName)
+{
+    if (!m_hash.contains(name))
+        return false;
+    // The thumbnail data stays where it is, only the index entry changes:
+    const CacheFileInfo info = m_hash.value(name);
+    removeIndexEntry(name);
+    if (m_hash.contains(contentName))
+        markStale(info);
+    else
+        setIndexEntry(contentName, info);
+    m_isDirty = true;
+    return true;
+}
+
+DB::FileName ImageManager::ThumbnailCache::releaseContentKey(const DB::FileName &name)
+{
+    const DB::FileName oldContentName = m_contentNames.take(name);
+    m_filesByContentName.remove(oldContentName, name);
+    return m_filesByContentName.contains(oldContentName) ? DB::FileName() : oldContentName;
+}
+
+DB::FileName ImageManager::ThumbnailCache::storageName(const DB::FileName &name) const
+{
+    QMutexLocker contentKeyLocker(&m_contentKeyLock);
+    return m_contentNames.value(name, name);
+}
+
+DB::FileNameList ImageManager::ThumbnailCache::filesFor(const DB::FileName &storageName) const
+{
+    QMutexLocker contentKeyLocker(&m_contentKeyLock);
+    if (!m_filesByContentName.contains(storageName))
+        return DB::FileNameList(QList<DB::FileName> { storageName });
+    return DB::FileNameList(m_filesByContentName.values(storageName));
+}
+
+void ImageManager::ThumbnailCache::markStale(const CacheFileInfo &info)
+{
+    m_staleBytes[info.fileIndex] += info.size;
+}
+
+void ImageManager::ThumbnailCache::countStaleBytes()
+{
+    // Everything in a thumbnail file that is not referenced by the index is stale:
+    QHash<int, qint64> usedBytes;
+    for (const CacheFileInfo &info : std::as_const(m_hash))
+        usedBytes[info.fileIndex] += info.size;
+    m_staleBytes.clear();
+    for (int i = 0; i <= m_currentFile; ++i) {
+        const qint64 fileSize = (i == m_currentFile) ? m_currentOffset : QFileInfo(fileNameForIndex(i)).size();
+        const qint64 staleBytes = fileSize - usedBytes.value(i);
+        if (staleBytes > 0)
+            m_staleBytes.insert(i, staleBytes);
+    }
+}
+
+qint64 ImageManager::ThumbnailCache::staleBytes() const
+{
+    QMutexLocker dataLocker(&m_dataLock);
+    qint64 result = 0;
+    for (const qint64 bytes : m_staleBytes)
+        result += bytes;
+    return result;
+}
+
+int ImageManager::ThumbnailCache::compact(double minimumStaleRatio)
+{
+    QMutexLocker compactionLocker(&m_compactionLock);
+    QElapsedTimer timer;
+    timer.start();
+    int compactedFiles = 0;
+    // The files are handled one at a time, so that the other threads are never blocked for long:
+    while (!m_compactionCanceled) {
+        QMutexLocker dataLocker(&m_dataLock);
+        int candidate = -1;
+        for (auto it = m_staleBytes.constBegin(); it != m_staleBytes.constEnd(); ++it) {
+            // the current file is still being appended to:
+            if (it.key() == m_currentFile || it.value() <= 0)
+                continue;
+            const qint64 fileSize = QFileInfo(fileNameForIndex(it.key())).size();
+            if (fileSize <= 0 || it.value() >= minimumStaleRatio * fileSize) {
+                candidate = it.key();
+                break;
+            }
+        }
+        dataLocker.unlock();
+        if (candidate == -1 || !compactFile(candidate))
+            break;
+        ++compactedFiles;
+    }
+    if (compactedFiles > 0)
+        qCDebug(TimingLog, "Compacted %d thumbnail files in %f seconds", compactedFiles, timer.elapsed() / 1000.0);
+    return compactedFiles;
+}
+
+bool ImageManager::ThumbnailCache::compactFile(int fileIndex)
+{
+    struct Entry {
+        DB::FileName name;
+        CacheFileInfo info;
+    };
+    QList<Entry> entries;
+    QMutexLocker dataLocker(&m_dataLock);
+    for (auto it = m_hash.constBegin(); it != m_hash.constEnd(); ++it) {
+        if (it.value().fileIndex == fileIndex)
+            entries.append({ it.key(), it.value() });
+    }
+    dataLocker.unlock();
+    // keep the order of the thumbnails in the file:
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.info.offset < b.info.offset; });
+
+    const QString fileName = fileNameForIndex(fileIndex);
+    QSaveFile compactedFile(fileName);
+    QList<CacheFileInfo> compactedInfos;
+    compactedInfos.reserve(entries.size());
+    if (!entries.isEmpty()) {
+        // Don't use mappingFor(), so that compaction does not push the mappings used for lookups out of the memcache:
+        const ThumbnailMapping source(fileName);
+        if (!source.isValid() || !compactedFile.open(QIODevice::WriteOnly)) {
+            qCWarning(ImageManagerLog) << "Could not compact thumbnail file" << fileName;
+            return false;
+        }
+        int offset = 0;
+        for (const Entry &entry : std::as_const(entries)) {
+            if (qint64(entry.info.offset) + entry.info.size > source.size()
+                || compactedFile.write(source.map.constData() + entry.info.offset, entry.info.size) != entry.info.size) {
+                qCWarning(ImageManagerLog) << "Could not compact thumbnail file" << fileName;
+                compactedFile.cancelWriting();
+                return false;
+            }
+            compactedInfos.append(CacheFileInfo(fileIndex, offset, entry.info.size));
+            offset += entry.info.size;
+        }
+    }
+
+    // Thumbnails that were removed or replaced in the meantime are stale data in the compacted file.
+    // Lookups wait until the index matches the new file; existing mappings of the old file stay valid.
+    dataLocker.relock();
+    // If the index can't be saved after replacing the file, the marker tells load() not to trust the index entries for the file:
+    QFile marker(compactionMarkerForIndex(fileIndex));
+    if (!marker.open(QIODevice::WriteOnly)) {
+        qCWarning(ImageManagerLog) << "Could not create compaction marker" << marker.fileName() << ":" << marker.errorString();
+        return false;
+    }
+    marker.close();
+    QMutexLocker memcacheLocker(&m_memcacheLock);
+    ++m_fileGeneration;
+    if (entries.isEmpty()) {
+        QFile::remove(fileName);
+    } else if (!compactedFile.commit()) {
+        qCWarning(ImageManagerLog) << "Could not replace thumbnail file" << fileName << "by its compacted version:" << compactedFile.errorString();
+        marker.remove();
+        ++m_fileGeneration;
+        return false;
+    }
+    m_unsavedCompactions.insert(fileIndex);
+    m_memcache->remove(fileIndex);
+    memcacheLocker.unlock();
+    qint64 staleBytes = 0;
+    for (qsizetype i = 0; i < entries.size(); ++i) {
+        const CacheFileInfo &oldInfo = entries.at(i).info;
+        const auto it = m_hash.constFind(entries.at(i).name);
+        if (it != m_hash.constEnd() && it->fileIndex == oldInfo.fileIndex && it->offset == oldInfo.offset && it->size == oldInfo.size) {
+            setIndexEntry(entries.at(i).name, compactedInfos.at(i));
+        } else {
+            staleBytes += oldInfo.size;
+        }
+    }
+    if (staleBytes > 0)
+        m_staleBytes.insert(fileIndex, staleBytes);
+    else
+        m_staleBytes.remove(fileIndex);
+    m_isDirty = true;
+    publishIndex();
+    ++m_fileGeneration;
+    dataLocker.unlock();
+
+    // Until the index is saved, the index file on disk does not match the compacted file:
+    QMutexLocker saveLocker(&m_saveLock);
+    m_needsFullSave = true;
+    saveLocker.unlock();
+    saveInternal();
+    return true;
+}
+
+void ImageManager::ThumbnailCache::scheduleCompaction()
+{
+    QMutexLocker dataLocker(&m_dataLock);
+    bool worthCompacting = false;
+    for (auto it = m_staleBytes.constBegin(); it != m_staleBytes.constEnd(); ++it) {
+        if (it.key() != m_currentFile && it.value() >= COMPACTION_MIN_STALE_BYTES) {
+            worthCompacting = true;
+            break;
+        }
+    }
+    dataLocker.unlock();
+    if (!worthCompacting)
+        return;
+    // only one compaction at a time; if one is already running, it picks up all candidates anyway:
+    m_compactionPool.tryStart([this] { compact(COMPACTION_STALE_RATIO); });
+}
+
+std::shared_ptr<const ImageManager::ThumbnailIndexSnapshot> ImageManager::ThumbnailCache::indexSnapshot() const
+{
+    QMutexLocker snapshotLocker(&m_snapshotLock);
+    return m_snapshot;
+}
+
+void ImageManager::ThumbnailCache::setIndexEntry(const DB::FileName &name, const CacheFileInfo &info)
+{
+    m_hash.insert(name, info);
+    m_snapshotChanges.insert(name, info);
+}
+
+void ImageManager::ThumbnailCache::removeIndexEntry(const DB::FileName &name)
+{
+    m_hash.remove(name);
+    m_snapshotChanges.insert(name, CacheFileInfo(REMOVED_ENTRY_FILE_INDEX, 0, 0));
+}
+
+void ImageManager::ThumbnailCache::clearIndex()
+{
+    m_hash.clear();
+    m_snapshotBase.reset();
+    m_snapshotChanges.clear();
+}
+
+void ImageManager::ThumbnailCache::publishIndex()
+{
+    if (!m_snapshotBase || m_snapshotChanges.size() > MAX_SNAPSHOT_CHANGES) {
+        // QHash is implicitly shared, i.e. the index is only copied when it is changed the next time:
+        m_snapshotBase = std::make_shared<const QHash<DB::FileName, CacheFileInfo>>(m_hash);
+        m_snapshotChanges.clear();
+    }
+    auto snapshot = std::make_shared<const ThumbnailIndexSnapshot>(ThumbnailIndexSnapshot { m_snapshotBase, m_snapshotChanges });
+    QMutexLocker snapshotLocker(&m_snapshotLock);
+    // the old snapshot is released after unlocking:
+    std::swap(m_snapshot, snapshot);
 }
 
 void ImageManager::ThumbnailCache::setThumbnailSize(int thumbSize)
@@ -657,6 +1329,8 @@ void ImageManager::ThumbnailCache::setThumbnailSize(int thumbSize)
     if (thumbSize != m_thumbnailSize) {
         m_thumbnailSize = thumbSize;
         flush();
+        for (size_t i = 0; i < m_tiers.size(); ++i)
+            m_tiers[i]->setThumbnailSize(tierSize(thumbSize, TIERS[i]));
         Q_EMIT cacheInvalidated();
     }
 }
@@ -10,11 +10,20 @@
 
 #include <kpabase/FileNameList.h>
 
+#include <QByteArrayView>
 #include <QDir>
 #include <QFile>
 #include <QHash>
 #include <QImage>
 #include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include <memory>
+#include <vector>
 
 template <class Key, class T>
 class QCache;
@@ -22,8 +31,46 @@ class QCache;
 namespace ImageManager
 {
 
+class ThumbnailIndexSnapshot;
 class ThumbnailMapping;
 
+/**
+ * @brief The ThumbnailData class is a read-only view of the JPEG data of a thumbnail.
+ *
+ * The data is not copied, but points directly into the memory-mapped thumbnail file.
+ * The ThumbnailData object keeps the mapping alive, i.e. the data stays valid as long
+ * as the ThumbnailData object (or a copy of it) exists - even if the ThumbnailCache
+ * has remapped, flushed or vacuumed the thumbnail file in the meantime.
+ *
+ * Copying a ThumbnailData object is cheap.
+ */
+class ThumbnailData
+{
+public:
+    ThumbnailData() = default;
+    ThumbnailData(std::shared_ptr<const ThumbnailMapping> mapping, QByteArrayView data);
+
+    bool isNull() const { return m_data.isNull(); }
+    qsizetype size() const { return m_data.size(); }
+    /**
+     * @return the thumbnail data; the view is valid for the lifetime of this object.
+     */
+    QByteArrayView view() const { return m_data; }
+    /**
+     * @brief rawData wraps the thumbnail data in a QByteArray without copying it.
+     * Like QByteArray::fromRawData(), the returned QByteArray must not outlive this object.
+     */
+    QByteArray rawData() const { return QByteArray::fromRawData(m_data.data(), m_data.size()); }
+    /**
+     * @return a deep copy of the thumbnail data.
+     */
+    QByteArray toByteArray() const { return m_data.toByteArray(); }
+
+private:
+    std::shared_ptr<const ThumbnailMapping> m_mapping;
+    QByteArrayView m_data;
+};
+
 /**
  * @brief The ThumbnailCache implements thumbnail storage optimized for speed.
  *
@@ -41,9 +88,32 @@ class ThumbnailMapping;
  * shown together, data locality is used to our advantage.
  *
  * ## Caveats
- * Note that thumbnails are only ever added, never deleted from the thumbnail files.
- * Old images remain in the thumbnail files - they are just removed from the index file.
- * Call vacuum() to clear out the removed image data from thumbnail files.
+ * Note that thumbnails are only ever appended to the thumbnail files.
+ * Removed or replaced thumbnails remain in the thumbnail files - they are just removed from the index file.
+ *
+ * The cache keeps track of the amount of such stale data in each thumbnail file.
+ * Files that consist mostly of stale data are compacted in the background, one file at a time
+ * (see compact()). Call vacuum() to rewrite all thumbnail files at once.
+ *
+ * ## Size tiers
+ * Besides the thumbnails of thumbnailSize(), the cache holds thumbnails in additional size tiers
+ * of half and double the thumbnail size. Each tier is stored like the main cache, in a sub-directory
+ * of the thumbnail directory.
+ * Consumers that need a smaller or a larger thumbnail can use the nearest tier (see tierFor())
+ * instead of scaling down the regular thumbnail or decoding the original image.
+ * Inserting a thumbnail removes the outdated thumbnails from all tiers. The tiers are filled by the consumers:
+ * the smaller tier when a thumbnail is read from a larger tier, and the larger tier when the original image is decoded anyway.
+ *
+ * ## Concurrency
+ * All methods are thread-safe. Lookups (contains(), lookupData()) don't use the index itself,
+ * but an immutable snapshot of it that is replaced whenever the index changes.
+ * Therefore, lookups from the GUI thread don't have to wait while other threads insert thumbnails or save the index.
+ *
+ * ## Content keys
+ * Usually, thumbnails are stored by file name. If a file has a content key (see setContentKey()),
+ * its thumbnail is stored by content key instead. Files with identical content then share a single thumbnail,
+ * and a file that is renamed or moved keeps its thumbnail without re-decoding the image.
+ * Content keys are not stored in the index file; they need to be set again whenever the cache is created.
  *
  * ## Further reading
  * - https://specifications.freedesktop.org/thumbnail-spec/thumbnail-spec-latest.html
@@ -69,10 +139,24 @@ public:
     /**
      * @brief insert inserts raw JPEG-encoded data into the thumbnail database.
      * It is recommended that you use insert(const DB::FileName&, const QImage&) if possible.
+     *
+     * This method is thread-safe. Concurrent inserts are written in batches:
+     * one of the inserting threads appends the data of all pending thumbnails to the thumbnail file
+     * with a single write, and the index entries of the whole batch become visible at once.
+     * When the method returns, the thumbnail is contained in the cache,
+     * and the outdated thumbnails for the file have been removed from the other size tiers.
      * @param name the image file name
      * @param thumbnailData the JPEG encoded image data
      */
     void insert(const DB::FileName &name, const QByteArray &thumbnailData);
+    /**
+     * @brief Insert a thumbnail into the tier with the given size.
+     * If \p tierSize is thumbnailSize(), this is the same as insert(const DB::FileName&, const QImage&).
+     * @param name the image file name
+     * @param image the thumbnail data; it should fit into a square of \p tierSize pixels.
+     * @param tierSize one of the tierSizes()
+     */
+    void insert(const DB::FileName &name, const QImage &image, int tierSize);
     /**
      * @brief lookup and return the thumbnail for the given file.
      * Note: this method requires a GuiApplication to exist.
@@ -84,16 +168,40 @@ public:
      * @brief lookupRawData
      * @param name the image file name
      * @return the raw JPEG thumbnail data or a null QByteArray.
+     * @see lookupData() for a variant that does not copy the data.
      */
     QByteArray lookupRawData(const DB::FileName &name) const;
+    /**
+     * @brief lookupData returns the raw JPEG thumbnail data without copying it.
+     * This method is thread-safe and can be called concurrently with insert().
+     * @param name the image file name
+     * @return a view of the thumbnail data, or a null ThumbnailData if no thumbnail was found.
+     */
+    ThumbnailData lookupData(const DB::FileName &name) const;
+    /**
+     * @brief lookupData returns the raw JPEG thumbnail data from the tier with the given size.
+     * @param name the image file name
+     * @param tierSize one of the tierSizes()
+     * @return a view of the thumbnail data, or a null ThumbnailData if no thumbnail was found.
+     */
+    ThumbnailData lookupData(const DB::FileName &name, int tierSize) const;
     /**
      * @brief Check if the ThumbnailCache contains a thumbnail for the given file.
      * @param name the image file name
      * @return \c true if the thumbnail exists, \c false otherwise.
      */
     bool contains(const DB::FileName &name) const;
+    /**
+     * @brief Check if the tier with the given size contains a thumbnail for the given file.
+     * @param name the image file name
+     * @param tierSize one of the tierSizes()
+     * @return \c true if the thumbnail exists, \c false otherwise.
+     */
+    bool contains(const DB::FileName &name, int tierSize) const;
     /**
      * @brief "Forget" the thumbnail for an image.
+     * If the image has a content key, the content key is removed as well.
+     * A thumbnail that is shared with other files via its content key stays in the cache for the other files.
      * @param name the image file name
      */
     void removeThumbnail(const DB::FileName &name);
@@ -104,6 +212,24 @@ public:
      */
     void removeThumbnails(const DB::FileNameList &names);
 
+    /**
+     * @brief setContentKey stores the thumbnail of a file under a key that identifies the content of the file.
+     *
+     * All files with the same content key share one thumbnail. The content key must change
+     * whenever the thumbnail would change, e.g. when the image is rotated.
+     * If the file already has a thumbnail that is stored by file name, it becomes the thumbnail for the content key.
+     * @param name the image file name
+     * @param contentKey a key identifying the file content, or an empty string to store the thumbnail by file name.
+     */
+    void setContentKey(const DB::FileName &name, const QString &contentKey);
+    /**
+     * @brief setContentKeys replaces the content keys of all files.
+     * Thumbnails of content keys that are no longer used by any file are removed.
+     * @param contentKeys the content key for each file that has one
+     * @see setContentKey()
+     */
+    void setContentKeys(const QHash<DB::FileName, QString> &contentKeys);
+
     /**
      * @brief thumbnailSize
      * Usually, this is the size of the thumbnails in the cache.
@@ -113,6 +239,21 @@ public:
      */
     int thumbnailSize() const;
 
+    /**
+     * @brief tierSizes
+     * @return the thumbnail sizes of all tiers in ascending order, including thumbnailSize().
+     */
+    QList<int> tierSizes() const;
+
+    /**
+     * @brief tierFor chooses the tier to use for a thumbnail of the given size.
+     * @param name the image file name
+     * @param size the size (i.e. the longer side) of the thumbnail that is needed
+     * @return the smallest tier of at least \p size pixels that contains a thumbnail for the file.
+     * If there is no such tier, the largest tier containing a thumbnail is returned, or -1 if there is no thumbnail at all.
+     */
+    int tierFor(const DB::FileName &name, int size) const;
+
     /**
      * @brief Returns the file format version of the thumbnailindex file currently on disk.
      *
@@ -149,6 +290,30 @@ public:
      */
     void vacuum();
 
+    /**
+     * @brief Compacts the thumbnail files that contain a large share of stale data.
+     *
+     * Unlike vacuum(), this method rewrites one file at a time and only the files where
+     * the share of stale data is at least \p minimumStaleRatio. The file that new thumbnails
+     * are currently appended to is never compacted.
+     *
+     * Thumbnails can be inserted and looked up while a file is being compacted.
+     * The compacted file replaces the old one atomically; ThumbnailData objects that refer to
+     * the old file keep it alive until they are destroyed.
+     * To ensure consistency, the cache is saved after each rewritten file.
+     *
+     * This method is called periodically in a background thread.
+     * @param minimumStaleRatio the share of stale data that a file needs to have to be compacted
+     * @return the number of compacted thumbnail files
+     */
+    int compact(double minimumStaleRatio);
+
+    /**
+     * @brief staleBytes
+     * @return the number of bytes in the thumbnail files that belong to removed or replaced thumbnails.
+     */
+    qint64 staleBytes() const;
+
 public Q_SLOTS:
     /**
      * @brief Save the thumbnail cache to disk.
@@ -203,6 +368,57 @@ Q_SIGNALS:
     void thumbnailUpdated(const DB::FileName &name);
 
 private:
+    /**
+     * @brief Create a cache with a fixed thumbnail size.
+     * @param baseDirectory the directory in which the \c thumbnailindex file resides.
+     * @param tierSize the thumbnail size of a size tier, or 0 for the main cache.
+     */
+    ThumbnailCache(const QString &baseDirectory, int tierSize);
+    /**
+     * @brief tierCache
+     * @return the cache for the tier with the given size, or \c nullptr if there is no such tier.
+     */
+    ThumbnailCache *tierCache(int tierSize) const;
+    /**
+     * @brief invalidateTiers removes the thumbnail for a file from all tiers, because it is most likely outdated.
+     */
+    void invalidateTiers(const DB::FileName &name);
+    /**
+     * @brief insertStored writes the thumbnail data under the given storage name, without touching the tiers.
+     * @param storedName the name under which the thumbnail is stored (see storageName())
+     * @param thumbnailData the JPEG encoded image data
+     * @see insert(const DB::FileName &, const QByteArray &)
+     */
+    void insertStored(const DB::FileName &storedName, const QByteArray &thumbnailData);
+
+    /**
+     * @brief storageName
+     * @return the name under which the thumbnail for the given file is stored in the index.
+     */
+    DB::FileName storageName(const DB::FileName &name) const;
+    /**
+     * @brief filesFor
+     * @return all files whose thumbnail is stored under the given name.
+     */
+    DB::FileNameList filesFor(const DB::FileName &storageName) const;
+    /**
+     * @brief releaseContentKey removes the content key of a file.
+     * The caller must hold m_contentKeyLock.
+     * @return the storage name of the thumbnail if it is no longer used by any file, or a null FileName.
+     */
+    DB::FileName releaseContentKey(const DB::FileName &name);
+    /**
+     * @brief adoptThumbnail turns a thumbnail that is stored by file name into the thumbnail for a content name.
+     * The caller must hold m_dataLock, and needs to request a full save if the index was changed.
+     * @return \c true if the index was changed
+     */
+    bool adoptThumbnail(const DB::FileName &name, const DB::FileName &contentName);
+    /**
+     * @brief removeEntry removes a thumbnail from the index.
+     * The caller must hold m_dataLock.
+     */
+    void removeEntry(const DB::FileName &storageName);
+
     /**
      * @brief load the \c thumbnailindex file if possible.
      * This function populates the thumbnail hash, but does not
@@ -212,6 +428,19 @@ private:
      */
     void load();
     QString fileNameForIndex(int index) const;
+    /**
+     * @brief compactionMarkerForIndex
+     * The marker file exists while the thumbnail file has been compacted, but the index file has not been saved since.
+     * @param index the index of the thumbnail file
+     * @return the file path of the compaction marker for the thumbnail file
+     */
+    QString compactionMarkerForIndex(int index) const;
+    /**
+     * @brief discardUnsavedCompactions removes the thumbnails of all files that have a compaction marker from the index.
+     * If a compaction was interrupted before the index was saved, the index entries for the file don't match its content.
+     * The caller must hold m_dataLock.
+     */
+    void discardUnsavedCompactions();
     /**
      * @brief thumbnailPath
      * @param utf8FileName the name of the file (does not have to exist), UTF-8 encoded
@@ -224,18 +453,127 @@ private:
      * @return the file path for the named file in the thumbnail directory
      */
     QString thumbnailPath(const QString &fileName) const;
+    /**
+     * @brief mappingFor returns a memory mapping of the thumbnail file with the given index.
+     * If the cached mapping of the file is shorter than \p minimumSize (i.e. the file has grown since
+     * it was mapped), the file is mapped again. Existing users of the old mapping are not affected.
+     * @param fileIndex the index of the thumbnail file
+     * @param minimumSize the number of bytes that the mapping needs to cover
+     * @param fileGeneration the value of m_fileGeneration when the caller looked up the index entry
+     * @param filesReplaced is set to \c true if thumbnail files have been replaced since then
+     * @return the mapping, or a \c nullptr if the file could not be mapped or if thumbnail files have been replaced
+     */
+    std::shared_ptr<const ThumbnailMapping> mappingFor(int fileIndex, qint64 minimumSize, quint64 fileGeneration, bool *filesReplaced) const;
+    /**
+     * @brief indexSnapshot
+     * @return the current snapshot of the index, for lookups that must not wait for writers.
+     */
+    std::shared_ptr<const ThumbnailIndexSnapshot> indexSnapshot() const;
+    /**
+     * @brief setIndexEntry adds or replaces an entry of the index.
+     * The caller must hold m_dataLock and call publishIndex() afterwards.
+     */
+    void setIndexEntry(const DB::FileName &name, const CacheFileInfo &info);
+    /**
+     * @brief removeIndexEntry removes an entry from the index.
+     * The caller must hold m_dataLock and call publishIndex() afterwards.
+     */
+    void removeIndexEntry(const DB::FileName &name);
+    /**
+     * @brief clearIndex removes all entries from the index.
+     * The caller must hold m_dataLock and call publishIndex() afterwards.
+     */
+    void clearIndex();
+    /**
+     * @brief publishIndex replaces the index snapshot used by lookups with the current index.
+     * The caller must hold m_dataLock.
+     */
+    void publishIndex();
+
+    struct PendingThumbnail {
+        DB::FileName name;
+        QByteArray data;
+    };
+    /**
+     * @brief writeThumbnails appends a batch of thumbnails to the thumbnail files and adds them to the index.
+     * Only one thread at a time may call this method.
+     */
+    void writeThumbnails(const QList<PendingThumbnail> &batch);
+    /**
+     * @brief appendToThumbnailFile writes data to the thumbnail file with the given index.
+     * The caller must hold m_thumbnailWriterLock.
+     * @return \c true, if the data was written and flushed successfully
+     */
+    bool appendToThumbnailFile(int fileIndex, int offset, const QByteArray &data);
+    /**
+     * @brief markStale records that a thumbnail in a thumbnail file is no longer used.
+     * The caller must hold m_dataLock.
+     */
+    void markStale(const CacheFileInfo &info);
+    /**
+     * @brief countStaleBytes determines the amount of stale data per thumbnail file from the file sizes and the index.
+     * The caller must hold m_dataLock.
+     */
+    void countStaleBytes();
+    /**
+     * @brief compactFile rewrites a single thumbnail file, keeping only the thumbnails that are still in the index.
+     * The compaction marker of the file is created before the file is replaced and removed once the index is saved.
+     * The caller must hold m_compactionLock.
+     * @return \c true if the file was compacted
+     */
+    bool compactFile(int fileIndex);
+    /**
+     * @brief scheduleCompaction runs compact() in a background thread if a thumbnail file is worth compacting.
+     */
+    void scheduleCompaction();
 
     int m_fileVersion = -1;
     int m_thumbnailSize = -1;
     const QDir m_baseDir;
+    /* The additional size tiers; tier caches don't have tiers themselves */
+    std::vector<std::unique_ptr<ThumbnailCache>> m_tiers;
+    /* The index; only change it using setIndexEntry(), removeIndexEntry() and clearIndex() */
     QHash<DB::FileName, CacheFileInfo> m_hash;
     QHash<DB::FileName, CacheFileInfo> m_unsavedHash;
-    /* Protects accesses to the data (hash and unsaved hash) */
+    /* The index as seen by lookups; protected by m_snapshotLock, which is never held for longer than it takes to copy the pointer */
+    std::shared_ptr<const ThumbnailIndexSnapshot> m_snapshot;
+    mutable QMutex m_snapshotLock;
+    /* The parts of the next snapshot: an older copy of the index and the entries that changed since; protected by m_dataLock */
+    std::shared_ptr<const QHash<DB::FileName, CacheFileInfo>> m_snapshotBase;
+    QHash<DB::FileName, CacheFileInfo> m_snapshotChanges;
+    /* Incremented before and after thumbnail files are replaced or removed, i.e. odd while that happens.
+     * Files are only replaced or removed while holding both m_dataLock and m_memcacheLock. */
+    std::atomic<quint64> m_fileGeneration = 0;
+    /* Protects accesses to the data (hash and unsaved hash); lookups don't need it */
     mutable QMutex m_dataLock;
     /* Prevents multiple saves from happening simultaneously */
     QMutex m_saveLock;
     /* Protects writing thumbnails to disk */
     QMutex m_thumbnailWriterLock;
+    /* Protects the write queue and the fields below it */
+    QMutex m_writeQueueLock;
+    QWaitCondition m_writeQueueCondition;
+    /* Thumbnails waiting to be written by the next batch */
+    QList<PendingThumbnail> m_writeQueue;
+    /* Set while a thread is writing a batch */
+    bool m_writerActive = false;
+    /* Number of thumbnails queued and written so far; used to find out whether a queued thumbnail is written */
+    quint64 m_queuedCount = 0;
+    quint64 m_writtenCount = 0;
+    /* Number of bytes per thumbnail file that belong to removed or replaced thumbnails; protected by m_dataLock */
+    QHash<int, qint64> m_staleBytes;
+    /* Thumbnail files that were compacted since the index was last saved in full; protected by m_dataLock */
+    QSet<int> m_unsavedCompactions;
+    /* Prevents compaction, vacuum() and flush() from running at the same time */
+    QMutex m_compactionLock;
+    /* Runs the background compaction */
+    QThreadPool m_compactionPool;
+    std::atomic<bool> m_compactionCanceled = false;
+    /* Storage name for each file with a content key, and the files for each storage name; protected by m_contentKeyLock.
+     * If both m_contentKeyLock and m_dataLock are needed, m_contentKeyLock must be locked first. */
+    QHash<DB::FileName, DB::FileName> m_contentNames;
+    QMultiHash<DB::FileName, DB::FileName> m_filesByContentName;
+    mutable QMutex m_contentKeyLock;
     int m_currentFile;
     int m_currentOffset;
     QTimer *m_timer;
@@ -261,9 +599,14 @@ private:
 
     /**
      * Holds an in-memory cache of thumbnail files.
+     * Mappings are shared with the ThumbnailData objects handed out by lookupData(),
+     * so evicting a mapping from the cache does not invalidate data that is still in use.
      */
-    mutable QCache<int, ThumbnailMapping> *m_memcache;
+    mutable QCache<int, std::shared_ptr<const ThumbnailMapping>> *m_memcache;
+    /* Protects accesses to the memcache */
+    mutable QMutex m_memcacheLock;
     mutable QFile *m_currentWriter;
+    const bool m_isTier;
 };
 
 /**
@@ -271,6 +614,15 @@ private:
  * @return the default thumbnail (sub-)directory name, e.g. ".thumbnails"
  */
 QString defaultThumbnailDirectory();
+
+/**
+ * @brief contentKeyFor
+ * The thumbnail depends on the rotation as well as on the file content.
+ * @param md5Hex the checksum of the image file, as a hex string
+ * @param angle the rotation of the image
+ * @return the content key for the thumbnail of an image, as used by ThumbnailCache::setContentKey()
+ */
+QString contentKeyFor(const QString &md5Hex, int angle);
 }
 
 #endif /* KPATHUMBNAILS_THUMBNAILCACHE_H */
@@ -0,0 +1,257 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "ThumbnailPipeline.h"
+
+#include "JpegCodec.h"
+#include "ThumbnailCache.h"
+
+#include <kpabase/Logging.h>
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QThread>
+#include <QTransform>
+#include <QWaitCondition>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace
+{
+struct Item {
+    DB::FileName fileName;
+    int angle = 0;
+    QImage image;
+};
+
+/**
+ * A queue that blocks the producer while it is full and the consumer while it is empty.
+ */
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity)
+        : m_capacity(qMax(1, capacity))
+    {
+    }
+    void push(Item item)
+    {
+        QMutexLocker locker(&m_lock);
+        while (m_items.size() >= m_capacity)
+            m_notFull.wait(&m_lock);
+        m_items.enqueue(std::move(item));
+        m_notEmpty.wakeOne();
+    }
+    /**
+     * @return \c false if the queue is closed and there are no more items
+     */
+    bool pop(Item &item)
+    {
+        QMutexLocker locker(&m_lock);
+        while (m_items.isEmpty() && !m_closed)
+            m_notEmpty.wait(&m_lock);
+        if (m_items.isEmpty())
+            return false;
+        item = m_items.dequeue();
+        m_notFull.wakeOne();
+        return true;
+    }
+    void close()
+    {
+        QMutexLocker locker(&m_lock);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+    }
+
+private:
+    const int m_capacity;
+    QMutex m_lock;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<Item> m_items;
+    bool m_closed = false;
+};
+
+struct Stage {
+    Stage(const QString &name, int threads, int queueCapacity)
+        : name(name)
+        , threads(qMax(1, threads))
+        , input(queueCapacity)
+        , running(this->threads)
+    {
+    }
+    const QString name;
+    const int threads;
+    BoundedQueue input;
+    QAtomicInteger<qint64> items = 0;
+    QAtomicInteger<qint64> busyNanoseconds = 0;
+    /// Number of threads that are still running; the last one closes the input queue of the next stage.
+    QAtomicInt running;
+};
+
+bool decode(Item &item, int thumbnailSize)
+{
+    QFile file(item.fileName.absolute());
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(ImageManagerLog) << "Could not open image file" << item.fileName.relative();
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (data.startsWith("\xFF\xD8"))
+        item.image = ImageManager::decodeJpeg(data, thumbnailSize);
+    // not a JPEG file, or one that libjpeg can't decode into RGB:
+    if (item.image.isNull())
+        item.image = QImage::fromData(data);
+    if (item.image.isNull()) {
+        qCWarning(ImageManagerLog) << "Could not decode image file" << item.fileName.relative();
+        return false;
+    }
+    return true;
+}
+
+bool scale(Item &item, int thumbnailSize)
+{
+    if (item.angle != 0) {
+        QTransform matrix;
+        matrix.rotate(item.angle);
+        item.image = item.image.transformed(matrix);
+    }
+    if (item.image.width() > thumbnailSize || item.image.height() > thumbnailSize)
+        item.image = item.image.scaled(thumbnailSize, thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return true;
+}
+
+bool store(Item &item, ImageManager::ThumbnailCache *thumbnailCache)
+{
+    const QByteArray data = ImageManager::encodeJpeg(item.image);
+    item.image = QImage();
+    if (data.isNull()) {
+        qCWarning(ImageManagerLog) << "Could not encode thumbnail for" << item.fileName.relative();
+        return false;
+    }
+    thumbnailCache->insert(item.fileName, data);
+    return true;
+}
+}
+
+struct ImageManager::ThumbnailPipeline::Private {
+    Private(ThumbnailCache *thumbnailCache, const Configuration &configuration)
+        : thumbnailCache(thumbnailCache)
+        , configuration(configuration)
+        , decodeStage(QStringLiteral("decode"), configuration.decodeThreads, configuration.queueCapacity)
+        , scaleStage(QStringLiteral("scale"), configuration.scaleThreads, configuration.queueCapacity)
+        , storeStage(QStringLiteral("store"), configuration.storeThreads, configuration.queueCapacity)
+    {
+    }
+
+    void startStage(Stage &stage, Stage *next, const std::function<bool(Item &)> &work)
+    {
+        for (int i = 0; i < stage.threads; ++i) {
+            threads.emplace_back(QThread::create([this, &stage, next, work] {
+                Item item;
+                while (stage.input.pop(item)) {
+                    QElapsedTimer timer;
+                    timer.start();
+                    const bool ok = work(item);
+                    stage.busyNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+                    stage.items.fetchAndAddRelaxed(1);
+                    if (!ok)
+                        failed.fetchAndAddRelaxed(1);
+                    else if (next)
+                        next->input.push(std::move(item));
+                }
+                if (!stage.running.deref() && next)
+                    next->input.close();
+            }));
+            threads.back()->start();
+        }
+    }
+
+    ThumbnailCache *const thumbnailCache;
+    const Configuration configuration;
+    Stage decodeStage;
+    Stage scaleStage;
+    Stage storeStage;
+    QAtomicInt failed = 0;
+    std::vector<std::unique_ptr<QThread>> threads;
+    QElapsedTimer timer;
+    qint64 elapsed = -1;
+};
+
+double ImageManager::ThumbnailPipeline::StageStatistics::throughput() const
+{
+    if (busyNanoseconds <= 0)
+        return 0.0;
+    return items * threads * 1e9 / busyNanoseconds;
+}
+
+ImageManager::ThumbnailPipeline::ThumbnailPipeline(ThumbnailCache *thumbnailCache, const Configuration &configuration)
+    : d(std::make_unique<Private>(thumbnailCache, configuration))
+{
+    const int thumbnailSize = configuration.thumbnailSize;
+    d->timer.start();
+    d->startStage(d->decodeStage, &d->scaleStage, [thumbnailSize](Item &item) { return decode(item, thumbnailSize); });
+    d->startStage(d->scaleStage, &d->storeStage, [thumbnailSize](Item &item) { return scale(item, thumbnailSize); });
+    d->startStage(d->storeStage, nullptr, [thumbnailCache](Item &item) { return store(item, thumbnailCache); });
+}
+
+ImageManager::ThumbnailPipeline::~ThumbnailPipeline()
+{
+    finish();
+}
+
+void ImageManager::ThumbnailPipeline::add(const DB::FileName &fileName, int angle)
+{
+    Q_ASSERT(d->elapsed == -1);
+    d->decodeStage.input.push(Item { fileName, angle, QImage() });
+}
+
+void ImageManager::ThumbnailPipeline::finish()
+{
+    if (d->elapsed != -1)
+        return;
+    d->decodeStage.input.close();
+    for (const auto &thread : d->threads)
+        thread->wait();
+    d->elapsed = d->timer.elapsed();
+}
+
+QList<ImageManager::ThumbnailPipeline::StageStatistics> ImageManager::ThumbnailPipeline::statistics() const
+{
+    QList<StageStatistics> result;
+    for (const Stage *stage : { &d->decodeStage, &d->scaleStage, &d->storeStage }) {
+        result.append({ stage->name, stage->threads, stage->items.loadRelaxed(), stage->busyNanoseconds.loadRelaxed() });
+    }
+    return result;
+}
+
+int ImageManager::ThumbnailPipeline::failedCount() const
+{
+    return d->failed.loadRelaxed();
+}
+
+qint64 ImageManager::ThumbnailPipeline::elapsedMilliseconds() const
+{
+    return d->elapsed != -1 ? d->elapsed : d->timer.elapsed();
+}
+
+void ImageManager::ThumbnailPipeline::logStatistics() const
+{
+    const auto stages = statistics();
+    for (const StageStatistics &stage : stages) {
+        qCInfo(TimingLog, "ThumbnailPipeline: stage %s (%d threads): %lld items, %.1f items/s",
+               qPrintable(stage.name), stage.threads, stage.items, stage.throughput());
+    }
+    qCInfo(TimingLog, "ThumbnailPipeline: %lld images (%d failed) in %lld ms",
+           stages.constFirst().items, failedCount(), elapsedMilliseconds());
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,117 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef KPATHUMBNAILS_THUMBNAILPIPELINE_H
+#define KPATHUMBNAILS_THUMBNAILPIPELINE_H
+
+#include <kpabase/FileName.h>
+
+#include <QList>
+#include <QString>
+
+#include <memory>
+
+namespace ImageManager
+{
+
+class ThumbnailCache;
+
+/**
+ * @brief The ThumbnailPipeline creates thumbnails for a stream of image files.
+ *
+ * Thumbnail creation is split into three stages, each running in its own set of threads:
+ *  -# \b decode reads the image file and decodes it. JPEG files are decoded using the DCT scaling
+ *     of libjpeg (see decodeJpeg()), so that only about as many pixels as needed are decoded.
+ *  -# \b scale rotates the image and scales it to the thumbnail size using Qt's smooth scaling,
+ *     which is vectorized on all common platforms.
+ *  -# \b store encodes the thumbnail (see encodeJpeg()) and inserts it into the ThumbnailCache,
+ *     which batches concurrent inserts.
+ *
+ * The stages are connected by bounded queues, so that a slow stage throttles the ones before it
+ * instead of piling up decoded images in memory.
+ * The number of threads can be configured separately for each stage.
+ *
+ * The pipeline records how many items each stage has processed and how much time it spent on them.
+ * This makes it easy to find out which stage is the bottleneck.
+ */
+class ThumbnailPipeline
+{
+public:
+    struct Configuration {
+        /// Size of the longer side of the thumbnails.
+        int thumbnailSize = 256;
+        int decodeThreads = 2;
+        int scaleThreads = 1;
+        int storeThreads = 1;
+        /// Maximum number of items waiting in front of each stage.
+        int queueCapacity = 16;
+    };
+
+    struct StageStatistics {
+        QString name;
+        int threads = 0;
+        qint64 items = 0;
+        /// Time spent processing items, summed up over all threads of the stage.
+        qint64 busyNanoseconds = 0;
+        /**
+         * @return the number of items per second that the stage can process with its threads.
+         * Waiting times are not included, so this is the throughput the stage would have if it were the bottleneck.
+         */
+        double throughput() const;
+    };
+
+    /**
+     * @brief Creates the pipeline and starts its threads.
+     * @param thumbnailCache the cache that the thumbnails are inserted into
+     * @param configuration
+     */
+    ThumbnailPipeline(ThumbnailCache *thumbnailCache, const Configuration &configuration);
+    /**
+     * @brief Waits for all queued images to be processed.
+     * @see finish()
+     */
+    ~ThumbnailPipeline();
+    ThumbnailPipeline(const ThumbnailPipeline &) = delete;
+    ThumbnailPipeline &operator=(const ThumbnailPipeline &) = delete;
+
+    /**
+     * @brief add an image file to the pipeline.
+     * If the decode stage is fully booked, this method blocks until there is room in its queue.
+     * @param fileName the image file
+     * @param angle the rotation that is applied to the thumbnail
+     */
+    void add(const DB::FileName &fileName, int angle = 0);
+    /**
+     * @brief finish waits for all queued images to be processed and stops the threads.
+     * After calling finish(), no more images can be added.
+     */
+    void finish();
+
+    /**
+     * @return the statistics for each stage, in processing order
+     */
+    QList<StageStatistics> statistics() const;
+    /**
+     * @return the number of images for which no thumbnail could be created
+     */
+    int failedCount() const;
+    /**
+     * @return the time between starting and finishing the pipeline
+     */
+    qint64 elapsedMilliseconds() const;
+    /**
+     * @brief logStatistics writes the statistics to the timing log.
+     */
+    void logStatistics() const;
+
+private:
+    struct Private;
+    std::unique_ptr<Private> d;
+};
+
+}
+
+#endif /* KPATHUMBNAILS_THUMBNAILPIPELINE_H */
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,125 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "TestCategoryMatcher.h"
+
+#include "TestDatabaseFixture.h"
+
+#include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
+#include <DB/search/ImageSearchInfo.h>
+#include <kpabase/FileName.h>
+
+#include <QHashSeed>
+
+namespace
+{
+constexpr auto msgPreconditionFailed = "Precondition for test failed - please fix unit test!";
+// Family = { Jesper, Anne Helene }, Europe = { Oslo, Berlin }
+constexpr auto indexXml {
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<KPhotoAlbum version=\"11\" compressed=\"1\">\n"
+    " <Categories>\n"
+    "  <Category name=\"Events\" id=\"1\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"0\">\n"
+    "   <value value=\"untagged\" id=\"1\" meta=\"mark-untagged\"/>\n"
+    "  </Category>\n"
+    "  <Category name=\"People\" id=\"2\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"1\">\n"
+    "   <value value=\"Jesper\" id=\"1\"/>\n"
+    "   <value value=\"Anne Helene\" id=\"2\"/>\n"
+    "   <value value=\"Tobias\" id=\"3\"/>\n"
+    "   <value value=\"Family\" id=\"4\"/>\n"
+    "  </Category>\n"
+    "  <Category name=\"Places\" id=\"3\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"0\">\n"
+    "   <value value=\"Oslo\" id=\"1\"/>\n"
+    "   <value value=\"Berlin\" id=\"2\"/>\n"
+    "   <value value=\"Europe\" id=\"3\"/>\n"
+    "  </Category>\n"
+    " </Categories>\n"
+    " <images>\n"
+    "  <image file=\"a.jpg\" startDate=\"2026-01-01T10:00:00\" md5sum=\"00000000000000000000000000000001\" width=\"640\" height=\"480\" tags_2=\"1\" tags_3=\"1\"/>\n"
+    "  <image file=\"b.jpg\" startDate=\"2026-01-01T10:01:00\" md5sum=\"00000000000000000000000000000002\" width=\"640\" height=\"480\" tags_2=\"1,2\" tags_3=\"1\"/>\n"
+    "  <image file=\"c.jpg\" startDate=\"2026-01-01T10:02:00\" md5sum=\"00000000000000000000000000000003\" width=\"640\" height=\"480\"/>\n"
+    "  <image file=\"d.jpg\" startDate=\"2026-01-01T10:03:00\" md5sum=\"00000000000000000000000000000004\" width=\"640\" height=\"480\" tags_2=\"2\" tags_3=\"2\"/>\n"
+    "  <image file=\"e.jpg\" startDate=\"2026-01-01T10:04:00\" md5sum=\"00000000000000000000000000000005\" width=\"640\" height=\"480\" tags_2=\"3\"/>\n"
+    "  <image file=\"f.jpg\" startDate=\"2026-01-01T10:05:00\" md5sum=\"00000000000000000000000000000006\" width=\"640\" height=\"480\" tags_2=\"1,3\" tags_3=\"2\"/>\n"
+    " </images>\n"
+    " <member-groups>\n"
+    "  <member category=\"People\" group-name=\"Family\" members=\"1,2\"/>\n"
+    "  <member category=\"Places\" group-name=\"Europe\" members=\"1,2\"/>\n"
+    " </member-groups>\n"
+    "</KPhotoAlbum>\n"
+};
+}
+
+void KPATest::TestCategoryMatcher::initTestCase()
+{
+    QHashSeed::setDeterministicGlobalSeed();
+}
+
+void KPATest::TestCategoryMatcher::evalAllMatchesEval_data()
+{
+    const QString none = DB::ImageDB::NONE();
+    const auto noOther = [&none](const QString &text) {
+        return QStringLiteral("%1 & %2").arg(text, none);
+    };
+    QTest::addColumn<QString>("people");
+    QTest::addColumn<QString>("places");
+    QTest::addColumn<QStringList>("expected");
+
+    QTest::newRow("value") << QStringLiteral("Jesper") << QString() << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("b.jpg"), QStringLiteral("f.jpg") });
+    QTest::newRow("unknown value") << QStringLiteral("Unknown") << QString() << QStringList();
+    QTest::newRow("and") << QStringLiteral("Jesper & Anne Helene") << QString() << QStringList({ QStringLiteral("b.jpg") });
+    QTest::newRow("or") << QStringLiteral("Jesper | Tobias") << QString() << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("b.jpg"), QStringLiteral("e.jpg"), QStringLiteral("f.jpg") });
+    QTest::newRow("not") << QStringLiteral("!Jesper") << QString() << QStringList({ QStringLiteral("c.jpg"), QStringLiteral("d.jpg"), QStringLiteral("e.jpg") });
+    QTest::newRow("and not") << QStringLiteral("Jesper & !Anne Helene") << QString() << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("f.jpg") });
+    QTest::newRow("none") << none << QString() << QStringList({ QStringLiteral("c.jpg") });
+    QTest::newRow("value or none") << QStringLiteral("Jesper | %1").arg(none) << QString() << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("b.jpg"), QStringLiteral("c.jpg"), QStringLiteral("f.jpg") });
+    QTest::newRow("no other") << noOther(QStringLiteral("Jesper")) << QString() << QStringList({ QStringLiteral("a.jpg") });
+    QTest::newRow("and no other") << noOther(QStringLiteral("Jesper & Anne Helene")) << QString() << QStringList({ QStringLiteral("b.jpg") });
+    QTest::newRow("group") << QStringLiteral("Family") << QString() << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("b.jpg"), QStringLiteral("d.jpg"), QStringLiteral("f.jpg") });
+    // only the group tag itself counts as matched, not its members:
+    QTest::newRow("group no other") << noOther(QStringLiteral("Family")) << QString() << QStringList();
+    QTest::newRow("and not group") << QStringLiteral("Tobias & !Family") << QString() << QStringList({ QStringLiteral("e.jpg") });
+    QTest::newRow("other category group") << QString() << QStringLiteral("Europe") << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("b.jpg"), QStringLiteral("d.jpg"), QStringLiteral("f.jpg") });
+    QTest::newRow("other category no other") << QString() << noOther(QStringLiteral("Oslo")) << QStringList({ QStringLiteral("a.jpg"), QStringLiteral("b.jpg") });
+    QTest::newRow("two categories") << QStringLiteral("Jesper") << QStringLiteral("Berlin") << QStringList({ QStringLiteral("f.jpg") });
+    QTest::newRow("two categories none") << none << none << QStringList({ QStringLiteral("c.jpg") });
+}
+
+void KPATest::TestCategoryMatcher::evalAllMatchesEval()
+{
+    QFETCH(QString, people);
+    QFETCH(QString, places);
+    QFETCH(QStringList, expected);
+
+    TestDatabaseFixture fixture(indexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    auto db = fixture.db();
+    QVERIFY2(db->images().size() == 6, msgPreconditionFailed);
+
+    DB::ImageSearchInfo info;
+    if (!people.isEmpty())
+        info.setCategoryMatchText(QStringLiteral("People"), people);
+    if (!places.isEmpty())
+        info.setCategoryMatchText(QStringLiteral("Places"), places);
+
+    const DB::RoaringBitmap categoryMatches = info.categoryMatches(db->tagIndex());
+    QStringList matched;
+    const auto images = db->images();
+    for (const auto &image : images) {
+        const bool eval = info.match(image);
+        QVERIFY2(eval == categoryMatches.contains(image->ordinal()), qPrintable(image->fileName().relative()));
+        QCOMPARE(info.match(image, categoryMatches), eval);
+        if (eval)
+            matched.append(image->fileName().relative());
+    }
+    matched.sort();
+    QCOMPARE(matched, expected);
+}
+
+QTEST_MAIN(KPATest::TestCategoryMatcher)
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
+
+#include "moc_TestCategoryMatcher.cpp"
@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_CATEGORYMATCHER_H
+#define KPATEST_CATEGORYMATCHER_H
+
+#include <QtTest/QTest>
+
+namespace KPATest
+{
+class TestCategoryMatcher : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    /**
+     * @brief Check that evaluating a search for all images at once (evalAll) gives the same result as matching image by image (eval).
+     */
+    void evalAllMatchesEval_data();
+    void evalAllMatchesEval();
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_DATABASEFIXTURE_H
+#define KPATEST_DATABASEFIXTURE_H
+
+#include <DB/ImageDB.h>
+#include <kpabase/SettingsData.h>
+#include <kpabase/UIDelegate.h>
+
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+
+namespace KPATest
+{
+/**
+ * @brief A small database with the categories People and Places, four images and a generation.
+ * Jesper is tagged on a.jpg and b.jpg, Anne Helene on b.jpg and d.jpg; a.jpg is in Oslo and d.jpg in Berlin.
+ */
+constexpr auto defaultIndexXml {
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<KPhotoAlbum version=\"11\" compressed=\"1\" generation=\"test-generation\">\n"
+    " <Categories>\n"
+    "  <Category name=\"Events\" id=\"1\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"0\">\n"
+    "   <value value=\"untagged\" id=\"1\" meta=\"mark-untagged\"/>\n"
+    "  </Category>\n"
+    "  <Category name=\"People\" id=\"2\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"1\">\n"
+    "   <value value=\"Jesper\" id=\"1\"/>\n"
+    "   <value value=\"Anne Helene\" id=\"2\"/>\n"
+    "  </Category>\n"
+    "  <Category name=\"Places\" id=\"3\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"0\">\n"
+    "   <value value=\"Oslo\" id=\"1\"/>\n"
+    "   <value value=\"Berlin\" id=\"2\"/>\n"
+    "  </Category>\n"
+    " </Categories>\n"
+    " <images>\n"
+    "  <image file=\"a.jpg\" startDate=\"2026-01-01T10:00:00\" md5sum=\"00000000000000000000000000000001\" width=\"640\" height=\"480\" tags_2=\"1\" tags_3=\"1\"/>\n"
+    "  <image file=\"b.jpg\" startDate=\"2026-01-01T10:01:00\" md5sum=\"00000000000000000000000000000002\" width=\"640\" height=\"480\" tags_2=\"1,2\"/>\n"
+    "  <image file=\"c.jpg\" startDate=\"2026-01-01T10:02:00\" md5sum=\"00000000000000000000000000000003\" width=\"640\" height=\"480\"/>\n"
+    "  <image file=\"d.jpg\" startDate=\"2026-01-01T10:03:00\" md5sum=\"00000000000000000000000000000004\" width=\"640\" height=\"480\" tags_2=\"2\" tags_3=\"2\"/>\n"
+    " </images>\n"
+    "</KPhotoAlbum>\n"
+};
+
+/**
+ * @brief A UI delegate that gives a fixed answer to all questions.
+ */
+class TestUIDelegate : public DB::DummyUIDelegate
+{
+public:
+    DB::UserFeedback answer = DB::UserFeedback::SafeDefaultAction;
+
+protected:
+    DB::UserFeedback askWarningContinueCancel(const QString &, const QString &, const QString &) override { return answer; }
+    DB::UserFeedback askQuestionYesNo(const QString &, const QString &, const QString &) override { return answer; }
+};
+
+/**
+ * @brief Settings and an image database in a temporary directory, loaded from the given XML database file content.
+ * The image database is deleted together with the fixture.
+ */
+class TestDatabaseFixture
+{
+public:
+    explicit TestDatabaseFixture(const char *indexXml)
+    {
+        if (!m_tmpDir.isValid())
+            return;
+        Settings::SettingsData::setup(m_tmpDir.path(), m_uiDelegate);
+        m_configFile = m_tmpDir.filePath(QStringLiteral("index.xml"));
+        QFile file(m_configFile);
+        if (!file.open(QIODevice::WriteOnly) || file.write(indexXml) < 0)
+            return;
+        file.close();
+        load();
+    }
+    ~TestDatabaseFixture()
+    {
+        if (m_isLoaded)
+            DB::ImageDB::deleteInstance();
+    }
+    TestDatabaseFixture(const TestDatabaseFixture &) = delete;
+    TestDatabaseFixture &operator=(const TestDatabaseFixture &) = delete;
+
+    bool isValid() const
+    {
+        return m_isLoaded;
+    }
+    DB::ImageDB *db() const
+    {
+        return DB::ImageDB::instance();
+    }
+    /**
+     * @return the XML database file
+     */
+    const QString &configFile() const
+    {
+        return m_configFile;
+    }
+    /**
+     * @brief uiDelegate can be used to answer the questions that are asked while loading the database.
+     */
+    TestUIDelegate &uiDelegate()
+    {
+        return m_uiDelegate;
+    }
+    /**
+     * @brief reload deletes the image database and loads it again from the database directory.
+     * Changes that were not saved or written to the journal are lost, as if KPhotoAlbum had crashed.
+     */
+    void reload()
+    {
+        DB::ImageDB::deleteInstance();
+        m_isLoaded = false;
+        load();
+    }
+
+private:
+    void load()
+    {
+        DB::ImageDB::setupXMLDB(m_configFile, m_uiDelegate);
+        m_isLoaded = true;
+    }
+
+    QTemporaryDir m_tmpDir;
+    TestUIDelegate m_uiDelegate;
+    QString m_configFile;
+    bool m_isLoaded = false;
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
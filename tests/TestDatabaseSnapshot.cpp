@@ -0,0 +1,202 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "TestDatabaseSnapshot.h"
+
+#include "TestDatabaseFixture.h"
+
+#include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
+#include <DB/XML/DatabaseSnapshot.h>
+#include <kpabase/FileName.h>
+#include <kpabase/SettingsData.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHashSeed>
+
+namespace
+{
+constexpr auto msgPreconditionFailed = "Precondition for test failed - please fix unit test!";
+
+/**
+ * @brief A database that uses every field that is stored in the snapshot:
+ * a.jpg has a label, a description, a date range, an angle, a rating and a tag with an area;
+ * b.jpg and c.jpg are stacked, and d.mp4 is a video.
+ */
+constexpr auto snapshotIndexXml {
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<KPhotoAlbum version=\"11\" compressed=\"1\" generation=\"test-generation\">\n"
+    " <Categories>\n"
+    "  <Category name=\"Events\" id=\"1\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"0\">\n"
+    "   <value value=\"untagged\" id=\"1\" meta=\"mark-untagged\"/>\n"
+    "  </Category>\n"
+    "  <Category name=\"People\" id=\"2\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"1\">\n"
+    "   <value value=\"Jesper\" id=\"1\"/>\n"
+    "   <value value=\"Anne Helene\" id=\"2\"/>\n"
+    "  </Category>\n"
+    "  <Category name=\"Places\" id=\"3\" icon=\"\" show=\"1\" viewtype=\"0\" thumbnailsize=\"32\" positionable=\"0\">\n"
+    "   <value value=\"Oslo\" id=\"1\"/>\n"
+    "   <value value=\"Berlin\" id=\"2\"/>\n"
+    "  </Category>\n"
+    " </Categories>\n"
+    " <images>\n"
+    "  <image file=\"a.jpg\" label=\"Sunset\" description=\"Evening\" startDate=\"2026-01-01T18:00:00\" endDate=\"2026-01-01T19:00:00\" angle=\"90\" md5sum=\"00000000000000000000000000000001\" width=\"640\" height=\"480\" rating=\"8\" tags_2=\"1+a=10 20 30 40,2\" tags_3=\"1\"/>\n"
+    "  <image file=\"b.jpg\" startDate=\"2026-01-02T10:00:00\" md5sum=\"00000000000000000000000000000002\" width=\"480\" height=\"640\" stackId=\"1\" stackOrder=\"1\" tags_2=\"1\"/>\n"
+    "  <image file=\"c.jpg\" startDate=\"2026-01-02T10:00:01\" md5sum=\"00000000000000000000000000000003\" width=\"480\" height=\"640\" rating=\"0\" stackId=\"1\" stackOrder=\"2\"/>\n"
+    "  <image file=\"d.mp4\" startDate=\"2026-01-03T12:00:00\" md5sum=\"00000000000000000000000000000004\" width=\"1920\" height=\"1080\" videoLength=\"42\" tags_3=\"2\"/>\n"
+    " </images>\n"
+    "</KPhotoAlbum>\n"
+};
+
+/**
+ * @return all fields of the image in a form that can be compared and printed by QCOMPARE
+ */
+QStringList describe(const DB::ImageInfoPtr &info)
+{
+    const DB::ImageDate date = info->date();
+    QStringList result {
+        QStringLiteral("file=%1").arg(info->fileName().relative()),
+        QStringLiteral("label=%1").arg(info->label()),
+        QStringLiteral("description=%1").arg(info->description()),
+        QStringLiteral("start=%1").arg(date.start().toString(Qt::ISODate)),
+        QStringLiteral("end=%1").arg(date.end().toString(Qt::ISODate)),
+        QStringLiteral("angle=%1").arg(info->angle()),
+        QStringLiteral("md5sum=%1").arg(info->MD5Sum().toHexString()),
+        QStringLiteral("size=%1x%2").arg(info->size().width()).arg(info->size().height()),
+        QStringLiteral("mediaType=%1").arg(static_cast<int>(info->mediaType())),
+        QStringLiteral("rating=%1").arg(info->rating()),
+        QStringLiteral("stack=%1/%2").arg(info->stackId()).arg(info->stackOrder()),
+        QStringLiteral("videoLength=%1").arg(info->videoLength()),
+    };
+
+    QStringList categories = info->availableCategories();
+    categories.sort();
+    for (const QString &category : std::as_const(categories)) {
+        const Utilities::StringSet itemSet = info->itemsOfCategory(category);
+        QStringList items(itemSet.begin(), itemSet.end());
+        items.sort();
+        for (const QString &item : std::as_const(items)) {
+            const QRect area = info->areaForTag(category, item);
+            result.append(QStringLiteral("tag=%1/%2 area=%3,%4 %5x%6").arg(category, item).arg(area.x()).arg(area.y()).arg(area.width()).arg(area.height()));
+        }
+    }
+    return result;
+}
+
+QList<QStringList> describeAll(DB::ImageDB *db)
+{
+    QList<QStringList> result;
+    const auto images = db->images();
+    for (const DB::ImageInfoPtr &info : images)
+        result.append(describe(info));
+    return result;
+}
+
+QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+/**
+ * @return \c true, if DB::DatabaseSnapshot::load() would use the snapshot for the XML file
+ */
+bool snapshotIsUsable(const QString &xmlFileName)
+{
+    QByteArray data = readFile(xmlFileName);
+    DB::ImageInfoList images;
+    return DB::DatabaseSnapshot::load(xmlFileName, data, images);
+}
+}
+
+void KPATest::TestDatabaseSnapshot::initTestCase()
+{
+    QHashSeed::setDeterministicGlobalSeed();
+}
+
+void KPATest::TestDatabaseSnapshot::roundTrip()
+{
+    TestDatabaseFixture fixture(snapshotIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    auto settings = Settings::SettingsData::instance();
+    settings->setUseDatabaseSnapshot(true);
+    fixture.db()->save();
+    QVERIFY(QFile::exists(DB::DatabaseSnapshot::fileNameFor(fixture.configFile())));
+    QVERIFY(snapshotIsUsable(fixture.configFile()));
+
+    settings->setUseDatabaseSnapshot(false);
+    fixture.reload();
+    const QList<QStringList> expected = describeAll(fixture.db());
+    QCOMPARE(expected.size(), 4);
+    // make sure that the test database covers all the fields that are stored in the snapshot:
+    QVERIFY2(expected.at(0).contains(QStringLiteral("tag=People/Jesper area=10,20 30x40")), msgPreconditionFailed);
+    QVERIFY2(expected.at(0).contains(QStringLiteral("rating=8")), msgPreconditionFailed);
+    QVERIFY2(expected.at(2).contains(QStringLiteral("stack=1/2")), msgPreconditionFailed);
+    QVERIFY2(expected.at(3).contains(QStringLiteral("videoLength=42")), msgPreconditionFailed);
+
+    settings->setUseDatabaseSnapshot(true);
+    fixture.reload();
+    const QList<QStringList> actual = describeAll(fixture.db());
+    QCOMPARE(actual.size(), expected.size());
+    for (qsizetype i = 0; i < expected.size(); ++i)
+        QCOMPARE(actual.at(i), expected.at(i));
+    // the stack is restored as well:
+    const auto stacked = fixture.db()->getStackFor(DB::FileName::fromRelativePath(QStringLiteral("b.jpg")));
+    QCOMPARE(stacked.size(), 2);
+}
+
+void KPATest::TestDatabaseSnapshot::changedFileInvalidatesSnapshot_data()
+{
+    QTest::addColumn<QByteArray>("newDescription");
+
+    QTest::newRow("different size") << QByteArrayLiteral("Late evening");
+    // the file size is unchanged, so only the modification time and the checksum tell the difference:
+    QTest::newRow("same size") << QByteArrayLiteral("Morning");
+}
+
+void KPATest::TestDatabaseSnapshot::changedFileInvalidatesSnapshot()
+{
+    QFETCH(QByteArray, newDescription);
+
+    TestDatabaseFixture fixture(snapshotIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    Settings::SettingsData::instance()->setUseDatabaseSnapshot(true);
+    fixture.db()->save();
+    QVERIFY2(snapshotIsUsable(fixture.configFile()), msgPreconditionFailed);
+
+    // change the XML file behind the back of KPhotoAlbum, e.g. by editing it by hand:
+    QByteArray content = readFile(fixture.configFile());
+    QVERIFY2(content.count("description=\"Evening\"") == 1, msgPreconditionFailed);
+    content.replace("description=\"Evening\"", "description=\"" + newDescription + "\"");
+    const QDateTime modified = QFileInfo(fixture.configFile()).lastModified();
+    {
+        QFile file(fixture.configFile());
+        QVERIFY2(file.open(QIODevice::WriteOnly) && file.write(content) == content.size(), msgPreconditionFailed);
+        file.flush();
+        // the file system might not notice a change of the modification time within the same second:
+        QVERIFY2(file.setFileTime(modified.addSecs(60), QFileDevice::FileModificationTime), msgPreconditionFailed);
+    }
+
+    QVERIFY(!snapshotIsUsable(fixture.configFile()));
+    QByteArray data = readFile(fixture.configFile());
+    DB::ImageInfoList images;
+    DB::DatabaseSnapshot::load(fixture.configFile(), data, images);
+    QCOMPARE(data, content);
+    QVERIFY(images.isEmpty());
+
+    fixture.reload();
+    const auto info = fixture.db()->info(DB::FileName::fromRelativePath(QStringLiteral("a.jpg")));
+    QVERIFY(info);
+    QCOMPARE(info->description(), QString::fromUtf8(newDescription));
+}
+
+QTEST_MAIN(KPATest::TestDatabaseSnapshot)
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
+
+#include "moc_TestDatabaseSnapshot.cpp"
@@ -0,0 +1,32 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_DATABASESNAPSHOT_H
+#define KPATEST_DATABASESNAPSHOT_H
+
+#include <QtTest/QTest>
+
+namespace KPATest
+{
+class TestDatabaseSnapshot : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    /**
+     * @brief Check that the images loaded from the snapshot are identical to the images loaded from the XML file.
+     */
+    void roundTrip();
+    /**
+     * @brief Check that the snapshot is not used once the XML file was changed after saving.
+     */
+    void changedFileInvalidatesSnapshot_data();
+    void changedFileInvalidatesSnapshot();
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -10,7 +10,9 @@
 #include <kpabase/SettingsData.h>
 #include <kpabase/UIDelegate.h>
 
+#include <QFile>
 #include <QHashSeed>
+#include <QImage>
 #include <QLoggingCategory>
 #include <QRegularExpression>
 #include <QSignalSpy>
@@ -59,6 +61,55 @@ void KPATest::TestExifDatabase::trivialTests()
     QCOMPARE(progress.maximum(), 0);
 }
 
+void KPATest::TestExifDatabase::addManyFiles_data()
+{
+    QTest::addColumn<int>("fileCount");
+
+    // SQLite allows at most 999 parameters per statement, i.e. a few dozen rows of the exif table.
+    // Neither count is a multiple of the rows per statement, so the last statement is shorter:
+    QTest::newRow("few files") << 101;
+    // enough files to switch the database into bulk ingest mode:
+    QTest::newRow("many files") << 1001;
+}
+
+void KPATest::TestExifDatabase::addManyFiles()
+{
+    QFETCH(int, fileCount);
+
+    QTemporaryDir tmpDir;
+    QVERIFY2(tmpDir.isValid(), msgPreconditionFailed);
+
+    DB::DummyUIDelegate uiDelegate;
+    Settings::SettingsData::setup(tmpDir.path(), uiDelegate);
+
+    // the files don't need to have any Exif data to get a row in the database:
+    const QString firstFile = tmpDir.filePath(QStringLiteral("image-0.jpg"));
+    QImage image { 8, 8, QImage::Format_RGB32 };
+    image.fill(Qt::red);
+    QVERIFY2(image.save(firstFile, "JPG"), msgPreconditionFailed);
+    DB::FileNameList files;
+    for (int i = 0; i < fileCount; ++i) {
+        const QString relativeFileName = QStringLiteral("image-%1.jpg").arg(i);
+        if (i > 0)
+            QVERIFY2(QFile::copy(firstFile, tmpDir.filePath(relativeFileName)), msgPreconditionFailed);
+        files.append(DB::FileName::fromRelativePath(relativeFileName));
+    }
+
+    const QString dbFile = tmpDir.filePath(QStringLiteral("exif-db.sqlite"));
+    Exif::Database db(dbFile, uiDelegate);
+    QVERIFY2(db.isUsable(), msgPreconditionFailed);
+
+    QVERIFY(db.add(files));
+    QVERIFY(db.isUsable());
+    QCOMPARE(db.size(), fileCount);
+    // the database is a single file again afterwards:
+    QVERIFY(!QFile::exists(dbFile + QStringLiteral("-wal")));
+
+    // adding the files again replaces the rows:
+    QVERIFY(db.add(files.mid(0, 3)));
+    QCOMPARE(db.size(), fileCount);
+}
+
 QTEST_MAIN(KPATest::TestExifDatabase)
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
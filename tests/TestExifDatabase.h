@@ -15,6 +15,11 @@ class TestExifDatabase : public QObject
 private Q_SLOTS:
     void initTestCase();
     void trivialTests();
+    /**
+     * @brief Check that adding more rows than fit into a single insert statement adds all files.
+     */
+    void addManyFiles_data();
+    void addManyFiles();
 };
 }
 
@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "TestJournal.h"
+
+#include "TestDatabaseFixture.h"
+
+#include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
+#include <DB/XML/Journal.h>
+#include <kpabase/FileName.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHashSeed>
+#include <QRegularExpression>
+
+namespace
+{
+constexpr auto msgPreconditionFailed = "Precondition for test failed - please fix unit test!";
+
+DB::ImageInfoPtr imageFor(DB::ImageDB *db, const char *fileName)
+{
+    return db->info(DB::FileName::fromRelativePath(QString::fromLatin1(fileName)));
+}
+}
+
+void KPATest::TestJournal::initTestCase()
+{
+    QHashSeed::setDeterministicGlobalSeed();
+}
+
+void KPATest::TestJournal::autosaveAppendsOnlyChangedImages()
+{
+    TestDatabaseFixture fixture(defaultIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    auto db = fixture.db();
+    QCOMPARE(db->images().size(), 4);
+
+    // no image was changed since loading, so there is nothing to write:
+    const QString journalFile = DB::Journal::fileName(fixture.configFile());
+    db->autosave();
+    QVERIFY(!QFile::exists(journalFile));
+
+    const DB::ImageInfoPtr info = db->info(DB::FileName::fromRelativePath(QStringLiteral("b.jpg")));
+    QVERIFY2(info, msgPreconditionFailed);
+    info->setLabel(QStringLiteral("changed"));
+    db->autosave();
+
+    QFile journal(journalFile);
+    QVERIFY(journal.open(QIODevice::ReadOnly));
+    const QByteArray content = journal.readAll();
+    QCOMPARE(content.count("<image "), 1);
+    QVERIFY(content.contains("file=\"b.jpg\""));
+    QVERIFY(content.contains("label=\"changed\""));
+}
+
+void KPATest::TestJournal::replayAppliesChanges()
+{
+    TestDatabaseFixture fixture(defaultIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    fixture.uiDelegate().answer = DB::UserFeedback::Confirm;
+    auto db = fixture.db();
+    QVERIFY2(!db->hasReplayedJournal(), msgPreconditionFailed);
+
+    // two batches:
+    imageFor(db, "b.jpg")->setLabel(QStringLiteral("changed"));
+    db->autosave();
+    imageFor(db, "a.jpg")->addCategoryInfo(QStringLiteral("People"), QStringLiteral("Anne Helene"));
+    imageFor(db, "b.jpg")->setRating(8);
+    db->autosave();
+    QVERIFY2(QFile::exists(DB::Journal::fileName(fixture.configFile())), msgPreconditionFailed);
+
+    fixture.reload();
+    db = fixture.db();
+    QVERIFY(db->hasReplayedJournal());
+    QCOMPARE(db->images().size(), 4);
+    const DB::ImageInfoPtr a = imageFor(db, "a.jpg");
+    const DB::ImageInfoPtr b = imageFor(db, "b.jpg");
+    QVERIFY(a && b);
+    QCOMPARE(b->label(), QStringLiteral("changed"));
+    QCOMPARE(b->rating(), short(8));
+    QCOMPARE(a->itemsOfCategory(QStringLiteral("People")), DB::StringSet({ QStringLiteral("Jesper"), QStringLiteral("Anne Helene") }));
+    // the tag index is built after the journal was replayed:
+    QVERIFY(db->tagIndex().postings(QStringLiteral("People"), QStringLiteral("Anne Helene")).contains(a->ordinal()));
+}
+
+void KPATest::TestJournal::replayIgnoresOtherGeneration()
+{
+    TestDatabaseFixture fixture(defaultIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    fixture.uiDelegate().answer = DB::UserFeedback::Confirm;
+    auto db = fixture.db();
+    const QString originalLabel = imageFor(db, "b.jpg")->label();
+    imageFor(db, "b.jpg")->setLabel(QStringLiteral("changed"));
+    db->autosave();
+
+    // pretend that the journal was written for another version of the database file:
+    const QString journalFile = DB::Journal::fileName(fixture.configFile());
+    QFile journal(journalFile);
+    QVERIFY2(journal.open(QIODevice::ReadWrite), msgPreconditionFailed);
+    QByteArray content = journal.readAll();
+    QVERIFY2(content.startsWith("KPhotoAlbum journal 1 test-generation\n"), msgPreconditionFailed);
+    content.replace("test-generation", "other-generation");
+    journal.resize(0);
+    journal.write(content);
+    journal.close();
+
+    fixture.reload();
+    db = fixture.db();
+    QVERIFY(!db->hasReplayedJournal());
+    QCOMPARE(imageFor(db, "b.jpg")->label(), originalLabel);
+    QVERIFY(!QFile::exists(journalFile));
+}
+
+void KPATest::TestJournal::replayDropsDamagedBatch_data()
+{
+    QTest::addColumn<bool>("truncate");
+    QTest::newRow("truncated") << true;
+    QTest::newRow("corrupt") << false;
+}
+
+void KPATest::TestJournal::replayDropsDamagedBatch()
+{
+    QFETCH(bool, truncate);
+
+    TestDatabaseFixture fixture(defaultIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    fixture.uiDelegate().answer = DB::UserFeedback::Confirm;
+    auto db = fixture.db();
+    const QString originalLabel = imageFor(db, "a.jpg")->label();
+    const QString journalFile = DB::Journal::fileName(fixture.configFile());
+
+    imageFor(db, "b.jpg")->setLabel(QStringLiteral("first batch"));
+    db->autosave();
+    const qint64 firstBatchEnd = QFileInfo(journalFile).size();
+    QVERIFY2(firstBatchEnd > 0, msgPreconditionFailed);
+    imageFor(db, "a.jpg")->setLabel(QStringLiteral("second batch"));
+    db->autosave();
+
+    QFile journal(journalFile);
+    QVERIFY2(journal.open(QIODevice::ReadWrite), msgPreconditionFailed);
+    QByteArray content = journal.readAll();
+    QVERIFY2(content.size() > firstBatchEnd, msgPreconditionFailed);
+    if (truncate) {
+        // as if KPhotoAlbum crashed while writing the second batch:
+        content.chop(10);
+    } else {
+        // the size of the batch is still right, but the checksum does not match:
+        const qsizetype labelPos = content.indexOf("second batch", firstBatchEnd);
+        QVERIFY2(labelPos > 0, msgPreconditionFailed);
+        content[labelPos] = 'S';
+    }
+    journal.resize(0);
+    journal.write(content);
+    journal.close();
+
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("Ignoring incomplete changes at the end of journal")));
+    fixture.reload();
+    db = fixture.db();
+    QVERIFY(db->hasReplayedJournal());
+    QCOMPARE(imageFor(db, "b.jpg")->label(), QStringLiteral("first batch"));
+    QCOMPARE(imageFor(db, "a.jpg")->label(), originalLabel);
+    // the damaged batch is removed from the journal:
+    QCOMPARE(QFileInfo(journalFile).size(), firstBatchEnd);
+}
+
+QTEST_MAIN(KPATest::TestJournal)
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
+
+#include "moc_TestJournal.cpp"
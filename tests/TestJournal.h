@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_JOURNAL_H
+#define KPATEST_JOURNAL_H
+
+#include <QtTest/QTest>
+
+namespace KPATest
+{
+class TestJournal : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void autosaveAppendsOnlyChangedImages();
+    /**
+     * @brief Check that the changes in the journal are applied when the database is loaded.
+     */
+    void replayAppliesChanges();
+    /**
+     * @brief Check that a journal that belongs to another version of the database file is ignored.
+     */
+    void replayIgnoresOtherGeneration();
+    /**
+     * @brief Check that a damaged last batch is dropped, while the batches before it are applied.
+     */
+    void replayDropsDamagedBatch_data();
+    void replayDropsDamagedBatch();
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,149 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "TestRoaringBitmap.h"
+
+#include "RoaringBitmap.h"
+
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+using DB::RoaringBitmap;
+
+namespace
+{
+QList<RoaringBitmap::Value> toList(const std::set<RoaringBitmap::Value> &set)
+{
+    return QList<RoaringBitmap::Value>(set.cbegin(), set.cend());
+}
+}
+
+void KPATest::TestRoaringBitmap::addRemoveContains()
+{
+    RoaringBitmap bitmap;
+    QVERIFY(bitmap.isEmpty());
+    QCOMPARE(bitmap.cardinality(), 0);
+
+    QVERIFY(bitmap.add(42));
+    QVERIFY(!bitmap.add(42));
+    QVERIFY(bitmap.add(0));
+    QVERIFY(bitmap.add(0xFFFFFFFF));
+    QVERIFY(bitmap.add(70000));
+    QCOMPARE(bitmap.cardinality(), 4);
+    QVERIFY(bitmap.contains(0));
+    QVERIFY(bitmap.contains(42));
+    QVERIFY(bitmap.contains(70000));
+    QVERIFY(bitmap.contains(0xFFFFFFFF));
+    QVERIFY(!bitmap.contains(43));
+    QVERIFY(!bitmap.contains(42 + 65536));
+
+    QVERIFY(bitmap.remove(42));
+    QVERIFY(!bitmap.remove(42));
+    QVERIFY(!bitmap.contains(42));
+    QCOMPARE(bitmap.toList(), QList<RoaringBitmap::Value>({ 0, 70000, 0xFFFFFFFF }));
+
+    bitmap.clear();
+    QVERIFY(bitmap.isEmpty());
+}
+
+void KPATest::TestRoaringBitmap::containerConversion()
+{
+    // fill a chunk densely enough to switch to a bitset container and back again:
+    RoaringBitmap dense;
+    RoaringBitmap sparse;
+    for (RoaringBitmap::Value value = 0; value < 10000; ++value)
+        dense.add(value);
+    QCOMPARE(dense.cardinality(), 10000);
+    for (RoaringBitmap::Value value = 0; value < 9000; ++value)
+        QVERIFY(dense.remove(value));
+    for (RoaringBitmap::Value value = 9000; value < 10000; ++value)
+        sparse.add(value);
+    QCOMPARE(dense.cardinality(), 1000);
+    QVERIFY(dense == sparse);
+}
+
+void KPATest::TestRoaringBitmap::fromRange()
+{
+    QVERIFY(RoaringBitmap::fromRange(5, 5).isEmpty());
+    const auto range = RoaringBitmap::fromRange(65000, 140000);
+    QCOMPARE(range.cardinality(), 75000);
+    QVERIFY(!range.contains(64999));
+    QVERIFY(range.contains(65000));
+    QVERIFY(range.contains(139999));
+    QVERIFY(!range.contains(140000));
+}
+
+void KPATest::TestRoaringBitmap::setOperations()
+{
+    auto *random = QRandomGenerator::global();
+    // small and large value ranges yield dense (bitset) and sparse (array) containers:
+    for (const RoaringBitmap::Value range : { 70000u, 300000u, 0xFFFFFFFFu }) {
+        RoaringBitmap a;
+        RoaringBitmap b;
+        std::set<RoaringBitmap::Value> setA;
+        std::set<RoaringBitmap::Value> setB;
+        for (int i = 0; i < 20000; ++i) {
+            const auto valueA = random->bounded(range);
+            a.add(valueA);
+            setA.insert(valueA);
+            const auto valueB = random->bounded(range);
+            b.add(valueB);
+            setB.insert(valueB);
+        }
+        QCOMPARE(a.toList(), toList(setA));
+        QCOMPARE(b.cardinality(), qsizetype(setB.size()));
+
+        std::set<RoaringBitmap::Value> expected;
+        std::set_intersection(setA.cbegin(), setA.cend(), setB.cbegin(), setB.cend(), std::inserter(expected, expected.end()));
+        QCOMPARE((a & b).toList(), toList(expected));
+
+        expected.clear();
+        std::set_union(setA.cbegin(), setA.cend(), setB.cbegin(), setB.cend(), std::inserter(expected, expected.end()));
+        QCOMPARE((a | b).toList(), toList(expected));
+
+        expected.clear();
+        std::set_difference(setA.cbegin(), setA.cend(), setB.cbegin(), setB.cend(), std::inserter(expected, expected.end()));
+        QCOMPARE((a - b).toList(), toList(expected));
+
+        RoaringBitmap c = a;
+        c |= b;
+        c -= b;
+        QVERIFY(c == a - b);
+        c &= a;
+        QVERIFY(c == a - b);
+    }
+}
+
+void KPATest::TestRoaringBitmap::iteration()
+{
+    RoaringBitmap bitmap;
+    QVERIFY(bitmap.begin() == bitmap.end());
+
+    const QList<RoaringBitmap::Value> values { 1, 2, 63, 64, 65535, 65536, 200000 };
+    for (const auto value : values)
+        bitmap.add(value);
+    QList<RoaringBitmap::Value> iterated;
+    for (const auto value : bitmap)
+        iterated.append(value);
+    QCOMPARE(iterated, values);
+
+    // the same for a bitset container:
+    bitmap = RoaringBitmap::fromRange(0, 5000);
+    bitmap.add(70000);
+    iterated.clear();
+    std::copy(bitmap.begin(), bitmap.end(), std::back_inserter(iterated));
+    QCOMPARE(iterated.size(), 5001);
+    QCOMPARE(iterated.constFirst(), 0u);
+    QCOMPARE(iterated.at(4999), 4999u);
+    QCOMPARE(iterated.constLast(), 70000u);
+}
+
+QTEST_MAIN(KPATest::TestRoaringBitmap)
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
+
+#include "moc_TestRoaringBitmap.cpp"
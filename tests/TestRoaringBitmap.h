@@ -0,0 +1,27 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_ROARINGBITMAP_H
+#define KPATEST_ROARINGBITMAP_H
+
+#include <QtTest/QTest>
+
+namespace KPATest
+{
+class TestRoaringBitmap : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void addRemoveContains();
+    void containerConversion();
+    void fromRange();
+    void setOperations();
+    void iteration();
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "TestTagDictionary.h"
+
+#include "TagDictionary.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using DB::TagDictionary;
+using DB::TagId;
+using DB::TagIdList;
+
+// The dictionary is shared by the whole process, so every test case uses names of its own.
+
+void KPATest::TestTagDictionary::internLookup()
+{
+    auto &dictionary = TagDictionary::instance();
+    const QString jesper = QStringLiteral("internLookup/Jesper");
+    const QString anne = QStringLiteral("internLookup/Anne Helene");
+
+    QCOMPARE(dictionary.lookup(jesper), TagId(0));
+    const TagId jesperId = dictionary.intern(jesper);
+    QVERIFY(jesperId != 0);
+    QCOMPARE(dictionary.intern(jesper), jesperId);
+    QCOMPARE(dictionary.lookup(jesper), jesperId);
+    QCOMPARE(dictionary.name(jesperId), jesper);
+
+    const TagId anneId = dictionary.intern(anne);
+    QVERIFY(anneId != 0);
+    QVERIFY(anneId != jesperId);
+    QCOMPARE(dictionary.name(anneId), anne);
+
+    // lookup doesn't intern:
+    QCOMPARE(dictionary.lookup(QStringLiteral("internLookup/unknown")), TagId(0));
+    QCOMPARE(dictionary.lookup(QStringLiteral("internLookup/unknown")), TagId(0));
+
+    // unknown ids have no name:
+    QVERIFY(dictionary.name(0).isNull());
+    QVERIFY(dictionary.name(TagId(-1)).isNull());
+}
+
+void KPATest::TestTagDictionary::internSet()
+{
+    auto &dictionary = TagDictionary::instance();
+    const QString known = QStringLiteral("internSet/known");
+    const TagId knownId = dictionary.intern(known);
+
+    const DB::StringSet names { known, QStringLiteral("internSet/new 1"), QStringLiteral("internSet/new 2") };
+    const TagIdList ids = dictionary.intern(names);
+    QCOMPARE(ids.size(), 3);
+    QVERIFY(std::is_sorted(ids.cbegin(), ids.cend()));
+    QVERIFY(ids.contains(knownId));
+    QCOMPARE(dictionary.names(ids), names);
+    for (const auto &name : names)
+        QVERIFY(ids.contains(dictionary.lookup(name)));
+
+    QVERIFY(dictionary.intern(DB::StringSet()).isEmpty());
+    // unknown ids are skipped:
+    QCOMPARE(dictionary.names({ 0, knownId }), DB::StringSet({ known }));
+}
+
+void KPATest::TestTagDictionary::concurrentIntern()
+{
+    auto &dictionary = TagDictionary::instance();
+    constexpr int threadCount = 4;
+    constexpr int nameCount = 500;
+    const auto nameFor = [](int i) {
+        return QStringLiteral("concurrentIntern/tag %1").arg(i);
+    };
+
+    // every thread interns all names, single names and sets alternately:
+    std::vector<TagIdList> ids(threadCount);
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int thread = 0; thread < threadCount; ++thread) {
+        threads.emplace_back(QThread::create([&dictionary, &nameFor, &ids, thread] {
+            for (int i = 0; i < nameCount; i += 2) {
+                ids[thread].append(dictionary.intern(nameFor(i)));
+                ids[thread].append(dictionary.intern(DB::StringSet { nameFor(i + 1) }));
+            }
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads)
+        QVERIFY(thread->wait());
+
+    for (int thread = 1; thread < threadCount; ++thread)
+        QCOMPARE(ids[thread], ids[0]);
+    for (int i = 0; i < nameCount; ++i) {
+        QVERIFY(ids[0].at(i) != 0);
+        QCOMPARE(dictionary.name(ids[0].at(i)), nameFor(i));
+    }
+}
+
+void KPATest::TestTagDictionary::sortedLists()
+{
+    TagIdList list;
+    QVERIFY(TagDictionary::insertSorted(list, 5));
+    QVERIFY(TagDictionary::insertSorted(list, 1));
+    QVERIFY(TagDictionary::insertSorted(list, 9));
+    QVERIFY(TagDictionary::insertSorted(list, 3));
+    QVERIFY(!TagDictionary::insertSorted(list, 5));
+    QCOMPARE(list, TagIdList({ 1, 3, 5, 9 }));
+
+    QVERIFY(TagDictionary::containsSorted(list, 3));
+    QVERIFY(!TagDictionary::containsSorted(list, 4));
+    QVERIFY(!TagDictionary::containsSorted(TagIdList(), 4));
+
+    QVERIFY(TagDictionary::removeSorted(list, 3));
+    QVERIFY(!TagDictionary::removeSorted(list, 3));
+    QCOMPARE(list, TagIdList({ 1, 5, 9 }));
+
+    QVERIFY(TagDictionary::intersectsSorted(list, { 2, 9 }));
+    QVERIFY(!TagDictionary::intersectsSorted(list, { 2, 4, 10 }));
+    QVERIFY(!TagDictionary::intersectsSorted(list, TagIdList()));
+}
+
+QTEST_MAIN(KPATest::TestTagDictionary)
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
+
+#include "moc_TestTagDictionary.cpp"
@@ -0,0 +1,29 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_TAGDICTIONARY_H
+#define KPATEST_TAGDICTIONARY_H
+
+#include <QtTest/QTest>
+
+namespace KPATest
+{
+class TestTagDictionary : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void internLookup();
+    void internSet();
+    /**
+     * @brief Intern the same names from several threads at once and check that every name gets exactly one id.
+     */
+    void concurrentIntern();
+    void sortedLists();
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
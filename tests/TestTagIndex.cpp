@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#include "TestTagIndex.h"
+
+#include "TestDatabaseFixture.h"
+
+#include <DB/CategoryCollection.h>
+#include <DB/ImageDB.h>
+#include <DB/ImageInfo.h>
+#include <DB/TagIndex.h>
+#include <kpabase/FileName.h>
+
+#include <QHashSeed>
+#include <QMap>
+
+#include <algorithm>
+
+using DB::RoaringBitmap;
+using DB::TagDictionary;
+using DB::TagId;
+using DB::TagIdList;
+
+namespace
+{
+constexpr auto msgPreconditionFailed = "Precondition for test failed - please fix unit test!";
+/**
+ * @brief indexMismatch compares the tag index of the database with the tags of its images.
+ * @return a description of the first difference, or an empty string if the index matches the images
+ */
+QString indexMismatch(const DB::ImageDB *db, const QStringList &categories)
+{
+    const DB::TagIndex &index = db->tagIndex();
+    const auto images = db->images();
+    for (const QString &category : categories) {
+        QMap<QString, RoaringBitmap> expected;
+        for (const auto &info : images) {
+            const auto items = info->itemsOfCategory(category);
+            for (const auto &item : items)
+                expected[item].add(info->ordinal());
+        }
+
+        QStringList tags = index.tags(category);
+        tags.sort();
+        if (tags != expected.keys())
+            return QStringLiteral("%1: index has tags (%2), images have tags (%3)").arg(category, tags.join(QStringLiteral(", ")), expected.keys().join(QStringLiteral(", ")));
+        for (auto it = expected.cbegin(); it != expected.cend(); ++it) {
+            if (!(index.postings(category, it.key()) == it.value()))
+                return QStringLiteral("%1/%2: postings do not match the images").arg(category, it.key());
+        }
+    }
+    return {};
+}
+}
+
+void KPATest::TestTagIndex::initTestCase()
+{
+    QHashSeed::setDeterministicGlobalSeed();
+}
+
+void KPATest::TestTagIndex::postings()
+{
+    // The dictionary is shared by the whole process, so the names are prefixed with the test name:
+    auto &dictionary = TagDictionary::instance();
+    const QString peopleName = QStringLiteral("postings/People");
+    const TagId people = dictionary.intern(peopleName);
+    const TagId places = dictionary.intern(QStringLiteral("postings/Places"));
+    const TagId jesper = dictionary.intern(QStringLiteral("postings/Jesper"));
+    const TagId anne = dictionary.intern(QStringLiteral("postings/Anne Helene"));
+    const TagId oslo = dictionary.intern(QStringLiteral("postings/Oslo"));
+
+    DB::TagIndex index;
+    index.add(people, jesper, 1);
+    index.add(people, jesper, 2);
+    index.add(people, anne, 2);
+    index.add(places, oslo, 3);
+    // adding is idempotent:
+    index.add(people, jesper, 1);
+
+    QCOMPARE(index.postings(people, jesper).toList(), QList<RoaringBitmap::Value>({ 1, 2 }));
+    QCOMPARE(index.postings(people, anne).toList(), QList<RoaringBitmap::Value>({ 2 }));
+    QVERIFY(index.postings(places, jesper).isEmpty());
+    QVERIFY(index.postings(0, jesper).isEmpty());
+    QCOMPARE(index.postings(people, TagIdList({ jesper, anne })).toList(), QList<RoaringBitmap::Value>({ 1, 2 }));
+    QCOMPARE(index.postingsForCategory(people).toList(), QList<RoaringBitmap::Value>({ 1, 2 }));
+    TagIdList peopleTags { jesper, anne };
+    std::sort(peopleTags.begin(), peopleTags.end());
+    QCOMPARE(index.tagIds(people), peopleTags);
+    // the QString overloads use the same postings:
+    QCOMPARE(index.postings(peopleName, QStringLiteral("postings/Jesper")), index.postings(people, jesper));
+    QVERIFY(index.postings(peopleName, QStringLiteral("postings/unknown")).isEmpty());
+
+    // removing the last posting of a tag removes the tag:
+    index.remove(people, jesper, 1);
+    index.remove(people, jesper, 1);
+    QCOMPARE(index.postings(people, jesper).toList(), QList<RoaringBitmap::Value>({ 2 }));
+    index.remove(people, anne, 2);
+    QCOMPARE(index.tagIds(people), TagIdList({ jesper }));
+
+    // renaming onto an existing tag merges the postings:
+    index.add(people, anne, 3);
+    index.renameTag(peopleName, QStringLiteral("postings/Anne Helene"), QStringLiteral("postings/Jesper"));
+    QCOMPARE(index.postings(people, jesper).toList(), QList<RoaringBitmap::Value>({ 2, 3 }));
+    QVERIFY(index.postings(people, anne).isEmpty());
+    QCOMPARE(index.tags(peopleName), QStringList({ QStringLiteral("postings/Jesper") }));
+
+    // renaming onto a new tag:
+    index.renameTag(peopleName, QStringLiteral("postings/Jesper"), QStringLiteral("postings/Jesper K"));
+    QVERIFY(index.postings(people, jesper).isEmpty());
+    QCOMPARE(index.postings(peopleName, QStringLiteral("postings/Jesper K")).toList(), QList<RoaringBitmap::Value>({ 2, 3 }));
+
+    index.removeTag(peopleName, QStringLiteral("postings/Jesper K"));
+    QVERIFY(index.tagIds(people).isEmpty());
+    QVERIFY(index.postingsForCategory(people).isEmpty());
+
+    index.renameCategory(QStringLiteral("postings/Places"), QStringLiteral("postings/Locations"));
+    QVERIFY(index.postingsForCategory(places).isEmpty());
+    QCOMPARE(index.postings(QStringLiteral("postings/Locations"), QStringLiteral("postings/Oslo")).toList(), QList<RoaringBitmap::Value>({ 3 }));
+
+    index.clear();
+    QVERIFY(index.postingsForCategory(QStringLiteral("postings/Locations")).isEmpty());
+    QCOMPARE(index.imageCount(), 0);
+}
+
+void KPATest::TestTagIndex::syncWithImages()
+{
+    TestDatabaseFixture fixture(defaultIndexXml);
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    auto db = fixture.db();
+    QCOMPARE(db->images().size(), 4);
+    QCOMPARE(db->tagIndex().imageCount(), 4);
+    const auto images = db->images();
+    for (const auto &info : images)
+        QVERIFY(info->ordinal() != 0);
+
+    const QStringList categories { QStringLiteral("People"), QStringLiteral("Places") };
+    QCOMPARE(indexMismatch(db, categories), QString());
+    QCOMPARE(db->tagIndex().postings(QStringLiteral("People"), QStringLiteral("Jesper")).cardinality(), 2);
+
+    const auto imageFor = [db](const char *fileName) {
+        return db->info(DB::FileName::fromRelativePath(QString::fromLatin1(fileName)));
+    };
+    const DB::ImageInfoPtr a = imageFor("a.jpg");
+    const DB::ImageInfoPtr b = imageFor("b.jpg");
+    const DB::ImageInfoPtr c = imageFor("c.jpg");
+    QVERIFY2(a && b && c, msgPreconditionFailed);
+
+    // changing the tags of single images:
+    a->addCategoryInfo(QStringLiteral("People"), QStringLiteral("Anne Helene"));
+    a->removeCategoryInfo(QStringLiteral("Places"), QStringLiteral("Oslo"));
+    c->setCategoryInfo(QStringLiteral("Places"), { QStringLiteral("Berlin"), QStringLiteral("Paris") });
+    QCOMPARE(indexMismatch(db, categories), QString());
+    QVERIFY(db->tagIndex().postings(QStringLiteral("Places"), QStringLiteral("Oslo")).isEmpty());
+
+    // renaming a tag:
+    const DB::CategoryPtr people = db->categoryCollection()->categoryForName(QStringLiteral("People"));
+    QVERIFY2(people, msgPreconditionFailed);
+    people->renameItem(QStringLiteral("Jesper"), QStringLiteral("Jesper K"));
+    QCOMPARE(indexMismatch(db, categories), QString());
+    QVERIFY(db->tagIndex().postings(QStringLiteral("People"), QStringLiteral("Jesper")).isEmpty());
+
+    // renaming a tag onto an existing tag merges them:
+    people->renameItem(QStringLiteral("Anne Helene"), QStringLiteral("Jesper K"));
+    QCOMPARE(indexMismatch(db, categories), QString());
+    QCOMPARE(b->itemsOfCategory(QStringLiteral("People")), DB::StringSet({ QStringLiteral("Jesper K") }));
+    QCOMPARE(db->tagIndex().postings(QStringLiteral("People"), QStringLiteral("Jesper K")).cardinality(), 3);
+
+    // removing a tag:
+    const DB::CategoryPtr places = db->categoryCollection()->categoryForName(QStringLiteral("Places"));
+    QVERIFY2(places, msgPreconditionFailed);
+    places->removeItem(QStringLiteral("Berlin"));
+    QCOMPARE(indexMismatch(db, categories), QString());
+    QCOMPARE(c->itemsOfCategory(QStringLiteral("Places")), DB::StringSet({ QStringLiteral("Paris") }));
+
+    // renaming a category:
+    db->categoryCollection()->rename(QStringLiteral("Places"), QStringLiteral("Locations"));
+    QCOMPARE(indexMismatch(db, { QStringLiteral("People"), QStringLiteral("Locations") }), QString());
+    QVERIFY(db->tagIndex().postingsForCategory(QStringLiteral("Places")).isEmpty());
+    QCOMPARE(db->tagIndex().postings(QStringLiteral("Locations"), QStringLiteral("Paris")).toList(), QList<RoaringBitmap::Value>({ c->ordinal() }));
+}
+
+QTEST_MAIN(KPATest::TestTagIndex)
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
+
+#include "moc_TestTagIndex.cpp"
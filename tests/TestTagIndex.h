@@ -0,0 +1,29 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+#ifndef KPATEST_TAGINDEX_H
+#define KPATEST_TAGINDEX_H
+
+#include <QtTest/QTest>
+
+namespace KPATest
+{
+class TestTagIndex : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void postings();
+    /**
+     * @brief Change the tags of the images in a database and check that the index always matches the images.
+     * This covers adding and removing tags, renaming tags (including merging two tags) and renaming categories.
+     */
+    void syncWithImages();
+};
+}
+
+#endif
+
+// vi:expandtab:tabstop=4 shiftwidth=4:
@@ -6,16 +6,23 @@
 
 #include "TestThumbnailCache.h"
 
+#include "JpegCodec.h"
 #include "ThumbnailCache.h"
 
 #include <kpabase/SettingsData.h>
 #include <kpabase/UIDelegate.h>
 
 #include <QBuffer>
+#include <QFileInfo>
 #include <QHashSeed>
 #include <QLoggingCategory>
 #include <QRegularExpression>
 #include <QSignalSpy>
+#include <QThread>
+
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace
 {
@@ -39,6 +46,69 @@ constexpr auto v5IndexHexData {
     "0000001C006E00650077005F0077006100760065005F0032002E006A0070006700000000000000000000229D" // "new_wave_2.jpg"
     "000000160062006C00610063006B00690065002E006A00700067000000000000462C00001F0B" // "blackie.jpg"
 };
+
+/**
+ * @brief Settings and an empty thumbnail cache in a temporary directory.
+ */
+class ThumbnailCacheFixture
+{
+public:
+    ThumbnailCacheFixture()
+    {
+        if (!m_tmpDir.isValid())
+            return;
+        Settings::SettingsData::setup(m_tmpDir.path(), m_uiDelegate);
+        m_thumbnailDir.setPath(m_tmpDir.filePath(ImageManager::defaultThumbnailDirectory()));
+        QDir().mkdir(m_thumbnailDir.path());
+
+        const QRegularExpression thumbnailIndexNotFoundRegex { QStringLiteral("Thumbnail index file \"%1\" not found!")
+                                                                   .arg(m_thumbnailDir.filePath(QStringLiteral("thumbnailindex"))) };
+        QTest::ignoreMessage(QtWarningMsg, thumbnailIndexNotFoundRegex);
+        m_cache = std::make_unique<ImageManager::ThumbnailCache>(m_thumbnailDir.path());
+    }
+    bool isValid() const
+    {
+        return m_cache != nullptr;
+    }
+    const QDir &thumbnailDir() const
+    {
+        return m_thumbnailDir;
+    }
+    ImageManager::ThumbnailCache &cache()
+    {
+        return *m_cache;
+    }
+    /**
+     * @brief reload destroys the cache and loads it again from the thumbnail directory.
+     */
+    void reload()
+    {
+        m_cache.reset();
+        m_cache = std::make_unique<ImageManager::ThumbnailCache>(m_thumbnailDir.path());
+    }
+
+private:
+    QTemporaryDir m_tmpDir;
+    DB::DummyUIDelegate m_uiDelegate;
+    QDir m_thumbnailDir;
+    std::unique_ptr<ImageManager::ThumbnailCache> m_cache;
+};
+
+QImage solidImage(int width, int height, const QColor &color)
+{
+    QImage image { width, height, QImage::Format_RGB32 };
+    image.fill(color);
+    return image;
+}
+
+QByteArray jpegData(const QColor &color)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    solidImage(64, 64, color).save(&buffer, "JPG");
+    return data;
+}
 }
 
 void KPATest::TestThumbnailCache::initTestCase()
@@ -230,6 +300,345 @@ void KPATest::TestThumbnailCache::insertRemove()
     QCOMPARE(thumbnailCache.size(), 0);
 }
 
+void KPATest::TestThumbnailCache::lookupDataLifetime()
+{
+    ThumbnailCacheFixture fixture;
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    ImageManager::ThumbnailCache &thumbnailCache = fixture.cache();
+
+    const QByteArray redData = jpegData(Qt::red);
+    const QByteArray greenData = jpegData(Qt::green);
+    QVERIFY2(!redData.isEmpty() && !greenData.isEmpty(), msgPreconditionFailed);
+
+    const auto redFileName = DB::FileName::fromRelativePath(QStringLiteral("red.jpg"));
+    const auto greenFileName = DB::FileName::fromRelativePath(QStringLiteral("green.jpg"));
+
+    QVERIFY(thumbnailCache.lookupData(redFileName).isNull());
+    thumbnailCache.insert(redFileName, redData);
+    const ImageManager::ThumbnailData redThumbnail = thumbnailCache.lookupData(redFileName);
+    QVERIFY(!redThumbnail.isNull());
+    QCOMPARE(redThumbnail.toByteArray(), redData);
+
+    // appending to the same thumbnail file requires a new mapping, but the old one must stay valid:
+    thumbnailCache.insert(greenFileName, greenData);
+    const ImageManager::ThumbnailData greenThumbnail = thumbnailCache.lookupData(greenFileName);
+    QCOMPARE(greenThumbnail.toByteArray(), greenData);
+    QCOMPARE(redThumbnail.toByteArray(), redData);
+    QCOMPARE(thumbnailCache.lookupRawData(redFileName), redData);
+    QVERIFY(!thumbnailCache.lookup(greenFileName).isNull());
+
+    // the data stays valid even if the thumbnail files are deleted:
+    thumbnailCache.flush();
+    QVERIFY(thumbnailCache.lookupData(redFileName).isNull());
+    QCOMPARE(redThumbnail.toByteArray(), redData);
+    QCOMPARE(greenThumbnail.rawData(), greenData);
+}
+
+void KPATest::TestThumbnailCache::concurrentInsert()
+{
+    ThumbnailCacheFixture fixture;
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    ImageManager::ThumbnailCache &thumbnailCache = fixture.cache();
+
+    constexpr int threadCount = 4;
+    constexpr int thumbnailsPerThread = 60;
+    const auto fileNameFor = [](int thread, int i) {
+        return DB::FileName::fromRelativePath(QStringLiteral("thread%1/image%2.jpg").arg(thread).arg(i));
+    };
+    // the data doesn't need to be a valid JPEG image for this test:
+    const auto dataFor = [](int thread, int i) {
+        return QStringLiteral("thumbnail %1/%2").arg(thread).arg(i).toUtf8().repeated(1 + i);
+    };
+
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int thread = 0; thread < threadCount; ++thread) {
+        threads.emplace_back(QThread::create([&thumbnailCache, &fileNameFor, &dataFor, thread] {
+            for (int i = 0; i < thumbnailsPerThread; ++i)
+                thumbnailCache.insert(fileNameFor(thread, i), dataFor(thread, i));
+        }));
+        threads.back()->start();
+    }
+    for (const auto &thread : threads)
+        QVERIFY(thread->wait());
+
+    QCOMPARE(thumbnailCache.size(), threadCount * thumbnailsPerThread);
+    for (int thread = 0; thread < threadCount; ++thread) {
+        for (int i = 0; i < thumbnailsPerThread; ++i)
+            QCOMPARE(thumbnailCache.lookupRawData(fileNameFor(thread, i)), dataFor(thread, i));
+    }
+}
+
+void KPATest::TestThumbnailCache::lookupDuringInserts()
+{
+    ThumbnailCacheFixture fixture;
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    ImageManager::ThumbnailCache &thumbnailCache = fixture.cache();
+
+    constexpr int existingThumbnails = 100;
+    constexpr int threadCount = 4;
+    constexpr int insertsPerThread = 200;
+    const auto existingFileName = [](int i) {
+        return DB::FileName::fromRelativePath(QStringLiteral("existing/image%1.jpg").arg(i));
+    };
+    // the data doesn't need to be a valid JPEG image for this test:
+    const auto dataFor = [](int i) {
+        return QByteArray(1024 + i, char('a' + i % 26));
+    };
+    for (int i = 0; i < existingThumbnails; ++i)
+        thumbnailCache.insert(existingFileName(i), dataFor(i));
+
+    // Inserting threads write the thumbnail files and, every 100 thumbnails, the index file:
+    std::atomic<int> running = threadCount;
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int thread = 0; thread < threadCount; ++thread) {
+        threads.emplace_back(QThread::create([&thumbnailCache, &dataFor, &running, thread] {
+            for (int i = 0; i < insertsPerThread; ++i)
+                thumbnailCache.insert(DB::FileName::fromRelativePath(QStringLiteral("thread%1/image%2.jpg").arg(thread).arg(i)), dataFor(i));
+            --running;
+        }));
+        threads.back()->start();
+    }
+
+    // This is what the GUI thread does when it shows thumbnails.
+    // Every lookup must see the complete data of the existing thumbnails, no matter what the writers are doing:
+    int lookups = 0;
+    int incomplete = 0;
+    do {
+        const int i = lookups++ % existingThumbnails;
+        if (!thumbnailCache.contains(existingFileName(i)) || thumbnailCache.lookupRawData(existingFileName(i)) != dataFor(i))
+            ++incomplete;
+    } while (running > 0);
+    for (const auto &thread : threads)
+        QVERIFY(thread->wait());
+    QCOMPARE(incomplete, 0);
+
+    QCOMPARE(thumbnailCache.size(), existingThumbnails + threadCount * insertsPerThread);
+    for (int i = 0; i < insertsPerThread; ++i)
+        QCOMPARE(thumbnailCache.lookupRawData(DB::FileName::fromRelativePath(QStringLiteral("thread0/image%1.jpg").arg(i))), dataFor(i));
+}
+
+void KPATest::TestThumbnailCache::compact()
+{
+    ThumbnailCacheFixture fixture;
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    const QDir &thumbnailDir = fixture.thumbnailDir();
+    ImageManager::ThumbnailCache *thumbnailCache = &fixture.cache();
+
+    // Thumbnail files are limited to 32MiB, so 40 thumbnails of 1MiB fill the first file (33 thumbnails) and start a second one.
+    // The data doesn't need to be a valid JPEG image for this test:
+    constexpr qint64 thumbnailSize = 1024 * 1024;
+    constexpr int thumbnailCount = 40;
+    constexpr int thumbnailsInFirstFile = 33;
+    constexpr int removedCount = 25;
+    const auto fileNameFor = [](int i) {
+        return DB::FileName::fromRelativePath(QStringLiteral("image%1.jpg").arg(i));
+    };
+    const auto dataFor = [](int i) {
+        return QByteArray(thumbnailSize, char('a' + i % 26));
+    };
+    for (int i = 0; i < thumbnailCount; ++i)
+        thumbnailCache->insert(fileNameFor(i), dataFor(i));
+    const QString firstFile = thumbnailDir.filePath(QStringLiteral("thumb-0"));
+    QVERIFY2(QFileInfo(firstFile).size() == thumbnailsInFirstFile * thumbnailSize, msgPreconditionFailed);
+    QCOMPARE(thumbnailCache->staleBytes(), qint64(0));
+
+    DB::FileNameList removed;
+    for (int i = 0; i < removedCount; ++i)
+        removed.append(fileNameFor(i));
+    const ImageManager::ThumbnailData keptThumbnail = thumbnailCache->lookupData(fileNameFor(thumbnailsInFirstFile - 1));
+    // removeThumbnails() may already start the compaction in the background:
+    thumbnailCache->removeThumbnails(removed);
+    thumbnailCache->compact(0.5);
+
+    QCOMPARE(thumbnailCache->staleBytes(), qint64(0));
+    QCOMPARE(QFileInfo(firstFile).size(), (thumbnailsInFirstFile - removedCount) * thumbnailSize);
+    // the index has been saved after compacting the file:
+    const QString compactionMarker = firstFile + QStringLiteral(".compacted");
+    QVERIFY(!QFileInfo::exists(compactionMarker));
+    // the second file is still in use and must not be compacted:
+    QCOMPARE(QFileInfo(thumbnailDir.filePath(QStringLiteral("thumb-1"))).size(), (thumbnailCount - thumbnailsInFirstFile) * thumbnailSize);
+    QCOMPARE(keptThumbnail.toByteArray(), dataFor(thumbnailsInFirstFile - 1));
+    QCOMPARE(thumbnailCache->size(), thumbnailCount - removedCount);
+    for (int i = removedCount; i < thumbnailCount; ++i)
+        QCOMPARE(thumbnailCache->lookupRawData(fileNameFor(i)), dataFor(i));
+
+    // the saved index matches the compacted file:
+    fixture.reload();
+    thumbnailCache = &fixture.cache();
+    QCOMPARE(thumbnailCache->staleBytes(), qint64(0));
+    for (int i = 0; i < removedCount; ++i)
+        QVERIFY(!thumbnailCache->contains(fileNameFor(i)));
+    for (int i = removedCount; i < thumbnailCount; ++i)
+        QCOMPARE(thumbnailCache->lookupRawData(fileNameFor(i)), dataFor(i));
+
+    // a compaction that was interrupted before the index was saved leaves the marker behind:
+    QFile marker(compactionMarker);
+    QVERIFY2(marker.open(QIODevice::WriteOnly), msgPreconditionFailed);
+    marker.close();
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("was compacted, but the index was not saved afterwards")));
+    fixture.reload();
+    thumbnailCache = &fixture.cache();
+    QVERIFY(!QFileInfo::exists(compactionMarker));
+    QVERIFY(!QFileInfo::exists(firstFile));
+    QCOMPARE(thumbnailCache->size(), thumbnailCount - thumbnailsInFirstFile);
+    for (int i = removedCount; i < thumbnailsInFirstFile; ++i)
+        QVERIFY(!thumbnailCache->contains(fileNameFor(i)));
+    for (int i = thumbnailsInFirstFile; i < thumbnailCount; ++i)
+        QCOMPARE(thumbnailCache->lookupRawData(fileNameFor(i)), dataFor(i));
+}
+
+void KPATest::TestThumbnailCache::tiers()
+{
+    ThumbnailCacheFixture fixture;
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    ImageManager::ThumbnailCache &thumbnailCache = fixture.cache();
+
+    const int thumbnailSize = thumbnailCache.thumbnailSize();
+    const int smallSize = thumbnailSize / 2;
+    const int largeSize = thumbnailSize * 2;
+    QCOMPARE(thumbnailCache.tierSizes(), QList<int>({ smallSize, thumbnailSize, largeSize }));
+
+    const auto imageFileName = DB::FileName::fromRelativePath(QStringLiteral("image.jpg"));
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, thumbnailSize), -1);
+
+    // inserting a thumbnail does not fill the other tiers; the consumers do that when needed:
+    QImage thumbnail = solidImage(thumbnailSize, thumbnailSize / 2, Qt::red);
+    thumbnailCache.insert(imageFileName, thumbnail);
+    QVERIFY(!thumbnailCache.contains(imageFileName, smallSize));
+    QVERIFY(!thumbnailCache.contains(imageFileName, largeSize));
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize - 1), thumbnailSize);
+
+    const QImage smallThumbnail = solidImage(smallSize, smallSize / 2, Qt::red);
+    thumbnailCache.insert(imageFileName, smallThumbnail, smallSize);
+    QVERIFY(thumbnailCache.contains(imageFileName, smallSize));
+    QCOMPARE(QImage::fromData(thumbnailCache.lookupData(imageFileName, smallSize).view(), "JPG").size(), smallThumbnail.size());
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize - 1), smallSize);
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize + 1), thumbnailSize);
+    // no tier is large enough:
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, largeSize), thumbnailSize);
+
+    QImage largeThumbnail = solidImage(largeSize, largeSize / 2, Qt::red);
+    thumbnailCache.insert(imageFileName, largeThumbnail, largeSize);
+    QVERIFY(thumbnailCache.contains(imageFileName, largeSize));
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, thumbnailSize + 1), largeSize);
+    QCOMPARE(QImage::fromData(thumbnailCache.lookupData(imageFileName, largeSize).view(), "JPG").size(), largeThumbnail.size());
+    // the main cache is not affected:
+    QCOMPARE(QImage::fromData(thumbnailCache.lookupData(imageFileName).view(), "JPG").size(), thumbnail.size());
+
+    // a new thumbnail makes all tiers outdated:
+    thumbnail.fill(Qt::blue);
+    thumbnailCache.insert(imageFileName, thumbnail);
+    QVERIFY(!thumbnailCache.contains(imageFileName, largeSize));
+    QVERIFY(!thumbnailCache.contains(imageFileName, smallSize));
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize), thumbnailSize);
+    // the same goes for thumbnails that are inserted as JPEG data, e.g. by the ThumbnailPipeline:
+    thumbnailCache.insert(imageFileName, largeThumbnail, largeSize);
+    QVERIFY2(thumbnailCache.contains(imageFileName, largeSize), msgPreconditionFailed);
+    thumbnailCache.insert(imageFileName, thumbnailCache.lookupRawData(imageFileName));
+    QVERIFY(!thumbnailCache.contains(imageFileName, largeSize));
+
+    // vacuuming only moves the thumbnails, so the tiers stay valid:
+    thumbnailCache.insert(imageFileName, smallThumbnail, smallSize);
+    thumbnailCache.insert(imageFileName, largeThumbnail, largeSize);
+    QVERIFY2(thumbnailCache.contains(imageFileName, smallSize) && thumbnailCache.contains(imageFileName, largeSize), msgPreconditionFailed);
+    thumbnailCache.vacuum();
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize - 1), smallSize);
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, thumbnailSize + 1), largeSize);
+    QCOMPARE(QImage::fromData(thumbnailCache.lookupData(imageFileName, smallSize).view(), "JPG").size(), smallThumbnail.size());
+    QCOMPARE(QImage::fromData(thumbnailCache.lookupData(imageFileName, largeSize).view(), "JPG").size(), largeThumbnail.size());
+
+    thumbnailCache.removeThumbnail(imageFileName);
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize), -1);
+
+    // changing the thumbnail size changes the tier sizes, too:
+    thumbnailCache.insert(imageFileName, thumbnail);
+    thumbnailCache.setThumbnailSize(thumbnailSize * 2);
+    QCOMPARE(thumbnailCache.tierSizes(), QList<int>({ thumbnailSize, thumbnailSize * 2, thumbnailSize * 4 }));
+    QCOMPARE(thumbnailCache.tierFor(imageFileName, smallSize), -1);
+}
+
+void KPATest::TestThumbnailCache::contentKeys()
+{
+    ThumbnailCacheFixture fixture;
+    QVERIFY2(fixture.isValid(), msgPreconditionFailed);
+    ImageManager::ThumbnailCache &thumbnailCache = fixture.cache();
+    const int smallSize = thumbnailCache.tierSizes().constFirst();
+
+    const auto original = DB::FileName::fromRelativePath(QStringLiteral("original.jpg"));
+    const auto duplicate = DB::FileName::fromRelativePath(QStringLiteral("duplicate.jpg"));
+    const auto moved = DB::FileName::fromRelativePath(QStringLiteral("moved/original.jpg"));
+
+    // a thumbnail that was stored by file name is kept when the file gets a content key:
+    QImage thumbnail = solidImage(thumbnailCache.thumbnailSize(), thumbnailCache.thumbnailSize() / 2, Qt::red);
+    thumbnailCache.insert(original, thumbnail);
+    thumbnailCache.insert(original, solidImage(smallSize, smallSize / 2, Qt::red), smallSize);
+    const QByteArray thumbnailData = thumbnailCache.lookupRawData(original);
+    thumbnailCache.setContentKey(original, QStringLiteral("content-a"));
+    QVERIFY(thumbnailCache.contains(original));
+    QVERIFY(thumbnailCache.contains(original, smallSize));
+    QCOMPARE(thumbnailCache.size(), 1);
+
+    // duplicates and moved files share the thumbnail:
+    thumbnailCache.setContentKey(duplicate, QStringLiteral("content-a"));
+    thumbnailCache.setContentKey(moved, QStringLiteral("content-a"));
+    QCOMPARE(thumbnailCache.lookupRawData(duplicate), thumbnailData);
+    QCOMPARE(thumbnailCache.lookupRawData(moved), thumbnailData);
+    QVERIFY(thumbnailCache.contains(moved, smallSize));
+    QCOMPARE(thumbnailCache.size(), 1);
+
+    // a new thumbnail is updated for all files that share it:
+    QSignalSpy thumbnailUpdatedSpy { &thumbnailCache, &ImageManager::ThumbnailCache::thumbnailUpdated };
+    QVERIFY2(thumbnailUpdatedSpy.isValid(), msgPreconditionFailed);
+    thumbnail.fill(Qt::blue);
+    thumbnailCache.insert(duplicate, thumbnail);
+    QCOMPARE(thumbnailUpdatedSpy.count(), 3);
+    QCOMPARE(thumbnailCache.lookupRawData(original), thumbnailCache.lookupRawData(duplicate));
+
+    // removing the thumbnail of one file does not affect the others:
+    thumbnailCache.removeThumbnail(original);
+    QVERIFY(!thumbnailCache.contains(original));
+    QVERIFY(thumbnailCache.contains(duplicate));
+    QVERIFY(thumbnailCache.contains(moved));
+
+    // a different content key means a different thumbnail:
+    thumbnailCache.setContentKey(duplicate, QStringLiteral("content-b"));
+    QVERIFY(!thumbnailCache.contains(duplicate));
+    QVERIFY(thumbnailCache.contains(moved));
+
+    // thumbnails of content that is no longer used are discarded:
+    thumbnailCache.insert(original, thumbnail);
+    QCOMPARE(thumbnailCache.size(), 2);
+    thumbnailCache.setContentKeys({ { duplicate, QStringLiteral("content-b") } });
+    QVERIFY(thumbnailCache.contains(original));
+    QVERIFY(!thumbnailCache.contains(moved));
+    QCOMPARE(thumbnailCache.size(), 1);
+    QVERIFY(!thumbnailCache.contains(moved, smallSize));
+}
+
+void KPATest::TestThumbnailCache::jpegCodec()
+{
+    QImage image = solidImage(800, 600, Qt::blue);
+
+    const QByteArray data = ImageManager::encodeJpeg(image);
+    QVERIFY(data.startsWith("\xFF\xD8"));
+    QVERIFY(ImageManager::encodeJpeg(QImage()).isNull());
+
+    // without scaling:
+    QSize fullSize;
+    const QImage decoded = ImageManager::decodeJpeg(data, -1, &fullSize);
+    QCOMPARE(fullSize, image.size());
+    QCOMPARE(decoded.size(), image.size());
+    const QColor color = decoded.pixelColor(400, 300);
+    QVERIFY(color.blue() > 240 && color.red() < 16 && color.green() < 16);
+
+    // the largest scale factor that still yields the requested size is used:
+    QCOMPARE(ImageManager::decodeJpeg(data, 200).size(), QSize(200, 150));
+    QCOMPARE(ImageManager::decodeJpeg(data, 201).size(), QSize(400, 300));
+    QCOMPARE(ImageManager::decodeJpeg(data, 10).size(), QSize(100, 75));
+
+    QVERIFY(ImageManager::decodeJpeg(QByteArray("no JPEG data")).isNull());
+}
+
 QTEST_MAIN(KPATest::TestThumbnailCache)
 
 // vi:expandtab:tabstop=4 shiftwidth=4:
@@ -19,6 +19,34 @@ private Q_SLOTS:
      */
     void loadV4ThumbnailIndex();
     void insertRemove();
+    /**
+     * @brief Check that thumbnail data returned by lookupData() stays valid while the cache changes.
+     */
+    void lookupDataLifetime();
+    /**
+     * @brief Insert thumbnails from several threads at once and check that none get lost.
+     */
+    void concurrentInsert();
+    /**
+     * @brief Look up thumbnails while other threads insert thumbnails, and check that the lookups always see complete data.
+     * The latency of these lookups is measured by ThumbnailPipelineBenchmark.
+     */
+    void lookupDuringInserts();
+    /**
+     * @brief Remove most thumbnails from a thumbnail file and check that compact() discards their data.
+     * Also check that the thumbnails of a file are discarded if its compaction was interrupted before the index was saved.
+     */
+    void compact();
+    /**
+     * @brief Check that thumbnails are stored in the right size tiers.
+     * Also check that new thumbnails invalidate the tiers, but vacuum() does not.
+     */
+    void tiers();
+    /**
+     * @brief Check that files with the same content key share their thumbnail.
+     */
+    void contentKeys();
+    void jpegCodec();
 };
 }
 
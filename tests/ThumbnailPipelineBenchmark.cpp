@@ -0,0 +1,183 @@
+// SPDX-FileCopyrightText: 2026 The KPhotoAlbum Development Team
+//
+// SPDX-License-Identifier: LicenseRef-KDE-Accepted-GPL
+
+// Benchmark for the thumbnail pipeline.
+// Usage: ThumbnailPipelineBenchmark [options] <directory with JPEG files>
+
+#include "ThumbnailCache.h"
+#include "ThumbnailPipeline.h"
+
+#include <kpabase/FileName.h>
+#include <kpabase/SettingsData.h>
+#include <kpabase/UIDelegate.h>
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace
+{
+int intOption(const QCommandLineParser &parser, const QCommandLineOption &option)
+{
+    return parser.value(option).toInt();
+}
+
+/**
+ * @brief The previous way of building thumbnails, for comparison: decode, scale and store sequentially using QImage.
+ */
+qint64 runBaseline(ImageManager::ThumbnailCache &cache, const DB::FileNameList &files, int thumbnailSize)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (const DB::FileName &fileName : files) {
+        const QImage image(fileName.absolute());
+        cache.insert(fileName, image.scaled(thumbnailSize, thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
+    return timer.elapsed();
+}
+
+/**
+ * @brief Measure the latency of lookups, as done by the GUI thread, while other threads insert thumbnails.
+ * Lookups should not wait for the inserting threads.
+ */
+void runLookupLatency(ImageManager::ThumbnailCache &cache, const DB::FileNameList &files, int insertThreads, QTextStream &out)
+{
+    constexpr int lookups = 20000;
+    constexpr int maxInsertsPerThread = 5000;
+    const QByteArray data = cache.lookupRawData(files.constFirst());
+
+    // Inserting threads write the thumbnail files and, every 100 thumbnails, the index file:
+    std::atomic<bool> stop = false;
+    std::atomic<int> inserted = 0;
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int thread = 0; thread < insertThreads; ++thread) {
+        threads.emplace_back(QThread::create([&cache, &data, &stop, &inserted, thread] {
+            for (int i = 0; i < maxInsertsPerThread && !stop; ++i) {
+                cache.insert(DB::FileName::fromRelativePath(QStringLiteral("latency%1/image%2.jpg").arg(thread).arg(i)), data);
+                ++inserted;
+            }
+        }));
+        threads.back()->start();
+    }
+
+    QList<qint64> latencies;
+    latencies.reserve(lookups);
+    int missing = 0;
+    QElapsedTimer timer;
+    for (int i = 0; i < lookups; ++i) {
+        const DB::FileName &fileName = files.at(i % files.size());
+        timer.start();
+        const bool found = cache.contains(fileName) && !cache.lookupData(fileName).isNull();
+        latencies.append(timer.nsecsElapsed());
+        if (!found)
+            ++missing;
+    }
+    const int insertedDuringLookups = inserted;
+    stop = true;
+    for (const auto &thread : threads)
+        thread->wait();
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&latencies](int p) {
+        return latencies.at((latencies.size() - 1) * p / 100) / 1000.0;
+    };
+    out << "Lookups: " << lookups << " lookups (" << missing << " missing) while inserting " << insertedDuringLookups
+        << " thumbnails in " << insertThreads << " threads: median " << percentile(50) << " us, 99th percentile "
+        << percentile(99) << " us, maximum " << percentile(100) << " us" << Qt::endl;
+}
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Builds thumbnails for all JPEG files in a directory and reports the throughput of each pipeline stage."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("directory"), QStringLiteral("Directory containing sample JPEG files (searched recursively)."));
+    const QCommandLineOption decodeThreadsOption(QStringLiteral("decode-threads"), QStringLiteral("Number of decoder threads."), QStringLiteral("n"), QStringLiteral("4"));
+    const QCommandLineOption scaleThreadsOption(QStringLiteral("scale-threads"), QStringLiteral("Number of scaler threads."), QStringLiteral("n"), QStringLiteral("2"));
+    const QCommandLineOption storeThreadsOption(QStringLiteral("store-threads"), QStringLiteral("Number of encoder threads."), QStringLiteral("n"), QStringLiteral("2"));
+    const QCommandLineOption queueOption(QStringLiteral("queue-capacity"), QStringLiteral("Capacity of the queue in front of each stage."), QStringLiteral("n"), QStringLiteral("16"));
+    const QCommandLineOption sizeOption(QStringLiteral("size"), QStringLiteral("Thumbnail size in pixels."), QStringLiteral("px"), QStringLiteral("256"));
+    const QCommandLineOption baselineOption(QStringLiteral("baseline"), QStringLiteral("Also build the thumbnails sequentially using QImage, for comparison."));
+    const QCommandLineOption lookupLatencyOption(QStringLiteral("lookup-latency"),
+                                                 QStringLiteral("Afterwards, measure the latency of thumbnail lookups while n threads insert thumbnails."),
+                                                 QStringLiteral("n"));
+    parser.addOptions({ decodeThreadsOption, scaleThreadsOption, storeThreadsOption, queueOption, sizeOption, baselineOption, lookupLatencyOption });
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+    const QString imageDirectory = QDir(parser.positionalArguments().constFirst()).absolutePath();
+
+    // DB::FileName needs to know the image directory:
+    DB::DummyUIDelegate uiDelegate;
+    Settings::SettingsData::setup(imageDirectory, uiDelegate);
+
+    DB::FileNameList files;
+    QDirIterator it(imageDirectory, { QStringLiteral("*.jpg"), QStringLiteral("*.jpeg"), QStringLiteral("*.JPG"), QStringLiteral("*.JPEG") }, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files.append(DB::FileName::fromAbsolutePath(it.next()));
+    if (files.isEmpty()) {
+        out << "No JPEG files found in " << imageDirectory << Qt::endl;
+        return 1;
+    }
+
+    ImageManager::ThumbnailPipeline::Configuration configuration;
+    configuration.thumbnailSize = intOption(parser, sizeOption);
+    configuration.decodeThreads = intOption(parser, decodeThreadsOption);
+    configuration.scaleThreads = intOption(parser, scaleThreadsOption);
+    configuration.storeThreads = intOption(parser, storeThreadsOption);
+    configuration.queueCapacity = intOption(parser, queueOption);
+
+    QTemporaryDir cacheDir;
+    ImageManager::ThumbnailCache cache { cacheDir.path() };
+    ImageManager::ThumbnailPipeline pipeline { &cache, configuration };
+    for (const DB::FileName &fileName : std::as_const(files))
+        pipeline.add(fileName);
+    pipeline.finish();
+
+    out << "Pipeline: " << files.size() << " images in " << pipeline.elapsedMilliseconds() << " ms ("
+        << pipeline.failedCount() << " failed), "
+        << files.size() * 1000.0 / qMax<qint64>(1, pipeline.elapsedMilliseconds()) << " images/s" << Qt::endl;
+    const auto stages = pipeline.statistics();
+    for (const auto &stage : stages) {
+        out << "  " << stage.name << ": " << stage.threads << " threads, "
+            << stage.items << " items, busy " << stage.busyNanoseconds / 1000000 << " ms, "
+            << stage.throughput() << " items/s" << Qt::endl;
+    }
+
+    if (parser.isSet(lookupLatencyOption) && cache.size() > 0) {
+        DB::FileNameList thumbnails;
+        for (const DB::FileName &fileName : std::as_const(files)) {
+            if (cache.contains(fileName))
+                thumbnails.append(fileName);
+        }
+        runLookupLatency(cache, thumbnails, intOption(parser, lookupLatencyOption), out);
+    }
+
+    if (parser.isSet(baselineOption)) {
+        QTemporaryDir baselineCacheDir;
+        ImageManager::ThumbnailCache baselineCache { baselineCacheDir.path() };
+        const qint64 elapsed = runBaseline(baselineCache, files, configuration.thumbnailSize);
+        out << "Baseline: " << files.size() << " images in " << elapsed << " ms, "
+            << files.size() * 1000.0 / qMax<qint64>(1, elapsed) << " images/s" << Qt::endl;
+    }
+    return 0;
+}
+
+// vi:expandtab:tabstop=4 shiftwidth=4: